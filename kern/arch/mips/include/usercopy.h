@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _MIPS_USERCOPY_H_
+#define _MIPS_USERCOPY_H_
+
+/*
+ * Fast user/kernel copy routines, in usercopy.S.
+ *
+ *   usercopy: copy LEN bytes from SRC to DEST.
+ *   userzero: zero LEN bytes at DEST.
+ *
+ * Both return 0, or EFAULT if a load or store took a fault the VM
+ * system couldn't handle. The caller is responsible for checking the
+ * user address range first (see copycheck in vm/copyinout.c).
+ *
+ * Fault recovery doesn't use setjmp: the trap code looks the faulting
+ * PC up in usercopy_fixups, a table of code ranges ending with a
+ * zeroed entry, and resumes at the matching fixup address. So there's
+ * nothing to set up per call.
+ */
+
+int usercopy(void *dest, const void *src, size_t len);
+int userzero(void *dest, size_t len);
+
+struct usercopy_fixup {
+	vaddr_t uf_start;		/* first instruction covered */
+	vaddr_t uf_end;			/* one past the last */
+	vaddr_t uf_fixup;		/* where to resume */
+};
+
+extern const struct usercopy_fixup usercopy_fixups[];
+
+#endif /* _MIPS_USERCOPY_H_ */
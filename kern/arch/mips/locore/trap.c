@@ -39,6 +39,7 @@
 #include <proc.h>
 #include <current.h>
 #include <vm.h>
+#include <mips/usercopy.h>
 #include <mainbus.h>
 #include <syscall.h>
 
@@ -125,6 +126,25 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 	thread_exit();
 }
 
+/*
+ * If a fault happened inside the fast copy routines, arrange for
+ * the routine to return EFAULT. Returns true if it did.
+ */
+static
+bool
+usercopy_fixup(struct trapframe *tf)
+{
+	const struct usercopy_fixup *uf;
+
+	for (uf = usercopy_fixups; uf->uf_start != 0; uf++) {
+		if (tf->tf_epc >= uf->uf_start && tf->tf_epc < uf->uf_end) {
+			tf->tf_epc = uf->uf_fixup;
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * General trap (exception) handling function for mips.
  * This is called by the assembly-language exception handler once
@@ -233,6 +253,18 @@ mips_trap(struct trapframe *tf)
 		goto done;
 	}
 
+	/*
+	 * A kernel TLB miss in kseg2 is on the kernel heap arena,
+	 * which is always resident; just refill it.
+	 */
+	if (iskern && (code == EX_TLBL || code == EX_TLBS) &&
+	    tf->tf_vaddr >= MIPS_KSEG2) {
+		KSTAT_INC(ks_tlbfaults[KSTAT_TLB_KHEAP]);
+		if (kvmem_fault(tf->tf_vaddr) == 0) {
+			goto done;
+		}
+	}
+
 	/*
 	 * Ok, it wasn't any of the really easy cases.
 	 * Call vm_fault on the TLB exceptions.
@@ -240,16 +272,19 @@ mips_trap(struct trapframe *tf)
 	 */
 	switch (code) {
 	case EX_MOD:
+		KSTAT_INC(ks_tlbfaults[KSTAT_TLB_READONLY]);
 		if (vm_fault(VM_FAULT_READONLY, tf->tf_vaddr)==0) {
 			goto done;
 		}
 		break;
 	case EX_TLBL:
+		KSTAT_INC(ks_tlbfaults[KSTAT_TLB_READ]);
 		if (vm_fault(VM_FAULT_READ, tf->tf_vaddr)==0) {
 			goto done;
 		}
 		break;
 	case EX_TLBS:
+		KSTAT_INC(ks_tlbfaults[KSTAT_TLB_WRITE]);
 		if (vm_fault(VM_FAULT_WRITE, tf->tf_vaddr)==0) {
 			goto done;
 		}
@@ -303,8 +338,17 @@ mips_trap(struct trapframe *tf)
 	 *
 	 * This is accomplished by changing tf->tf_epc and returning
 	 * from the exception handler.
+	 *
+	 * The fast copy routines in usercopy.S, which copyin and
+	 * copyout use, work the same way, except that the resume
+	 * address is found by looking up the faulting PC in a table
+	 * rather than being set in the thread on every call.
 	 */
 
+	if (usercopy_fixup(tf)) {
+		goto done;
+	}
+
 	if (curthread != NULL &&
 	    curthread->t_machdep.tm_badfaultfunc != NULL) {
 		tf->tf_epc = (vaddr_t) curthread->t_machdep.tm_badfaultfunc;
@@ -35,6 +35,7 @@
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
+#include <cpu.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -89,6 +90,9 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	if (callno >= 0 && callno < KSTAT_NSYSCALLS) {
+		KSTAT_INC(ks_syscalls[callno]);
+	}
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -164,6 +168,10 @@ syscall(struct trapframe *tf)
 		err = sys_close(tf->tf_a0);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
 	    case SYS_read:
 		err = sys_read(
 			tf->tf_a0,
@@ -178,6 +186,62 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+	    case SYS_preadv:
+	    case SYS_pwritev:
+		{
+			/*
+			 * The 64-bit position needs an aligned register
+			 * pair, so a3 is skipped and it is passed on
+			 * the stack instead.
+			 */
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+
+			switch (callno) {
+			    case SYS_pread:
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_pwrite:
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+				break;
+			    case SYS_preadv:
+				err = sys_preadv(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, pos, &retval);
+				break;
+			    default:
+				err = sys_pwritev(tf->tf_a0,
+						  (userptr_t)tf->tf_a1,
+						  tf->tf_a2, pos, &retval);
+				break;
+			}
+		}
+		break;
 	    case SYS_lseek:
 		{
 			/*
@@ -261,6 +325,38 @@ syscall(struct trapframe *tf)
 		}
 		break;
 
+	    case SYS_poll:
+		err = sys_poll(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_select:
+		{
+			/* The fifth argument, the timeout, is on the stack */
+			userptr_t timeout;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &timeout, sizeof(timeout));
+			if (err) {
+				break;
+			}
+			err = sys_select(tf->tf_a0,
+					 (userptr_t)tf->tf_a1,
+					 (userptr_t)tf->tf_a2,
+					 (userptr_t)tf->tf_a3,
+					 timeout, &retval);
+		}
+		break;
+
+	    case SYS_ioring_setup:
+		err = sys_ioring_setup((userptr_t)tf->tf_a0);
+		break;
+	    case SYS_ioring_enter:
+		err = sys_ioring_enter(tf->tf_a0, &retval);
+		break;
+
 
 
 	    default:
@@ -136,6 +136,7 @@ alloc_kpages(unsigned npages)
 	if (pa==0) {
 		return 0;
 	}
+	KSTAT_ADD(ks_frames, npages);
 	return PADDR_TO_KVADDR(pa);
 }
 
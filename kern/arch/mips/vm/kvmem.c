@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel virtual memory arena.
+ *
+ * Multi-page kmalloc requests used to need that many physically
+ * contiguous frames, because kseg0 is direct-mapped; once memory is
+ * fragmented those fail even with plenty of free pages. Instead, big
+ * blocks get a run of virtual pages in kseg2 backed by whatever single
+ * frames are free, mapped through the TLB.
+ *
+ * The arena has a flat table with one entry per virtual page, in the
+ * form of a TLB entrylo. The low bits, which the TLB doesn't use, mark
+ * slots in use and chain the pages of one allocation together, the
+ * same way the frame table does. Kernel TLB misses on the arena are
+ * refilled from the table by kvmem_fault(); the mappings are never
+ * paged out.
+ *
+ * Nothing that can be touched during exception entry may live here:
+ * in particular thread stacks, which are a single page and so always
+ * come from kseg0.
+ *
+ * Like the rest of the VM system, this assumes one CPU: freeing
+ * pages only invalidates the local TLB.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <mips/tlb.h>
+#include <vm.h>
+
+/* Software bits in the table entries; the TLB ignores these. */
+#define KVMEM_USED	0x00000001	/* slot is allocated */
+#define KVMEM_CONT	0x00000002	/* next slot is the same allocation */
+#define KVMEM_SWBITS	0x000000ff
+
+#define KVMEM_BASE	MIPS_KSEG2
+#define KVMEM_MAXPAGES	(0x40000000 / PAGE_SIZE)	/* all of kseg2 */
+
+static struct spinlock kvmem_lock = SPINLOCK_INITIALIZER;
+static uint32_t *kvmem_table;		/* one entry per virtual page */
+static unsigned kvmem_npages;		/* size of the arena */
+static unsigned kvmem_rotor;		/* where the next search starts */
+static unsigned kvmem_inuse;		/* pages allocated */
+
+/*
+ * Set up the arena. This takes the table from the page allocator, so
+ * it must come after ram_bootstrap. The arena has twice as many pages
+ * as there is RAM, so that virtual space runs out long after physical
+ * space does.
+ */
+void
+kvmem_bootstrap(void)
+{
+	unsigned tablepages, i;
+	vaddr_t table;
+
+	kvmem_npages = 2 * (ram_getsize() / PAGE_SIZE);
+	if (kvmem_npages > KVMEM_MAXPAGES) {
+		kvmem_npages = KVMEM_MAXPAGES;
+	}
+
+	tablepages = DIVROUNDUP(kvmem_npages * sizeof(uint32_t), PAGE_SIZE);
+	table = alloc_kpages(tablepages);
+	if (table == 0) {
+		panic("kvmem: Could not allocate arena table\n");
+	}
+	kvmem_table = (uint32_t *)table;
+	for (i=0; i<kvmem_npages; i++) {
+		kvmem_table[i] = 0;
+	}
+}
+
+/*
+ * Drop any TLB entry for an arena page.
+ */
+static
+void
+kvmem_tlbinval(vaddr_t va)
+{
+	int spl, ix;
+
+	spl = splhigh();
+	ix = tlb_probe(va & TLBHI_VPAGE, 0);
+	if (ix >= 0) {
+		tlb_write(TLBHI_INVALID(ix), TLBLO_INVALID(), ix);
+	}
+	splx(spl);
+}
+
+/*
+ * Give back the slots of an allocation, from START for NPAGES pages,
+ * unmapping and freeing any frames behind them.
+ */
+static
+void
+kvmem_release(unsigned start, unsigned npages)
+{
+	unsigned i;
+	uint32_t ent;
+
+	/* the slots are ours until cleared, so no lock is needed yet */
+	for (i=start; i<start+npages; i++) {
+		ent = kvmem_table[i];
+		if (ent & TLBLO_VALID) {
+			kvmem_tlbinval(KVMEM_BASE + i * PAGE_SIZE);
+			free_kpages(PADDR_TO_KVADDR(ent & TLBLO_PPAGE));
+		}
+	}
+
+	spinlock_acquire(&kvmem_lock);
+	for (i=start; i<start+npages; i++) {
+		kvmem_table[i] = 0;
+	}
+	kvmem_inuse -= npages;
+	spinlock_release(&kvmem_lock);
+}
+
+/*
+ * Find and reserve NPAGES free slots in a row, next-fit from the
+ * rotor. Returns the first slot, or kvmem_npages if there's no room.
+ */
+static
+unsigned
+kvmem_reserve(unsigned npages)
+{
+	unsigned start, run, i, scanned;
+
+	spinlock_acquire(&kvmem_lock);
+
+	start = kvmem_rotor;
+	run = 0;
+	for (scanned = 0; scanned <= kvmem_npages + npages; scanned++) {
+		i = start + run;
+		if (i >= kvmem_npages) {
+			/* runs can't wrap; start over at the bottom */
+			start = 0;
+			run = 0;
+			continue;
+		}
+		if (kvmem_table[i] != 0) {
+			start = i + 1;
+			run = 0;
+			continue;
+		}
+		if (++run == npages) {
+			for (i=start; i<start+npages-1; i++) {
+				kvmem_table[i] = KVMEM_USED | KVMEM_CONT;
+			}
+			kvmem_table[i] = KVMEM_USED;
+			kvmem_rotor = start + npages;
+			kvmem_inuse += npages;
+			spinlock_release(&kvmem_lock);
+			return start;
+		}
+	}
+
+	spinlock_release(&kvmem_lock);
+	return kvmem_npages;
+}
+
+/*
+ * Allocate NPAGES virtually contiguous kernel pages. Returns 0 if out
+ * of address space or memory.
+ */
+vaddr_t
+alloc_kvpages(unsigned npages)
+{
+	unsigned start, i;
+	vaddr_t frame;
+
+	KASSERT(kvmem_table != NULL);
+	KASSERT(npages > 0);
+
+	start = kvmem_reserve(npages);
+	if (start == kvmem_npages) {
+		return 0;
+	}
+
+	for (i=start; i<start+npages; i++) {
+		frame = alloc_kpages(1);
+		if (frame == 0) {
+			kvmem_release(start, npages);
+			return 0;
+		}
+		/* nobody else can see this address yet */
+		kvmem_table[i] |= KVADDR_TO_PADDR(frame) |
+			TLBLO_VALID | TLBLO_DIRTY;
+	}
+
+	return KVMEM_BASE + start * PAGE_SIZE;
+}
+
+/*
+ * Free pages from alloc_kvpages. Returns -1 if ADDR isn't in the
+ * arena, so the caller can try somewhere else.
+ */
+int
+free_kvpages(vaddr_t addr)
+{
+	unsigned start, i;
+
+	if (addr < KVMEM_BASE ||
+	    addr >= KVMEM_BASE + kvmem_npages * PAGE_SIZE) {
+		return -1;
+	}
+	KASSERT(addr % PAGE_SIZE == 0);
+
+	start = (addr - KVMEM_BASE) / PAGE_SIZE;
+	if ((kvmem_table[start] & KVMEM_USED) == 0 ||
+	    (start > 0 && (kvmem_table[start-1] & KVMEM_CONT))) {
+		panic("kvmem: free of invalid addr 0x%x\n", addr);
+	}
+
+	for (i=start; kvmem_table[i] & KVMEM_CONT; i++) {
+		/* nothing */
+	}
+	kvmem_release(start, i - start + 1);
+	return 0;
+}
+
+/*
+ * Handle a kernel TLB miss in kseg2: load the mapping from the table.
+ */
+int
+kvmem_fault(vaddr_t faultaddress)
+{
+	uint32_t ent;
+	int spl;
+
+	if (faultaddress < KVMEM_BASE ||
+	    faultaddress >= KVMEM_BASE + kvmem_npages * PAGE_SIZE) {
+		return EFAULT;
+	}
+
+	ent = kvmem_table[(faultaddress - KVMEM_BASE) / PAGE_SIZE];
+	if ((ent & TLBLO_VALID) == 0) {
+		return EFAULT;
+	}
+
+	spl = splhigh();
+	tlb_random(faultaddress & TLBHI_VPAGE, ent & ~KVMEM_SWBITS);
+	splx(spl);
+	return 0;
+}
+
+/*
+ * Print arena usage.
+ */
+void
+kvmem_printstats(void)
+{
+	kprintf("kvmem: %u of %u pages in use\n", kvmem_inuse, kvmem_npages);
+}
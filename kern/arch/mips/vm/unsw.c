@@ -32,6 +32,8 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <spinlock.h>
+#include <current.h>
+#include <cpu.h>
 
 vaddr_t firstfree;   /* first free virtual address; set by start.S */
 
@@ -310,6 +312,7 @@ alloc_kpages(unsigned npages)
 	if (paddr == 0) {
 		return 0;
 	}
+	KSTAT_ADD(ks_frames, npages);
 	return PADDR_TO_KVADDR(paddr);
 }
 
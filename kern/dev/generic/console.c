@@ -39,6 +39,10 @@
  * supported, although such support could be added without undue
  * difficulty.
  *
+ * Output from threads goes through a transmit ring that the device's
+ * write-done interrupt drains, so writers only wait when the ring is
+ * full; input is collected in a receive ring by the read interrupt.
+ *
  * Note that nothing happens until we have a device to write to. A
  * buffer of size DELAYBUFSIZE is used to hold output that is
  * generated before this point. This means that (1) using kprintf for
@@ -55,6 +59,7 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -109,6 +114,105 @@ flush_delay_buf(void)
 
 //////////////////////////////////////////////////
 
+
+/*
+ * Number of characters in the rings.
+ */
+static
+unsigned
+con_txcount(struct con_softc *cs)
+{
+	return (cs->cs_txhead + CONSOLE_OUTPUT_BUFFER_SIZE - cs->cs_txtail)
+		% CONSOLE_OUTPUT_BUFFER_SIZE;
+}
+
+static
+unsigned
+con_rxcount(struct con_softc *cs)
+{
+	return (cs->cs_gotchars_head + CONSOLE_INPUT_BUFFER_SIZE -
+		cs->cs_gotchars_tail) % CONSOLE_INPUT_BUFFER_SIZE;
+}
+
+/*
+ * If the device is idle, hand it the next character from the
+ * transmit ring. The write-done interrupt (con_start) sends the rest.
+ */
+static
+void
+con_txstart(struct con_softc *cs)
+{
+	char ch;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_lock));
+
+	if (cs->cs_txbusy || cs->cs_txhead == cs->cs_txtail) {
+		return;
+	}
+	ch = cs->cs_txbuf[cs->cs_txtail];
+	cs->cs_txtail = (cs->cs_txtail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	cs->cs_txbusy = true;
+	cs->cs_send(cs->cs_devdata, ch);
+}
+
+/*
+ * Add a character to the transmit ring, waiting for space if it's
+ * full.
+ */
+static
+void
+con_txput(struct con_softc *cs, char ch)
+{
+	KASSERT(spinlock_do_i_hold(&cs->cs_lock));
+
+	while (con_txcount(cs) == CONSOLE_OUTPUT_BUFFER_SIZE - 1) {
+		con_txstart(cs);
+		wchan_sleep(cs->cs_wwchan, &cs->cs_lock);
+	}
+	cs->cs_txbuf[cs->cs_txhead] = ch;
+	cs->cs_txhead = (cs->cs_txhead + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+}
+
+/*
+ * Send everything in the transmit ring by polling.
+ *
+ * This comes before any polled output, so that the output from
+ * panic, interrupt handlers, and code holding spinlocks comes out
+ * after whatever was queued before it instead of jumping ahead; and
+ * so that queued output isn't lost when the system stops, since
+ * panic and shutdown both finish with polled output.
+ *
+ * We may already hold the lock, if something in here panics.
+ * Writers waiting for space are woken by con_start as usual when
+ * the character in flight (if any) finishes, but pollers have to be
+ * told here, since the ring may now be empty.
+ */
+static
+void
+con_txdrain(struct con_softc *cs)
+{
+	bool locked, drained;
+
+	locked = spinlock_do_i_hold(&cs->cs_lock);
+	if (!locked) {
+		spinlock_acquire(&cs->cs_lock);
+	}
+	drained = cs->cs_txtail != cs->cs_txhead;
+	while (cs->cs_txtail != cs->cs_txhead) {
+		cs->cs_sendpolled(cs->cs_devdata,
+				  cs->cs_txbuf[cs->cs_txtail]);
+		cs->cs_txtail = (cs->cs_txtail + 1) %
+			CONSOLE_OUTPUT_BUFFER_SIZE;
+	}
+	if (!locked) {
+		spinlock_release(&cs->cs_lock);
+	}
+
+	if (drained) {
+		pollq_wakeup(&cs->cs_pollq);
+	}
+}
+
 /*
  * Print a character, using polling instead of interrupts to wait for
  * I/O completion.
@@ -117,11 +221,10 @@ static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	con_txdrain(cs);
 	cs->cs_sendpolled(cs->cs_devdata, ch);
 }
 
-//////////////////////////////////////////////////
-
 /*
  * Print a character, using interrupts to wait for I/O completion.
  */
@@ -129,8 +232,10 @@ static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	spinlock_acquire(&cs->cs_lock);
+	con_txput(cs, ch);
+	con_txstart(cs);
+	spinlock_release(&cs->cs_lock);
 }
 
 /*
@@ -142,21 +247,26 @@ getch_intr(struct con_softc *cs)
 {
 	unsigned char ret;
 
-	P(cs->cs_rsem);
+	spinlock_acquire(&cs->cs_lock);
+	while (cs->cs_gotchars_head == cs->cs_gotchars_tail) {
+		wchan_sleep(cs->cs_rwchan, &cs->cs_lock);
+	}
 	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
 	cs->cs_gotchars_tail =
 		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
+	if (ret == '\n') {
+		cs->cs_gotlines--;
+	}
+	spinlock_release(&cs->cs_lock);
 	return ret;
 }
 
 /*
  * Called from underlying device when a read-ready interrupt occurs.
  *
- * Note: if gotchars_head == gotchars_tail, the buffer is empty. Thus
- * if gotchars_head+1 == gotchars_tail, the buffer is full. A slightly
- * tidier way to implement this check (that avoids wasting a slot,
- * too) would be with a second semaphore used with a nonblocking P,
- * but we don't have that in OS/161.
+ * This is where the (minimal) line discipline lives: CR becomes LF,
+ * and complete lines are counted so con_io can wait for a whole line
+ * and copy it out at once instead of waking up per keystroke.
  */
 void
 con_input(void *vcs, int ch)
@@ -164,27 +274,54 @@ con_input(void *vcs, int ch)
 	struct con_softc *cs = vcs;
 	unsigned nexthead;
 
+	if (ch == '\r') {
+		ch = '\n';
+	}
+
+	spinlock_acquire(&cs->cs_lock);
 	nexthead = (cs->cs_gotchars_head + 1) % CONSOLE_INPUT_BUFFER_SIZE;
 	if (nexthead == cs->cs_gotchars_tail) {
 		/* overflow; drop character */
+		spinlock_release(&cs->cs_lock);
 		return;
 	}
 
 	cs->cs_gotchars[cs->cs_gotchars_head] = ch;
 	cs->cs_gotchars_head = nexthead;
+	if (ch == '\n') {
+		cs->cs_gotlines++;
+	}
+	wchan_wakeall(cs->cs_rwchan, &cs->cs_lock);
+	spinlock_release(&cs->cs_lock);
 
-	V(cs->cs_rsem);
+	pollq_wakeup(&cs->cs_pollq);
 }
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ * Send the next character, and once the ring has drained to half
+ * full, let waiting writers and pollers refill it. (pollq_wakeup
+ * returns at once if nobody is polling.)
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
+	unsigned count;
+
+	spinlock_acquire(&cs->cs_lock);
+	cs->cs_txbusy = false;
+	con_txstart(cs);
+	count = con_txcount(cs);
+	if (count <= CONSOLE_OUTPUT_BUFFER_SIZE / 2 &&
+	    !wchan_isempty(cs->cs_wwchan, &cs->cs_lock)) {
+		wchan_wakeall(cs->cs_wwchan, &cs->cs_lock);
+	}
+	spinlock_release(&cs->cs_lock);
 
-	V(cs->cs_wsem);
+	if (count <= CONSOLE_OUTPUT_BUFFER_SIZE / 2) {
+		pollq_wakeup(&cs->cs_pollq);
+	}
 }
 
 //////////////////////////////////////////////////
@@ -240,15 +377,112 @@ con_eachopen(struct device *dev, int openflags)
 	return 0;
 }
 
+/*
+ * Size of the bounce buffer for moving data between the rings and
+ * the uio; the rings are protected by a spinlock, so uiomove can't
+ * touch them directly.
+ */
+#define CON_CHUNK 128
+
+/*
+ * Check if a read for RESID bytes can proceed: a complete line is
+ * waiting, or enough characters to fill the request or the bounce
+ * buffer, or the ring is full (so no newline can arrive until some
+ * of it is read).
+ */
+static
+bool
+con_rxready(struct con_softc *cs, size_t resid)
+{
+	unsigned count;
+
+	count = con_rxcount(cs);
+	return cs->cs_gotlines > 0 || count >= resid || count >= CON_CHUNK ||
+		count == CONSOLE_INPUT_BUFFER_SIZE - 1;
+}
+
+static
+int
+con_read(struct con_softc *cs, struct uio *uio)
+{
+	char buf[CON_CHUNK];
+	size_t n;
+	bool gotline, gotsome;
+	int result;
+
+	gotline = gotsome = false;
+	while (!gotline && uio->uio_resid > 0) {
+		spinlock_acquire(&cs->cs_lock);
+		if (gotsome && !con_rxready(cs, uio->uio_resid)) {
+			/*
+			 * We took the start of an overlong line from a
+			 * full ring; return it rather than waiting for
+			 * more, so a read after poll never blocks.
+			 */
+			spinlock_release(&cs->cs_lock);
+			break;
+		}
+		while (!con_rxready(cs, uio->uio_resid)) {
+			wchan_sleep(cs->cs_rwchan, &cs->cs_lock);
+		}
+		n = 0;
+		while (n < sizeof(buf) && n < uio->uio_resid &&
+		       cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+			buf[n] = cs->cs_gotchars[cs->cs_gotchars_tail];
+			cs->cs_gotchars_tail = (cs->cs_gotchars_tail + 1)
+				% CONSOLE_INPUT_BUFFER_SIZE;
+			if (buf[n++] == '\n') {
+				cs->cs_gotlines--;
+				gotline = true;
+				break;
+			}
+		}
+		spinlock_release(&cs->cs_lock);
+
+		result = uiomove(buf, n, uio);
+		if (result) {
+			return result;
+		}
+		gotsome = true;
+	}
+	return 0;
+}
+
 static
 int
-con_io(struct device *dev, struct uio *uio)
+con_write(struct con_softc *cs, struct uio *uio)
 {
+	char buf[CON_CHUNK];
+	size_t n, i;
 	int result;
-	char ch;
-	struct lock *lk;
 
-	(void)dev;  // unused
+	while (uio->uio_resid > 0) {
+		n = uio->uio_resid < sizeof(buf) ? uio->uio_resid : sizeof(buf);
+		result = uiomove(buf, n, uio);
+		if (result) {
+			return result;
+		}
+
+		spinlock_acquire(&cs->cs_lock);
+		for (i=0; i<n; i++) {
+			if (buf[i] == '\n') {
+				con_txput(cs, '\r');
+			}
+			con_txput(cs, buf[i]);
+		}
+		con_txstart(cs);
+		spinlock_release(&cs->cs_lock);
+	}
+	return 0;
+}
+
+static
+int
+con_io(struct device *dev, struct uio *uio)
+{
+	struct con_softc *cs = dev->d_data;
+	struct lock *lk;
+	int result;
 
 	if (uio->uio_rw==UIO_READ) {
 		lk = con_userlock_read;
@@ -259,36 +493,14 @@ con_io(struct device *dev, struct uio *uio)
 
 	KASSERT(lk != NULL);
 	lock_acquire(lk);
-
-	while (uio->uio_resid > 0) {
-		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
-			if (ch=='\r') {
-				ch = '\n';
-			}
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				break;
-			}
-		}
-		else {
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				putch('\r');
-			}
-			putch(ch);
-		}
+	if (uio->uio_rw==UIO_READ) {
+		result = con_read(cs, uio);
+	}
+	else {
+		result = con_write(cs, uio);
 	}
 	lock_release(lk);
-	return 0;
+	return result;
 }
 
 static
@@ -302,10 +514,43 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Poll: readable if a read won't block, that is, a complete line is
+ * waiting or the input ring is full (see con_read); writable if
+ * there's room in the transmit ring.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct poller *poller, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+	int result;
+
+	if (poller != NULL) {
+		result = poller_register(poller, &cs->cs_pollq);
+		if (result) {
+			return result;
+		}
+	}
+
+	*revents = 0;
+	spinlock_acquire(&cs->cs_lock);
+	if (cs->cs_gotlines > 0 ||
+	    con_rxcount(cs) == CONSOLE_INPUT_BUFFER_SIZE - 1) {
+		*revents |= events & (POLLIN | POLLRDNORM);
+	}
+	if (con_txcount(cs) < CONSOLE_OUTPUT_BUFFER_SIZE - 1) {
+		*revents |= events & (POLLOUT | POLLWRNORM);
+	}
+	spinlock_release(&cs->cs_lock);
+	return 0;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -343,7 +588,7 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct wchan *rwc, *wwc;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -359,33 +604,39 @@ config_con(struct con_softc *cs, int unit)
 	}
 	KASSERT(the_console==NULL);
 
-	rsem = sem_create("console read", 0);
-	if (rsem == NULL) {
+	rwc = wchan_create("console read");
+	if (rwc == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
-		sem_destroy(rsem);
+	wwc = wchan_create("console write");
+	if (wwc == NULL) {
+		wchan_destroy(rwc);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(rwc);
+		wchan_destroy(wwc);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(rwc);
+		wchan_destroy(wwc);
 		return ENOMEM;
 	}
 
-	cs->cs_rsem = rsem;
-	cs->cs_wsem = wsem;
+	spinlock_init(&cs->cs_lock);
+	cs->cs_rwchan = rwc;
+	cs->cs_wwchan = wwc;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	cs->cs_gotlines = 0;
+	cs->cs_txhead = 0;
+	cs->cs_txtail = 0;
+	cs->cs_txbusy = false;
+	pollq_init(&cs->cs_pollq);
 
 	the_console = cs;
 	con_userlock_read = rlk;
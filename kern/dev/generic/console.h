@@ -37,8 +37,19 @@
  * device, and are to be initialized by the attach routine.
  */
 
-#define CONSOLE_INPUT_BUFFER_SIZE 32
+#include <spinlock.h>
+#include <poll.h>
 
+#define CONSOLE_INPUT_BUFFER_SIZE 256
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
+
+/*
+ * Input and output each go through a ring buffer. The receive
+ * interrupt puts characters in cs_gotchars, translating CR to LF and
+ * counting complete lines; the transmit-done interrupt feeds the
+ * device the next character from cs_txbuf. In both rings head ==
+ * tail means empty, so one slot is always left unused.
+ */
 struct con_softc {
 	/* initialized by attach routine */
 	void *cs_devdata;
@@ -46,11 +57,18 @@ struct con_softc {
 	void (*cs_sendpolled)(void *devdata, int ch);
 
 	/* initialized by config routine */
-	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
+	struct spinlock cs_lock;	/* protects everything below */
+	struct wchan *cs_rwchan;	/* readers waiting for input */
+	struct wchan *cs_wwchan;	/* writers waiting for ring space */
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+	unsigned cs_gotlines;		/* newlines in cs_gotchars */
+	char cs_txbuf[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_txhead;		/* next slot to put a char in */
+	unsigned cs_txtail;		/* next slot to send from */
+	bool cs_txbusy;			/* device is sending a character */
+	struct pollq cs_pollq;		/* pollers waiting for I/O */
 };
 
 /*
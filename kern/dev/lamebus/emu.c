@@ -49,6 +49,7 @@
 #include <uio.h>
 #include <membar.h>
 #include <synch.h>
+#include <vm.h>
 #include <lamebus/emu.h>
 #include <platform/bus.h>
 #include <vfs.h>
@@ -300,14 +301,46 @@ emu_doread(struct emu_softc *sc, uint32_t handle, uint32_t len,
 }
 
 /*
- * Read from a hardware-level file handle.
+ * Read up to LEN bytes at POS from a hardware-level file handle into
+ * the kernel buffer BUF. Returns the amount read in GOT, and the
+ * data generation it is valid for in GEN.
+ *
+ * Unlike emu_doread, this copies out of e_iobuf with memcpy, so no
+ * page faults on user buffers happen while holding the device.
  */
 static
 int
-emu_read(struct emu_softc *sc, uint32_t handle, uint32_t len,
-	 struct uio *uio)
+emu_read(struct emu_softc *sc, uint32_t handle, off_t pos, uint32_t len,
+	 void *buf, size_t *got, unsigned *gen)
 {
-	return emu_doread(sc, handle, len, EMU_OP_READ, uio);
+	int result;
+
+	KASSERT(len <= EMU_MAXIO);
+
+	if (pos > (off_t)0xffffffff) {
+		/* beyond the largest size the file can have; generate EOF */
+		*got = 0;
+		*gen = sc->e_gen;
+		return 0;
+	}
+
+	lock_acquire(sc->e_lock);
+
+	emu_wreg(sc, REG_HANDLE, handle);
+	emu_wreg(sc, REG_IOLEN, len);
+	emu_wreg(sc, REG_OFFSET, pos);
+	emu_wreg(sc, REG_OPER, EMU_OP_READ);
+	result = emu_waitdone(sc);
+	if (result == 0) {
+		membar_load_load();
+		*got = emu_rreg(sc, REG_IOLEN);
+		KASSERT(*got <= len);
+		memcpy(buf, sc->e_iobuf, *got);
+		*gen = sc->e_gen;
+	}
+
+	lock_release(sc->e_lock);
+	return result;
 }
 
 /*
@@ -323,6 +356,10 @@ emu_readdir(struct emu_softc *sc, uint32_t handle, uint32_t len,
 
 /*
  * Write to a hardware-level file handle.
+ *
+ * The data reaches the device before we return, so any error is
+ * reported by the write that caused it; close can't report errors,
+ * so deferring the device operation could lose them silently.
  */
 static
 int
@@ -351,6 +388,7 @@ emu_write(struct emu_softc *sc, uint32_t handle, uint32_t len,
 
 	emu_wreg(sc, REG_OPER, EMU_OP_WRITE);
 	result = emu_waitdone(sc);
+	sc->e_gen++;
 
  out:
 	lock_release(sc->e_lock);
@@ -396,6 +434,7 @@ emu_trunc(struct emu_softc *sc, uint32_t handle, off_t len)
 	emu_wreg(sc, REG_IOLEN, len);
 	emu_wreg(sc, REG_OPER, EMU_OP_TRUNC);
 	result = emu_waitdone(sc);
+	sc->e_gen++;
 
 	lock_release(sc->e_lock);
 	return result;
@@ -529,44 +568,119 @@ emufs_reclaim(struct vnode *v)
 	lock_release(ef->ef_emu->e_lock);
 	vfs_biglock_release();
 
+	if (ev->ev_cache != NULL) {
+		kfree(ev->ev_cache);
+	}
+	lock_destroy(ev->ev_lock);
 	kfree(ev);
 	return 0;
 }
 
+/*
+ * Check if the read cache holds the byte at POS.
+ */
+static
+bool
+emufs_cachehit(struct emufs_vnode *ev, off_t pos)
+{
+	return ev->ev_cachegen == ev->ev_emu->e_gen &&
+		pos >= ev->ev_cachepos &&
+		pos < ev->ev_cachepos + (off_t)ev->ev_cachelen;
+}
+
+/*
+ * Fill the read cache for a read at uio_offset. The cache starts at
+ * the page the read starts in. A read that follows on from the last
+ * one fills the whole cache, so sequential reads (like loading a
+ * program) are prefetched a window at a time; otherwise only the
+ * pages the read needs are fetched.
+ */
+static
+int
+emufs_fillcache(struct emufs_vnode *ev, struct uio *uio)
+{
+	off_t pos;
+	size_t len;
+	int result;
+
+	KASSERT(lock_do_i_hold(ev->ev_lock));
+
+	pos = uio->uio_offset - uio->uio_offset % PAGE_SIZE;
+	if (uio->uio_offset == ev->ev_nextpos ||
+	    uio->uio_resid >= EMU_MAXIO) {
+		len = EMU_MAXIO;
+	}
+	else {
+		len = uio->uio_offset - pos + uio->uio_resid;
+		len = ROUNDUP(len, PAGE_SIZE);
+		if (len > EMU_MAXIO) {
+			len = EMU_MAXIO;
+		}
+	}
+
+	result = emu_read(ev->ev_emu, ev->ev_handle, pos, len, ev->ev_cache,
+			  &ev->ev_cachelen, &ev->ev_cachegen);
+	if (result) {
+		ev->ev_cachelen = 0;
+		return result;
+	}
+	ev->ev_cachepos = pos;
+	return 0;
+}
+
 /*
  * VOP_READ
+ *
+ * Reads go through a per-vnode cache of up to EMU_MAXIO bytes, so
+ * small sequential reads only go to the device once per window, and
+ * reads that hit the cache don't touch the device at all.
  */
 static
 int
 emufs_read(struct vnode *v, struct uio *uio)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	uint32_t amt;
-	size_t oldresid;
-	int result;
+	size_t amt, off;
+	int result = 0;
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	while (uio->uio_resid > 0) {
-		amt = uio->uio_resid;
-		if (amt > EMU_MAXIO) {
-			amt = EMU_MAXIO;
+	lock_acquire(ev->ev_lock);
+	if (ev->ev_cache == NULL) {
+		ev->ev_cache = kmalloc(EMU_MAXIO);
+		if (ev->ev_cache == NULL) {
+			lock_release(ev->ev_lock);
+			return ENOMEM;
 		}
+		ev->ev_cachelen = 0;
+	}
 
-		oldresid = uio->uio_resid;
-
-		result = emu_read(ev->ev_emu, ev->ev_handle, amt, uio);
-		if (result) {
-			return result;
+	while (uio->uio_resid > 0) {
+		if (!emufs_cachehit(ev, uio->uio_offset)) {
+			result = emufs_fillcache(ev, uio);
+			if (result) {
+				break;
+			}
+			if (!emufs_cachehit(ev, uio->uio_offset)) {
+				/* nothing read - EOF */
+				break;
+			}
 		}
 
-		if (uio->uio_resid == oldresid) {
-			/* nothing read - EOF */
+		off = uio->uio_offset - ev->ev_cachepos;
+		amt = ev->ev_cachelen - off;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		result = uiomove(ev->ev_cache + off, amt, uio);
+		if (result) {
 			break;
 		}
 	}
+	ev->ev_nextpos = uio->uio_offset;
 
-	return 0;
+	lock_release(ev->ev_lock);
+	return result;
 }
 
 /*
@@ -1096,6 +1210,7 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_mmap = emufs_mmap,
 	.vop_truncate = emufs_truncate,
 	.vop_namefile = emufs_uio_op_notdir,
+	.vop_poll = vnode_poll_ready,
 
 	.vop_creat = emufs_creat_notdir,
 	.vop_symlink = emufs_symlink_notdir,
@@ -1130,6 +1245,7 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_mmap = emufs_void_op_isdir,
 	.vop_truncate = emufs_truncate_isdir,
 	.vop_namefile = emufs_namefile,
+	.vop_poll = vnode_poll_ready,
 
 	.vop_creat = emufs_creat,
 	.vop_symlink = emufs_symlink,
@@ -1185,12 +1301,25 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 
 	ev->ev_emu = ef->ef_emu;
 	ev->ev_handle = handle;
+	ev->ev_cache = NULL;
+	ev->ev_cachepos = 0;
+	ev->ev_cachelen = 0;
+	ev->ev_cachegen = 0;
+	ev->ev_nextpos = 0;
+	ev->ev_lock = lock_create("emufs-vnode");
+	if (ev->ev_lock == NULL) {
+		lock_release(ef->ef_emu->e_lock);
+		vfs_biglock_release();
+		kfree(ev);
+		return ENOMEM;
+	}
 
 	result = vnode_init(&ev->ev_v, isdir ? &emufs_dirops : &emufs_fileops,
 			    &ef->ef_fs, ev);
 	if (result) {
 		lock_release(ef->ef_emu->e_lock);
 		vfs_biglock_release();
+		lock_destroy(ev->ev_lock);
 		kfree(ev);
 		return result;
 	}
@@ -1201,6 +1330,7 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 		vnode_cleanup(&ev->ev_v);
 		lock_release(ef->ef_emu->e_lock);
 		vfs_biglock_release();
+		lock_destroy(ev->ev_lock);
 		kfree(ev);
 		return result;
 	}
@@ -1356,6 +1486,7 @@ config_emu(struct emu_softc *sc, int emuno)
 		return ENOMEM;
 	}
 	sc->e_iobuf = bus_map_area(sc->e_busdata, sc->e_buspos, EMU_BUFFER);
+	sc->e_gen = 1;
 
 	snprintf(name, sizeof(name), "emu%d", emuno);
 
@@ -51,6 +51,9 @@ struct emu_softc {
 	struct semaphore *e_sem;
 	void *e_iobuf;
 
+	/* Bumped (under e_lock) when file data changes */
+	volatile unsigned e_gen;
+
 	/* Written by the interrupt handler */
 	uint32_t e_result;
 };
@@ -36,7 +36,10 @@
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
-#include <synch.h>
+#include <spinlock.h>
+#include <current.h>
+#include <cpu.h>
+#include <wchan.h>
 #include <platform/bus.h>
 #include <vfs.h>
 #include <lamebus/lhd.h>
@@ -96,15 +99,147 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * Request queue.
+ *
+ * Requests wait on lh_queue sorted by starting sector, and are served
+ * in C-LOOK order: the head sweeps upwards, taking the lowest request
+ * at or above the sector it just finished, and jumps back to the
+ * lowest request when there is nothing further up. A request whose
+ * first sector follows on from the one just done (the common case
+ * for sequential access from several threads) is therefore taken
+ * next, which gets the effect of merging adjacent requests; the
+ * hardware only moves one sector per operation anyway.
+ *
+ * The device is driven entirely from the interrupt handler once
+ * started: each completion copies the sector between the on-card
+ * buffer and the request's buffer and starts the next sector, without
+ * waiting for the submitting thread to run.
+ */
+
+/*
+ * Start the next sector, picking a new request if needed.
+ */
+static
+void
+lhd_start(struct lhd_softc *lh)
+{
+	struct lhd_req *lr, **prevp, **pickp;
+	uint32_t sector, statval;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	if (lh->lh_active == NULL) {
+		if (lh->lh_queue == NULL) {
+			return;
+		}
+		pickp = &lh->lh_queue;
+		for (prevp = &lh->lh_queue; *prevp != NULL;
+		     prevp = &(*prevp)->lr_next) {
+			if ((*prevp)->lr_sector >= lh->lh_headpos) {
+				pickp = prevp;
+				break;
+			}
+		}
+		lr = *pickp;
+		*pickp = lr->lr_next;
+		lr->lr_next = NULL;
+		lh->lh_active = lr;
+	}
+
+	lr = lh->lh_active;
+	sector = lr->lr_sector + lr->lr_pos;
+	statval = LHD_WORKING;
+	if (lr->lr_write) {
+		memcpy(lh->lh_buf, lr->lr_buf + lr->lr_pos * LHD_SECTSIZE,
+		       LHD_SECTSIZE);
+		membar_store_store();
+		statval |= LHD_ISWRITE;
+	}
+
+	/* Tell it what sector we want, and start the operation. */
+	lhd_wreg(lh, LHD_REG_SECT, sector);
+	lhd_wreg(lh, LHD_REG_STAT, statval);
+}
+
+/*
+ * Queue a request, and start the device if it's idle.
+ */
+static
+void
+lhd_enqueue(struct lhd_softc *lh, struct lhd_req *lr)
+{
+	struct lhd_req **pp;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	lr->lr_pos = 0;
+	lr->lr_result = 0;
+
+	/* After any others for the same sector, so they go in order. */
+	for (pp = &lh->lh_queue; *pp != NULL; pp = &(*pp)->lr_next) {
+		if ((*pp)->lr_sector > lr->lr_sector) {
+			break;
+		}
+	}
+	lr->lr_next = *pp;
+	*pp = lr;
+
+	if (lh->lh_active == NULL) {
+		lhd_start(lh);
+	}
+}
+
+void
+lhd_submit(struct lhd_softc *lh, struct lhd_req *lr)
+{
+	KASSERT(lr->lr_nsect > 0);
+	KASSERT(lr->lr_nsect <= lh->lh_dev.d_blocks);
+	KASSERT(lr->lr_sector <= lh->lh_dev.d_blocks - lr->lr_nsect);
+
+	spinlock_acquire(&lh->lh_lock);
+	lhd_enqueue(lh, lr);
+	spinlock_release(&lh->lh_lock);
+}
+
+/*
+ * Record that a sector has completed: move the data, and finish the
+ * request or go on to its next sector.
  */
 static
 void
 lhd_iodone(struct lhd_softc *lh, int err)
 {
-	lh->lh_result = err;
-	V(lh->lh_done);
+	struct lhd_req *lr;
+
+	spinlock_acquire(&lh->lh_lock);
+
+	lr = lh->lh_active;
+	if (lr == NULL) {
+		/* Spurious; nothing was started. */
+		spinlock_release(&lh->lh_lock);
+		return;
+	}
+
+	if (err == 0 && !lr->lr_write) {
+		membar_load_load();
+		memcpy(lr->lr_buf + lr->lr_pos * LHD_SECTSIZE, lh->lh_buf,
+		       LHD_SECTSIZE);
+		KSTAT_INC(ks_sectreads);
+	}
+	else if (err == 0) {
+		KSTAT_INC(ks_sectwrites);
+	}
+	lh->lh_headpos = lr->lr_sector + lr->lr_pos + 1;
+	lr->lr_pos++;
+
+	if (err != 0 || lr->lr_pos == lr->lr_nsect) {
+		lr->lr_result = err;
+		lh->lh_active = NULL;
+		lr->lr_done(lr);
+	}
+	lhd_start(lh);
+
+	spinlock_release(&lh->lh_lock);
 }
 
 /*
@@ -179,22 +314,41 @@ lhd_reset(struct lhd_softc *lh)
 }
 #endif
 
+/*
+ * Completion callback for lhd_io. Called with lh_lock held.
+ */
+static
+void
+lhd_io_done(struct lhd_req *lr)
+{
+	struct lhd_softc *lh = lr->lr_data;
+
+	wchan_wakeall(lh->lh_wchan, &lh->lh_lock);
+}
+
 /*
  * I/O function (for both reads and writes)
+ *
+ * Requests may cover any number of consecutive sectors. They are
+ * passed to the queue LHD_MAXREQ sectors at a time through a kernel
+ * buffer, since the transfers to and from the card happen in the
+ * interrupt handler, where the caller's buffer (which may be in user
+ * space) can't be touched.
  */
 static
 int
 lhd_io(struct device *d, struct uio *uio)
 {
 	struct lhd_softc *lh = d->d_data;
+	struct lhd_req lr;
 
 	uint32_t sector = uio->uio_offset / LHD_SECTSIZE;
 	uint32_t sectoff = uio->uio_offset % LHD_SECTSIZE;
 	uint32_t len = uio->uio_resid / LHD_SECTSIZE;
 	uint32_t lenoff = uio->uio_resid % LHD_SECTSIZE;
-	uint32_t i;
-	uint32_t statval = LHD_WORKING;
-	int result;
+	uint32_t n;
+	char *buf;
+	int result = 0;
 
 	/* Don't allow I/O that isn't sector-aligned. */
 	if (sectoff != 0 || lenoff != 0) {
@@ -202,66 +356,63 @@ lhd_io(struct device *d, struct uio *uio)
 	}
 
 	/* Don't allow I/O past the end of the disk. */
-	/* XXX this check can overflow */
-	if (sector+len > lh->lh_dev.d_blocks) {
+	if (uio->uio_offset < 0 ||
+	    len > lh->lh_dev.d_blocks ||
+	    sector > lh->lh_dev.d_blocks - len) {
 		return EINVAL;
 	}
-
-	/* Set up the value to write into the status register. */
-	if (uio->uio_rw==UIO_WRITE) {
-		statval |= LHD_ISWRITE;
+	if (len == 0) {
+		return 0;
 	}
 
-	/* Loop over all the sectors we were asked to do. */
-	for (i=0; i<len; i++) {
+	buf = kmalloc((len < LHD_MAXREQ ? len : LHD_MAXREQ) * LHD_SECTSIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
 
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
+	while (len > 0) {
+		n = len < LHD_MAXREQ ? len : LHD_MAXREQ;
 
-		/*
-		 * Are we writing? If so, transfer the data to the
-		 * on-card buffer.
-		 */
 		if (uio->uio_rw == UIO_WRITE) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-			membar_store_store();
+			result = uiomove(buf, n * LHD_SECTSIZE, uio);
 			if (result) {
-				V(lh->lh_clear);
-				return result;
+				break;
 			}
 		}
 
-		/* Tell it what sector we want... */
-		lhd_wreg(lh, LHD_REG_SECT, sector+i);
-
-		/* and start the operation. */
-		lhd_wreg(lh, LHD_REG_STAT, statval);
-
-		/* Now wait until the interrupt handler tells us we're done. */
-		P(lh->lh_done);
-
-		/* Get the result value saved by the interrupt handler. */
-		result = lh->lh_result;
-
-		/*
-		 * Are we reading? If so, and if we succeeded,
-		 * transfer the data out of the on-card buffer.
-		 */
-		if (result==0 && uio->uio_rw==UIO_READ) {
-			membar_load_load();
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
+		lr.lr_sector = sector;
+		lr.lr_nsect = n;
+		lr.lr_write = uio->uio_rw == UIO_WRITE;
+		lr.lr_buf = buf;
+		lr.lr_done = lhd_io_done;
+		lr.lr_data = lh;
+
+		/* Queue it, and wait until the interrupt handler finishes it. */
+		spinlock_acquire(&lh->lh_lock);
+		lhd_enqueue(lh, &lr);
+		while (lr.lr_pos < lr.lr_nsect && lr.lr_result == 0) {
+			wchan_sleep(lh->lh_wchan, &lh->lh_lock);
 		}
+		spinlock_release(&lh->lh_lock);
 
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
-
-		/* If we failed, return the error. */
+		result = lr.lr_result;
 		if (result) {
-			return result;
+			break;
+		}
+
+		if (uio->uio_rw == UIO_READ) {
+			result = uiomove(buf, n * LHD_SECTSIZE, uio);
+			if (result) {
+				break;
+			}
 		}
+
+		sector += n;
+		len -= n;
 	}
 
-	return 0;
+	kfree(buf);
+	return result;
 }
 
 static const struct device_ops lhd_devops = {
@@ -284,15 +435,14 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
-	if (lh->lh_clear == NULL) {
-		return ENOMEM;
-	}
-	lh->lh_done = sem_create("lhd-done", 0);
-	if (lh->lh_done == NULL) {
-		sem_destroy(lh->lh_clear);
-		lh->lh_clear = NULL;
+	/* Set up the request queue. */
+	spinlock_init(&lh->lh_lock);
+	lh->lh_queue = NULL;
+	lh->lh_active = NULL;
+	lh->lh_headpos = 0;
+	lh->lh_wchan = wchan_create("lhd");
+	if (lh->lh_wchan == NULL) {
+		spinlock_cleanup(&lh->lh_lock);
 		return ENOMEM;
 	}
 
@@ -31,12 +31,42 @@
 #define _LAMEBUS_LHD_H_
 
 #include <device.h>
+#include <spinlock.h>
 
 /*
  * Our sector size
  */
 #define LHD_SECTSIZE  512
 
+/*
+ * Largest request, in sectors
+ */
+#define LHD_MAXREQ    64
+
+/*
+ * Block I/O request.
+ *
+ * The submitter fills in the first block of fields and calls
+ * lhd_submit. The driver queues the request, transfers its sectors
+ * to or from lr_buf (which must be kernel memory), and calls lr_done
+ * when it has finished or failed. lr_done is called from the
+ * interrupt handler with the driver's spinlock held, so it must not
+ * sleep or submit more requests.
+ */
+struct lhd_req {
+	uint32_t lr_sector;		/* first sector */
+	uint32_t lr_nsect;		/* number of sectors */
+	bool lr_write;			/* true for writes */
+	char *lr_buf;			/* lr_nsect * LHD_SECTSIZE bytes */
+	void (*lr_done)(struct lhd_req *lr);	/* completion callback */
+	void *lr_data;			/* for lr_done */
+
+	/* Owned by the driver until lr_done is called */
+	uint32_t lr_pos;		/* sectors done so far */
+	int lr_result;			/* errno, valid in lr_done */
+	struct lhd_req *lr_next;	/* queue link */
+};
+
 /*
  * Hardware device data associated with lhd (LAMEbus hard disk)
  */
@@ -51,9 +81,11 @@ struct lhd_softc {
 	 */
 
 	void *lh_buf;			/* Pointer to on-card I/O buffer */
-	int lh_result;			/* Result from I/O operation */
-	struct semaphore *lh_clear;	/* Synchronization */
-	struct semaphore *lh_done;
+	struct spinlock lh_lock;	/* Protects the queue and device */
+	struct lhd_req *lh_queue;	/* Waiting requests, by sector */
+	struct lhd_req *lh_active;	/* Request in progress, or NULL */
+	uint32_t lh_headpos;		/* Sector after the last one done */
+	struct wchan *lh_wchan;		/* Threads waiting in lhd_io */
 
 	struct device lh_dev;		/* VFS device structure */
 };
@@ -61,4 +93,7 @@ struct lhd_softc {
 /* Functions called by lower-level drivers */
 void lhd_irq(/*struct lhd_softc*/ void *);	/* Interrupt handler */
 
+/* Functions called by higher-level code */
+void lhd_submit(struct lhd_softc *lh, struct lhd_req *lr);
+
 #endif /* _LAMEBUS_LHD_H_ */
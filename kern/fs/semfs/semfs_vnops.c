@@ -136,7 +136,8 @@ semfs_getsem(struct semfs_vnode *semv)
  * Wakeup helper. We only need to wake up if there are sleepers, which
  * should only be the case if the old count is 0; and we only
  * potentially need to wake more than one sleeper if the new count
- * will be more than 1.
+ * will be more than 1. The same goes for poll()ers, which only care
+ * about the count becoming nonzero.
  */
 static
 void
@@ -151,6 +152,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollq_wakeup(&sem->sems_pollq);
 }
 
 /*
@@ -255,6 +257,36 @@ semfs_write(struct vnode *vn, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Poll. The semaphore is readable (P won't block) if the count is
+ * nonzero; it's always writable.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, struct poller *poller, int *revents)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+	int result;
+
+	sem = semfs_getsem(semv);
+
+	lock_acquire(sem->sems_lock);
+	if (poller != NULL) {
+		result = poller_register(poller, &sem->sems_pollq);
+		if (result) {
+			lock_release(sem->sems_lock);
+			return result;
+		}
+	}
+	*revents = events & (POLLOUT | POLLWRNORM);
+	if (sem->sems_count > 0) {
+		*revents |= events & (POLLIN | POLLRDNORM);
+	}
+	lock_release(sem->sems_lock);
+	return 0;
+}
+
 /*
  * Truncate. Set the count to the specified value.
  *
@@ -666,6 +698,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
 	.vop_namefile = semfs_namefile,
+	.vop_poll = vnode_poll_ready,
 
 	.vop_creat = semfs_creat,
 	.vop_symlink = vopfail_symlink_nosys,
@@ -699,6 +732,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = semfs_poll,
 
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
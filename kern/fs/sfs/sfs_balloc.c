@@ -51,19 +51,61 @@ sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 	return sfs_writeblock(sfs, block, zeros, SFS_BLOCKSIZE);
 }
 
+/*
+ * Note that the freemap block holding DISKBLOCK's bit has changed.
+ * Only changed freemap blocks are written back, so a small change
+ * to a large freemap takes little room in the journal.
+ */
+static
+void
+sfs_freemap_dirty(struct sfs_fs *sfs, daddr_t diskblock)
+{
+	unsigned fmblock = diskblock / SFS_BITSPERBLOCK;
+
+	if (!bitmap_isset(sfs->sfs_freemapdirty, fmblock)) {
+		bitmap_mark(sfs->sfs_freemapdirty, fmblock);
+	}
+}
+
+/*
+ * Check if any of the freemap has changed since it was written back.
+ */
+bool
+sfs_freemap_isdirty(struct sfs_fs *sfs)
+{
+	unsigned i;
+
+	for (i=0; i<SFS_FREEMAPBLOCKS(sfs->sfs_sb.sb_nblocks); i++) {
+		if (bitmap_isset(sfs->sfs_freemapdirty, i)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Allocate a block.
+ *
+ * GOAL is where we'd like the block to be: we take the first free
+ * block at or after it, so that blocks allocated one after another
+ * for the same file end up next to each other on disk and can be
+ * read and written in clusters. Pass 0 if there's no preference.
+ *
+ * The block is zeroed on disk before we return it, even if the
+ * caller is about to fill it in the buffer cache: the journal only
+ * covers metadata, so once the block is mapped into a file it must
+ * not hold whatever the block's last owner left there.
  */
 int
-sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
+sfs_balloc(struct sfs_fs *sfs, daddr_t goal, daddr_t *diskblock)
 {
 	int result;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	result = bitmap_alloc_near(sfs->sfs_freemap, goal, diskblock);
 	if (result) {
 		return result;
 	}
-	sfs->sfs_freemapdirty = true;
+	sfs_freemap_dirty(sfs, *diskblock);
 
 	if (*diskblock >= sfs->sfs_sb.sb_nblocks) {
 		panic("sfs: %s: balloc: invalid block %u\n",
@@ -84,8 +126,12 @@ sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
 void
 sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 {
+	/* Discard any cached copy, so it never gets written back */
+	sfs_buf_drop(sfs, diskblock);
+	sfs_log_forget(sfs, diskblock);
+
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
-	sfs->sfs_freemapdirty = true;
+	sfs_freemap_dirty(sfs, diskblock);
 }
 
 /*
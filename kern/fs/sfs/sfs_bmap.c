@@ -39,36 +39,88 @@
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/*
+ * I/O buffer for handling indirect blocks in sfs_bmap.
+ *
+ * Note: in real life (and when you've done the fs assignment)
+ * you would get space from the disk buffer cache for this,
+ * not use a static area.
+ *
+ * Because sfs_io now maps whole runs of blocks at a time, we remember
+ * which indirect block (and on which volume) is in the buffer, so
+ * consecutive lookups through the same indirect block only read it
+ * once. sfs_bmap writes the buffer through whenever it changes it;
+ * the only other place indirect blocks are written or freed is
+ * sfs_itrunc, which invalidates the buffer.
+ */
+static uint32_t bmap_idbuf[SFS_DBPERIDB];
+static struct sfs_fs *bmap_idbuf_fs;
+static daddr_t bmap_idbuf_block;
+
+/*
+ * Forget whatever is in bmap_idbuf. Also called at unmount, so a
+ * later volume can't match a stale buffer by reusing the same
+ * struct sfs_fs address.
+ */
+void
+sfs_bmap_invalidate(void)
+{
+	bmap_idbuf_fs = NULL;
+	bmap_idbuf_block = 0;
+}
+
+/*
+ * Pick a place to allocate a new direct block: right after the
+ * nearest direct block before it, or right after the inode if the
+ * file doesn't have any yet.
+ */
+static
+daddr_t
+sfs_bmap_directgoal(struct sfs_vnode *sv, uint32_t fileblock)
+{
+	uint32_t i;
+
+	for (i=fileblock; i>0; i--) {
+		if (sv->sv_i.sfi_direct[i-1] != 0) {
+			return sv->sv_i.sfi_direct[i-1] + 1;
+		}
+	}
+	return sv->sv_ino + 1;
+}
+
 /*
  * Look up the disk block number (from 0 up to the number of blocks on
  * the disk) given a file and the logical block number within that
  * file. If DOALLOC is set, and no such block exists, one will be
  * allocated.
+ *
+ * New blocks are placed near the file's other blocks (see
+ * sfs_balloc) so that sequential I/O can be clustered. When DOALLOC
+ * is set, *ISNEW tells the caller whether the block was just
+ * allocated; it's zero on disk, so there's no need to read it. ISNEW
+ * may be NULL if DOALLOC is false.
  */
 int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
-	 daddr_t *diskblock)
+	 daddr_t *diskblock, bool *isnew)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
+	uint32_t *idbuf = bmap_idbuf;
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 	daddr_t block;
 	daddr_t idblock;
 	uint32_t idnum, idoff;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	KASSERT(sizeof(bmap_idbuf)==SFS_BLOCKSIZE);
 
 	/* Since we're using a static buffer, we'd better be locked. */
 	KASSERT(vfs_biglock_do_i_hold());
 
+	KASSERT(!doalloc || isnew != NULL);
+	if (isnew != NULL) {
+		*isnew = false;
+	}
+
 	/*
 	 * If the block we want is one of the direct blocks...
 	 */
@@ -82,7 +134,9 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		 * Do we need to allocate?
 		 */
 		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+			result = sfs_balloc(sfs,
+					    sfs_bmap_directgoal(sv, fileblock),
+					    &block);
 			if (result) {
 				return result;
 			}
@@ -90,6 +144,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 			/* Remember what we allocated; mark inode dirty */
 			sv->sv_i.sfi_direct[fileblock] = block;
 			sv->sv_dirty = true;
+			*isnew = true;
 		}
 
 		/*
@@ -141,9 +196,12 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		 * There's no indirect block allocated, but we need to
 		 * allocate a block whose number needs to be stored in
 		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
+		 * indirect block. Put it after the last direct block,
+		 * where the file's next data block would have gone.
 		 */
-		result = sfs_balloc(sfs, &idblock);
+		result = sfs_balloc(sfs,
+				    sfs_bmap_directgoal(sv, SFS_NDIRECT),
+				    &idblock);
 		if (result) {
 			return result;
 		}
@@ -155,16 +213,23 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		sv->sv_dirty = true;
 
 		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
+		bzero(bmap_idbuf, sizeof(bmap_idbuf));
+		bmap_idbuf_fs = sfs;
+		bmap_idbuf_block = idblock;
 	}
-	else {
+	else if (bmap_idbuf_fs != sfs || bmap_idbuf_block != idblock) {
 		/*
-		 * We already have an indirect block allocated; load it.
+		 * We already have an indirect block allocated; load it,
+		 * unless it's the one we already have in the buffer.
 		 */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
+		sfs_bmap_invalidate();
+		result = sfs_readblock(sfs, idblock, bmap_idbuf,
+				       sizeof(bmap_idbuf));
 		if (result) {
 			return result;
 		}
+		bmap_idbuf_fs = sfs;
+		bmap_idbuf_block = idblock;
 	}
 
 	/* Get the block out of the indirect block buffer */
@@ -172,17 +237,27 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
+		/* Goal: after the previous block, or the indirect block */
+		if (idoff > 0 && idbuf[idoff-1] != 0) {
+			block = idbuf[idoff-1] + 1;
+		}
+		else {
+			block = idblock + 1;
+		}
+		result = sfs_balloc(sfs, block, &block);
 		if (result) {
 			return result;
 		}
 
 		/* Remember the block we allocated */
 		idbuf[idoff] = block;
+		*isnew = true;
 
 		/* The indirect block is now dirty; write it back */
-		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_writeblock(sfs, idblock, bmap_idbuf,
+					sizeof(bmap_idbuf));
 		if (result) {
+			sfs_bmap_invalidate();
 			return result;
 		}
 	}
@@ -197,20 +272,51 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	return 0;
 }
 
+/*
+ * Count the distinct freemap blocks holding the bits for the N disk
+ * blocks in BLOCKS, which is how much journal space freeing them
+ * takes.
+ */
+static
+unsigned
+sfs_itrunc_fmblocks(const daddr_t *blocks, unsigned n)
+{
+	unsigned i, j, count = 0;
+
+	for (i=0; i<n; i++) {
+		for (j=0; j<i; j++) {
+			if (blocks[j] / SFS_BITSPERBLOCK ==
+			    blocks[i] / SFS_BITSPERBLOCK) {
+				break;
+			}
+		}
+		if (j == i) {
+			count++;
+		}
+	}
+	return count;
+}
+
 /*
  * Called for ftruncate() and from sfs_reclaim.
+ *
+ * This is one journal operation; before changing anything we work
+ * out which blocks it will free, so as to know how much of the
+ * journal it needs.
  */
 int
 sfs_itrunc(struct sfs_vnode *sv, off_t len)
 {
 	/*
-	 * I/O buffer for handling the indirect block.
+	 * I/O buffer for handling the indirect block, and the list
+	 * of blocks to free.
 	 *
 	 * Note: in real life (and when you've done the fs assignment)
 	 * you would get space from the disk buffer cache for this,
 	 * not use a static area.
 	 */
 	static uint32_t idbuf[SFS_DBPERIDB];
+	static daddr_t tofree[SFS_NDIRECT + SFS_DBPERIDB + 1];
 
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 
@@ -220,25 +326,16 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	uint32_t i, j;
 	daddr_t block, idblock;
 	uint32_t baseblock, highblock;
+	unsigned nfree;
 	int result;
-	int hasnonzero, iddirty;
+	int hasnonzero, iddirty, doindirect;
 
 	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
 
 	vfs_biglock_acquire();
 
-	/*
-	 * Go through the direct blocks. Discard any that are
-	 * past the limit we're truncating to.
-	 */
-	for (i=0; i<SFS_NDIRECT; i++) {
-		block = sv->sv_i.sfi_direct[i];
-		if (i >= blocklen && block != 0) {
-			sfs_bfree(sfs, block);
-			sv->sv_i.sfi_direct[i] = 0;
-			sv->sv_dirty = true;
-		}
-	}
+	/* We're about to rewrite or free the indirect block behind bmap */
+	sfs_bmap_invalidate();
 
 	/* Indirect block number */
 	idblock = sv->sv_i.sfi_indirect;
@@ -249,16 +346,62 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	/* The highest block in the indirect block */
 	highblock = baseblock + SFS_DBPERIDB - 1;
 
-	if (blocklen < highblock && idblock != 0) {
-		/* We're past the proposed EOF; may need to free stuff */
-
+	/* If we're past the proposed EOF, may need to free stuff */
+	doindirect = (blocklen < highblock && idblock != 0);
+	if (doindirect) {
 		/* Read the indirect block */
 		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
 		if (result) {
 			vfs_biglock_release();
 			return result;
 		}
+	}
+
+	/*
+	 * Collect the blocks we're going to free; the operation can
+	 * take a freemap block for each, plus the inode and the
+	 * indirect block.
+	 */
+	nfree = 0;
+	for (i=0; i<SFS_NDIRECT; i++) {
+		if (i >= blocklen && sv->sv_i.sfi_direct[i] != 0) {
+			tofree[nfree++] = sv->sv_i.sfi_direct[i];
+		}
+	}
+	if (doindirect) {
+		hasnonzero = 0;
+		for (j=0; j<SFS_DBPERIDB; j++) {
+			if (blocklen < baseblock+j && idbuf[j] != 0) {
+				tofree[nfree++] = idbuf[j];
+			}
+			else if (idbuf[j] != 0) {
+				hasnonzero = 1;
+			}
+		}
+		if (!hasnonzero) {
+			tofree[nfree++] = idblock;
+		}
+	}
+	result = sfs_log_begin(sfs, 2 + sfs_itrunc_fmblocks(tofree, nfree));
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	/*
+	 * Go through the direct blocks. Discard any that are
+	 * past the limit we're truncating to.
+	 */
+	for (i=0; i<SFS_NDIRECT; i++) {
+		block = sv->sv_i.sfi_direct[i];
+		if (i >= blocklen && block != 0) {
+			sfs_bfree(sfs, block);
+			sv->sv_i.sfi_direct[i] = 0;
+			sv->sv_dirty = true;
+		}
+	}
 
+	if (doindirect) {
 		hasnonzero = 0;
 		iddirty = 0;
 		for (j=0; j<SFS_DBPERIDB; j++) {
@@ -285,6 +428,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 			result = sfs_writeblock(sfs, idblock, idbuf,
 						sizeof(idbuf));
 			if (result) {
+				sfs_log_end(sfs);
 				vfs_biglock_release();
 				return result;
 			}
@@ -297,6 +441,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
+	sfs_log_end(sfs);
 	vfs_biglock_release();
 	return 0;
 }
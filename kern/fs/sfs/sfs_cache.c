@@ -0,0 +1,808 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * SFS filesystem
+ *
+ * File data block cache, read-ahead, and write-behind.
+ *
+ * Each volume keeps a small cache of file data blocks. Reads that
+ * hit in the cache are served from memory; writes go into the cache
+ * and are written back later. Metadata (inodes, directories, indirect
+ * blocks, the freemap) does not go through here; it is still read
+ * and written directly with sfs_readblock/sfs_writeblock. A block is
+ * only ever cached while it belongs to a file, so sfs_bfree discards
+ * any cached copy when the block is released.
+ *
+ * Each volume also has an I/O thread. Readers that look sequential
+ * queue read-ahead requests for it, and it fetches the requested
+ * blocks into the cache, clustering them into as few device requests
+ * as possible. When enough dirty blocks accumulate, or a file is
+ * closed for the last time, it is also woken to write dirty blocks
+ * back. fsync and sync write back synchronously, so they remain the
+ * barrier for data reaching the disk. Finally, it checkpoints the
+ * journal (see sfs_log.c) after each commit.
+ *
+ * Like the rest of SFS, all of this is protected by the vfs big lock.
+ * The I/O thread's request queue has its own lock, which is always
+ * acquired after (never while waiting for) the big lock.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <array.h>
+#include <uio.h>
+#include <synch.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <cpu.h>
+#include <vfs.h>
+#include <sfs.h>
+#include "sfsprivate.h"
+
+////////////////////////////////////////////////////////////
+// Buffer management
+
+/*
+ * Find the buffer holding BLOCK, if any, without counting it as a use.
+ *
+ * Linear search; the cache is small and the alternative is waiting
+ * for the disk.
+ */
+static
+struct sfs_buf *
+sfs_buf_lookup(struct sfs_cache *sc, daddr_t block)
+{
+	unsigned i;
+
+	if (block == 0) {
+		/* Block 0 is the superblock and is never cached */
+		return NULL;
+	}
+	for (i=0; i<SFS_NBUFS; i++) {
+		if (sc->sc_bufs[i].b_block == block) {
+			return &sc->sc_bufs[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Note a use of a buffer, for LRU replacement.
+ */
+static
+void
+sfs_buf_touch(struct sfs_cache *sc, struct sfs_buf *b)
+{
+	b->b_stamp = ++sc->sc_stamp;
+}
+
+/*
+ * Write back the run of consecutive dirty blocks that B is part of,
+ * up to SFS_MAXCLUSTER blocks starting from the front of the run, in
+ * a single device request.
+ */
+static
+int
+sfs_buf_flushrun(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_buf *run[SFS_MAXCLUSTER];
+	struct iovec iov[SFS_MAXCLUSTER];
+	struct uio ku;
+	struct sfs_buf *nb;
+	unsigned i, n;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(b->b_dirty);
+
+	/* Back up to the beginning of the run. */
+	while ((nb = sfs_buf_lookup(sc, b->b_block - 1)) != NULL &&
+	       nb->b_dirty) {
+		b = nb;
+	}
+
+	/* Collect the run going forward. */
+	n = 0;
+	while (b != NULL && b->b_dirty && n < SFS_MAXCLUSTER) {
+		run[n] = b;
+		iov[n].iov_kbase = b->b_data;
+		iov[n].iov_len = SFS_BLOCKSIZE;
+		n++;
+		b = sfs_buf_lookup(sc, b->b_block + 1);
+	}
+
+	ku.uio_iov = iov;
+	ku.uio_iovcnt = n;
+	ku.uio_offset = ((off_t)run[0]->b_block) * SFS_BLOCKSIZE;
+	ku.uio_resid = n * SFS_BLOCKSIZE;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_rw = UIO_WRITE;
+	ku.uio_space = NULL;
+
+	result = sfs_rwblock(sfs, &ku);
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<n; i++) {
+		run[i]->b_dirty = false;
+		KASSERT(sc->sc_ndirty > 0);
+		sc->sc_ndirty--;
+	}
+	return 0;
+}
+
+/*
+ * Find a buffer to reuse: an empty one if possible, otherwise the
+ * least recently used clean one. If MAYFLUSH is set and everything is
+ * dirty, write back the least recently used dirty buffer (and its
+ * neighbors) to make room; otherwise fail with EAGAIN.
+ *
+ * The buffer handed back is empty; the caller must claim it by
+ * setting b_block before looking for another one.
+ */
+static
+int
+sfs_buf_alloc(struct sfs_fs *sfs, bool mayflush, struct sfs_buf **ret)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_buf *b, *clean, *dirty;
+	unsigned i;
+	int result;
+
+	clean = dirty = NULL;
+	for (i=0; i<SFS_NBUFS; i++) {
+		b = &sc->sc_bufs[i];
+		if (b->b_block == 0) {
+			*ret = b;
+			return 0;
+		}
+		if (b->b_dirty) {
+			if (dirty == NULL || sc->sc_stamp - b->b_stamp >
+			    sc->sc_stamp - dirty->b_stamp) {
+				dirty = b;
+			}
+		}
+		else {
+			if (clean == NULL || sc->sc_stamp - b->b_stamp >
+			    sc->sc_stamp - clean->b_stamp) {
+				clean = b;
+			}
+		}
+	}
+
+	if (clean == NULL) {
+		if (!mayflush) {
+			return EAGAIN;
+		}
+		KASSERT(dirty != NULL);
+		result = sfs_buf_flushrun(sfs, dirty);
+		if (result) {
+			return result;
+		}
+		KASSERT(!dirty->b_dirty);
+		clean = dirty;
+	}
+
+	clean->b_block = 0;
+	*ret = clean;
+	return 0;
+}
+
+/*
+ * Look up BLOCK in the cache, counting it as a use. Returns NULL if
+ * it isn't there.
+ */
+struct sfs_buf *
+sfs_buf_find(struct sfs_fs *sfs, daddr_t block)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_buf *b;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	b = sfs_buf_lookup(sc, block);
+	if (b != NULL) {
+		sfs_buf_touch(sc, b);
+		KSTAT_INC(ks_cachehits);
+	}
+	else {
+		KSTAT_INC(ks_cachemisses);
+	}
+	return b;
+}
+
+/*
+ * Get a buffer for BLOCK, which belongs to inode INO. If the block
+ * isn't already cached and DOREAD is set, read it in; if DOREAD is
+ * not set the caller is about to overwrite the whole contents.
+ *
+ * The buffer remains valid until the caller next does something that
+ * might need a buffer, which in practice means until it lets go of
+ * the big lock or calls back into the cache.
+ */
+int
+sfs_buf_get(struct sfs_fs *sfs, uint32_t ino, daddr_t block, bool doread,
+	    struct sfs_buf **ret)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_buf *b;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(block != 0);
+
+	b = sfs_buf_find(sfs, block);
+	if (b != NULL) {
+		KASSERT(b->b_ino == ino);
+		*ret = b;
+		return 0;
+	}
+
+	result = sfs_buf_alloc(sfs, true, &b);
+	if (result) {
+		return result;
+	}
+
+	if (doread) {
+		result = sfs_readblock(sfs, block, b->b_data, SFS_BLOCKSIZE);
+		if (result) {
+			return result;
+		}
+	}
+
+	b->b_block = block;
+	b->b_ino = ino;
+	b->b_dirty = false;
+	sfs_buf_touch(sc, b);
+
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Mark a buffer dirty. If enough dirty buffers have piled up, wake
+ * the I/O thread to start writing them back.
+ */
+void
+sfs_buf_markdirty(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(b->b_block != 0);
+
+	if (!b->b_dirty) {
+		b->b_dirty = true;
+		sc->sc_ndirty++;
+	}
+	if (sc->sc_ndirty >= SFS_WBTHRESH) {
+		sfs_cache_writebehind(sfs);
+	}
+}
+
+/*
+ * Discard any cached copy of BLOCK, even if dirty. Called when the
+ * block is freed, and when a buffer's contents can't be trusted.
+ */
+void
+sfs_buf_drop(struct sfs_fs *sfs, daddr_t block)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_buf *b;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sc == NULL) {
+		/* Not mounted yet (or any more) */
+		return;
+	}
+
+	b = sfs_buf_lookup(sc, block);
+	if (b == NULL) {
+		return;
+	}
+	if (b->b_dirty) {
+		b->b_dirty = false;
+		KASSERT(sc->sc_ndirty > 0);
+		sc->sc_ndirty--;
+	}
+	b->b_block = 0;
+}
+
+/*
+ * Write back the dirty blocks of inode INO, or of all files if INO
+ * is SFS_NOINO.
+ */
+int
+sfs_buf_flush(struct sfs_fs *sfs, uint32_t ino)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_buf *b;
+	unsigned i;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<SFS_NBUFS && sc->sc_ndirty > 0; i++) {
+		b = &sc->sc_bufs[i];
+		if (b->b_dirty && (ino == SFS_NOINO || b->b_ino == ino)) {
+			result = sfs_buf_flushrun(sfs, b);
+			if (result) {
+				return result;
+			}
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// The I/O thread
+
+/*
+ * Find the vnode for inode INO if it's loaded. Does not take a
+ * reference; the caller must hold the big lock for as long as it
+ * uses the result.
+ */
+static
+struct sfs_vnode *
+sfs_cache_findvnode(struct sfs_fs *sfs, uint32_t ino)
+{
+	struct vnode *v;
+	struct sfs_vnode *sv;
+	unsigned i, num;
+
+	num = vnodearray_num(sfs->sfs_vnodes);
+	for (i=0; i<num; i++) {
+		v = vnodearray_get(sfs->sfs_vnodes, i);
+		sv = v->vn_data;
+		if (sv->sv_ino == ino) {
+			return sv;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Perform a read-ahead request: read the file blocks it names that
+ * aren't already cached, in runs of blocks that are consecutive on
+ * disk. Read-ahead is only a hint, so if anything goes wrong we just
+ * stop. We never write back dirty buffers to make room for it.
+ */
+static
+void
+sfs_cache_doreadahead(struct sfs_fs *sfs, const struct sfs_rareq *req)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_vnode *sv;
+	struct sfs_buf *run[SFS_MAXCLUSTER];
+	struct iovec iov[SFS_MAXCLUSTER];
+	struct uio ku;
+	uint32_t fileblock, endblock, eofblock;
+	daddr_t diskblock, nextblock;
+	unsigned i, n, maxrun;
+	int result;
+
+	sv = sfs_cache_findvnode(sfs, req->rr_ino);
+	if (sv == NULL) {
+		/* File was closed; don't bother */
+		return;
+	}
+
+	eofblock = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	fileblock = req->rr_fileblock;
+	endblock = fileblock + req->rr_nblocks;
+	if (endblock > eofblock) {
+		endblock = eofblock;
+	}
+
+	while (fileblock < endblock) {
+		result = sfs_bmap(sv, fileblock, false, &diskblock, NULL);
+		if (result) {
+			return;
+		}
+		if (diskblock == 0 || sfs_buf_lookup(sc, diskblock) != NULL) {
+			/* Hole, or already have it */
+			fileblock++;
+			continue;
+		}
+
+		/*
+		 * Claim buffers for as long a run as we can. Keep the
+		 * run shorter than the number of buffers that aren't
+		 * dirty, so that sfs_buf_alloc never picks a buffer we
+		 * already claimed as its least recently used one.
+		 */
+		maxrun = SFS_NBUFS - sc->sc_ndirty;
+		if (maxrun <= 1) {
+			return;
+		}
+		maxrun--;
+		if (maxrun > SFS_MAXCLUSTER) {
+			maxrun = SFS_MAXCLUSTER;
+		}
+		n = 0;
+		while (1) {
+			result = sfs_buf_alloc(sfs, false, &run[n]);
+			if (result) {
+				break;
+			}
+			run[n]->b_block = diskblock + n;
+			run[n]->b_ino = sv->sv_ino;
+			run[n]->b_dirty = false;
+			sfs_buf_touch(sc, run[n]);
+			iov[n].iov_kbase = run[n]->b_data;
+			iov[n].iov_len = SFS_BLOCKSIZE;
+			n++;
+
+			if (n == maxrun || fileblock + n >= endblock) {
+				break;
+			}
+			result = sfs_bmap(sv, fileblock + n, false,
+					  &nextblock, NULL);
+			if (result || nextblock != diskblock + n ||
+			    sfs_buf_lookup(sc, nextblock) != NULL) {
+				break;
+			}
+		}
+		if (n == 0) {
+			/* No clean buffers to read into */
+			return;
+		}
+
+		ku.uio_iov = iov;
+		ku.uio_iovcnt = n;
+		ku.uio_offset = ((off_t)diskblock) * SFS_BLOCKSIZE;
+		ku.uio_resid = n * SFS_BLOCKSIZE;
+		ku.uio_segflg = UIO_SYSSPACE;
+		ku.uio_rw = UIO_READ;
+		ku.uio_space = NULL;
+
+		result = sfs_rwblock(sfs, &ku);
+		if (result) {
+			for (i=0; i<n; i++) {
+				run[i]->b_block = 0;
+			}
+			return;
+		}
+
+		fileblock += n;
+	}
+}
+
+/*
+ * Write back one run of dirty blocks, the least recently used first.
+ * Returns true if there are more.
+ */
+static
+bool
+sfs_cache_dowriteback(struct sfs_fs *sfs)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_buf *b, *oldest;
+	unsigned i;
+
+	oldest = NULL;
+	for (i=0; i<SFS_NBUFS; i++) {
+		b = &sc->sc_bufs[i];
+		if (b->b_dirty && (oldest == NULL ||
+		    sc->sc_stamp - b->b_stamp >
+		    sc->sc_stamp - oldest->b_stamp)) {
+			oldest = b;
+		}
+	}
+	if (oldest == NULL) {
+		return false;
+	}
+
+	if (sfs_buf_flushrun(sfs, oldest)) {
+		/*
+		 * sfs_rwblock already complained and retried; leave
+		 * the blocks dirty for fsync or sync to report.
+		 */
+		return false;
+	}
+	return sc->sc_ndirty > 0;
+}
+
+/*
+ * Destroy the cache structure. Called by the I/O thread on its way
+ * out, because it may still be waiting for the big lock when the
+ * volume is unmounted.
+ */
+static
+void
+sfs_cache_destroy(struct sfs_cache *sc)
+{
+	cv_destroy(sc->sc_cv);
+	lock_destroy(sc->sc_lock);
+	kfree(sc);
+}
+
+/*
+ * Body of the I/O thread. Waits for read-ahead requests or a
+ * write-behind request and does them, taking the big lock for each
+ * piece of work separately so as not to hold up other users of the
+ * filesystem any longer than necessary.
+ *
+ * Because sfs_cache_shutdown runs with the big lock held, we must not
+ * wait for the big lock while holding sc_lock, and after getting the
+ * big lock we must check whether the volume has gone away.
+ */
+static
+void
+sfs_iothread(void *data1, unsigned long data2)
+{
+	struct sfs_cache *sc = data1;
+	struct sfs_fs *sfs = sc->sc_fs;
+	struct sfs_rareq req;
+	bool isra, isckpt, more;
+	int result;
+
+	(void)data2;
+
+	lock_acquire(sc->sc_lock);
+	while (1) {
+		while (!sc->sc_exit && sc->sc_racount == 0 &&
+		       !sc->sc_wbwanted && !sc->sc_ckptwanted) {
+			cv_wait(sc->sc_cv, sc->sc_lock);
+		}
+		if (sc->sc_exit) {
+			break;
+		}
+
+		/*
+		 * Read-ahead first; someone's probably waiting for it.
+		 * Then the checkpoint, which the next commit waits for.
+		 */
+		isra = sc->sc_racount > 0;
+		isckpt = false;
+		if (isra) {
+			req = sc->sc_raq[sc->sc_rahead];
+			sc->sc_rahead = (sc->sc_rahead + 1) % SFS_RAQSIZE;
+			sc->sc_racount--;
+		}
+		else if (sc->sc_ckptwanted) {
+			sc->sc_ckptwanted = false;
+			isckpt = true;
+		}
+		else {
+			sc->sc_wbwanted = false;
+		}
+		lock_release(sc->sc_lock);
+
+		vfs_biglock_acquire();
+		lock_acquire(sc->sc_lock);
+		if (sc->sc_exit) {
+			vfs_biglock_release();
+			break;
+		}
+		lock_release(sc->sc_lock);
+
+		if (isra) {
+			sfs_cache_doreadahead(sfs, &req);
+			more = false;
+		}
+		else if (isckpt) {
+			result = sfs_log_checkpoint(sfs);
+			if (result) {
+				/* The next commit will try again */
+				kprintf("sfs: %s: journal checkpoint failed: "
+					"%s\n", sfs->sfs_sb.sb_volname,
+					strerror(result));
+			}
+			more = false;
+		}
+		else {
+			more = sfs_cache_dowriteback(sfs);
+		}
+		vfs_biglock_release();
+
+		lock_acquire(sc->sc_lock);
+		if (more) {
+			sc->sc_wbwanted = true;
+		}
+	}
+	lock_release(sc->sc_lock);
+
+	/* The volume is gone; clean up after it. */
+	sfs_cache_destroy(sc);
+}
+
+/*
+ * Queue a read-ahead of NBLOCKS blocks of inode INO, starting at file
+ * block FILEBLOCK. If the queue is full, the request is dropped.
+ */
+void
+sfs_cache_readahead(struct sfs_fs *sfs, uint32_t ino, uint32_t fileblock,
+		    uint32_t nblocks)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+	struct sfs_rareq *req;
+
+	lock_acquire(sc->sc_lock);
+	if (sc->sc_racount < SFS_RAQSIZE) {
+		req = &sc->sc_raq[(sc->sc_rahead + sc->sc_racount)
+				  % SFS_RAQSIZE];
+		req->rr_ino = ino;
+		req->rr_fileblock = fileblock;
+		req->rr_nblocks = nblocks;
+		sc->sc_racount++;
+		cv_signal(sc->sc_cv, sc->sc_lock);
+	}
+	lock_release(sc->sc_lock);
+}
+
+/*
+ * Ask the I/O thread to checkpoint the journal.
+ */
+void
+sfs_cache_checkpoint(struct sfs_fs *sfs)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+
+	if (sc == NULL) {
+		return;
+	}
+	lock_acquire(sc->sc_lock);
+	if (!sc->sc_ckptwanted) {
+		sc->sc_ckptwanted = true;
+		cv_signal(sc->sc_cv, sc->sc_lock);
+	}
+	lock_release(sc->sc_lock);
+}
+
+/*
+ * Ask the I/O thread to write back dirty blocks.
+ */
+void
+sfs_cache_writebehind(struct sfs_fs *sfs)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+
+	lock_acquire(sc->sc_lock);
+	if (!sc->sc_wbwanted) {
+		sc->sc_wbwanted = true;
+		cv_signal(sc->sc_cv, sc->sc_lock);
+	}
+	lock_release(sc->sc_lock);
+}
+
+////////////////////////////////////////////////////////////
+// Setup and teardown
+
+/*
+ * Release the buffer memory.
+ */
+static
+void
+sfs_cache_freebufs(struct sfs_cache *sc)
+{
+	unsigned i;
+
+	for (i=0; i<SFS_NBUFS; i++) {
+		if (sc->sc_bufs[i].b_data != NULL) {
+			kfree(sc->sc_bufs[i].b_data);
+			sc->sc_bufs[i].b_data = NULL;
+		}
+		sc->sc_bufs[i].b_block = 0;
+	}
+}
+
+/*
+ * Set up the cache for a volume being mounted and start its I/O
+ * thread.
+ */
+int
+sfs_cache_init(struct sfs_fs *sfs)
+{
+	struct sfs_cache *sc;
+	unsigned i;
+	int result;
+
+	sc = kmalloc(sizeof(*sc));
+	if (sc == NULL) {
+		return ENOMEM;
+	}
+
+	for (i=0; i<SFS_NBUFS; i++) {
+		sc->sc_bufs[i].b_block = 0;
+		sc->sc_bufs[i].b_ino = SFS_NOINO;
+		sc->sc_bufs[i].b_dirty = false;
+		sc->sc_bufs[i].b_stamp = 0;
+		sc->sc_bufs[i].b_data = NULL;
+	}
+	for (i=0; i<SFS_NBUFS; i++) {
+		sc->sc_bufs[i].b_data = kmalloc(SFS_BLOCKSIZE);
+		if (sc->sc_bufs[i].b_data == NULL) {
+			sfs_cache_freebufs(sc);
+			kfree(sc);
+			return ENOMEM;
+		}
+	}
+	sc->sc_stamp = 0;
+	sc->sc_ndirty = 0;
+
+	sc->sc_lock = lock_create("sfs_cache");
+	if (sc->sc_lock == NULL) {
+		sfs_cache_freebufs(sc);
+		kfree(sc);
+		return ENOMEM;
+	}
+	sc->sc_cv = cv_create("sfs_cache");
+	if (sc->sc_cv == NULL) {
+		lock_destroy(sc->sc_lock);
+		sfs_cache_freebufs(sc);
+		kfree(sc);
+		return ENOMEM;
+	}
+	sc->sc_rahead = 0;
+	sc->sc_racount = 0;
+	sc->sc_wbwanted = false;
+	sc->sc_ckptwanted = false;
+	sc->sc_exit = false;
+
+	sc->sc_fs = sfs;
+	sfs->sfs_cache = sc;
+
+	result = thread_fork("sfs_io", kproc, sfs_iothread, sc, 0);
+	if (result) {
+		sfs->sfs_cache = NULL;
+		sfs_cache_freebufs(sc);
+		sfs_cache_destroy(sc);
+		return result;
+	}
+
+	return 0;
+}
+
+/*
+ * Shut down the cache when unmounting. Everything should already
+ * have been written back by sfs_sync. The I/O thread frees the
+ * cache structure itself when it notices.
+ */
+void
+sfs_cache_shutdown(struct sfs_fs *sfs)
+{
+	struct sfs_cache *sc = sfs->sfs_cache;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(sc->sc_ndirty == 0);
+
+	sfs_cache_freebufs(sc);
+	sfs->sfs_cache = NULL;
+
+	lock_acquire(sc->sc_lock);
+	sc->sc_exit = true;
+	cv_signal(sc->sc_cv, sc->sc_lock);
+	lock_release(sc->sc_lock);
+}
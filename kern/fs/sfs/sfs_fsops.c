@@ -52,8 +52,9 @@
 
 /*
  * Routine for doing I/O (reads or writes) on the free block bitmap.
- * We always do the whole bitmap at once; writing individual sectors
- * might or might not be a worthwhile optimization.
+ * We read the whole bitmap at once, but write back only the sectors
+ * that have changed (see sfs_balloc.c); on a big volume, that keeps
+ * the freemap from crowding everything else out of the journal.
  *
  * The free block bitmap consists of SFS_FREEMAPBLOCKS 512-byte
  * sectors of bits, one bit for each sector on the filesystem. The
@@ -92,9 +93,16 @@ sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 			result = sfs_readblock(sfs, SFS_FREEMAP_START+j, ptr,
 					       SFS_BLOCKSIZE);
 		}
-		else {
+		else if (bitmap_isset(sfs->sfs_freemapdirty, j)) {
+			/* (only the blocks that have changed) */
 			result = sfs_writeblock(sfs, SFS_FREEMAP_START+j, ptr,
 						SFS_BLOCKSIZE);
+			if (result == 0) {
+				bitmap_unmark(sfs->sfs_freemapdirty, j);
+			}
+		}
+		else {
+			result = 0;
 		}
 
 		/* If we failed, stop. */
@@ -102,6 +110,11 @@ sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 			return result;
 		}
 	}
+
+	/* We changed the bits behind the bitmap's back; let it catch up */
+	if (rw == UIO_READ) {
+		bitmap_resync(sfs->sfs_freemap);
+	}
 	return 0;
 }
 
@@ -113,12 +126,16 @@ int
 sfs_sync_vnodes(struct sfs_fs *sfs)
 {
 	unsigned i, num;
+	int result;
 
 	/* Go over the array of loaded vnodes, syncing as we go. */
 	num = vnodearray_num(sfs->sfs_vnodes);
 	for (i=0; i<num; i++) {
 		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+		result = sfs_sync_inode(v->vn_data);
+		if (result) {
+			return result;
+		}
 	}
 	return 0;
 }
@@ -130,17 +147,7 @@ static
 int
 sfs_sync_freemap(struct sfs_fs *sfs)
 {
-	int result;
-
-	if (sfs->sfs_freemapdirty) {
-		result = sfs_freemapio(sfs, UIO_WRITE);
-		if (result) {
-			return result;
-		}
-		sfs->sfs_freemapdirty = false;
-	}
-
-	return 0;
+	return sfs_freemapio(sfs, UIO_WRITE);
 }
 
 /*
@@ -163,6 +170,51 @@ sfs_sync_superblock(struct sfs_fs *sfs)
 	return 0;
 }
 
+/*
+ * Write out everything that's dirty: file data first, then the
+ * inodes, freemap, and superblock. On a volume with a journal the
+ * metadata all goes into the running transaction, which is then
+ * committed; this is what makes the transaction a consistent picture
+ * of the volume, and since all file data is written first, committed
+ * metadata never refers to blocks whose contents are still only in
+ * memory.
+ */
+int
+sfs_commit(struct sfs_fs *sfs)
+{
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	/* Only between operations (see sfs_log_begin) */
+	KASSERT(sfs->sfs_log == NULL || !sfs->sfs_log->lg_inop);
+
+	/* Write back all cached file data. */
+	result = sfs_buf_flush(sfs, SFS_NOINO);
+	if (result) {
+		return result;
+	}
+
+	/* If any vnodes need to be written, write them. */
+	result = sfs_sync_vnodes(sfs);
+
+	/* If the free block map needs to be written, write it. */
+	if (result == 0) {
+		result = sfs_sync_freemap(sfs);
+	}
+
+	/* If the superblock needs to be written, write it. */
+	if (result == 0) {
+		result = sfs_sync_superblock(sfs);
+	}
+
+	/* And commit it all. */
+	if (result == 0) {
+		result = sfs_log_commit(sfs);
+	}
+	return result;
+}
+
 /*
  * Sync routine. This is what gets invoked if you do FS_SYNC on the
  * sfs filesystem structure.
@@ -208,29 +260,10 @@ sfs_sync(struct fs *fs)
 
 	sfs = fs->fs_data;
 
-	/* If any vnodes need to be written, write them. */
-	result = sfs_sync_vnodes(sfs);
-	if (result) {
-		vfs_biglock_release();
-		return result;
-	}
-
-	/* If the free block map needs to be written, write it. */
-	result = sfs_sync_freemap(sfs);
-	if (result) {
-		vfs_biglock_release();
-		return result;
-	}
-
-	/* If the superblock needs to be written, write it. */
-	result = sfs_sync_superblock(sfs);
-	if (result) {
-		vfs_biglock_release();
-		return result;
-	}
+	result = sfs_commit(sfs);
 
 	vfs_biglock_release();
-	return 0;
+	return result;
 }
 
 /*
@@ -259,9 +292,18 @@ static
 void
 sfs_fs_destroy(struct sfs_fs *sfs)
 {
+	if (sfs->sfs_cache != NULL) {
+		sfs_cache_shutdown(sfs);
+	}
+	if (sfs->sfs_log != NULL) {
+		sfs_log_destroy(sfs);
+	}
 	if (sfs->sfs_freemap != NULL) {
 		bitmap_destroy(sfs->sfs_freemap);
 	}
+	if (sfs->sfs_freemapdirty != NULL) {
+		bitmap_destroy(sfs->sfs_freemapdirty);
+	}
 	vnodearray_destroy(sfs->sfs_vnodes);
 	KASSERT(sfs->sfs_device == NULL);
 	kfree(sfs);
@@ -277,6 +319,7 @@ int
 sfs_unmount(struct fs *fs)
 {
 	struct sfs_fs *sfs = fs->fs_data;
+	int result;
 
 	vfs_biglock_acquire();
 
@@ -288,7 +331,17 @@ sfs_unmount(struct fs *fs)
 
 	/* We should have just had sfs_sync called. */
 	KASSERT(sfs->sfs_superdirty == false);
-	KASSERT(sfs->sfs_freemapdirty == false);
+	KASSERT(sfs_freemap_isdirty(sfs) == false);
+
+	/* Leave the volume with everything in place and the journal empty */
+	result = sfs_log_checkpoint(sfs);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	/* Drop any cached indirect block belonging to this volume */
+	sfs_bmap_invalidate();
 
 	/* The vfs layer takes care of the device for us */
 	sfs->sfs_device = NULL;
@@ -328,6 +381,7 @@ sfs_fs_create(void)
 	COMPILE_ASSERT(sizeof(struct sfs_superblock)==SFS_BLOCKSIZE);
 	COMPILE_ASSERT(sizeof(struct sfs_dinode)==SFS_BLOCKSIZE);
 	COMPILE_ASSERT(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
+	COMPILE_ASSERT(sizeof(struct sfs_loghdr)==SFS_BLOCKSIZE);
 
 	/* Allocate object */
 	sfs = kmalloc(sizeof(struct sfs_fs));
@@ -358,7 +412,13 @@ sfs_fs_create(void)
 
 	/* freemap */
 	sfs->sfs_freemap = NULL;
-	sfs->sfs_freemapdirty = false;
+	sfs->sfs_freemapdirty = NULL;
+
+	/* block cache (set up once the volume is loaded) */
+	sfs->sfs_cache = NULL;
+
+	/* journal (likewise) */
+	sfs->sfs_log = NULL;
 
 	return sfs;
 
@@ -448,9 +508,23 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Ensure null termination of the volume name */
 	sfs->sfs_sb.sb_volname[sizeof(sfs->sfs_sb.sb_volname)-1] = 0;
 
+	/*
+	 * Recover from the journal, if there is one, before reading
+	 * any other metadata.
+	 */
+	result = sfs_log_init(sfs);
+	if (result) {
+		sfs->sfs_device = NULL;
+		sfs_fs_destroy(sfs);
+		vfs_biglock_release();
+		return result;
+	}
+	sfs->sfs_sb.sb_volname[sizeof(sfs->sfs_sb.sb_volname)-1] = 0;
+
 	/* Load free block bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_FREEMAPBITS(sfs));
-	if (sfs->sfs_freemap == NULL) {
+	sfs->sfs_freemapdirty = bitmap_create(SFS_FS_FREEMAPBLOCKS(sfs));
+	if (sfs->sfs_freemap == NULL || sfs->sfs_freemapdirty == NULL) {
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
 		vfs_biglock_release();
@@ -464,6 +538,15 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 		return result;
 	}
 
+	/* Set up the block cache and start the I/O thread */
+	result = sfs_cache_init(sfs);
+	if (result) {
+		sfs->sfs_device = NULL;
+		sfs_fs_destroy(sfs);
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
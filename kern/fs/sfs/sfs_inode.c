@@ -36,9 +36,15 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <vfs.h>
+#include <slab.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/* Allocator for in-memory vnodes. */
+static struct kmem_cache sfs_vnode_cache =
+	KMEM_CACHE_INITIALIZER("sfs_vnode", sizeof(struct sfs_vnode),
+			       NULL, NULL);
+
 
 /*
  * Write an on-disk inode structure back out to disk.
@@ -102,17 +108,31 @@ sfs_reclaim(struct vnode *v)
 		}
 	}
 
+	/* Writing back (and perhaps freeing) the inode is one operation */
+	result = sfs_log_begin(sfs, SFS_LOG_INODE);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
 	if (result) {
+		sfs_log_end(sfs);
 		vfs_biglock_release();
 		return result;
 	}
 
+	/* Have the file's cached data written back in the background */
+	if (sv->sv_i.sfi_linkcount > 0) {
+		sfs_cache_writebehind(sfs);
+	}
+
 	/* If there are no on-disk references, discard the inode */
 	if (sv->sv_i.sfi_linkcount==0) {
 		sfs_bfree(sfs, sv->sv_ino);
 	}
+	sfs_log_end(sfs);
 
 	/* Remove the vnode structure from the table in the struct sfs_fs. */
 	num = vnodearray_num(sfs->sfs_vnodes);
@@ -136,7 +156,7 @@ sfs_reclaim(struct vnode *v)
 	vfs_biglock_release();
 
 	/* Release the storage for the vnode structure itself. */
-	kfree(sv);
+	kmem_cache_free(&sfs_vnode_cache, sv);
 
 	/* Done */
 	return 0;
@@ -184,7 +204,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 
 	/* Didn't have it loaded; load it */
 
-	sv = kmalloc(sizeof(struct sfs_vnode));
+	sv = kmem_cache_alloc(&sfs_vnode_cache);
 	if (sv==NULL) {
 		return ENOMEM;
 	}
@@ -198,13 +218,18 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_readblock(sfs, ino, &sv->sv_i, sizeof(sv->sv_i));
 	if (result) {
-		kfree(sv);
+		kmem_cache_free(&sfs_vnode_cache, sv);
 		return result;
 	}
 
 	/* Not dirty yet */
 	sv->sv_dirty = false;
 
+	/* No access pattern yet */
+	sv->sv_ranext = 0;
+	sv->sv_rawindow = 0;
+	sv->sv_raend = 0;
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out by sfs_balloc and
@@ -235,7 +260,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
 	if (result) {
-		kfree(sv);
+		kmem_cache_free(&sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -246,7 +271,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
 	if (result) {
 		vnode_cleanup(&sv->sv_absvn);
-		kfree(sv);
+		kmem_cache_free(&sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -256,10 +281,12 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 }
 
 /*
- * Create a new filesystem object and hand back its vnode.
+ * Create a new filesystem object and hand back its vnode. DIR is the
+ * directory it's going into; the inode is placed near it.
  */
 int
-sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
+sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode *dir,
+	    struct sfs_vnode **ret)
 {
 	uint32_t ino;
 	int result;
@@ -269,7 +296,7 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * number is the block number, so just get a block.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, dir->sv_ino, &ino);
 	if (result) {
 		return result;
 	}
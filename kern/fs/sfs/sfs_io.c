@@ -49,13 +49,13 @@
  * Note: sfs_readblock is used to read the superblock
  * early in mount, before sfs is fully (or even mostly)
  * initialized, and so may not use anything from sfs
- * except sfs_device.
+ * except sfs_device and sfs_log (which is NULL then).
  */
 
 /*
- * Read or write a block, retrying I/O errors.
+ * Read or write a block, or a run of consecutive blocks, retrying
+ * I/O errors.
  */
-static
 int
 sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 {
@@ -64,9 +64,10 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 
 	KASSERT(vfs_biglock_do_i_hold());
 
-	DEBUG(DB_SFS, "sfs: %s %llu\n",
+	DEBUG(DB_SFS, "sfs: %s %llu (%zu blocks)\n",
 	      uio->uio_rw == UIO_READ ? "read" : "write",
-	      uio->uio_offset / SFS_BLOCKSIZE);
+	      uio->uio_offset / SFS_BLOCKSIZE,
+	      uio->uio_resid / SFS_BLOCKSIZE);
 
  retry:
 	result = DEVOP_IO(sfs->sfs_device, uio);
@@ -102,7 +103,8 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 }
 
 /*
- * Read a block.
+ * Read a block. If the journal has a newer copy than the disk, use
+ * that.
  */
 int
 sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
@@ -112,12 +114,17 @@ sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 
 	KASSERT(len == SFS_BLOCKSIZE);
 
+	if (sfs->sfs_log != NULL && sfs_log_read(sfs, block, data)) {
+		return 0;
+	}
+
 	SFSUIO(&iov, &ku, data, block, UIO_READ);
 	return sfs_rwblock(sfs, &ku);
 }
 
 /*
- * Write a block.
+ * Write a block. This is only used for metadata, which goes into the
+ * journal if the volume has one.
  */
 int
 sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
@@ -127,6 +134,10 @@ sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 
 	KASSERT(len == SFS_BLOCKSIZE);
 
+	if (sfs->sfs_log != NULL) {
+		return sfs_log_write(sfs, block, data);
+	}
+
 	SFSUIO(&iov, &ku, data, block, UIO_WRITE);
 	return sfs_rwblock(sfs, &ku);
 }
@@ -141,6 +152,10 @@ sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
  * we don't clobber the portion of the block we're not intending to
  * write over.
  *
+ * The block goes through the buffer cache, so successive small reads
+ * or writes within one block only touch the disk once, and writes are
+ * left for write-behind.
+ *
  * SKIPSTART is the number of bytes to skip past at the beginning of
  * the sector; LEN is the number of bytes to actually read or write.
  * UIO is the area to do the I/O into.
@@ -150,18 +165,11 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
 	daddr_t diskblock;
 	uint32_t fileblock;
+	bool isnew;
 	int result;
 
 	/* Allocate missing blocks if and only if we're writing */
@@ -169,14 +177,14 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 
 	KASSERT(skipstart + len <= SFS_BLOCKSIZE);
 
-	/* We're using a global static buffer; it had better be locked */
+	/* Buffers are only good while we hold the lock */
 	KASSERT(vfs_biglock_do_i_hold());
 
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
 	/* Get the disk block number */
-	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
+	result = sfs_bmap(sv, fileblock, doalloc, &diskblock, &isnew);
 	if (result) {
 		return result;
 	}
@@ -184,52 +192,67 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Send zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_readblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block. A block we just allocated is zeros on disk, so
+	 * don't read it; start from zeros instead.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = sfs_buf_get(sfs, sv->sv_ino, diskblock, !isnew, &buf);
 	if (result) {
 		return result;
 	}
+	if (isnew) {
+		bzero(buf->b_data, SFS_BLOCKSIZE);
+	}
+
+	/*
+	 * Now perform the requested operation into/out of the buffer.
+	 */
+	result = uiomove((char *)buf->b_data + skipstart, len, uio);
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * If it was a write, the block is now dirty. (Even if uiomove
+	 * failed partway; some of the data may have been changed.)
 	 */
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		sfs_buf_markdirty(sfs, buf);
 	}
 
-	return 0;
+	return result;
 }
 
 /*
- * Do I/O (either read or write) of a single whole block.
+ * Do I/O (either read or write) of a run of whole blocks, starting at
+ * the current uio offset and covering at most MAXBLOCKS blocks.
+ *
+ * When reading, blocks found in the buffer cache are copied from
+ * there. Otherwise, consecutive file blocks that are also consecutive
+ * on disk are clustered into a single device request straight into
+ * the uio, so a large sequential transfer costs one DEVOP_IO per
+ * extent rather than one per block. A run of unallocated blocks is
+ * likewise handled in one go by sending zeros.
+ *
+ * When writing, the block goes into the buffer cache and is written
+ * back later (see sfs_cache.c), which is where the clustering of
+ * writes happens.
+ *
+ * We may transfer fewer than MAXBLOCKS blocks; the caller should call
+ * us again until the whole region has been done.
  */
 static
 int
-sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
+sfs_blockio(struct sfs_vnode *sv, struct uio *uio, uint32_t maxblocks)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
-	daddr_t diskblock;
-	uint32_t fileblock;
+	struct sfs_buf *buf;
+	daddr_t diskblock, nextblock;
+	uint32_t fileblock, nblocks;
+	bool isnew;
 	int result;
 	bool doalloc = (uio->uio_rw==UIO_WRITE);
 	off_t saveoff;
@@ -237,24 +260,94 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	off_t saveres;
 	off_t diskres;
 
+	KASSERT(maxblocks > 0);
+
+	if (maxblocks > SFS_MAXCLUSTER) {
+		maxblocks = SFS_MAXCLUSTER;
+	}
+
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
 	/* Look up the disk block number */
-	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
+	result = sfs_bmap(sv, fileblock, doalloc, &diskblock, &isnew);
 	if (result) {
 		return result;
 	}
 
+	if (uio->uio_rw == UIO_WRITE) {
+		/*
+		 * Writes go into the buffer cache, one block at a
+		 * time, and are written back later in clusters. We're
+		 * overwriting the whole block, so don't read it first.
+		 */
+		bool wasdirty;
+
+		KASSERT(diskblock != 0);
+		buf = sfs_buf_find(sfs, diskblock);
+		wasdirty = buf != NULL && buf->b_dirty;
+		result = sfs_buf_get(sfs, sv->sv_ino, diskblock, false, &buf);
+		if (result) {
+			return result;
+		}
+		if (isnew) {
+			/*
+			 * Nothing has been written to a new block, so if
+			 * uiomove fails partway the rest must read as
+			 * zeros, and the block has to be written.
+			 */
+			bzero(buf->b_data, SFS_BLOCKSIZE);
+		}
+		result = uiomove(buf->b_data, SFS_BLOCKSIZE, uio);
+		if (result && !wasdirty && !isnew) {
+			/* Contents are garbage now; forget them */
+			sfs_buf_drop(sfs, diskblock);
+			return result;
+		}
+		sfs_buf_markdirty(sfs, buf);
+		return result;
+	}
+
+	if (diskblock != 0) {
+		/* If we already have the block, copy it from memory. */
+		buf = sfs_buf_find(sfs, diskblock);
+		if (buf != NULL) {
+			return uiomove(buf->b_data, SFS_BLOCKSIZE, uio);
+		}
+	}
+
+	/*
+	 * See how far the run extends. If looking up a later block
+	 * fails (e.g. we run out of space while allocating) just stop
+	 * here; we'll get the error again on the next call, after the
+	 * part we already have has been transferred.
+	 */
+	for (nblocks = 1; nblocks < maxblocks; nblocks++) {
+		result = sfs_bmap(sv, fileblock + nblocks, false,
+				  &nextblock, NULL);
+		if (result) {
+			break;
+		}
+		if (diskblock == 0) {
+			if (nextblock != 0) {
+				break;
+			}
+		}
+		else if (nextblock != diskblock + nblocks ||
+			 sfs_buf_find(sfs, nextblock) != NULL) {
+			break;
+		}
+	}
+
 	if (diskblock == 0) {
 		/*
-		 * No block - fill with zeros.
+		 * No blocks - fill with zeros.
 		 *
 		 * We must be reading, or sfs_bmap would have
-		 * allocated a block for us.
+		 * allocated them for us.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		return uiomovezeros(SFS_BLOCKSIZE, uio);
+		return uiomovezeros(nblocks * SFS_BLOCKSIZE, uio);
 	}
 
 	/*
@@ -266,11 +359,11 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	uio->uio_offset = diskoff;
 
 	/*
-	 * Temporarily set the residue to be one block size.
+	 * Temporarily set the residue to the size of the run.
 	 */
-	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
+	KASSERT(uio->uio_resid >= nblocks * SFS_BLOCKSIZE);
 	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
+	diskres = nblocks * SFS_BLOCKSIZE;
 	uio->uio_resid = diskres;
 
 	result = sfs_rwblock(sfs, uio);
@@ -285,6 +378,57 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	return result;
 }
 
+/*
+ * Sequential read detection. Called after reading file blocks FIRST
+ * through LAST. If the read picks up where the last one left off
+ * (or in the same block, for small reads), grow the read-ahead window
+ * and, once less than half a window's worth of prefetched blocks is
+ * left ahead of the reader, ask the I/O thread for another window.
+ * Anything else is random access, which closes the window.
+ */
+static
+void
+sfs_readahead(struct sfs_vnode *sv, uint32_t first, uint32_t last)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t start, end;
+
+	if (first == sv->sv_ranext || first + 1 == sv->sv_ranext) {
+		if (sv->sv_rawindow == 0) {
+			sv->sv_rawindow = SFS_RA_MINWINDOW;
+		}
+		else if (sv->sv_rawindow < SFS_RA_MAXWINDOW) {
+			sv->sv_rawindow *= 2;
+		}
+	}
+	else {
+		sv->sv_rawindow = 0;
+		sv->sv_raend = 0;
+	}
+	sv->sv_ranext = last + 1;
+
+	if (sv->sv_rawindow == 0) {
+		return;
+	}
+
+	start = last + 1;
+	if (sv->sv_raend > start) {
+		if (sv->sv_raend - start >= sv->sv_rawindow / 2) {
+			/* Still far enough ahead */
+			return;
+		}
+		start = sv->sv_raend;
+	}
+	end = last + 1 + sv->sv_rawindow;
+	if (start >= end ||
+	    start >= DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE)) {
+		return;
+	}
+
+	sfs_cache_readahead(sfs, sv->sv_ino, start, end - start);
+	sv->sv_raend = end;
+}
+
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
  */
@@ -292,11 +436,13 @@ int
 sfs_io(struct sfs_vnode *sv, struct uio *uio)
 {
 	uint32_t blkoff;
-	uint32_t nblocks, i;
+	uint32_t nblocks, done;
+	uint32_t firstblock;
 	int result = 0;
 	uint32_t origresid, extraresid = 0;
 
 	origresid = uio->uio_resid;
+	firstblock = uio->uio_offset / SFS_BLOCKSIZE;
 
 	/*
 	 * If reading, check for EOF. If we can read a partial area,
@@ -352,11 +498,15 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	 */
 	KASSERT(uio->uio_offset % SFS_BLOCKSIZE == 0);
 	nblocks = uio->uio_resid / SFS_BLOCKSIZE;
-	for (i=0; i<nblocks; i++) {
-		result = sfs_blockio(sv, uio);
+	while (nblocks > 0) {
+		done = uio->uio_resid;
+		result = sfs_blockio(sv, uio, nblocks);
 		if (result) {
 			goto out;
 		}
+		done -= uio->uio_resid;
+		KASSERT(done > 0 && done % SFS_BLOCKSIZE == 0);
+		nblocks -= done / SFS_BLOCKSIZE;
 	}
 
 	/*
@@ -381,6 +531,13 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 		sv->sv_dirty = true;
 	}
 
+	/* If reading and we did anything, consider reading ahead */
+	if (uio->uio_resid != origresid - extraresid &&
+	    uio->uio_rw == UIO_READ) {
+		sfs_readahead(sv, firstblock,
+			      (uio->uio_offset - 1) / SFS_BLOCKSIZE);
+	}
+
 	/* Add in any extra amount we couldn't read because of EOF */
 	uio->uio_resid += extraresid;
 
@@ -411,7 +568,7 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	uint32_t vnblock;
 	uint32_t blockoffset;
 	daddr_t diskblock;
-	bool doalloc;
+	bool doalloc, isnew;
 	int result;
 
 	/*
@@ -432,7 +589,8 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 
 	/* Get the disk block number */
 	doalloc = (rw == UIO_WRITE);
-	result = sfs_bmap(sv, vnblock, doalloc, &diskblock);
+	result = sfs_bmap(sv, vnblock, doalloc, &diskblock,
+			  doalloc ? &isnew : NULL);
 	if (result) {
 		return result;
 	}
@@ -446,10 +604,17 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		return 0;
 	}
 
-	/* Read the block */
-	result = sfs_readblock(sfs, diskblock, metaiobuf, sizeof(metaiobuf));
-	if (result) {
-		return result;
+	if (doalloc && isnew) {
+		/* Freshly allocated; it's zeros on disk */
+		bzero(metaiobuf, sizeof(metaiobuf));
+	}
+	else {
+		/* Read the block */
+		result = sfs_readblock(sfs, diskblock, metaiobuf,
+				       sizeof(metaiobuf));
+		if (result) {
+			return result;
+		}
 	}
 
 	if (rw == UIO_READ) {
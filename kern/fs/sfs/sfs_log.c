@@ -0,0 +1,698 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * SFS filesystem
+ *
+ * Metadata journal.
+ *
+ * Volumes made by a current mksfs have a journal area (see
+ * sb_logstart). Metadata blocks -- inodes, directory blocks, indirect
+ * blocks, the freemap and the superblock -- are then never written in
+ * place directly. sfs_writeblock hands them to sfs_log_write, which
+ * keeps the latest copy of each in the running transaction in
+ * memory, and sfs_readblock looks there first.
+ *
+ * sfs_commit (in sfs_fsops.c) writes all dirty metadata into the
+ * running transaction and calls sfs_log_commit, which writes the
+ * copies to the journal in one sequential request and then writes
+ * the journal header; once the header is on disk the transaction
+ * will survive a crash. Because everything dirty goes into one
+ * transaction, however many operations produced it, this is a group
+ * commit. Writing the blocks to their real places (checkpointing) is
+ * left to the I/O thread, and must be finished before the next
+ * commit reuses the journal.
+ *
+ * A transaction has room for only so many blocks, and must never be
+ * committed with an operation half done. So each operation that
+ * changes metadata is bracketed by sfs_log_begin and sfs_log_end;
+ * sfs_log_begin is told the most blocks the operation can add,
+ * counting the inodes and freemap blocks it dirties (which only go
+ * in at commit time), and commits first if they might not fit. An
+ * operation too big for even an empty transaction fails instead.
+ *
+ * At mount, sfs_log_init replays a transaction whose header was
+ * committed but not yet marked checkpointed, so recovery time depends
+ * only on the size of the journal.
+ *
+ * File data does not go through the journal, but sfs_commit writes
+ * back all cached data before committing, so committed metadata
+ * never points at blocks that haven't been written yet.
+ *
+ * Volumes without a journal area work as before, writing metadata in
+ * place.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <bitmap.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <sfs.h>
+#include "sfsprivate.h"
+
+/*
+ * Read or write one block, bypassing the journal.
+ */
+static
+int
+sfs_log_rawio(struct sfs_fs *sfs, daddr_t block, void *data, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+
+	SFSUIO(&iov, &ku, data, block, rw);
+	return sfs_rwblock(sfs, &ku);
+}
+
+/*
+ * Add a block's contents into a journal checksum (see kern/sfs.h).
+ */
+static
+uint32_t
+sfs_log_sum(uint32_t sum, const void *data)
+{
+	const unsigned char *p = data;
+	unsigned i;
+
+	for (i=0; i<SFS_BLOCKSIZE; i++) {
+		sum = sum*31 + p[i];
+	}
+	return sum;
+}
+
+/*
+ * Write the journal header describing transaction SEQ, made of the
+ * blocks in TX, or with no blocks if TX is NULL.
+ */
+static
+int
+sfs_log_writehdr(struct sfs_fs *sfs, uint32_t seq, struct sfs_logtx *tx)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+	struct sfs_loghdr *hdr = &lg->lg_hdr;
+	unsigned i;
+
+	bzero(hdr, sizeof(*hdr));
+	hdr->lh_magic = SFS_LOG_MAGIC;
+	hdr->lh_seq = seq;
+	if (tx != NULL) {
+		hdr->lh_nblocks = tx->tx_n;
+		for (i=0; i<tx->tx_n; i++) {
+			hdr->lh_blocks[i] = tx->tx_blocks[i];
+			hdr->lh_sum = sfs_log_sum(hdr->lh_sum, tx->tx_data[i]);
+		}
+	}
+	return sfs_log_rawio(sfs, lg->lg_start, hdr, UIO_WRITE);
+}
+
+/*
+ * Write the copies in TX to the journal, right after the header, as
+ * few device requests as possible.
+ */
+static
+int
+sfs_log_writecopies(struct sfs_fs *sfs, struct sfs_logtx *tx)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+	struct iovec iov[SFS_MAXCLUSTER];
+	struct uio ku;
+	unsigned i, n;
+	int result;
+
+	for (i=0; i<tx->tx_n; i += n) {
+		for (n=0; n<SFS_MAXCLUSTER && i+n < tx->tx_n; n++) {
+			iov[n].iov_kbase = tx->tx_data[i+n];
+			iov[n].iov_len = SFS_BLOCKSIZE;
+		}
+
+		ku.uio_iov = iov;
+		ku.uio_iovcnt = n;
+		ku.uio_offset = ((off_t)(lg->lg_start + 1 + i)) * SFS_BLOCKSIZE;
+		ku.uio_resid = n * SFS_BLOCKSIZE;
+		ku.uio_segflg = UIO_SYSSPACE;
+		ku.uio_rw = UIO_WRITE;
+		ku.uio_space = NULL;
+
+		result = sfs_rwblock(sfs, &ku);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Find BLOCK in TX; returns its slot or -1.
+ */
+static
+int
+sfs_log_find(struct sfs_logtx *tx, daddr_t block)
+{
+	unsigned i;
+
+	for (i=0; i<tx->tx_n; i++) {
+		if (tx->tx_blocks[i] == block) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+////////////////////////////////////////////////////////////
+// Reading and writing metadata
+
+/*
+ * If we have a newer copy of BLOCK than the disk does, copy it into
+ * DATA and return true.
+ */
+bool
+sfs_log_read(struct sfs_fs *sfs, daddr_t block, void *data)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+	struct sfs_logtx *tx;
+	int slot;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	/* The running transaction is newer than the committed one */
+	tx = lg->lg_run;
+	slot = sfs_log_find(tx, block);
+	if (slot < 0) {
+		tx = lg->lg_ckpt;
+		slot = sfs_log_find(tx, block);
+	}
+	if (slot < 0) {
+		return false;
+	}
+	memcpy(data, tx->tx_data[slot], SFS_BLOCKSIZE);
+	return true;
+}
+
+/*
+ * Put a new version of metadata block BLOCK in the running
+ * transaction. sfs_log_begin has made sure there's room.
+ */
+int
+sfs_log_write(struct sfs_fs *sfs, daddr_t block, const void *data)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+	struct sfs_logtx *tx = lg->lg_run;
+	int slot;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	slot = sfs_log_find(tx, block);
+	if (slot >= 0) {
+		memcpy(tx->tx_data[slot], data, SFS_BLOCKSIZE);
+		return 0;
+	}
+
+	if (tx->tx_n == lg->lg_max) {
+		panic("sfs: %s: journal transaction overflow (block %u)\n",
+		      sfs->sfs_sb.sb_volname, block);
+	}
+
+	tx->tx_blocks[tx->tx_n] = block;
+	memcpy(tx->tx_data[tx->tx_n], data, SFS_BLOCKSIZE);
+	tx->tx_n++;
+	return 0;
+}
+
+/*
+ * BLOCK is being freed; it may be reused for file data, which is
+ * written in place, so no stale copy of it may be written out later.
+ * A committed copy has to go to its place now, while the block still
+ * belongs to what the committed transaction says it does; a copy in
+ * the running transaction can just be dropped.
+ */
+void
+sfs_log_forget(struct sfs_fs *sfs, daddr_t block)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+	struct sfs_logtx *tx;
+	int slot;
+	int result;
+
+	if (lg == NULL) {
+		return;
+	}
+
+	if (sfs_log_find(lg->lg_ckpt, block) >= 0) {
+		result = sfs_log_checkpoint(sfs);
+		if (result) {
+			kprintf("sfs: %s: journal checkpoint failed: %s\n",
+				sfs->sfs_sb.sb_volname, strerror(result));
+		}
+	}
+
+	tx = lg->lg_run;
+	slot = sfs_log_find(tx, block);
+	if (slot >= 0) {
+		/* Move the last entry into the hole */
+		tx->tx_n--;
+		if ((unsigned)slot != tx->tx_n) {
+			void *tmp = tx->tx_data[slot];
+
+			tx->tx_blocks[slot] = tx->tx_blocks[tx->tx_n];
+			tx->tx_data[slot] = tx->tx_data[tx->tx_n];
+			tx->tx_data[tx->tx_n] = tmp;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Operations
+
+/*
+ * Count the blocks the running transaction will hold once sfs_commit
+ * has added the dirty inodes, freemap blocks, and superblock.
+ */
+static
+unsigned
+sfs_log_pending(struct sfs_fs *sfs)
+{
+	struct sfs_logtx *tx = sfs->sfs_log->lg_run;
+	unsigned n, i, num;
+
+	n = tx->tx_n;
+
+	num = vnodearray_num(sfs->sfs_vnodes);
+	for (i=0; i<num; i++) {
+		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
+		struct sfs_vnode *sv = v->vn_data;
+
+		if (sv->sv_dirty && sfs_log_find(tx, sv->sv_ino) < 0) {
+			n++;
+		}
+	}
+
+	num = SFS_FREEMAPBLOCKS(sfs->sfs_sb.sb_nblocks);
+	for (i=0; i<num; i++) {
+		if (bitmap_isset(sfs->sfs_freemapdirty, i) &&
+		    sfs_log_find(tx, SFS_FREEMAP_START + i) < 0) {
+			n++;
+		}
+	}
+
+	if (sfs->sfs_superdirty && sfs_log_find(tx, SFS_SUPER_BLOCK) < 0) {
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Start an operation that will add at most NBLOCKS blocks to the
+ * running transaction. If they might not fit, commit what's there
+ * first, while it's still a consistent picture of the volume.
+ */
+int
+sfs_log_begin(struct sfs_fs *sfs, unsigned nblocks)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (lg == NULL) {
+		return 0;
+	}
+	KASSERT(!lg->lg_inop);
+
+	if (nblocks > lg->lg_max) {
+		kprintf("sfs: %s: operation needs %u journal blocks; "
+			"only room for %u\n", sfs->sfs_sb.sb_volname,
+			nblocks, lg->lg_max);
+		return ENOSPC;
+	}
+
+	if (sfs_log_pending(sfs) + nblocks > lg->lg_max) {
+		result = sfs_commit(sfs);
+		if (result) {
+			return result;
+		}
+		KASSERT(sfs_log_pending(sfs) + nblocks <= lg->lg_max);
+	}
+
+	lg->lg_inop = true;
+	return 0;
+}
+
+/*
+ * Finish an operation started with sfs_log_begin, whether or not it
+ * succeeded.
+ */
+void
+sfs_log_end(struct sfs_fs *sfs)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+
+	if (lg == NULL) {
+		return;
+	}
+	KASSERT(lg->lg_inop);
+	lg->lg_inop = false;
+}
+
+/*
+ * Most file blocks one write operation may cover. Each may need a new
+ * block, and so a freemap block; besides that the write can dirty the
+ * inode, the indirect block, and the indirect block's freemap block
+ * (see sfs_log_writeblocks). Unless the freemap is large, that always
+ * fits, and a write needs only one operation.
+ */
+unsigned
+sfs_log_maxwrite(struct sfs_fs *sfs)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+
+	if (lg == NULL ||
+	    SFS_FREEMAPBLOCKS(sfs->sfs_sb.sb_nblocks) + 2 <= lg->lg_max) {
+		return SFS_NDIRECT + SFS_NINDIRECT * SFS_DBPERIDB;
+	}
+	return lg->lg_max > 3 ? lg->lg_max - 3 : 0;
+}
+
+/*
+ * Most journal blocks a write covering NBLOCKS file blocks can add.
+ */
+unsigned
+sfs_log_writeblocks(struct sfs_fs *sfs, unsigned nblocks)
+{
+	unsigned fmblocks = SFS_FREEMAPBLOCKS(sfs->sfs_sb.sb_nblocks);
+
+	if (nblocks + 1 < fmblocks) {
+		fmblocks = nblocks + 1;
+	}
+	return 2 + fmblocks;
+}
+
+////////////////////////////////////////////////////////////
+// Commit and checkpoint
+
+/*
+ * Commit the running transaction. The caller is responsible for
+ * having put everything it wants in it (see sfs_commit).
+ */
+int
+sfs_log_commit(struct sfs_fs *sfs)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+	struct sfs_logtx *tx;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (lg == NULL || lg->lg_run->tx_n == 0) {
+		return 0;
+	}
+
+	/* The journal holds only one transaction; retire the last one */
+	result = sfs_log_checkpoint(sfs);
+	if (result) {
+		return result;
+	}
+
+	tx = lg->lg_run;
+
+	/* Copies first, then the header that makes them count */
+	result = sfs_log_writecopies(sfs, tx);
+	if (result) {
+		return result;
+	}
+	result = sfs_log_writehdr(sfs, lg->lg_seq + 1, tx);
+	if (result) {
+		return result;
+	}
+	lg->lg_seq++;
+
+	/* Start a new running transaction */
+	KASSERT(lg->lg_ckpt->tx_n == 0);
+	lg->lg_run = lg->lg_ckpt;
+	lg->lg_ckpt = tx;
+
+	/* The I/O thread will put the blocks in place */
+	sfs_cache_checkpoint(sfs);
+	return 0;
+}
+
+/*
+ * Write the blocks of the committed transaction to their places and
+ * mark the journal empty.
+ */
+int
+sfs_log_checkpoint(struct sfs_fs *sfs)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+	struct sfs_logtx *tx;
+	unsigned i;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (lg == NULL || lg->lg_ckpt->tx_n == 0) {
+		return 0;
+	}
+	tx = lg->lg_ckpt;
+
+	for (i=0; i<tx->tx_n; i++) {
+		result = sfs_log_rawio(sfs, tx->tx_blocks[i], tx->tx_data[i],
+				       UIO_WRITE);
+		if (result) {
+			return result;
+		}
+	}
+
+	result = sfs_log_writehdr(sfs, lg->lg_seq, NULL);
+	if (result) {
+		return result;
+	}
+	tx->tx_n = 0;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// Mount-time recovery, setup, and teardown
+
+/*
+ * Check the header in HDR (just read from the journal) and, if it
+ * describes a committed transaction, copy its blocks into place.
+ * BUF is a block-sized scratch buffer.
+ */
+static
+int
+sfs_log_replay(struct sfs_fs *sfs, daddr_t start, unsigned max,
+	       struct sfs_loghdr *hdr, void *buf)
+{
+	uint32_t sum;
+	unsigned i;
+	int result;
+
+	if (hdr->lh_magic != SFS_LOG_MAGIC) {
+		kprintf("sfs: %s: bad journal header (magic 0x%x)\n",
+			sfs->sfs_sb.sb_volname, hdr->lh_magic);
+		return EINVAL;
+	}
+	if (hdr->lh_nblocks == 0) {
+		/* Clean */
+		return 0;
+	}
+	if (hdr->lh_nblocks > max) {
+		kprintf("sfs: %s: journal transaction %u has %u blocks; "
+			"only room for %u\n", sfs->sfs_sb.sb_volname,
+			hdr->lh_seq, hdr->lh_nblocks, max);
+		return EINVAL;
+	}
+
+	/* Make sure the copies are all there */
+	sum = 0;
+	for (i=0; i<hdr->lh_nblocks; i++) {
+		if (hdr->lh_blocks[i] >= sfs->sfs_sb.sb_nblocks) {
+			kprintf("sfs: %s: journal transaction %u: "
+				"block %u out of range\n",
+				sfs->sfs_sb.sb_volname, hdr->lh_seq,
+				hdr->lh_blocks[i]);
+			return EINVAL;
+		}
+		result = sfs_log_rawio(sfs, start + 1 + i, buf, UIO_READ);
+		if (result) {
+			return result;
+		}
+		sum = sfs_log_sum(sum, buf);
+	}
+	if (sum != hdr->lh_sum) {
+		/* Can't happen unless a write was lost; don't use it */
+		kprintf("sfs: %s: journal transaction %u is damaged; "
+			"ignoring it\n", sfs->sfs_sb.sb_volname, hdr->lh_seq);
+		return 0;
+	}
+
+	kprintf("sfs: %s: replaying journal transaction %u (%u blocks)\n",
+		sfs->sfs_sb.sb_volname, hdr->lh_seq, hdr->lh_nblocks);
+	for (i=0; i<hdr->lh_nblocks; i++) {
+		result = sfs_log_rawio(sfs, start + 1 + i, buf, UIO_READ);
+		if (result) {
+			return result;
+		}
+		result = sfs_log_rawio(sfs, hdr->lh_blocks[i], buf,
+				       UIO_WRITE);
+		if (result) {
+			return result;
+		}
+		if (hdr->lh_blocks[i] == SFS_SUPER_BLOCK) {
+			/* Don't keep using the old superblock */
+			memcpy(&sfs->sfs_sb, buf, sizeof(sfs->sfs_sb));
+		}
+	}
+	return 0;
+}
+
+/*
+ * Release the memory of the in-memory journal.
+ */
+static
+void
+sfs_log_free(struct sfs_log *lg)
+{
+	unsigned i, j;
+
+	for (i=0; i<2; i++) {
+		for (j=0; j<SFS_LOG_MAXBLOCKS; j++) {
+			if (lg->lg_tx[i].tx_data[j] != NULL) {
+				kfree(lg->lg_tx[i].tx_data[j]);
+			}
+		}
+	}
+	kfree(lg);
+}
+
+/*
+ * Set up the journal for a volume being mounted, replaying it first
+ * if necessary. Must be called before the freemap is loaded, since
+ * the journal may hold a newer version of it.
+ */
+int
+sfs_log_init(struct sfs_fs *sfs)
+{
+	struct sfs_superblock *sb = &sfs->sfs_sb;
+	struct sfs_log *lg;
+	daddr_t start;
+	unsigned i, j, max;
+	int result;
+
+	KASSERT(sfs->sfs_log == NULL);
+
+	if (sb->sb_logstart == 0) {
+		/* Old volume; no journal */
+		return 0;
+	}
+
+	start = sb->sb_logstart;
+	if (start < SFS_FREEMAP_START + SFS_FREEMAPBLOCKS(sb->sb_nblocks) ||
+	    start >= sb->sb_nblocks ||
+	    sb->sb_lognblocks < 2 ||
+	    sb->sb_lognblocks > sb->sb_nblocks - start) {
+		kprintf("sfs: %s: bad journal location %u (%u blocks)\n",
+			sb->sb_volname, start, sb->sb_lognblocks);
+		return EINVAL;
+	}
+	max = sb->sb_lognblocks - 1;
+	if (max > SFS_LOG_MAXBLOCKS) {
+		max = SFS_LOG_MAXBLOCKS;
+	}
+
+	lg = kmalloc(sizeof(*lg));
+	if (lg == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<2; i++) {
+		lg->lg_tx[i].tx_n = 0;
+		for (j=0; j<SFS_LOG_MAXBLOCKS; j++) {
+			lg->lg_tx[i].tx_data[j] = NULL;
+		}
+	}
+	for (i=0; i<2; i++) {
+		for (j=0; j<max; j++) {
+			lg->lg_tx[i].tx_data[j] = kmalloc(SFS_BLOCKSIZE);
+			if (lg->lg_tx[i].tx_data[j] == NULL) {
+				sfs_log_free(lg);
+				return ENOMEM;
+			}
+		}
+	}
+
+	/* Recover, using the first buffer for scratch space */
+	result = sfs_log_rawio(sfs, start, &lg->lg_hdr, UIO_READ);
+	if (result) {
+		sfs_log_free(lg);
+		return result;
+	}
+	result = sfs_log_replay(sfs, start, max, &lg->lg_hdr,
+				lg->lg_tx[0].tx_data[0]);
+	if (result) {
+		sfs_log_free(lg);
+		return result;
+	}
+
+	lg->lg_start = start;
+	lg->lg_max = max;
+	lg->lg_seq = lg->lg_hdr.lh_seq;
+	lg->lg_run = &lg->lg_tx[0];
+	lg->lg_ckpt = &lg->lg_tx[1];
+	lg->lg_inop = false;
+	sfs->sfs_log = lg;
+
+	/* Mark the journal empty now that everything is in place */
+	if (lg->lg_hdr.lh_nblocks != 0) {
+		result = sfs_log_writehdr(sfs, lg->lg_seq, NULL);
+		if (result) {
+			sfs->sfs_log = NULL;
+			sfs_log_free(lg);
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Discard the journal at unmount. It must already have been committed
+ * and checkpointed.
+ */
+void
+sfs_log_destroy(struct sfs_fs *sfs)
+{
+	struct sfs_log *lg = sfs->sfs_log;
+
+	KASSERT(lg->lg_run->tx_n == 0);
+	KASSERT(lg->lg_ckpt->tx_n == 0);
+
+	sfs->sfs_log = NULL;
+	sfs_log_free(lg);
+}
@@ -111,18 +111,51 @@ sfs_read(struct vnode *v, struct uio *uio)
 
 /*
  * Called for write(). sfs_io() does the work.
+ *
+ * Each piece of the write is one journal operation. Ordinarily the
+ * whole write is one piece, but on a volume whose freemap is large
+ * compared to the journal it may take several.
  */
 static
 int
 sfs_write(struct vnode *v, struct uio *uio)
 {
 	struct sfs_vnode *sv = v->vn_data;
-	int result;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
+	uint32_t blkoff, maxblocks, nblocks;
+	size_t len, extraresid;
+	int result = 0;
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
 	vfs_biglock_acquire();
-	result = sfs_io(sv, uio);
+	maxblocks = sfs_log_maxwrite(sfs);
+	if (maxblocks == 0) {
+		vfs_biglock_release();
+		return ENOSPC;
+	}
+	while (uio->uio_resid > 0) {
+		/* Hide whatever doesn't fit in this piece */
+		blkoff = uio->uio_offset % SFS_BLOCKSIZE;
+		len = maxblocks * SFS_BLOCKSIZE - blkoff;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		extraresid = uio->uio_resid - len;
+		uio->uio_resid = len;
+		nblocks = DIVROUNDUP(blkoff + len, SFS_BLOCKSIZE);
+
+		result = sfs_log_begin(sfs, sfs_log_writeblocks(sfs, nblocks));
+		if (result == 0) {
+			result = sfs_io(sv, uio);
+			sfs_log_end(sfs);
+		}
+
+		uio->uio_resid += extraresid;
+		if (result) {
+			break;
+		}
+	}
 	vfs_biglock_release();
 
 	return result;
@@ -215,17 +248,32 @@ sfs_isseekable(struct vnode *v)
 
 /*
  * Called for fsync(), and also on filesystem unmount, global sync(),
- * and some other cases.
+ * and some other cases. Write back the file's cached data first, then
+ * the inode, so the inode never describes data that isn't there yet.
  */
 static
 int
 sfs_fsync(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
 	int result;
 
 	vfs_biglock_acquire();
-	result = sfs_sync_inode(sv);
+	if (sfs->sfs_log != NULL) {
+		/*
+		 * With a journal, the cheapest safe thing is to commit
+		 * everything: one sequential write to the journal, after
+		 * the dirty data.
+		 */
+		result = sfs_commit(sfs);
+	}
+	else {
+		result = sfs_buf_flush(sfs, sv->sv_ino);
+		if (result == 0) {
+			result = sfs_sync_inode(sv);
+		}
+	}
 	vfs_biglock_release();
 
 	return result;
@@ -317,11 +365,17 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	}
 
 	/* Didn't exist - create it */
-	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
+	result = sfs_log_begin(sfs, SFS_LOG_DIRENT + SFS_LOG_INODE);
 	if (result) {
 		vfs_biglock_release();
 		return result;
 	}
+	result = sfs_makeobj(sfs, SFS_TYPE_FILE, sv, &newguy);
+	if (result) {
+		sfs_log_end(sfs);
+		vfs_biglock_release();
+		return result;
+	}
 
 	/* We don't currently support file permissions; ignore MODE */
 	(void)mode;
@@ -329,6 +383,8 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	/* Link it into the directory */
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
+		/* (reclaiming the new inode is an operation of its own) */
+		sfs_log_end(sfs);
 		VOP_DECREF(&newguy->sv_absvn);
 		vfs_biglock_release();
 		return result;
@@ -342,6 +398,7 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 
 	*ret = &newguy->sv_absvn;
 
+	sfs_log_end(sfs);
 	vfs_biglock_release();
 	return 0;
 }
@@ -355,6 +412,7 @@ static
 int
 sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 {
+	struct sfs_fs *sfs = dir->vn_fs->fs_data;
 	struct sfs_vnode *sv = dir->vn_data;
 	struct sfs_vnode *f = file->vn_data;
 	int result;
@@ -369,9 +427,16 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 		return EINVAL;
 	}
 
+	result = sfs_log_begin(sfs, SFS_LOG_DIRENT + SFS_LOG_INODE);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* Create the link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
+		sfs_log_end(sfs);
 		vfs_biglock_release();
 		return result;
 	}
@@ -380,6 +445,7 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = true;
 
+	sfs_log_end(sfs);
 	vfs_biglock_release();
 	return 0;
 }
@@ -391,6 +457,7 @@ static
 int
 sfs_remove(struct vnode *dir, const char *name)
 {
+	struct sfs_fs *sfs = dir->vn_fs->fs_data;
 	struct sfs_vnode *sv = dir->vn_data;
 	struct sfs_vnode *victim;
 	int slot;
@@ -406,15 +473,22 @@ sfs_remove(struct vnode *dir, const char *name)
 	}
 
 	/* Erase its directory entry. */
-	result = sfs_dir_unlink(sv, slot);
+	result = sfs_log_begin(sfs, SFS_LOG_DIRENT + SFS_LOG_INODE);
 	if (result==0) {
-		/* If we succeeded, decrement the link count. */
-		KASSERT(victim->sv_i.sfi_linkcount > 0);
-		victim->sv_i.sfi_linkcount--;
-		victim->sv_dirty = true;
+		result = sfs_dir_unlink(sv, slot);
+		if (result==0) {
+			/* If we succeeded, decrement the link count. */
+			KASSERT(victim->sv_i.sfi_linkcount > 0);
+			victim->sv_i.sfi_linkcount--;
+			victim->sv_dirty = true;
+		}
+		sfs_log_end(sfs);
 	}
 
-	/* Discard the reference that sfs_lookonce got us */
+	/*
+	 * Discard the reference that sfs_lookonce got us. If that
+	 * reclaims the file, freeing it is an operation of its own.
+	 */
 	VOP_DECREF(&victim->sv_absvn);
 
 	vfs_biglock_release();
@@ -453,6 +527,13 @@ sfs_rename(struct vnode *d1, const char *n1,
 	/* We don't support subdirectories */
 	KASSERT(g1->sv_i.sfi_type == SFS_TYPE_FILE);
 
+	result = sfs_log_begin(sfs, 2*SFS_LOG_DIRENT + SFS_LOG_INODE);
+	if (result) {
+		VOP_DECREF(&g1->sv_absvn);
+		vfs_biglock_release();
+		return result;
+	}
+
 	/*
 	 * Link it under the new name.
 	 *
@@ -484,6 +565,8 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_i.sfi_linkcount--;
 	g1->sv_dirty = true;
 
+	sfs_log_end(sfs);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
 
@@ -505,6 +588,8 @@ sfs_rename(struct vnode *d1, const char *n1,
 	}
 	g1->sv_i.sfi_linkcount--;
  puke:
+	sfs_log_end(sfs);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
 	vfs_biglock_release();
@@ -602,6 +687,7 @@ const struct vnode_ops sfs_fileops = {
 	.vop_mmap = sfs_mmap,
 	.vop_truncate = sfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = vnode_poll_ready,
 
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
@@ -636,6 +722,7 @@ const struct vnode_ops sfs_dirops = {
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
 	.vop_namefile = sfs_namefile,
+	.vop_poll = vnode_poll_ready,
 
 	.vop_creat = sfs_creat,
 	.vop_symlink = vopfail_symlink_nosys,
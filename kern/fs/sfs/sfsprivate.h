@@ -41,16 +41,118 @@ extern const struct vnode_ops sfs_dirops;
 #define SFSUIO(iov, uio, ptr, block, rw) \
     uio_kinit(iov, uio, ptr, SFS_BLOCKSIZE, ((off_t)(block))*SFS_BLOCKSIZE, rw)
 
+/* Largest number of blocks sfs_io will cluster into one device request */
+#define SFS_MAXCLUSTER  32
+
+/*
+ * Journal blocks operations need (see sfs_log_begin). Changing a
+ * directory entry can take the directory block, the directory's
+ * indirect block, freemap blocks for allocating both, and the
+ * directory's inode; creating, changing, or freeing an inode takes
+ * the inode and a freemap block.
+ */
+#define SFS_LOG_DIRENT  5
+#define SFS_LOG_INODE   2
+
+/* Block cache and I/O thread tuning (sfs_cache.c) */
+#define SFS_NBUFS         128              /* cached blocks per volume */
+#define SFS_WBTHRESH      (SFS_NBUFS/4)    /* dirty blocks to start writing */
+#define SFS_RAQSIZE       8                /* queued read-ahead requests */
+#define SFS_RA_MINWINDOW  4                /* initial read-ahead, in blocks */
+#define SFS_RA_MAXWINDOW  SFS_MAXCLUSTER   /* largest read-ahead window */
+
+/*
+ * A cached file data block.
+ */
+struct sfs_buf {
+	daddr_t b_block;		/* disk block held; 0 if empty */
+	uint32_t b_ino;			/* inode the block belongs to */
+	bool b_dirty;			/* needs writing back */
+	unsigned b_stamp;		/* time of last use, for LRU */
+	void *b_data;			/* SFS_BLOCKSIZE bytes of data */
+};
+
+/*
+ * Read-ahead request for the I/O thread.
+ */
+struct sfs_rareq {
+	uint32_t rr_ino;		/* file */
+	uint32_t rr_fileblock;		/* first block to fetch */
+	uint32_t rr_nblocks;		/* number of blocks */
+};
+
+/*
+ * Per-volume block cache and I/O thread state.
+ */
+struct sfs_cache {
+	struct sfs_fs *sc_fs;			/* volume we belong to */
+	struct sfs_buf sc_bufs[SFS_NBUFS];	/* the buffers */
+	unsigned sc_stamp;			/* LRU clock */
+	unsigned sc_ndirty;			/* number of dirty buffers */
+
+	/* The rest is protected by sc_lock rather than the big lock */
+	struct lock *sc_lock;
+	struct cv *sc_cv;			/* I/O thread waits here */
+	struct sfs_rareq sc_raq[SFS_RAQSIZE];	/* read-ahead queue */
+	unsigned sc_rahead, sc_racount;
+	bool sc_wbwanted;			/* write-behind requested */
+	bool sc_ckptwanted;			/* journal checkpoint requested */
+	bool sc_exit;				/* volume is being unmounted */
+};
+
+/*
+ * A journal transaction in memory: the latest contents of each
+ * metadata block it covers.
+ */
+struct sfs_logtx {
+	unsigned tx_n;				/* number of blocks */
+	daddr_t tx_blocks[SFS_LOG_MAXBLOCKS];	/* home locations */
+	void *tx_data[SFS_LOG_MAXBLOCKS];	/* SFS_BLOCKSIZE each */
+};
+
+/*
+ * Per-volume journal state (sfs_log.c). Metadata writes collect in
+ * the running transaction until it is committed; it then waits in
+ * lg_ckpt until its blocks have been written to their real places,
+ * which must happen before the next commit reuses the journal.
+ */
+struct sfs_log {
+	daddr_t lg_start;			/* header block */
+	unsigned lg_max;			/* blocks per transaction */
+	uint32_t lg_seq;			/* last transaction number */
+	struct sfs_logtx lg_tx[2];
+	struct sfs_logtx *lg_run;		/* collecting changes */
+	struct sfs_logtx *lg_ckpt;		/* committed, not in place */
+	bool lg_inop;				/* operation in progress */
+	struct sfs_loghdr lg_hdr;		/* header I/O buffer */
+};
+
 
 /* Functions in sfs_balloc.c */
-int sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock);
+int sfs_balloc(struct sfs_fs *sfs, daddr_t goal, daddr_t *diskblock);
 void sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock);
 int sfs_bused(struct sfs_fs *sfs, daddr_t diskblock);
+bool sfs_freemap_isdirty(struct sfs_fs *sfs);
+
+/* Functions in sfs_cache.c */
+struct sfs_buf *sfs_buf_find(struct sfs_fs *sfs, daddr_t block);
+int sfs_buf_get(struct sfs_fs *sfs, uint32_t ino, daddr_t block, bool doread,
+		struct sfs_buf **ret);
+void sfs_buf_markdirty(struct sfs_fs *sfs, struct sfs_buf *b);
+void sfs_buf_drop(struct sfs_fs *sfs, daddr_t block);
+int sfs_buf_flush(struct sfs_fs *sfs, uint32_t ino);
+void sfs_cache_readahead(struct sfs_fs *sfs, uint32_t ino,
+		uint32_t fileblock, uint32_t nblocks);
+void sfs_cache_writebehind(struct sfs_fs *sfs);
+void sfs_cache_checkpoint(struct sfs_fs *sfs);
+int sfs_cache_init(struct sfs_fs *sfs);
+void sfs_cache_shutdown(struct sfs_fs *sfs);
 
 /* Functions in sfs_bmap.c */
 int sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
-		daddr_t *diskblock);
+		daddr_t *diskblock, bool *isnew);
 int sfs_itrunc(struct sfs_vnode *sv, off_t len);
+void sfs_bmap_invalidate(void);
 
 /* Functions in sfs_dir.c */
 int sfs_dir_findname(struct sfs_vnode *sv, const char *name,
@@ -62,20 +164,38 @@ int sfs_lookonce(struct sfs_vnode *sv, const char *name,
 		struct sfs_vnode **ret,
 		int *slot);
 
+/* Functions in sfs_fsops.c */
+int sfs_commit(struct sfs_fs *sfs);
+
 /* Functions in sfs_inode.c */
 int sfs_sync_inode(struct sfs_vnode *sv);
 int sfs_reclaim(struct vnode *v);
 int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		struct sfs_vnode **ret);
-int sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret);
+int sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode *dir,
+		struct sfs_vnode **ret);
 int sfs_getroot(struct fs *fs, struct vnode **ret);
 
 /* Functions in sfs_io.c */
+int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
 int sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_io(struct sfs_vnode *sv, struct uio *uio);
 int sfs_metaio(struct sfs_vnode *sv, off_t pos, void *data, size_t len,
 	       enum uio_rw rw);
 
+/* Functions in sfs_log.c */
+int sfs_log_init(struct sfs_fs *sfs);
+void sfs_log_destroy(struct sfs_fs *sfs);
+bool sfs_log_read(struct sfs_fs *sfs, daddr_t block, void *data);
+int sfs_log_write(struct sfs_fs *sfs, daddr_t block, const void *data);
+void sfs_log_forget(struct sfs_fs *sfs, daddr_t block);
+int sfs_log_begin(struct sfs_fs *sfs, unsigned nblocks);
+void sfs_log_end(struct sfs_fs *sfs);
+unsigned sfs_log_maxwrite(struct sfs_fs *sfs);
+unsigned sfs_log_writeblocks(struct sfs_fs *sfs, unsigned nblocks);
+int sfs_log_commit(struct sfs_fs *sfs);
+int sfs_log_checkpoint(struct sfs_fs *sfs);
+
 
 #endif /* _SFSPRIVATE_H_ */
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <array.h>
+#include <fs.h>
+#include <vnode.h>
+
+#ifndef TMPFS_INLINE
+#define TMPFS_INLINE INLINE
+#endif
+
+/*
+ * tmpfs: a filesystem that lives entirely in kernel memory.
+ *
+ * File data is kept in whole kernel pages, allocated when first
+ * written; holes read as zeros. Directories are hash tables, so
+ * lookups don't scan. Nothing is ever written to disk, and the
+ * contents go away when the system does.
+ *
+ * Instances are permanent: they're attached with vfs_addfs, like
+ * emu0: and sem:, so there is no unmount. All instances together may
+ * hold at most 1/TMPFS_RAMSHARE of physical memory in file pages;
+ * writes past that fail with ENOSPC.
+ */
+
+/*
+ * Constants
+ */
+
+#define TMPFS_MINBUCKETS	8	/* initial directory hash size */
+#define TMPFS_RAMSHARE		4	/* all file pages: 1/this of RAM */
+
+/*
+ * Directory entry. Entries are chained in the directory's hash
+ * table for lookup, and also kept in a slot array, whose index is
+ * used as the getdirentry position.
+ */
+struct tmpfs_dirent {
+	char *td_name;				/* Name */
+	struct tmpfs_node *td_node;		/* What it refers to */
+	unsigned td_slot;			/* Index in tn_slots */
+	struct tmpfs_dirent *td_hashnext;	/* Hash chain */
+};
+DECLARRAY(tmpfs_dirent, TMPFS_INLINE);
+
+/*
+ * A file or directory.
+ *
+ * A node lives as long as it has links or a vnode. The vnode is
+ * embedded and only valid while tn_hasvnode is set; it's reinitialized
+ * each time the node is looked up again after VOP_RECLAIM. Since
+ * directories can't be hard linked, a directory's tn_dirent is its
+ * (only) entry in its parent.
+ */
+struct tmpfs_node {
+	struct vnode tn_vnode;			/* Abstract vnode */
+	struct tmpfs *tn_fs;			/* Back-pointer to fs */
+	uint32_t tn_ino;			/* Inode number, for stat */
+	mode_t tn_type;				/* S_IFREG or S_IFDIR */
+	unsigned tn_nlink;			/* Links from directories */
+	bool tn_hasvnode;			/* tn_vnode is live */
+
+	/* Regular files; protected by tn_lock */
+	struct lock *tn_lock;
+	off_t tn_size;				/* File size */
+	vaddr_t *tn_pages;			/* Data pages, 0 for a hole */
+	unsigned tn_npages;			/* Size of tn_pages */
+
+	/* Directories; protected by tf_lock */
+	struct tmpfs_node *tn_parent;		/* ..; NULL for the root */
+	struct tmpfs_dirent *tn_dirent;		/* Our entry in the parent */
+	struct tmpfs_dirent **tn_buckets;	/* Hash table */
+	unsigned tn_nbuckets;			/* Power of two */
+	unsigned tn_nentries;			/* Entries in the table */
+	struct tmpfs_direntarray *tn_slots;	/* Entries in slot order */
+};
+
+/*
+ * The filesystem.
+ *
+ * tf_lock covers the whole namespace: every directory, the link
+ * counts, and whether nodes have vnodes. Lock ordering: tf_lock before
+ * any tn_lock.
+ */
+struct tmpfs {
+	struct fs tf_absfs;			/* Abstract fs object */
+	char *tf_name;				/* Volume name */
+	struct lock *tf_lock;			/* Namespace lock */
+	struct tmpfs_node *tf_root;		/* Root directory */
+	uint32_t tf_nextino;			/* Next inode number */
+	unsigned tf_nvnodes;			/* Vnodes in use */
+};
+
+/*
+ * Arrays
+ */
+
+DEFARRAY(tmpfs_dirent, TMPFS_INLINE);
+
+
+/*
+ * Functions.
+ */
+
+/* in tmpfs_obj.c */
+void tmpfs_pages_bootstrap(void);
+struct tmpfs_node *tmpfs_node_create(struct tmpfs *tf, mode_t type);
+void tmpfs_node_destroy(struct tmpfs_node *tn);
+int tmpfs_file_getpage(struct tmpfs_node *tn, unsigned pageno,
+		       bool create, vaddr_t *ret);
+int tmpfs_file_truncate(struct tmpfs_node *tn, off_t len);
+struct tmpfs_dirent *tmpfs_dir_find(struct tmpfs_node *dir,
+				    const char *name);
+int tmpfs_dir_add(struct tmpfs_node *dir, const char *name,
+		  struct tmpfs_node *tn);
+void tmpfs_dir_remove(struct tmpfs_node *dir, struct tmpfs_dirent *td);
+
+/* in tmpfs_vnops.c */
+int tmpfs_getvnode(struct tmpfs_node *tn, struct vnode **ret);
+
+
+#endif /* TMPFS_H */
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <stat.h>
+#include <lib.h>
+#include <synch.h>
+#include <vfs.h>
+#include <fs.h>
+#include <vnode.h>
+
+#include "tmpfs.h"
+
+////////////////////////////////////////////////////////////
+// fs-level operations
+
+/*
+ * Sync doesn't need to do anything.
+ */
+static
+int
+tmpfs_sync(struct fs *fs)
+{
+	(void)fs;
+	return 0;
+}
+
+static
+const char *
+tmpfs_getvolname(struct fs *fs)
+{
+	struct tmpfs *tf = fs->fs_data;
+
+	return tf->tf_name;
+}
+
+/*
+ * Get the root directory vnode.
+ */
+static
+int
+tmpfs_getroot(struct fs *fs, struct vnode **ret)
+{
+	struct tmpfs *tf = fs->fs_data;
+	int result;
+
+	lock_acquire(tf->tf_lock);
+	result = tmpfs_getvnode(tf->tf_root, ret);
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// mount logic
+
+/*
+ * Unmount routine. tmpfs instances are attached with vfs_addfs and
+ * so can't be named to vfs_unmount; they last until shutdown, and
+ * their contents with them.
+ */
+static
+int
+tmpfs_unmount(struct fs *fs)
+{
+	(void)fs;
+	return EBUSY;
+}
+
+/*
+ * Operations table.
+ */
+static const struct fs_ops tmpfs_fsops = {
+	.fsop_sync = tmpfs_sync,
+	.fsop_getvolname = tmpfs_getvolname,
+	.fsop_getroot = tmpfs_getroot,
+	.fsop_unmount = tmpfs_unmount,
+};
+
+/*
+ * Constructor for struct tmpfs.
+ */
+static
+struct tmpfs *
+tmpfs_create(const char *name)
+{
+	struct tmpfs *tf;
+
+	tf = kmalloc(sizeof(*tf));
+	if (tf == NULL) {
+		goto fail_total;
+	}
+	tf->tf_name = kstrdup(name);
+	if (tf->tf_name == NULL) {
+		goto fail_tf;
+	}
+	tf->tf_lock = lock_create("tmpfs_ns");
+	if (tf->tf_lock == NULL) {
+		goto fail_name;
+	}
+	tf->tf_nextino = 1;
+	tf->tf_nvnodes = 0;
+
+	tf->tf_root = tmpfs_node_create(tf, S_IFDIR);
+	if (tf->tf_root == NULL) {
+		goto fail_lock;
+	}
+	/* The root has no parent; count a link so it's never freed */
+	tf->tf_root->tn_nlink = 1;
+
+	tf->tf_absfs.fs_data = tf;
+	tf->tf_absfs.fs_ops = &tmpfs_fsops;
+	return tf;
+
+ fail_lock:
+	lock_destroy(tf->tf_lock);
+ fail_name:
+	kfree(tf->tf_name);
+ fail_tf:
+	kfree(tf);
+ fail_total:
+	return NULL;
+}
+
+/*
+ * Destructor for struct tmpfs, for a fresh one that couldn't be
+ * attached. Nothing has been created in it yet.
+ */
+static
+void
+tmpfs_destroy(struct tmpfs *tf)
+{
+	KASSERT(tf->tf_root->tn_nentries == 0);
+
+	tf->tf_root->tn_nlink = 0;
+	tmpfs_node_destroy(tf->tf_root);
+	lock_destroy(tf->tf_lock);
+	kfree(tf->tf_name);
+	kfree(tf);
+}
+
+/*
+ * Create an empty tmpfs and attach it as NAME:. Called from the
+ * menu's mount command; there's no device underneath, so NAME is
+ * just the name to give it.
+ */
+int
+tmpfs_mount(const char *name)
+{
+	struct tmpfs *tf;
+	int result;
+
+	tf = tmpfs_create(name);
+	if (tf == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_addfs(name, &tf->tf_absfs);
+	if (result) {
+		tmpfs_destroy(tf);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Attach "tmp:" during bootup, for scratch files.
+ */
+void
+tmpfs_bootstrap(void)
+{
+	int result;
+
+	tmpfs_pages_bootstrap();
+	result = tmpfs_mount("tmp");
+	if (result) {
+		panic("Attaching tmpfs: %s\n", strerror(result));
+	}
+}
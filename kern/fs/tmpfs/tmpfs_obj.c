@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <stat.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <vm.h>
+#include <mainbus.h>
+
+#define TMPFS_INLINE
+#include "tmpfs.h"
+
+////////////////////////////////////////////////////////////
+// nodes
+
+/*
+ * Constructor for tmpfs_node. TYPE is S_IFREG or S_IFDIR. Call with
+ * tf_lock held (for the inode number) unless the fs is being set up.
+ */
+struct tmpfs_node *
+tmpfs_node_create(struct tmpfs *tf, mode_t type)
+{
+	struct tmpfs_node *tn;
+	unsigned i;
+
+	tn = kmalloc(sizeof(*tn));
+	if (tn == NULL) {
+		goto fail_return;
+	}
+	tn->tn_lock = lock_create("tmpfs");
+	if (tn->tn_lock == NULL) {
+		goto fail_tn;
+	}
+
+	tn->tn_fs = tf;
+	tn->tn_ino = tf->tf_nextino++;
+	tn->tn_type = type;
+	tn->tn_nlink = 0;
+	tn->tn_hasvnode = false;
+
+	tn->tn_size = 0;
+	tn->tn_pages = NULL;
+	tn->tn_npages = 0;
+
+	tn->tn_parent = NULL;
+	tn->tn_dirent = NULL;
+	tn->tn_buckets = NULL;
+	tn->tn_nbuckets = 0;
+	tn->tn_nentries = 0;
+	tn->tn_slots = NULL;
+
+	if (type == S_IFDIR) {
+		tn->tn_buckets = kmalloc(TMPFS_MINBUCKETS *
+					 sizeof(*tn->tn_buckets));
+		if (tn->tn_buckets == NULL) {
+			goto fail_lock;
+		}
+		for (i=0; i<TMPFS_MINBUCKETS; i++) {
+			tn->tn_buckets[i] = NULL;
+		}
+		tn->tn_nbuckets = TMPFS_MINBUCKETS;
+		tn->tn_slots = tmpfs_direntarray_create();
+		if (tn->tn_slots == NULL) {
+			goto fail_buckets;
+		}
+	}
+	return tn;
+
+ fail_buckets:
+	kfree(tn->tn_buckets);
+ fail_lock:
+	lock_destroy(tn->tn_lock);
+ fail_tn:
+	kfree(tn);
+ fail_return:
+	return NULL;
+}
+
+/*
+ * Destructor for tmpfs_node. Releases the file's pages. Directories
+ * must be empty.
+ */
+void
+tmpfs_node_destroy(struct tmpfs_node *tn)
+{
+	KASSERT(tn->tn_hasvnode == false);
+	KASSERT(tn->tn_nentries == 0);
+
+	if (tn->tn_type == S_IFDIR) {
+		tmpfs_direntarray_setsize(tn->tn_slots, 0);
+		tmpfs_direntarray_destroy(tn->tn_slots);
+		kfree(tn->tn_buckets);
+	}
+	else {
+		lock_acquire(tn->tn_lock);
+		tmpfs_file_truncate(tn, 0);
+		lock_release(tn->tn_lock);
+	}
+	lock_destroy(tn->tn_lock);
+	kfree(tn);
+}
+
+////////////////////////////////////////////////////////////
+// file data
+
+/*
+ * File pages of all tmpfs instances together are counted against one
+ * budget, since any number of instances can be mounted. The lock is
+ * a spinlock because pages are filled in with only a tn_lock held.
+ */
+static struct spinlock tmpfs_pagelock = SPINLOCK_INITIALIZER;
+static unsigned tmpfs_npages;		/* File pages allocated */
+static unsigned tmpfs_maxpages;		/* Limit on tmpfs_npages */
+
+/*
+ * Set the page budget. Called once, before anything is mounted.
+ */
+void
+tmpfs_pages_bootstrap(void)
+{
+	tmpfs_maxpages = mainbus_ramsize() / PAGE_SIZE / TMPFS_RAMSHARE;
+}
+
+/*
+ * Get a zeroed page for a file, charging it against the budget.
+ * Returns 0 if the budget is used up or memory is short.
+ */
+static
+vaddr_t
+tmpfs_page_alloc(void)
+{
+	vaddr_t page;
+
+	spinlock_acquire(&tmpfs_pagelock);
+	if (tmpfs_npages >= tmpfs_maxpages) {
+		spinlock_release(&tmpfs_pagelock);
+		return 0;
+	}
+	tmpfs_npages++;
+	spinlock_release(&tmpfs_pagelock);
+
+	page = alloc_kpages(1);
+	if (page == 0) {
+		spinlock_acquire(&tmpfs_pagelock);
+		tmpfs_npages--;
+		spinlock_release(&tmpfs_pagelock);
+		return 0;
+	}
+	bzero((void *)page, PAGE_SIZE);
+	return page;
+}
+
+/*
+ * Give back a file page.
+ */
+static
+void
+tmpfs_page_free(vaddr_t page)
+{
+	free_kpages(page);
+
+	spinlock_acquire(&tmpfs_pagelock);
+	KASSERT(tmpfs_npages > 0);
+	tmpfs_npages--;
+	spinlock_release(&tmpfs_pagelock);
+}
+
+/*
+ * Get page PAGENO of a file. If it isn't there, hand back 0, or if
+ * CREATE is set, allocate a zeroed page for it. Call with tn_lock
+ * held.
+ */
+int
+tmpfs_file_getpage(struct tmpfs_node *tn, unsigned pageno, bool create,
+		   vaddr_t *ret)
+{
+	vaddr_t *newpages;
+	unsigned newnum, i;
+	vaddr_t page;
+
+	KASSERT(lock_do_i_hold(tn->tn_lock));
+
+	if (pageno >= tn->tn_npages) {
+		if (!create) {
+			*ret = 0;
+			return 0;
+		}
+		newnum = tn->tn_npages * 2;
+		if (newnum <= pageno) {
+			newnum = pageno + 1;
+		}
+		newpages = kmalloc(newnum * sizeof(*newpages));
+		if (newpages == NULL) {
+			return ENOSPC;
+		}
+		for (i=0; i<tn->tn_npages; i++) {
+			newpages[i] = tn->tn_pages[i];
+		}
+		for (; i<newnum; i++) {
+			newpages[i] = 0;
+		}
+		kfree(tn->tn_pages);
+		tn->tn_pages = newpages;
+		tn->tn_npages = newnum;
+	}
+
+	page = tn->tn_pages[pageno];
+	if (page == 0 && create) {
+		page = tmpfs_page_alloc();
+		if (page == 0) {
+			return ENOSPC;
+		}
+		tn->tn_pages[pageno] = page;
+	}
+	*ret = page;
+	return 0;
+}
+
+/*
+ * Set the size of a file, freeing whole pages past the end and
+ * zeroing the rest of the last page, so that growing the file again
+ * exposes zeros. Call with tn_lock held.
+ */
+int
+tmpfs_file_truncate(struct tmpfs_node *tn, off_t len)
+{
+	unsigned keep, i;
+	size_t tail;
+
+	KASSERT(lock_do_i_hold(tn->tn_lock));
+	KASSERT(len >= 0);
+
+	if (len < tn->tn_size) {
+		keep = DIVROUNDUP(len, PAGE_SIZE);
+		for (i=keep; i<tn->tn_npages; i++) {
+			if (tn->tn_pages[i] != 0) {
+				tmpfs_page_free(tn->tn_pages[i]);
+				tn->tn_pages[i] = 0;
+			}
+		}
+		tail = len % PAGE_SIZE;
+		if (tail != 0 && keep <= tn->tn_npages &&
+		    tn->tn_pages[keep - 1] != 0) {
+			bzero((char *)tn->tn_pages[keep - 1] + tail,
+			      PAGE_SIZE - tail);
+		}
+		if (keep == 0) {
+			kfree(tn->tn_pages);
+			tn->tn_pages = NULL;
+			tn->tn_npages = 0;
+		}
+	}
+	tn->tn_size = len;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// directories
+
+static
+unsigned
+tmpfs_hash(const char *name)
+{
+	unsigned h = 5381;
+
+	while (*name) {
+		h = h * 33 + (unsigned char)*name++;
+	}
+	return h;
+}
+
+/*
+ * Double the hash table once it averages more than two entries per
+ * bucket. If there's no memory, keep the old table; it still works.
+ */
+static
+void
+tmpfs_dir_grow(struct tmpfs_node *dir)
+{
+	struct tmpfs_dirent **newbuckets, *td;
+	unsigned newnum, i, h;
+
+	newnum = dir->tn_nbuckets * 2;
+	newbuckets = kmalloc(newnum * sizeof(*newbuckets));
+	if (newbuckets == NULL) {
+		return;
+	}
+	for (i=0; i<newnum; i++) {
+		newbuckets[i] = NULL;
+	}
+	for (i=0; i<dir->tn_nbuckets; i++) {
+		while ((td = dir->tn_buckets[i]) != NULL) {
+			dir->tn_buckets[i] = td->td_hashnext;
+			h = tmpfs_hash(td->td_name) & (newnum - 1);
+			td->td_hashnext = newbuckets[h];
+			newbuckets[h] = td;
+		}
+	}
+	kfree(dir->tn_buckets);
+	dir->tn_buckets = newbuckets;
+	dir->tn_nbuckets = newnum;
+}
+
+/*
+ * Squeeze the free slots out of the slot array.
+ */
+static
+void
+tmpfs_dir_pack(struct tmpfs_node *dir)
+{
+	struct tmpfs_dirent *td;
+	unsigned i, j, num;
+
+	num = tmpfs_direntarray_num(dir->tn_slots);
+	for (i=j=0; i<num; i++) {
+		td = tmpfs_direntarray_get(dir->tn_slots, i);
+		if (td != NULL) {
+			td->td_slot = j;
+			tmpfs_direntarray_set(dir->tn_slots, j++, td);
+		}
+	}
+	KASSERT(j == dir->tn_nentries);
+	tmpfs_direntarray_setsize(dir->tn_slots, j);
+}
+
+/*
+ * Look up NAME in DIR. Call with tf_lock held.
+ */
+struct tmpfs_dirent *
+tmpfs_dir_find(struct tmpfs_node *dir, const char *name)
+{
+	struct tmpfs_dirent *td;
+	unsigned h;
+
+	KASSERT(lock_do_i_hold(dir->tn_fs->tf_lock));
+	KASSERT(dir->tn_type == S_IFDIR);
+
+	h = tmpfs_hash(name) & (dir->tn_nbuckets - 1);
+	for (td = dir->tn_buckets[h]; td != NULL; td = td->td_hashnext) {
+		if (!strcmp(td->td_name, name)) {
+			return td;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add an entry NAME for TN to DIR and count the link. The name must
+ * not already be there. Call with tf_lock held.
+ */
+int
+tmpfs_dir_add(struct tmpfs_node *dir, const char *name,
+	      struct tmpfs_node *tn)
+{
+	struct tmpfs_dirent *td;
+	unsigned h;
+	int result;
+
+	KASSERT(lock_do_i_hold(dir->tn_fs->tf_lock));
+	KASSERT(tmpfs_dir_find(dir, name) == NULL);
+
+	td = kmalloc(sizeof(*td));
+	if (td == NULL) {
+		return ENOMEM;
+	}
+	td->td_name = kstrdup(name);
+	if (td->td_name == NULL) {
+		kfree(td);
+		return ENOMEM;
+	}
+	td->td_node = tn;
+	result = tmpfs_direntarray_add(dir->tn_slots, td, &td->td_slot);
+	if (result) {
+		kfree(td->td_name);
+		kfree(td);
+		return result;
+	}
+
+	h = tmpfs_hash(name) & (dir->tn_nbuckets - 1);
+	td->td_hashnext = dir->tn_buckets[h];
+	dir->tn_buckets[h] = td;
+	dir->tn_nentries++;
+
+	tn->tn_nlink++;
+	if (tn->tn_type == S_IFDIR) {
+		tn->tn_parent = dir;
+		tn->tn_dirent = td;
+	}
+
+	if (dir->tn_nentries > 2 * dir->tn_nbuckets) {
+		tmpfs_dir_grow(dir);
+	}
+	return 0;
+}
+
+/*
+ * Remove entry TD from DIR and drop the link it held. Destroying the
+ * node, if that was the last link, is up to the caller. Call with
+ * tf_lock held.
+ */
+void
+tmpfs_dir_remove(struct tmpfs_node *dir, struct tmpfs_dirent *td)
+{
+	struct tmpfs_dirent **pp;
+	struct tmpfs_node *tn = td->td_node;
+	unsigned h, num;
+
+	KASSERT(lock_do_i_hold(dir->tn_fs->tf_lock));
+
+	h = tmpfs_hash(td->td_name) & (dir->tn_nbuckets - 1);
+	for (pp = &dir->tn_buckets[h]; *pp != td; pp = &(*pp)->td_hashnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = td->td_hashnext;
+	dir->tn_nentries--;
+
+	/* Free the slot, and any free slots left at the end */
+	tmpfs_direntarray_set(dir->tn_slots, td->td_slot, NULL);
+	num = tmpfs_direntarray_num(dir->tn_slots);
+	while (num > 0 &&
+	       tmpfs_direntarray_get(dir->tn_slots, num - 1) == NULL) {
+		num--;
+	}
+	/* shrinking can't fail */
+	tmpfs_direntarray_setsize(dir->tn_slots, num);
+
+	/*
+	 * If most of the slots are free, pack them. This moves entries
+	 * under a concurrent getdirentry, which may then skip some;
+	 * that's allowed when the directory changes.
+	 */
+	if (num > 2 * dir->tn_nentries + TMPFS_MINBUCKETS) {
+		tmpfs_dir_pack(dir);
+	}
+
+	KASSERT(tn->tn_nlink > 0);
+	tn->tn_nlink--;
+	if (tn->tn_type == S_IFDIR && tn->tn_dirent == td) {
+		tn->tn_parent = NULL;
+		tn->tn_dirent = NULL;
+	}
+
+	kfree(td->td_name);
+	kfree(td);
+}
@@ -0,0 +1,868 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vfs.h>
+#include <vnode.h>
+
+#include "tmpfs.h"
+
+/* Largest file we'll hold; keeps page numbers in an unsigned */
+#define TMPFS_MAXFILESIZE	((off_t)1 << 32)
+
+////////////////////////////////////////////////////////////
+// basic ops
+
+static
+int
+tmpfs_eachopen(struct vnode *vn, int openflags)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+
+	if (tn->tn_type == S_IFDIR) {
+		if ((openflags & O_ACCMODE) != O_RDONLY) {
+			return EISDIR;
+		}
+		if (openflags & O_APPEND) {
+			return EISDIR;
+		}
+	}
+
+	return 0;
+}
+
+static
+int
+tmpfs_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+tmpfs_gettype(struct vnode *vn, mode_t *ret)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+
+	*ret = tn->tn_type;
+	return 0;
+}
+
+static
+bool
+tmpfs_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return true;
+}
+
+/*
+ * Nothing is ever on disk, so there's nothing to sync.
+ */
+static
+int
+tmpfs_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+static
+int
+tmpfs_stat(struct vnode *vn, struct stat *buf)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_fs;
+	unsigned i, npages;
+
+	bzero(buf, sizeof(*buf));
+
+	if (tn->tn_type == S_IFDIR) {
+		lock_acquire(tf->tf_lock);
+		buf->st_size = tn->tn_nentries;
+		lock_release(tf->tf_lock);
+		buf->st_mode = S_IFDIR | 0755;
+		buf->st_nlink = 2;
+	}
+	else {
+		lock_acquire(tf->tf_lock);
+		buf->st_nlink = tn->tn_nlink;
+		lock_release(tf->tf_lock);
+
+		npages = 0;
+		lock_acquire(tn->tn_lock);
+		for (i=0; i<tn->tn_npages; i++) {
+			if (tn->tn_pages[i] != 0) {
+				npages++;
+			}
+		}
+		buf->st_size = tn->tn_size;
+		lock_release(tn->tn_lock);
+		buf->st_mode = S_IFREG | 0644;
+		buf->st_blocks = npages;
+	}
+	buf->st_blksize = PAGE_SIZE;
+	buf->st_dev = 0;
+	buf->st_ino = tn->tn_ino;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// file ops
+
+static
+int
+tmpfs_read(struct vnode *vn, struct uio *uio)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	vaddr_t page;
+	size_t amt, off;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	lock_acquire(tn->tn_lock);
+	while (uio->uio_resid > 0 && uio->uio_offset < tn->tn_size) {
+		off = uio->uio_offset % PAGE_SIZE;
+		amt = PAGE_SIZE - off;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		if ((off_t)amt > tn->tn_size - uio->uio_offset) {
+			amt = tn->tn_size - uio->uio_offset;
+		}
+
+		result = tmpfs_file_getpage(tn, uio->uio_offset / PAGE_SIZE,
+					    false, &page);
+		if (result) {
+			break;
+		}
+		if (page == 0) {
+			result = uiomovezeros(amt, uio);
+		}
+		else {
+			result = uiomove((char *)page + off, amt, uio);
+		}
+		if (result) {
+			break;
+		}
+	}
+	lock_release(tn->tn_lock);
+	return result;
+}
+
+static
+int
+tmpfs_write(struct vnode *vn, struct uio *uio)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	vaddr_t page;
+	size_t amt, off;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+
+	if (uio->uio_offset < 0) {
+		return EINVAL;
+	}
+	if (uio->uio_offset + (off_t)uio->uio_resid > TMPFS_MAXFILESIZE) {
+		return EFBIG;
+	}
+
+	lock_acquire(tn->tn_lock);
+	while (uio->uio_resid > 0) {
+		off = uio->uio_offset % PAGE_SIZE;
+		amt = PAGE_SIZE - off;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+
+		result = tmpfs_file_getpage(tn, uio->uio_offset / PAGE_SIZE,
+					    true, &page);
+		if (result) {
+			break;
+		}
+		result = uiomove((char *)page + off, amt, uio);
+		if (result) {
+			break;
+		}
+		if (uio->uio_offset > tn->tn_size) {
+			tn->tn_size = uio->uio_offset;
+		}
+	}
+	lock_release(tn->tn_lock);
+	return result;
+}
+
+static
+int
+tmpfs_truncate(struct vnode *vn, off_t len)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	int result;
+
+	if (len < 0) {
+		return EINVAL;
+	}
+	if (len > TMPFS_MAXFILESIZE) {
+		return EFBIG;
+	}
+
+	lock_acquire(tn->tn_lock);
+	result = tmpfs_file_truncate(tn, len);
+	lock_release(tn->tn_lock);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// directory ops
+
+/*
+ * Directory read. The position is the slot number; empty slots are
+ * skipped.
+ */
+static
+int
+tmpfs_getdirentry(struct vnode *dirvn, struct uio *uio)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_fs;
+	struct tmpfs_dirent *td = NULL;
+	unsigned num, pos;
+	int result = 0;
+
+	KASSERT(uio->uio_offset >= 0);
+	pos = uio->uio_offset;
+
+	lock_acquire(tf->tf_lock);
+
+	num = tmpfs_direntarray_num(dir->tn_slots);
+	while (pos < num) {
+		td = tmpfs_direntarray_get(dir->tn_slots, pos);
+		if (td != NULL) {
+			break;
+		}
+		pos++;
+	}
+	if (pos < num) {
+		result = uiomove(td->td_name, strlen(td->td_name), uio);
+		/* uiomove counted bytes; the position is a slot */
+		uio->uio_offset = pos + 1;
+	}
+
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Backend for getcwd: the path from the root, built by walking up
+ * the parent links.
+ */
+static
+int
+tmpfs_namefile(struct vnode *vn, struct uio *uio)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_fs;
+	struct tmpfs_node *p;
+	size_t total, pos, len;
+	char *buf;
+	int result;
+
+	lock_acquire(tf->tf_lock);
+
+	/* Each name plus a slash between names */
+	total = 0;
+	for (p = tn; p->tn_parent != NULL; p = p->tn_parent) {
+		total += strlen(p->tn_dirent->td_name) + 1;
+	}
+	if (p != tf->tf_root) {
+		/* removed */
+		lock_release(tf->tf_lock);
+		return ENOENT;
+	}
+	if (total == 0) {
+		/* the root is the empty string */
+		lock_release(tf->tf_lock);
+		return 0;
+	}
+	total--;
+
+	buf = kmalloc(total);
+	if (buf == NULL) {
+		lock_release(tf->tf_lock);
+		return ENOMEM;
+	}
+	/* Fill from the end: "a/b/c" */
+	pos = total;
+	for (p = tn; p->tn_parent != NULL; p = p->tn_parent) {
+		len = strlen(p->tn_dirent->td_name);
+		pos -= len;
+		memcpy(buf + pos, p->tn_dirent->td_name, len);
+		if (pos > 0) {
+			buf[--pos] = '/';
+		}
+	}
+	KASSERT(pos == 0);
+	lock_release(tf->tf_lock);
+
+	result = uiomove(buf, total, uio);
+	kfree(buf);
+	return result;
+}
+
+/*
+ * Destroy a node that has lost its last link, unless it still has a
+ * vnode; then reclaim does it. Call with tf_lock held.
+ */
+static
+void
+tmpfs_maybe_destroy(struct tmpfs_node *tn)
+{
+	KASSERT(lock_do_i_hold(tn->tn_fs->tf_lock));
+
+	if (tn->tn_nlink == 0 && !tn->tn_hasvnode) {
+		tmpfs_node_destroy(tn);
+	}
+}
+
+/*
+ * Common code for creat and mkdir: make a new TYPE node called NAME
+ * in DIR. Call with tf_lock held.
+ */
+static
+int
+tmpfs_makeobj(struct tmpfs_node *dir, const char *name, mode_t type,
+	      struct tmpfs_node **ret)
+{
+	struct tmpfs_node *tn;
+	int result;
+
+	if (dir->tn_nlink == 0) {
+		/* directory has been removed */
+		return ENOENT;
+	}
+
+	tn = tmpfs_node_create(dir->tn_fs, type);
+	if (tn == NULL) {
+		return ENOSPC;
+	}
+	result = tmpfs_dir_add(dir, name, tn);
+	if (result) {
+		tmpfs_node_destroy(tn);
+		return result;
+	}
+	*ret = tn;
+	return 0;
+}
+
+/*
+ * Create a file. If EXCL is set, insist that the filename not already
+ * exist; otherwise, if it already exists, just open it.
+ */
+static
+int
+tmpfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
+	    struct vnode **ret)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_fs;
+	struct tmpfs_dirent *td;
+	struct tmpfs_node *tn;
+	int result;
+
+	/* No permissions; ignore MODE */
+	(void)mode;
+
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return EEXIST;
+	}
+
+	lock_acquire(tf->tf_lock);
+	td = tmpfs_dir_find(dir, name);
+	if (td != NULL) {
+		if (excl) {
+			lock_release(tf->tf_lock);
+			return EEXIST;
+		}
+		result = tmpfs_getvnode(td->td_node, ret);
+		lock_release(tf->tf_lock);
+		return result;
+	}
+
+	result = tmpfs_makeobj(dir, name, S_IFREG, &tn);
+	if (result == 0) {
+		result = tmpfs_getvnode(tn, ret);
+	}
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+static
+int
+tmpfs_mkdir(struct vnode *dirvn, const char *name, mode_t mode)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_fs;
+	struct tmpfs_node *tn;
+	int result;
+
+	(void)mode;
+
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return EEXIST;
+	}
+
+	lock_acquire(tf->tf_lock);
+	if (tmpfs_dir_find(dir, name) != NULL) {
+		result = EEXIST;
+	}
+	else {
+		result = tmpfs_makeobj(dir, name, S_IFDIR, &tn);
+	}
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Hard link. Directories can't be linked.
+ */
+static
+int
+tmpfs_link(struct vnode *dirvn, const char *name, struct vnode *filevn)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_fs;
+	struct tmpfs_node *tn;
+	int result;
+
+	if (filevn->vn_fs != dirvn->vn_fs) {
+		return EXDEV;
+	}
+	tn = filevn->vn_data;
+	if (tn->tn_type == S_IFDIR) {
+		return EINVAL;
+	}
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return EEXIST;
+	}
+
+	lock_acquire(tf->tf_lock);
+	if (dir->tn_nlink == 0) {
+		result = ENOENT;
+	}
+	else if (tmpfs_dir_find(dir, name) != NULL) {
+		result = EEXIST;
+	}
+	else {
+		result = tmpfs_dir_add(dir, name, tn);
+	}
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Delete a file. As with other files, its data stays around until
+ * the last vnode reference goes away.
+ */
+static
+int
+tmpfs_remove(struct vnode *dirvn, const char *name)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_fs;
+	struct tmpfs_dirent *td;
+	struct tmpfs_node *tn;
+	int result = 0;
+
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return EINVAL;
+	}
+
+	lock_acquire(tf->tf_lock);
+	td = tmpfs_dir_find(dir, name);
+	if (td == NULL) {
+		result = ENOENT;
+	}
+	else if (td->td_node->tn_type == S_IFDIR) {
+		result = EISDIR;
+	}
+	else {
+		tn = td->td_node;
+		tmpfs_dir_remove(dir, td);
+		tmpfs_maybe_destroy(tn);
+	}
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+static
+int
+tmpfs_rmdir(struct vnode *dirvn, const char *name)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_fs;
+	struct tmpfs_dirent *td;
+	struct tmpfs_node *tn;
+	int result = 0;
+
+	if (!strcmp(name, ".")) {
+		return EINVAL;
+	}
+	if (!strcmp(name, "..")) {
+		return ENOTEMPTY;
+	}
+
+	lock_acquire(tf->tf_lock);
+	td = tmpfs_dir_find(dir, name);
+	if (td == NULL) {
+		result = ENOENT;
+	}
+	else if (td->td_node->tn_type != S_IFDIR) {
+		result = ENOTDIR;
+	}
+	else if (td->td_node->tn_nentries > 0) {
+		result = ENOTEMPTY;
+	}
+	else {
+		tn = td->td_node;
+		tmpfs_dir_remove(dir, td);
+		tmpfs_maybe_destroy(tn);
+	}
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Rename. Since the whole namespace is under tf_lock, this is
+ * atomic; the only thing to watch for is moving a directory into
+ * itself.
+ */
+static
+int
+tmpfs_rename(struct vnode *dirvn1, const char *name1,
+	     struct vnode *dirvn2, const char *name2)
+{
+	struct tmpfs_node *dir1 = dirvn1->vn_data;
+	struct tmpfs_node *dir2 = dirvn2->vn_data;
+	struct tmpfs *tf = dir1->tn_fs;
+	struct tmpfs_dirent *td1, *td2;
+	struct tmpfs_node *tn, *old, *p;
+	int result = 0;
+
+	if (dirvn1->vn_fs != dirvn2->vn_fs) {
+		return EXDEV;
+	}
+	if (!strcmp(name1, ".") || !strcmp(name1, "..") ||
+	    !strcmp(name2, ".") || !strcmp(name2, "..")) {
+		return EINVAL;
+	}
+
+	lock_acquire(tf->tf_lock);
+
+	td1 = tmpfs_dir_find(dir1, name1);
+	if (td1 == NULL) {
+		result = ENOENT;
+		goto out;
+	}
+	tn = td1->td_node;
+	if (dir2->tn_nlink == 0) {
+		result = ENOENT;
+		goto out;
+	}
+
+	if (tn->tn_type == S_IFDIR) {
+		for (p = dir2; p != NULL; p = p->tn_parent) {
+			if (p == tn) {
+				result = EINVAL;
+				goto out;
+			}
+		}
+	}
+
+	td2 = tmpfs_dir_find(dir2, name2);
+	if (td2 != NULL) {
+		old = td2->td_node;
+		if (old == tn) {
+			/* same file; nothing to do */
+			goto out;
+		}
+		if (tn->tn_type == S_IFDIR && old->tn_type != S_IFDIR) {
+			result = ENOTDIR;
+			goto out;
+		}
+		if (tn->tn_type != S_IFDIR && old->tn_type == S_IFDIR) {
+			result = EISDIR;
+			goto out;
+		}
+		if (old->tn_type == S_IFDIR && old->tn_nentries > 0) {
+			result = ENOTEMPTY;
+			goto out;
+		}
+
+		/* Point the existing entry at the file being moved */
+		td2->td_node = tn;
+		tn->tn_nlink++;
+		if (tn->tn_type == S_IFDIR) {
+			tn->tn_parent = dir2;
+			tn->tn_dirent = td2;
+		}
+		old->tn_nlink--;
+		if (old->tn_type == S_IFDIR) {
+			old->tn_parent = NULL;
+			old->tn_dirent = NULL;
+		}
+		tmpfs_maybe_destroy(old);
+	}
+	else {
+		result = tmpfs_dir_add(dir2, name2, tn);
+		if (result) {
+			goto out;
+		}
+	}
+
+	tmpfs_dir_remove(dir1, td1);
+
+ out:
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Lookup: get a single name from a directory. (The VFS layer walks
+ * paths a component at a time.)
+ */
+static
+int
+tmpfs_lookup(struct vnode *dirvn, char *path, struct vnode **ret)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_fs;
+	struct tmpfs_dirent *td;
+	int result;
+
+	if (!strcmp(path, ".")) {
+		VOP_INCREF(dirvn);
+		*ret = dirvn;
+		return 0;
+	}
+
+	lock_acquire(tf->tf_lock);
+	if (!strcmp(path, "..")) {
+		if (dir == tf->tf_root) {
+			VOP_INCREF(dirvn);
+			*ret = dirvn;
+			result = 0;
+		}
+		else if (dir->tn_parent == NULL) {
+			result = ENOENT;
+		}
+		else {
+			result = tmpfs_getvnode(dir->tn_parent, ret);
+		}
+	}
+	else {
+		td = tmpfs_dir_find(dir, path);
+		if (td == NULL) {
+			result = ENOENT;
+		}
+		else {
+			result = tmpfs_getvnode(td->td_node, ret);
+		}
+	}
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Lookparent: the VFS layer has already split off the last
+ * component, so just return the directory and copy the name.
+ */
+static
+int
+tmpfs_lookparent(struct vnode *dirvn, char *path,
+		 struct vnode **ret, char *namebuf, size_t bufmax)
+{
+	if (strlen(path)+1 > bufmax) {
+		return ENAMETOOLONG;
+	}
+	strcpy(namebuf, path);
+
+	VOP_INCREF(dirvn);
+	*ret = dirvn;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vnode lifecycle operations
+
+/*
+ * Reclaim - drop a vnode that's no longer in use. The node itself
+ * goes too if it has no links left.
+ */
+static
+int
+tmpfs_reclaim(struct vnode *vn)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_fs;
+
+	lock_acquire(tf->tf_lock);
+
+	/* vnode refcount is protected by the vnode's ->vn_countlock */
+	spinlock_acquire(&vn->vn_countlock);
+	if (vn->vn_refcount > 1) {
+		/* consume the reference VOP_DECREF passed us */
+		vn->vn_refcount--;
+
+		spinlock_release(&vn->vn_countlock);
+		lock_release(tf->tf_lock);
+		return EBUSY;
+	}
+	spinlock_release(&vn->vn_countlock);
+
+	KASSERT(tn->tn_hasvnode);
+	vnode_cleanup(&tn->tn_vnode);
+	tn->tn_hasvnode = false;
+	KASSERT(tf->tf_nvnodes > 0);
+	tf->tf_nvnodes--;
+
+	tmpfs_maybe_destroy(tn);
+
+	lock_release(tf->tf_lock);
+	return 0;
+}
+
+/*
+ * Vnode ops table for dirs.
+ */
+static const struct vnode_ops tmpfs_dirops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = tmpfs_eachopen,
+	.vop_reclaim = tmpfs_reclaim,
+
+	.vop_read = vopfail_uio_isdir,
+	.vop_readlink = vopfail_uio_isdir,
+	.vop_getdirentry = tmpfs_getdirentry,
+	.vop_write = vopfail_uio_isdir,
+	.vop_ioctl = tmpfs_ioctl,
+	.vop_stat = tmpfs_stat,
+	.vop_gettype = tmpfs_gettype,
+	.vop_isseekable = tmpfs_isseekable,
+	.vop_fsync = tmpfs_fsync,
+	.vop_mmap = vopfail_mmap_isdir,
+	.vop_truncate = vopfail_truncate_isdir,
+	.vop_namefile = tmpfs_namefile,
+	.vop_poll = vnode_poll_ready,
+
+	.vop_creat = tmpfs_creat,
+	.vop_symlink = vopfail_symlink_nosys,
+	.vop_mkdir = tmpfs_mkdir,
+	.vop_link = tmpfs_link,
+	.vop_remove = tmpfs_remove,
+	.vop_rmdir = tmpfs_rmdir,
+	.vop_rename = tmpfs_rename,
+	.vop_lookup = tmpfs_lookup,
+	.vop_lookparent = tmpfs_lookparent,
+};
+
+/*
+ * Vnode ops table for files.
+ */
+static const struct vnode_ops tmpfs_fileops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = tmpfs_eachopen,
+	.vop_reclaim = tmpfs_reclaim,
+
+	.vop_read = tmpfs_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = tmpfs_write,
+	.vop_ioctl = tmpfs_ioctl,
+	.vop_stat = tmpfs_stat,
+	.vop_gettype = tmpfs_gettype,
+	.vop_isseekable = tmpfs_isseekable,
+	.vop_fsync = tmpfs_fsync,
+	.vop_mmap = vopfail_mmap_nosys,
+	.vop_truncate = tmpfs_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = vnode_poll_ready,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+/*
+ * Get the vnode for a node, setting it up if the node doesn't have
+ * one right now. Call with tf_lock held.
+ */
+int
+tmpfs_getvnode(struct tmpfs_node *tn, struct vnode **ret)
+{
+	struct tmpfs *tf = tn->tn_fs;
+	int result;
+
+	KASSERT(lock_do_i_hold(tf->tf_lock));
+
+	if (tn->tn_hasvnode) {
+		VOP_INCREF(&tn->tn_vnode);
+	}
+	else {
+		result = vnode_init(&tn->tn_vnode,
+				    tn->tn_type == S_IFDIR ?
+				    &tmpfs_dirops : &tmpfs_fileops,
+				    &tf->tf_absfs, tn);
+		/* vnode_init doesn't actually fail */
+		KASSERT(result == 0);
+		tn->tn_hasvnode = true;
+		tf->tf_nvnodes++;
+	}
+	*ret = &tn->tn_vnode;
+	return 0;
+}
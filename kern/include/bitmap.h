@@ -37,7 +37,18 @@
  *     bitmap_create  - allocate a new bitmap object.
  *                      Returns NULL on error.
  *     bitmap_getdata - return pointer to raw bit data (for I/O).
+ *     bitmap_resync  - recompute internal state after the raw bit data
+ *                      has been changed through bitmap_getdata.
  *     bitmap_alloc   - locate a cleared bit, set it, and return its index.
+ *                      Searches next-fit, from where the last call left
+ *                      off.
+ *     bitmap_alloc_near - like bitmap_alloc, but take the first cleared
+ *                      bit at or after GOAL, wrapping around to the
+ *                      beginning if there are none past it.
+ *     bitmap_alloc_run - locate N consecutive cleared bits at or after
+ *                      GOAL (wrapping around), set them, and return
+ *                      the index of the first.
+ *     bitmap_nfree   - return the number of cleared bits.
  *     bitmap_mark    - set a clear bit by its index.
  *     bitmap_unmark  - clear a set bit by its index.
  *     bitmap_isset   - return whether a particular bit is set or not.
@@ -49,7 +60,13 @@ struct bitmap;  /* Opaque. */
 
 struct bitmap *bitmap_create(unsigned nbits);
 void          *bitmap_getdata(struct bitmap *);
+void           bitmap_resync(struct bitmap *);
 int            bitmap_alloc(struct bitmap *, unsigned *index);
+int            bitmap_alloc_near(struct bitmap *, unsigned goal,
+                                 unsigned *index);
+int            bitmap_alloc_run(struct bitmap *, unsigned goal, unsigned n,
+                                unsigned *index);
+unsigned       bitmap_nfree(struct bitmap *);
 void           bitmap_mark(struct bitmap *, unsigned index);
 void           bitmap_unmark(struct bitmap *, unsigned index);
 int            bitmap_isset(struct bitmap *, unsigned index);
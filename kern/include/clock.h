@@ -79,5 +79,28 @@ void timespec_sub(const struct timespec *t1,
  */
 void clocksleep(int seconds);
 
+/*
+ * Timeouts: call a function after some number of hardclock ticks.
+ * The function runs on CPU 0 in interrupt context with a spinlock
+ * held, so it must not sleep; it should do little more than wake
+ * something up.
+ *
+ * timeout_init  - set up TO to call FUNC(DATA).
+ * timeout_start - arm (or rearm) TO to go off in TICKS ticks.
+ * timeout_stop  - disarm TO. Once this returns, FUNC is not running
+ *                 and will not be called.
+ */
+struct timeout {
+	struct timeout *to_next;	/* next pending timeout */
+	unsigned to_ticks;		/* ticks left */
+	bool to_pending;		/* on the pending list */
+	void (*to_func)(void *);
+	void *to_data;
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *data);
+void timeout_start(struct timeout *to, unsigned ticks);
+void timeout_stop(struct timeout *to);
+
 
 #endif /* _CLOCK_H_ */
@@ -50,6 +50,8 @@
  * returns the actual length of string found in GOT. DEST is always
  * null-terminated on success. LEN and GOT include the null terminator.
  *
+ * copyoutzeros zeroes LEN bytes at a user-space address USERDEST.
+ *
  * All of these functions return 0 on success, EFAULT if a memory
  * addressing error was encountered, or (for the string versions)
  * ENAMETOOLONG if the space available was insufficient.
@@ -66,6 +68,7 @@
 
 int copyin(const_userptr_t usersrc, void *dest, size_t len);
 int copyout(const void *src, userptr_t userdest, size_t len);
+int copyoutzeros(userptr_t userdest, size_t len);
 int copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *got);
 int copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *got);
 
@@ -34,6 +34,7 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+#include <kstat.h>
 
 
 /*
@@ -61,6 +62,7 @@ struct cpu {
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	struct kstats c_stats;		/* Event counters (see kstat.h) */
 
 	/*
 	 * Accessed by other cpus.
@@ -112,6 +114,12 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Copy cpu number NUM's event counters (see kstat.h) into *STATS.
+ * Returns false if there is no such cpu.
+ */
+bool cpu_getstats(unsigned num, struct kstats *stats);
+
 /*
  * Produce a string describing the CPU type.
  */
@@ -36,6 +36,7 @@
 
 
 struct uio;  /* in <uio.h> */
+struct poller;  /* in <poll.h> */
 
 /*
  * Filesystem-namespace-accessible device.
@@ -61,6 +62,18 @@ struct device_ops {
 	int (*devop_eachopen)(struct device *, int flags_from_open);
 	int (*devop_io)(struct device *, struct uio *);
 	int (*devop_ioctl)(struct device *, int op, userptr_t data);
+
+	/* optional; devices without it are always ready (see vop_poll) */
+	int (*devop_poll)(struct device *, int events,
+			  struct poller *poller, int *revents);
+
+	/*
+	 * Set for a character device whose reads produce a document,
+	 * such as a report, rather than a stream. It is then seekable,
+	 * so each open file has its own offset and reaches EOF at the
+	 * end of the document.
+	 */
+	bool devop_seekable;
 };
 
 /*
@@ -69,6 +82,7 @@ struct device_ops {
 #define DEVOP_EACHOPEN(d, f)	((d)->d_ops->devop_eachopen(d, f))
 #define DEVOP_IO(d, u)		((d)->d_ops->devop_io(d, u))
 #define DEVOP_IOCTL(d, op, p)	((d)->d_ops->devop_ioctl(d, op, p))
+#define DEVOP_POLL(d, ev, pl, r) ((d)->d_ops->devop_poll(d, ev, pl, r))
 
 
 /* Create vnode for a vfs-level device. */
@@ -79,6 +93,11 @@ void dev_uncreate_vnode(struct vnode *vn);
 
 /* Initialization functions for builtin vfs-level devices. */
 void devnull_create(void);
+void devkheap_create(void);
+void devstats_create(void);
+
+/* Create a RAM disk of SIZE bytes, mountable as NAME (vfs/ramdisk.c). */
+int ramdisk_create(const char *name, size_t size);
 
 /* Function that kicks off device probe and attach. */
 void dev_bootstrap(void);
@@ -45,6 +45,14 @@ struct emufs_vnode {
 	struct vnode ev_v;		/* abstract vnode structure */
 	struct emu_softc *ev_emu;	/* device */
 	uint32_t ev_handle;		/* file handle */
+
+	/* Read cache; all protected by ev_lock */
+	struct lock *ev_lock;
+	char *ev_cache;			/* EMU_MAXIO bytes, or NULL */
+	off_t ev_cachepos;		/* file offset of cached data */
+	size_t ev_cachelen;		/* bytes of cached data */
+	unsigned ev_cachegen;		/* e_gen when the cache was filled */
+	off_t ev_nextpos;		/* where a sequential read would start */
 };
 
 struct emufs_fs {
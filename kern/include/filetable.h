@@ -54,8 +54,16 @@
  * make this code safe for multithreaded processes? What happens if
  * one thread calls close() while another one is in the middle of e.g.
  * read() using the same file handle?
+ *
+ * Only the slots below ft_used are meaningful; the rest are garbage
+ * and behave as if they were empty. This means creating, copying, and
+ * destroying a table only touch the descriptors a process actually
+ * uses, which matters for fork. ft_lowfree is a hint for place: every
+ * slot below it is in use.
  */
 struct filetable {
+	unsigned ft_used;		/* slots [0, ft_used) are valid */
+	unsigned ft_lowfree;		/* no free slot below this */
 	struct openfile *ft_openfiles[OPEN_MAX];
 };
 
@@ -86,6 +86,10 @@ struct fs_ops {
 
 /* Initialization functions for builtin fake file systems. */
 void semfs_bootstrap(void);
+void tmpfs_bootstrap(void);
+
+/* Attach another empty tmpfs as NAME: (fs/tmpfs). */
+int tmpfs_mount(const char *name);
 
 
 #endif /* _FS_H_ */
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_IORING_H_
+#define _KERN_IORING_H_
+
+/*
+ * Submission/completion ring for batching file system calls.
+ *
+ * The ring lives in user memory. A process registers it once with
+ * ioring_setup(), then fills in submission entries, advances sq_tail,
+ * and calls ioring_enter() to have the kernel run the pending
+ * entries in order. For each one the kernel posts a completion entry
+ * carrying the caller's tag and the result (the value the equivalent
+ * system call would return, or minus the error code) and advances
+ * sq_head and cq_tail. The process consumes completions by advancing
+ * cq_head.
+ *
+ * Indexes are free-running; entry I of either queue is at
+ * I % ir_entries, and ir_entries must be a power of two no larger
+ * than IORING_MAX_ENTRIES. The kernel stops early rather than
+ * overwrite completions that haven't been consumed.
+ */
+
+#define IORING_MAX_ENTRIES	4096
+
+/* Operations */
+#define IORING_OP_NOP		0	/* do nothing */
+#define IORING_OP_READ		1	/* read(fd, buf, len) or pread */
+#define IORING_OP_WRITE		2	/* write(fd, buf, len) or pwrite */
+#define IORING_OP_OPEN		3	/* open(buf, flags, len) */
+#define IORING_OP_CLOSE		4	/* close(fd) */
+#define IORING_OP_FSYNC		5	/* fsync(fd) */
+
+struct ioring_sqe {
+	off_t sqe_pos;			/* position; -1 for seek position */
+#ifdef _KERNEL
+	userptr_t sqe_ubuf;		/* buffer, or path for OPEN */
+#else
+	void *sqe_buf;			/* buffer, or path for OPEN */
+#endif
+	size_t sqe_len;			/* length, or mode for OPEN */
+	int sqe_op;			/* IORING_OP_* */
+	int sqe_fd;			/* file descriptor */
+	int sqe_flags;			/* open flags for OPEN */
+	unsigned sqe_data;		/* caller's tag */
+};
+
+struct ioring_cqe {
+	unsigned cqe_data;		/* sqe_data of the entry */
+	int cqe_res;			/* result, or -errno */
+};
+
+struct ioring {
+	/* written by the kernel (keep these two first) */
+	unsigned sq_head;		/* next entry the kernel runs */
+	unsigned cq_tail;		/* next completion the kernel posts */
+
+	/* written by the process */
+	unsigned sq_tail;		/* next entry the process fills */
+	unsigned cq_head;		/* next completion to consume */
+	unsigned ir_entries;		/* size of both queues */
+#ifdef _KERNEL
+	userptr_t ir_usqes;
+	userptr_t ir_ucqes;
+#else
+	struct ioring_sqe *ir_sqes;	/* submission queue */
+	struct ioring_cqe *ir_cqes;	/* completion queue */
+#endif
+};
+
+#endif /* _KERN_IORING_H_ */
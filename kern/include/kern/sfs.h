@@ -49,6 +49,9 @@
 #define SFS_FREEMAP_START 2             /* 1st block of the freemap */
 #define SFS_NOINO         0             /* inode # for free dir entry */
 #define SFS_ROOTDIR_INO   1             /* loc'n of the root dir inode */
+#define SFS_LOGBLOCKS     32            /* journal size mksfs creates */
+#define SFS_LOG_MAGIC     0x5f5010c0    /* magic number in journal header */
+#define SFS_LOG_MAXBLOCKS 124           /* most blocks in one transaction */
 
 /* Number of bits in a block */
 #define SFS_BITSPERBLOCK (SFS_BLOCKSIZE * CHAR_BIT)
@@ -74,7 +77,29 @@ struct sfs_superblock {
 	uint32_t sb_magic;		/* Magic number; should be SFS_MAGIC */
 	uint32_t sb_nblocks;			/* Number of blocks in fs */
 	char sb_volname[SFS_VOLNAME_SIZE];	/* Name of this volume */
-	uint32_t reserved[118];			/* unused, set to 0 */
+	uint32_t sb_logstart;			/* 1st block of journal, or 0 */
+	uint32_t sb_lognblocks;			/* Number of journal blocks */
+	uint32_t reserved[116];			/* unused, set to 0 */
+};
+
+/*
+ * On-disk journal header. This lives in the first block of the
+ * journal (sb_logstart); the following blocks hold copies of the
+ * metadata blocks of one transaction, the copy in journal block i+1
+ * belonging in disk block lh_blocks[i].
+ *
+ * A transaction is committed once a header with a nonzero lh_nblocks
+ * and matching lh_sum is on disk. lh_sum is computed over the bytes
+ * of the copies, in order, as sum = sum*31 + byte starting from 0.
+ * Once the copies have been written to their real locations the
+ * header is rewritten with lh_nblocks 0.
+ */
+struct sfs_loghdr {
+	uint32_t lh_magic;			/* Should be SFS_LOG_MAGIC */
+	uint32_t lh_seq;			/* Transaction number */
+	uint32_t lh_nblocks;			/* Blocks logged; 0 if none */
+	uint32_t lh_sum;			/* Checksum of logged blocks */
+	uint32_t lh_blocks[SFS_LOG_MAXBLOCKS];	/* Home locations */
 };
 
 /*
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KHEAPPROF_H_
+#define _KHEAPPROF_H_
+
+/*
+ * Kernel heap profiler.
+ *
+ * When turned on, kmalloc and kfree report each block to the
+ * profiler, which keeps live bytes, peak live bytes and allocation
+ * counts per (call site, size class). Unlike the LABELS debug build,
+ * this needs no recompile and costs one test of a flag per call when
+ * it's off.
+ *
+ * The report is available from the kernel menu (khprof) and by
+ * reading the device kheap:. Writing "on", "off" or "reset" to the
+ * device controls the profiler.
+ *
+ * Functions:
+ *
+ * kheapprof_start  - clear the statistics and start profiling;
+ *                    returns ENOMEM if the tables can't be set up.
+ * kheapprof_stop   - stop profiling; the statistics are kept.
+ * kheapprof_report - format the statistics into a kmalloc'd string
+ *                    and return it (NULL if out of memory); its
+ *                    length goes in *LENRET. The caller frees it.
+ * kheapprof_print  - print the report on the console.
+ *
+ * kheapprof_alloc/free are the hooks called by kmalloc and kfree
+ * when kheapprof_on is set.
+ */
+
+extern volatile bool kheapprof_on;
+
+int kheapprof_start(void);
+void kheapprof_stop(void);
+char *kheapprof_report(size_t *lenret);
+void kheapprof_print(void);
+
+void kheapprof_alloc(void *ptr, size_t class, vaddr_t caller);
+void kheapprof_free(void *ptr);
+
+#endif /* _KHEAPPROF_H_ */
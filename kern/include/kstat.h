@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KSTAT_H_
+#define _KSTAT_H_
+
+/*
+ * Kernel event counters.
+ *
+ * Each cpu keeps its own set in its struct cpu (c_stats) and bumps
+ * them without locking, so an increment can occasionally be lost to
+ * an interrupt or a migration landing in the middle of it; they are
+ * for measurement, not accounting. Before the boot cpu exists nothing
+ * is counted.
+ *
+ * KSTAT_INC/KSTAT_ADD need <current.h> and <cpu.h> where they are
+ * used.
+ *
+ * The counters, summed and per cpu, are available from the kernel
+ * menu (stats) and by reading the device stats:.
+ *
+ * Functions:
+ *
+ * kstat_report - format the counters into a kmalloc'd string and
+ *                return it (NULL if out of memory); its length goes
+ *                in *LENRET. The caller frees it.
+ * kstat_print  - print the report on the console.
+ */
+
+/* Enough for every syscall number in <kern/syscall.h> */
+#define KSTAT_NSYSCALLS		128
+
+/* Kinds of TLB fault: vm_fault's three, plus kernel heap misses */
+#define KSTAT_TLB_READ		0
+#define KSTAT_TLB_WRITE		1
+#define KSTAT_TLB_READONLY	2
+#define KSTAT_TLB_KHEAP		3
+#define KSTAT_NTLB		4
+
+struct kstats {
+	uint32_t ks_syscalls[KSTAT_NSYSCALLS];	/* by call number */
+	uint32_t ks_tlbfaults[KSTAT_NTLB];	/* by KSTAT_TLB_* */
+	uint32_t ks_pagefaults;		/* faults that had to get a page */
+	uint32_t ks_frames;		/* physical pages allocated */
+	uint32_t ks_switches;		/* context switches */
+	uint32_t ks_migrations;		/* threads moved to another cpu */
+	uint32_t ks_sleeps;		/* wchan_sleep calls */
+	uint32_t ks_lockwaits;		/* lock_acquire calls that waited */
+	uint32_t ks_sectreads;		/* disk sectors read */
+	uint32_t ks_sectwrites;		/* disk sectors written */
+	uint32_t ks_cachehits;		/* SFS buffer cache lookups found */
+	uint32_t ks_cachemisses;	/* ... and not found */
+};
+
+#define KSTAT_ADD(field, n) \
+	do { \
+		if (CURCPU_EXISTS()) { \
+			curcpu->c_stats.field += (n); \
+		} \
+	} while (0)
+#define KSTAT_INC(field) KSTAT_ADD(field, 1)
+
+char *kstat_report(size_t *lenret);
+void kstat_print(void);
+
+#endif /* _KSTAT_H_ */
@@ -63,9 +63,15 @@ struct openfile {
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* wrap an already-open vnode (consumes the vnode reference on success) */
+int openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
 
+/* true if the caller's reference is the only one */
+bool openfile_isexclusive(struct openfile *);
+
 
 #endif /* _OPENFILE_H_ */
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Readiness notification, for poll() and select().
+ *
+ * An object that can become readable or writable (a pipe, the
+ * console, a semaphore) embeds a struct pollq. Its vop_poll reports
+ * which of the requested events are ready now and, if it's passed a
+ * poller, registers it on the pollq. Whenever the object's state
+ * changes it calls pollq_wakeup, which wakes every registered poller.
+ *
+ * A struct poller is the state of one poll() or select() call. The
+ * caller clears it with poller_reset, polls each object, and if none
+ * was ready sleeps in poller_wait until some object (or the timeout)
+ * wakes it, then polls again. Registering happens only on the first
+ * pass; poller_cleanup removes all the registrations at the end.
+ *
+ * pollq_wakeup may be called from interrupt handlers. It does nothing
+ * (without locking) if no poller is registered, so it's cheap to call
+ * on every state change; the memory barrier pairs with the lock
+ * release in poller_register so a poller that registers and then
+ * finds the object not ready can't miss the wakeup.
+ */
+
+#include <kern/poll.h>
+#include <spinlock.h>
+#include <clock.h>
+
+struct pollent;
+
+struct pollq {
+	struct spinlock pq_lock;	/* protects pq_ents */
+	struct pollent *pq_ents;	/* registered pollers */
+};
+
+struct poller {
+	struct spinlock pl_lock;	/* protects pl_ready, pl_timedout */
+	struct wchan *pl_wchan;		/* the polling thread sleeps here */
+	bool pl_ready;			/* something happened */
+	bool pl_timedout;		/* the timeout went off */
+	struct timeout pl_timeout;	/* timeout, if any */
+	struct pollent *pl_ents;	/* registrations; owned by poller */
+};
+
+void pollq_init(struct pollq *pq);
+void pollq_cleanup(struct pollq *pq);
+void pollq_wakeup(struct pollq *pq);
+
+int poller_init(struct poller *pl);
+void poller_cleanup(struct poller *pl);
+int poller_register(struct poller *pl, struct pollq *pq);
+void poller_settimeout(struct poller *pl, unsigned ticks);
+void poller_reset(struct poller *pl);
+bool poller_wait(struct poller *pl);
+
+#endif /* _POLL_H_ */
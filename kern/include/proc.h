@@ -64,6 +64,7 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
+	userptr_t p_ioring;		/* ioring_setup() ring, or NULL */
 
 	/* add more material here as needed */
 };
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _RAID_H_
+#define _RAID_H_
+
+/*
+ * Software RAID.
+ *
+ * A RAID set is a block device built from several mountable disks
+ * (usually lhd units). The member disks are claimed with
+ * vfs_claimdev, so they can't be mounted separately while in use,
+ * and the set is added to the VFS as a mountable device of its own
+ * that SFS can be put on like any other disk.
+ *
+ * Levels:
+ *    RAID_STRIPE (0) - blocks are striped across all the disks in
+ *                      units of RAID_STRIPESECTS blocks. The capacity
+ *                      is the sum of the disks.
+ *    RAID_MIRROR (1) - every disk holds a copy of everything. Writes
+ *                      go to all disks; reads go to whichever disk is
+ *                      least busy. A disk that fails an I/O is dropped
+ *                      and the set keeps running on the others.
+ *
+ * raid_create - build a RAID set named NAME at level LEVEL from the
+ *               NDISKS devices named in DISKS. The disks must have
+ *               the same block size; the set is as large as the
+ *               smallest one allows.
+ */
+
+#define RAID_STRIPE		0
+#define RAID_MIRROR		1
+
+#define RAID_MAXDISKS		8
+#define RAID_STRIPESECTS	16
+
+int raid_create(const char *name, int level,
+		unsigned ndisks, char **disks);
+
+#endif /* _RAID_H_ */
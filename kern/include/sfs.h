@@ -56,6 +56,9 @@ struct sfs_vnode {
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	uint32_t sv_ranext;             /* block a sequential read is at */
+	uint32_t sv_rawindow;           /* read-ahead window (blocks) */
+	uint32_t sv_raend;              /* end of blocks already prefetched */
 };
 
 /*
@@ -68,7 +71,9 @@ struct sfs_fs {
 	struct device *sfs_device;      /* device mounted on */
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
-	bool sfs_freemapdirty;          /* true if freemap modified */
+	struct bitmap *sfs_freemapdirty; /* freemap blocks modified */
+	struct sfs_cache *sfs_cache;    /* data block cache and I/O thread */
+	struct sfs_log *sfs_log;        /* metadata journal, if any */
 };
 
 /*
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+/*
+ * Slab allocator for fixed-size kernel objects.
+ *
+ * A kmem_cache hands out objects of one size. Objects are carved out
+ * of whole pages ("slabs"); each page's bookkeeping lives in a table
+ * indexed by physical page number, so finding the slab an object
+ * belongs to is a single lookup. kmalloc uses a cache per size class
+ * for small allocations; hot kernel objects (threads, processes, open
+ * files, vnodes, page tables) have caches of their own.
+ *
+ * Each CPU keeps a magazine of free objects for each cache, and the
+ * common case of kmem_cache_alloc and kmem_cache_free just pops or
+ * pushes the magazine with interrupts off, without taking any lock.
+ * Only when the magazine runs empty or fills up is the cache's lock
+ * taken to move a batch of objects to or from the slabs.
+ *
+ * A cache may have a constructor, which is run on each object when
+ * its slab is created, and a destructor, which is run when the slab
+ * is given back. Objects must be freed in their constructed state;
+ * allocating one skips the work the constructor did. The constructor
+ * returns an error code; if it fails, the allocation fails.
+ *
+ * Caches are declared statically with KMEM_CACHE_INITIALIZER and need
+ * no setup beyond kmem_bootstrap() at boot; they're never destroyed.
+ */
+
+#include <spinlock.h>
+#include <platform/maxcpus.h>
+
+struct slab;
+struct kmem_mag;
+
+struct kmem_cache {
+	const char *kc_name;		/* name, for statistics */
+	size_t kc_size;			/* object size requested */
+	int (*kc_ctor)(void *obj);	/* constructor, or NULL */
+	void (*kc_dtor)(void *obj);	/* destructor, or NULL */
+	bool kc_nomag;			/* no per-CPU magazines */
+
+	struct spinlock kc_lock;	/* protects the rest */
+	size_t kc_objsize;		/* bytes per object, 0 until set up */
+	size_t kc_linkoff;		/* where the free list link goes */
+	unsigned kc_perslab;		/* objects per slab */
+	struct slab *kc_partial;	/* slabs with free objects */
+	unsigned kc_nslabs;		/* total slabs */
+	unsigned kc_nfree;		/* free objects in the slabs */
+	struct kmem_cache *kc_next;	/* on the list of all caches */
+
+	struct kmem_mag *kc_mags[MAXCPUS]; /* per-CPU magazines */
+};
+
+#define KMEM_CACHE_INITIALIZER(name, size, ctor, dtor) \
+	{ (name), (size), (ctor), (dtor), false, SPINLOCK_INITIALIZER, \
+	  0, 0, 0, NULL, 0, 0, NULL, { NULL } }
+
+/*
+ * Functions:
+ *
+ * kmem_bootstrap   - set up the page table; call once after
+ *                    ram_bootstrap and before any allocation.
+ * kmem_cache_alloc - get an object, or NULL if out of memory.
+ * kmem_cache_free  - give an object back to the cache it came from.
+ * kmem_free        - give an object back to whatever cache it came
+ *                    from; returns -1 if it isn't a slab object.
+ * kmem_printstats  - print per-cache statistics.
+ */
+void kmem_bootstrap(void);
+void *kmem_cache_alloc(struct kmem_cache *kc);
+void kmem_cache_free(struct kmem_cache *kc, void *obj);
+int kmem_free(void *obj);
+void kmem_printstats(void);
+
+#endif /* _SLAB_H_ */
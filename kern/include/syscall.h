@@ -74,8 +74,17 @@ int sys_getpid(pid_t *retval);
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
+int sys_pipe(userptr_t fds);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	       int *retval);
+int sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+		int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
 
 int sys_chdir(const_userptr_t path);
@@ -92,4 +101,11 @@ int sys_fstat(int fd, userptr_t statptr);
 int sys_fsync(int fd);
 int sys_ftruncate(int fd, off_t len);
 
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys_select(int nfds, userptr_t readfds, userptr_t writefds,
+	       userptr_t exceptfds, userptr_t timeout, int *retval);
+
+int sys_ioring_setup(userptr_t ring);
+int sys_ioring_enter(unsigned to_submit, int *retval);
+
 #endif /* _SYSCALL_H_ */
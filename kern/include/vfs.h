@@ -81,6 +81,27 @@ int vfs_lookup(char *path, struct vnode **result);
 int vfs_lookparent(char *path, struct vnode **result,
 		   char *buf, size_t buflen);
 
+/*
+ * Name cache used by vfs_lookup and vfs_lookparent (vfsdcache.c).
+ *
+ *    vfs_dcache_lookup  - Look up NAME in DIR. Returns true on a hit,
+ *                         with *RESULT set to an incref'd vnode, or to
+ *                         NULL if the name is known not to exist.
+ *    vfs_dcache_enter   - Record that NAME in DIR is VN (NULL for "does
+ *                         not exist").
+ *    vfs_dcache_remove  - Invalidate NAME in DIR. Must be called by
+ *                         anything that creates, removes, or renames
+ *                         NAME, after doing so.
+ *    vfs_dcache_purgefs - Drop all entries for FS (before unmount).
+ */
+
+void vfs_dcache_bootstrap(void);
+bool vfs_dcache_lookup(struct vnode *dir, const char *name,
+		       struct vnode **result);
+void vfs_dcache_enter(struct vnode *dir, const char *name, struct vnode *vn);
+void vfs_dcache_remove(struct vnode *dir, const char *name);
+void vfs_dcache_purgefs(struct fs *fs);
+
 /*
  * VFS layer high-level operations on pathnames
  * Because lookup may destroy pathnames, these all may too.
@@ -163,6 +184,13 @@ int vfs_getcwd(struct uio *buf);
  *                    previously returned by vfs_swapon should be
  *                    decref'd first. Similar to vfs_unmount.
  *
+ *    vfs_claimdev  - Look up DEVNAME and mark it as in use by another
+ *                    device (e.g. a RAID set), returning the raw
+ *                    device vnode. It can then no longer be mounted.
+ *
+ *    vfs_releasedev - Undo vfs_claimdev. The vnode should be decref'd
+ *                    first.
+ *
  *    vfs_unmountall - Unmount all mounted filesystems.
  */
 
@@ -181,6 +209,8 @@ int vfs_mount(const char *devname, void *data,
 int vfs_unmount(const char *devname);
 int vfs_swapon(const char *devname, struct vnode **result);
 int vfs_swapoff(const char *devname);
+int vfs_claimdev(const char *devname, struct vnode **result);
+int vfs_releasedev(const char *devname);
 int vfs_unmountall(void);
 
 /*
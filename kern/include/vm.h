@@ -55,6 +55,18 @@ int vm_fault(int faulttype, vaddr_t faultaddress);
 vaddr_t alloc_kpages(unsigned npages);
 void free_kpages(vaddr_t addr);
 
+/*
+ * Kernel virtual memory arena (machine-dependent): virtually
+ * contiguous kernel pages backed by non-contiguous frames, for large
+ * kmalloc blocks. free_kvpages returns -1 if the address isn't in the
+ * arena; kvmem_fault handles kernel TLB misses on it.
+ */
+void kvmem_bootstrap(void);
+vaddr_t alloc_kvpages(unsigned npages);
+int free_kvpages(vaddr_t addr);
+int kvmem_fault(vaddr_t faultaddress);
+void kvmem_printstats(void);
+
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
 
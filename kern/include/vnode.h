@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct poller;
 
 
 /*
@@ -131,6 +132,12 @@ struct vnode {
  *                      of the file and copy to the specified
  *                      uio. Need not work on objects that are not
  *                      directories.
+ *    vop_poll        - Report in REVENTS which of the POLL* EVENTS
+ *                      could be done now without blocking. If POLLER
+ *                      is not NULL, first register it with
+ *                      poller_register so it's woken when that may
+ *                      change. Objects that never block can use
+ *                      vnode_poll_ready.
  *
  *****************************************
  *
@@ -196,6 +203,8 @@ struct vnode_ops {
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
 	int (*vop_namefile)(struct vnode *file, struct uio *uio);
+	int (*vop_poll)(struct vnode *object, int events,
+			struct poller *poller, int *revents);
 
 
 	int (*vop_creat)(struct vnode *dir,
@@ -240,6 +249,7 @@ struct vnode_ops {
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
+#define VOP_POLL(vn, ev, pl, rev)       (__VOP(vn, poll)(vn, ev, pl, rev))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
 #define VOP_SYMLINK(vn, name, content)  (__VOP(vn, symlink)(vn, name, content))
@@ -279,6 +289,13 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * Common vop_poll for objects that are always ready, like regular
+ * files and directories.
+ */
+int vnode_poll_ready(struct vnode *vn, int events, struct poller *poller,
+		     int *revents);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
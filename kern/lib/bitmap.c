@@ -47,11 +47,77 @@
 #define WORD_TYPE       unsigned char
 #define WORD_ALLBITS    (0xff)
 
+/*
+ * Summary words. Bit i of summary word s is set when data word
+ * s*SUMMARY_BITS+i is completely full (or past the end), so the
+ * allocators can skip a full data word by looking at one summary
+ * bit, and SUMMARY_BITS of them at once by looking at one summary
+ * word. The summary never goes to disk, so its word size doesn't
+ * matter.
+ */
+#define SUMMARY_BITS    32
+#define SUMMARY_TYPE    uint32_t
+#define SUMMARY_ALLBITS (0xffffffff)
+
 struct bitmap {
         unsigned nbits;
+        unsigned nwords;
+        unsigned nfree;         /* number of clear bits */
+        unsigned hint;          /* next-fit cursor (word index) */
         WORD_TYPE *v;
+        SUMMARY_TYPE *summary;
 };
 
+static
+inline
+void
+bitmap_updatesummary(struct bitmap *b, unsigned ix)
+{
+        SUMMARY_TYPE mask = ((SUMMARY_TYPE)1) << (ix % SUMMARY_BITS);
+
+        if (b->v[ix] == WORD_ALLBITS) {
+                b->summary[ix / SUMMARY_BITS] |= mask;
+        }
+        else {
+                b->summary[ix / SUMMARY_BITS] &= ~mask;
+        }
+}
+
+/*
+ * Find the first data word at or after STARTIX that has a clear bit.
+ */
+static
+int
+bitmap_findword(struct bitmap *b, unsigned startix, unsigned *ret)
+{
+        unsigned s, bit, nsummary;
+        SUMMARY_TYPE sw;
+
+        if (startix >= b->nwords) {
+                return ENOSPC;
+        }
+        nsummary = DIVROUNDUP(b->nwords, SUMMARY_BITS);
+
+        /* Pretend the words before STARTIX are full */
+        s = startix / SUMMARY_BITS;
+        sw = b->summary[s] |
+                ((((SUMMARY_TYPE)1) << (startix % SUMMARY_BITS)) - 1);
+
+        while (sw == SUMMARY_ALLBITS) {
+                s++;
+                if (s >= nsummary) {
+                        return ENOSPC;
+                }
+                sw = b->summary[s];
+        }
+
+        for (bit = 0; sw & (((SUMMARY_TYPE)1) << bit); bit++) {
+                /* nothing */
+        }
+        *ret = s*SUMMARY_BITS + bit;
+        KASSERT(*ret < b->nwords);
+        return 0;
+}
 
 struct bitmap *
 bitmap_create(unsigned nbits)
@@ -69,9 +135,17 @@ bitmap_create(unsigned nbits)
                 kfree(b);
                 return NULL;
         }
+        b->summary = kmalloc(DIVROUNDUP(words, SUMMARY_BITS) *
+                             sizeof(SUMMARY_TYPE));
+        if (b->summary == NULL) {
+                kfree(b->v);
+                kfree(b);
+                return NULL;
+        }
 
         bzero(b->v, words*sizeof(WORD_TYPE));
         b->nbits = nbits;
+        b->nwords = words;
 
         /* Mark any leftover bits at the end in use */
         if (words > nbits / BITS_PER_WORD) {
@@ -86,6 +160,7 @@ bitmap_create(unsigned nbits)
                 }
         }
 
+        bitmap_resync(b);
         return b;
 }
 
@@ -95,31 +170,222 @@ bitmap_getdata(struct bitmap *b)
         return b->v;
 }
 
+/*
+ * Recompute the summary words and free count from the raw bits.
+ */
+void
+bitmap_resync(struct bitmap *b)
+{
+        unsigned ix, j, nsummary;
+
+        nsummary = DIVROUNDUP(b->nwords, SUMMARY_BITS);
+        bzero(b->summary, nsummary * sizeof(SUMMARY_TYPE));
+
+        /* Words past the end don't exist; call them full */
+        for (ix = b->nwords; ix < nsummary * SUMMARY_BITS; ix++) {
+                b->summary[ix / SUMMARY_BITS] |=
+                        ((SUMMARY_TYPE)1) << (ix % SUMMARY_BITS);
+        }
+
+        b->nfree = 0;
+        for (ix = 0; ix < b->nwords; ix++) {
+                bitmap_updatesummary(b, ix);
+                for (j = 0; j < BITS_PER_WORD; j++) {
+                        if ((b->v[ix] & ((WORD_TYPE)1 << j)) == 0) {
+                                b->nfree++;
+                        }
+                }
+        }
+        b->hint = 0;
+}
+
+/*
+ * Take the lowest clear bit at or above bit FIRSTOFFSET of word IX,
+ * if there is one.
+ */
+static
+int
+bitmap_allocword(struct bitmap *b, unsigned ix, unsigned firstoffset,
+                 unsigned *index)
+{
+        unsigned offset;
+
+        for (offset = firstoffset; offset < BITS_PER_WORD; offset++) {
+                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
+
+                if ((b->v[ix] & mask)==0) {
+                        b->v[ix] |= mask;
+                        *index = (ix*BITS_PER_WORD)+offset;
+                        KASSERT(*index < b->nbits);
+                        KASSERT(b->nfree > 0);
+                        b->nfree--;
+                        bitmap_updatesummary(b, ix);
+                        return 0;
+                }
+        }
+        return ENOSPC;
+}
+
+/*
+ * Next-fit: start looking where the last allocation left off, so
+ * repeated allocations don't rescan the (full) front of the map.
+ */
 int
 bitmap_alloc(struct bitmap *b, unsigned *index)
 {
         unsigned ix;
-        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-        unsigned offset;
+        int result;
+
+        if (b->nfree == 0) {
+                return ENOSPC;
+        }
+
+        result = bitmap_findword(b, b->hint, &ix);
+        if (result) {
+                /* Nothing past the cursor; wrap around */
+                result = bitmap_findword(b, 0, &ix);
+                KASSERT(result == 0);
+        }
+        b->hint = ix;
+
+        result = bitmap_allocword(b, ix, 0, index);
+        KASSERT(result == 0);
+        return 0;
+}
 
-        for (ix=0; ix<maxix; ix++) {
-                if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
+int
+bitmap_alloc_near(struct bitmap *b, unsigned goal, unsigned *index)
+{
+        unsigned startix, ix;
+        int result;
+
+        if (b->nfree == 0) {
+                return ENOSPC;
+        }
 
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        KASSERT(*index < b->nbits);
+        if (goal >= b->nbits) {
+                goal = 0;
+        }
+        startix = goal / BITS_PER_WORD;
+
+        /* First the rest of the word the goal is in... */
+        if (bitmap_allocword(b, startix, goal % BITS_PER_WORD, index)==0) {
+                return 0;
+        }
+
+        /* ...then the following words, wrapping around to startix. */
+        result = bitmap_findword(b, startix + 1, &ix);
+        if (result) {
+                result = bitmap_findword(b, 0, &ix);
+                KASSERT(result == 0);
+        }
+
+        result = bitmap_allocword(b, ix, 0, index);
+        KASSERT(result == 0);
+        return 0;
+}
+
+/*
+ * Look for N consecutive clear bits starting at or after bit START
+ * and ending before bit LIMIT. Full words are skipped using the
+ * summary and empty words are taken whole.
+ */
+static
+int
+bitmap_findrun(struct bitmap *b, unsigned start, unsigned limit,
+               unsigned n, unsigned *ret)
+{
+        unsigned pos, ix, run, runstart;
+        WORD_TYPE mask;
+
+        run = 0;
+        runstart = start;
+        pos = start;
+        while (pos < limit) {
+                ix = pos / BITS_PER_WORD;
+                if (pos % BITS_PER_WORD == 0) {
+                        if (b->v[ix] == WORD_ALLBITS) {
+                                run = 0;
+                                if (bitmap_findword(b, ix, &ix)) {
+                                        return ENOSPC;
+                                }
+                                pos = ix * BITS_PER_WORD;
+                                continue;
+                        }
+                        if (b->v[ix] == 0 && pos + BITS_PER_WORD <= limit) {
+                                if (run == 0) {
+                                        runstart = pos;
+                                }
+                                run += BITS_PER_WORD;
+                                pos += BITS_PER_WORD;
+                                if (run >= n) {
+                                        *ret = runstart;
                                         return 0;
                                 }
+                                continue;
                         }
-                        KASSERT(0);
                 }
+
+                mask = ((WORD_TYPE)1) << (pos % BITS_PER_WORD);
+                if (b->v[ix] & mask) {
+                        run = 0;
+                }
+                else {
+                        if (run == 0) {
+                                runstart = pos;
+                        }
+                        run++;
+                        if (run == n) {
+                                *ret = runstart;
+                                return 0;
+                        }
+                }
+                pos++;
         }
         return ENOSPC;
 }
 
+int
+bitmap_alloc_run(struct bitmap *b, unsigned goal, unsigned n,
+                 unsigned *index)
+{
+        unsigned start, limit, i;
+        int result;
+
+        KASSERT(n > 0);
+        if (n > b->nfree) {
+                return ENOSPC;
+        }
+        if (goal >= b->nbits) {
+                goal = 0;
+        }
+
+        result = bitmap_findrun(b, goal, b->nbits, n, &start);
+        if (result && goal > 0) {
+                /* Wrap around; runs don't, so stop short of the goal */
+                limit = goal + n - 1;
+                if (limit > b->nbits) {
+                        limit = b->nbits;
+                }
+                result = bitmap_findrun(b, 0, limit, n, &start);
+        }
+        if (result) {
+                return result;
+        }
+
+        for (i=0; i<n; i++) {
+                bitmap_mark(b, start + i);
+        }
+        *index = start;
+        return 0;
+}
+
+unsigned
+bitmap_nfree(struct bitmap *b)
+{
+        return b->nfree;
+}
+
 static
 inline
 void
@@ -142,6 +408,8 @@ bitmap_mark(struct bitmap *b, unsigned index)
 
         KASSERT((b->v[ix] & mask)==0);
         b->v[ix] |= mask;
+        b->nfree--;
+        bitmap_updatesummary(b, ix);
 }
 
 void
@@ -155,6 +423,8 @@ bitmap_unmark(struct bitmap *b, unsigned index)
 
         KASSERT((b->v[ix] & mask)!=0);
         b->v[ix] &= ~mask;
+        b->nfree++;
+        bitmap_updatesummary(b, ix);
 }
 
 
@@ -171,6 +441,7 @@ bitmap_isset(struct bitmap *b, unsigned index)
 void
 bitmap_destroy(struct bitmap *b)
 {
+        kfree(b->summary);
         kfree(b->v);
         kfree(b);
 }
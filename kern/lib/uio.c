@@ -35,11 +35,13 @@
 #include <copyinout.h>
 
 /*
- * See uio.h for a description.
+ * Common code for uiomove and uiomovezeros. If ZEROS is set, PTR is
+ * ignored and the destination is zero-filled instead, without going
+ * through a buffer of zeros.
  */
-
+static
 int
-uiomove(void *ptr, size_t n, struct uio *uio)
+uio_transfer(void *ptr, size_t n, struct uio *uio, bool zeros)
 {
 	struct iovec *iov;
 	size_t size;
@@ -82,7 +84,10 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 
 		switch (uio->uio_segflg) {
 		    case UIO_SYSSPACE:
-			    if (uio->uio_rw == UIO_READ) {
+			    if (zeros) {
+				    bzero(iov->iov_kbase, size);
+			    }
+			    else if (uio->uio_rw == UIO_READ) {
 				    memmove(iov->iov_kbase, ptr, size);
 			    }
 			    else {
@@ -92,7 +97,10 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 			    break;
 		    case UIO_USERSPACE:
 		    case UIO_USERISPACE:
-			    if (uio->uio_rw == UIO_READ) {
+			    if (zeros) {
+				    result = copyoutzeros(iov->iov_ubase, size);
+			    }
+			    else if (uio->uio_rw == UIO_READ) {
 				    result = copyout(ptr, iov->iov_ubase,size);
 			    }
 			    else {
@@ -111,37 +119,32 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 		iov->iov_len -= size;
 		uio->uio_resid -= size;
 		uio->uio_offset += size;
-		ptr = ((char *)ptr + size);
+		if (!zeros) {
+			ptr = ((char *)ptr + size);
+		}
 		n -= size;
 	}
 
 	return 0;
 }
 
+/*
+ * See uio.h for a description.
+ */
+
 int
-uiomovezeros(size_t n, struct uio *uio)
+uiomove(void *ptr, size_t n, struct uio *uio)
 {
-	/* static, so initialized as zero */
-	static char zeros[16];
-	size_t amt;
-	int result;
+	return uio_transfer(ptr, n, uio, false);
+}
 
+int
+uiomovezeros(size_t n, struct uio *uio)
+{
 	/* This only makes sense when reading */
 	KASSERT(uio->uio_rw == UIO_READ);
 
-	while (n > 0) {
-		amt = sizeof(zeros);
-		if (amt > n) {
-			amt = n;
-		}
-		result = uiomove(zeros, amt, uio);
-		if (result) {
-			return result;
-		}
-		n -= amt;
-	}
-
-	return 0;
+	return uio_transfer(NULL, n, uio, true);
 }
 
 /*
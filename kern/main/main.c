@@ -43,6 +43,7 @@
 #include <current.h>
 #include <synch.h>
 #include <vm.h>
+#include <slab.h>
 #include <mainbus.h>
 #include <vfs.h>
 #include <device.h>
@@ -109,6 +110,8 @@ boot(void)
 
 	/* Early initialization. */
 	ram_bootstrap();
+	kmem_bootstrap();
+	kvmem_bootstrap();
 	proc_bootstrap();
 	thread_bootstrap();
 	pid_bootstrap();
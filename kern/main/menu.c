@@ -41,12 +41,18 @@
 #include <thread.h>
 #include <proc.h>
 #include <vfs.h>
+#include <fs.h>
+#include <device.h>
 #include <sfs.h>
 #include <pid.h>
 #include <syscall.h>
 #include <test.h>
+#include <kheapprof.h>
+#include <kstat.h>
+#include <raid.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-tmpfs.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -377,6 +383,9 @@ static const struct {
 #if OPT_SFS
 	{ "sfs", sfs_mount },
 #endif
+#if OPT_TMPFS
+	{ "tmpfs", tmpfs_mount },
+#endif
 };
 
 static
@@ -430,6 +439,71 @@ cmd_unmount(int nargs, char **args)
 	return vfs_unmount(device);
 }
 
+/*
+ * Command for building a software RAID set out of disks, e.g.
+ * "raid 0 raid0 lhd1 lhd2" to stripe across lhd1 and lhd2. The set
+ * can then be mounted like a disk.
+ */
+static
+int
+cmd_raid(int nargs, char **args)
+{
+	int level;
+
+	if (nargs < 5) {
+		kprintf("Usage: raid 0|1 name disk: disk: ...\n");
+		return EINVAL;
+	}
+
+	if (!strcmp(args[1], "0")) {
+		level = RAID_STRIPE;
+	}
+	else if (!strcmp(args[1], "1")) {
+		level = RAID_MIRROR;
+	}
+	else {
+		kprintf("raid: level must be 0 (stripe) or 1 (mirror)\n");
+		return EINVAL;
+	}
+
+	/* Allow (but do not require) colon after the set name */
+	if (args[2][strlen(args[2])-1]==':') {
+		args[2][strlen(args[2])-1] = 0;
+	}
+
+	return raid_create(args[2], level, nargs - 3, &args[3]);
+}
+
+/*
+ * Command for creating a RAM disk, e.g. "ramdisk ram0 512" for a
+ * 512K disk that can be formatted with mksfs via ram0raw: and then
+ * mounted.
+ */
+static
+int
+cmd_ramdisk(int nargs, char **args)
+{
+	int kbytes;
+
+	if (nargs != 3) {
+		kprintf("Usage: ramdisk name kbytes\n");
+		return EINVAL;
+	}
+
+	/* Allow (but do not require) colon after the name */
+	if (args[1][strlen(args[1])-1]==':') {
+		args[1][strlen(args[1])-1] = 0;
+	}
+
+	kbytes = atoi(args[2]);
+	if (kbytes <= 0 || (size_t)kbytes > (size_t)-1 / 1024) {
+		kprintf("ramdisk: bad size %s\n", args[2]);
+		return EINVAL;
+	}
+
+	return ramdisk_create(args[1], (size_t)kbytes * 1024);
+}
+
 /*
  * Command to set the "boot fs".
  *
@@ -500,6 +574,43 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_kheapprof(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 1) {
+		kheapprof_print();
+	}
+	else if (nargs == 2 &&
+		 (!strcmp(args[1], "on") || !strcmp(args[1], "reset"))) {
+		result = kheapprof_start();
+		if (result) {
+			kprintf("khprof: %s\n", strerror(result));
+		}
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		kheapprof_stop();
+	}
+	else {
+		kprintf("Usage: khprof [on|off|reset]\n");
+	}
+
+	return 0;
+}
+
+static
+int
+cmd_kstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kstat_print();
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -534,6 +645,8 @@ static const char *opsmenu[] = {
 	"[p]       Other program             ",
 	"[mount]   Mount a filesystem        ",
 	"[unmount] Unmount a filesystem      ",
+	"[raid]    Build a RAID set          ",
+	"[ramdisk] Create a RAM disk         ",
 	"[bootfs]  Set \"boot\" filesystem     ",
 	"[pf]      Print a file              ",
 	"[cd]      Change directory          ",
@@ -566,6 +679,7 @@ static const char *testmenu[] = {
 	"[km2] kmalloc stress test           ",
 	"[km3] Large kmalloc test            ",
 	"[km4] Multipage kmalloc test        ",
+	"[km5] Fragmented multipage kmalloc  ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
@@ -606,6 +720,8 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[khprof] Kernel heap profile        ",
+	"[stats] Kernel event counters       ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -641,6 +757,8 @@ static struct {
 	{ "p",		cmd_prog },
 	{ "mount",	cmd_mount },
 	{ "unmount",	cmd_unmount },
+	{ "raid",	cmd_raid },
+	{ "ramdisk",	cmd_ramdisk },
 	{ "bootfs",	cmd_bootfs },
 	{ "pf",		printfile },
 	{ "cd",		cmd_chdir },
@@ -657,6 +775,8 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "khprof",     cmd_kheapprof },
+	{ "stats",      cmd_kstats },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -667,6 +787,7 @@ static struct {
 	{ "km2",	kmallocstress },
 	{ "km3",	kmalloctest3 },
 	{ "km4",	kmalloctest4 },
+	{ "km5",	kmalloctest5 },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
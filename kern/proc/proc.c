@@ -52,12 +52,19 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <slab.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
 struct proc *kproc;
 
+/*
+ * Allocator for proc structures.
+ */
+static struct kmem_cache proc_cache =
+	KMEM_CACHE_INITIALIZER("proc", sizeof(struct proc), NULL, NULL);
+
 /*
  * Create a proc structure.
  */
@@ -67,20 +74,20 @@ proc_create(const char *name)
 {
 	struct proc *proc;
 
-	proc = kmalloc(sizeof(*proc));
+	proc = kmem_cache_alloc(&proc_cache);
 	if (proc == NULL) {
 		return NULL;
 	}
 	proc->p_name = kstrdup(name);
 	if (proc->p_name == NULL) {
-		kfree(proc);
+		kmem_cache_free(&proc_cache, proc);
 		return NULL;
 	}
 
 	proc->p_threadslock = lock_create("p_threads");
 	if (proc->p_threadslock == NULL) {
 		kfree(proc->p_name);
-		kfree(proc);
+		kmem_cache_free(&proc_cache, proc);
 		return NULL;
 	}
 	threadarray_init(&proc->p_threads);
@@ -94,6 +101,7 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
+	proc->p_ioring = NULL;
 
 	return proc;
 }
@@ -188,7 +196,7 @@ proc_destroy(struct proc *proc)
 	lock_destroy(proc->p_threadslock);
 
 	kfree(proc->p_name);
-	kfree(proc);
+	kmem_cache_free(&proc_cache, proc);
 }
 
 /*
@@ -327,6 +335,8 @@ proc_fork(struct proc **ret)
 		VOP_INCREF(curproc->p_cwd);
 		newproc->p_cwd = curproc->p_cwd;
 	}
+	/* The address space was copied, so the ring is at the same place */
+	newproc->p_ioring = curproc->p_ioring;
 	spinlock_release(&curproc->p_lock);
 
 	*ret = newproc;
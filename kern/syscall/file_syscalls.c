@@ -35,8 +35,10 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <kern/limits.h>
+#include <kern/iovec.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
+#include <limits.h>
 #include <lib.h>
 #include <uio.h>
 #include <proc.h>
@@ -46,6 +48,7 @@
 #include <vfs.h>
 #include <vnode.h>
 #include <openfile.h>
+#include <pipe.h>
 #include <filetable.h>
 #include <syscall.h>
 
@@ -104,33 +107,67 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 	return 0;
 }
 
+/* Largest total transfer, since the count is returned as a ssize_t */
+#define RW_MAXSIZE ((size_t)-1 >> 1)
+
 /*
- * Common logic for read and write.
+ * Common logic for all the read and write calls.
+ *
+ * IOV/IOVCNT describe the user's buffers, already in kernel memory.
+ * If POSITIONAL is false, the I/O happens at the file's seek position,
+ * which is locked for the duration (unless the open file isn't shared,
+ * which is the usual case) and updated afterwards. Otherwise
+ * it happens at POS and the seek position is neither used nor locked,
+ * so positional I/O on a shared open file does not serialize.
  *
  * Look up the fd, then use VOP_READ or VOP_WRITE.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
+sys_readwrite(int fd, struct iovec *iov, unsigned iovcnt,
+	      bool positional, off_t pos, enum uio_rw rw,
 	      int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
-	bool locked;
-	off_t pos;
-	struct iovec iov;
+	bool useoffset, locked;
 	struct uio useruio;
+	size_t size;
+	unsigned i;
 	int result;
 
+	/* add up the buffer sizes; the total has to fit in the result */
+	size = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > RW_MAXSIZE - size) {
+			return EINVAL;
+		}
+		size += iov[i].iov_len;
+	}
+
 	/* better be a valid file descriptor */
 	result = filetable_get(curproc->p_filetable, fd, &file);
 	if (result) {
 		return result;
 	}
 
-	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
-		lock_acquire(file->of_offsetlock);
+	/*
+	 * Only lock the seek position if we're really using it and
+	 * someone else could be too.
+	 */
+	useoffset = false;
+	locked = false;
+	if (positional) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			result = ESPIPE;
+			goto fail;
+		}
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		useoffset = true;
+		if (!openfile_isexclusive(file)) {
+			lock_acquire(file->of_offsetlock);
+			locked = true;
+		}
 		pos = file->of_offset;
 	}
 	else {
@@ -142,8 +179,14 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	/* set up a uio with the buffers, their size, and the offset */
+	useruio.uio_iov = iov;
+	useruio.uio_iovcnt = iovcnt;
+	useruio.uio_offset = pos;
+	useruio.uio_resid = size;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = proc_getas();
 
 	/* do the read or write */
 	result = (rw == UIO_READ) ?
@@ -153,9 +196,11 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	if (locked) {
+	if (useoffset) {
 		/* set the offset to the updated offset in the uio */
 		file->of_offset = useruio.uio_offset;
+	}
+	if (locked) {
 		lock_release(file->of_offsetlock);
 	}
 
@@ -177,13 +222,61 @@ fail:
 	return result;
 }
 
+/*
+ * Common logic for the vectored calls: copy in the user's iovec
+ * array and hand it to sys_readwrite. Short arrays (the usual case)
+ * are kept on the stack.
+ */
+#define SMALL_IOVCNT 8
+
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt,
+	       bool positional, off_t pos, enum uio_rw rw,
+	       int badaccmode, ssize_t *retval)
+{
+	struct iovec smalliov[SMALL_IOVCNT];
+	struct iovec *iov;
+	int result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= SMALL_IOVCNT) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result == 0) {
+		result = sys_readwrite(fd, iov, iovcnt, positional, pos,
+				       rw, badaccmode, retval);
+	}
+
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, false, 0,
+			     UIO_READ, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +285,95 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, false, 0,
+			     UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pread() - read at an explicit position, leaving the seek position
+ * alone.
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	if (pos < 0) {
+		return EINVAL;
+	}
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, true, pos,
+			     UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - write at an explicit position.
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	if (pos < 0) {
+		return EINVAL;
+	}
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, true, pos,
+			     UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * readv() - scatter read; use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, false, 0,
+			      UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - gather write; use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, false, 0,
+			      UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * preadv() - scatter read at an explicit position.
+ */
+int
+sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	   int *retval)
+{
+	if (pos < 0) {
+		return EINVAL;
+	}
+	return sys_readwritev(fd, iov, iovcnt, true, pos,
+			      UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwritev() - gather write at an explicit position.
+ */
+int
+sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos,
+	    int *retval)
+{
+	if (pos < 0) {
+		return EINVAL;
+	}
+	return sys_readwritev(fd, iov, iovcnt, true, pos,
+			      UIO_WRITE, O_RDONLY, retval);
 }
 
 /*
@@ -224,6 +405,61 @@ sys_close(int fd)
 	return 0;
 }
 
+/*
+ * pipe() - make a pipe and put its two ends in the file table.
+ */
+int
+sys_pipe(userptr_t fdsptr)
+{
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile, *junk;
+	int fds[2];
+	int result;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return result;
+	}
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return result;
+	}
+
+	result = filetable_place(curproc->p_filetable, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(curproc->p_filetable, writefile, &fds[1]);
+	if (result) {
+		filetable_placeat(curproc->p_filetable, NULL, fds[0], &junk);
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		filetable_placeat(curproc->p_filetable, NULL, fds[0], &junk);
+		filetable_placeat(curproc->p_filetable, NULL, fds[1], &junk);
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	return 0;
+}
+
 /*
  * lseek() - manipulate the seek position.
  */
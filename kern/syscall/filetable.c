@@ -45,17 +45,15 @@ struct filetable *
 filetable_create(void)
 {
 	struct filetable *ft;
-	int fd;
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
 		return NULL;
 	}
 
-	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
-	}
+	/* the table starts empty; the slots themselves needn't be cleared */
+	ft->ft_used = 0;
+	ft->ft_lowfree = 0;
 
 	return ft;
 }
@@ -66,12 +64,12 @@ filetable_create(void)
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
+	unsigned fd;
 
 	KASSERT(ft != NULL);
 
 	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; fd < ft->ft_used; fd++) {
 		if (ft->ft_openfiles[fd] != NULL) {
 			openfile_decref(ft->ft_openfiles[fd]);
 			ft->ft_openfiles[fd] = NULL;
@@ -100,7 +98,7 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
 	struct openfile *file;
-	int fd;
+	unsigned fd;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -114,13 +112,15 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 	}
 
 	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; fd < src->ft_used; fd++) {
 		file = src->ft_openfiles[fd];
 		if (file != NULL) {
 			openfile_incref(file);
 		}
 		dest->ft_openfiles[fd] = file;
 	}
+	dest->ft_used = src->ft_used;
+	dest->ft_lowfree = src->ft_lowfree;
 
 	*dest_ret = dest;
 	return 0;
@@ -151,7 +151,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
 	struct openfile *file;
 
-	if (!filetable_okfd(ft, fd)) {
+	if (!filetable_okfd(ft, fd) || (unsigned)fd >= ft->ft_used) {
 		return EBADF;
 	}
 
@@ -184,6 +184,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
+	KASSERT((unsigned)fd < ft->ft_used);
 	KASSERT(ft->ft_openfiles[fd] == file);
 }
 
@@ -200,17 +201,25 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	unsigned fd;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	/* Everything below ft_lowfree is in use, so start there. */
+	for (fd = ft->ft_lowfree; fd < ft->ft_used; fd++) {
 		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
+			break;
+		}
+	}
+	if (fd == ft->ft_used) {
+		if (fd == OPEN_MAX) {
+			return EMFILE;
 		}
+		ft->ft_used++;
 	}
 
-	return EMFILE;
+	ft->ft_openfiles[fd] = file;
+	ft->ft_lowfree = fd + 1;
+	*fd_ret = fd;
+	return 0;
 }
 
 /*
@@ -232,6 +241,31 @@ filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 {
 	KASSERT(filetable_okfd(ft, fd));
 
+	if ((unsigned)fd >= ft->ft_used) {
+		/* Beyond the valid slots; grow over the gap if needed. */
+		*oldfile_ret = NULL;
+		if (newfile == NULL) {
+			return;
+		}
+		while (ft->ft_used < (unsigned)fd) {
+			ft->ft_openfiles[ft->ft_used++] = NULL;
+		}
+		ft->ft_openfiles[fd] = newfile;
+		ft->ft_used = fd + 1;
+		return;
+	}
+
 	*oldfile_ret = ft->ft_openfiles[fd];
 	ft->ft_openfiles[fd] = newfile;
+
+	if (newfile == NULL) {
+		if ((unsigned)fd < ft->ft_lowfree) {
+			ft->ft_lowfree = fd;
+		}
+		/* Trim empty slots off the end. */
+		while (ft->ft_used > 0 &&
+		       ft->ft_openfiles[ft->ft_used - 1] == NULL) {
+			ft->ft_used--;
+		}
+	}
 }
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Batched file system calls through a submission/completion ring.
+ * See <kern/ioring.h> for the layout.
+ *
+ * Each entry is run by calling the ordinary system call function, so
+ * argument checking and semantics are exactly the same as making the
+ * calls one at a time; what's saved is the trap (and trapframe save
+ * and restore) per call. Entries are run synchronously, in order, in
+ * ioring_enter: they need the calling process's address space and
+ * file table, which a kernel worker thread wouldn't have.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/ioring.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/*
+ * Bytes of the ring header the kernel writes back (sq_head, cq_tail).
+ */
+#define IORING_KERNSIZE	(2 * sizeof(unsigned))
+
+static
+bool
+ioring_okentries(unsigned entries)
+{
+	return entries > 0 && entries <= IORING_MAX_ENTRIES &&
+		(entries & (entries - 1)) == 0;
+}
+
+/*
+ * Run one submission entry. Returns the result for the completion
+ * entry: what the system call would return, or minus the error.
+ */
+static
+int
+ioring_run(const struct ioring_sqe *sqe)
+{
+	int retval = 0;
+	int err;
+
+	switch (sqe->sqe_op) {
+	    case IORING_OP_NOP:
+		err = 0;
+		break;
+	    case IORING_OP_READ:
+		if (sqe->sqe_pos < 0) {
+			err = sys_read(sqe->sqe_fd, sqe->sqe_ubuf,
+				       sqe->sqe_len, &retval);
+		}
+		else {
+			err = sys_pread(sqe->sqe_fd, sqe->sqe_ubuf,
+					sqe->sqe_len, sqe->sqe_pos, &retval);
+		}
+		break;
+	    case IORING_OP_WRITE:
+		if (sqe->sqe_pos < 0) {
+			err = sys_write(sqe->sqe_fd, sqe->sqe_ubuf,
+					sqe->sqe_len, &retval);
+		}
+		else {
+			err = sys_pwrite(sqe->sqe_fd, sqe->sqe_ubuf,
+					 sqe->sqe_len, sqe->sqe_pos, &retval);
+		}
+		break;
+	    case IORING_OP_OPEN:
+		err = sys_open(sqe->sqe_ubuf, sqe->sqe_flags, sqe->sqe_len,
+			       &retval);
+		break;
+	    case IORING_OP_CLOSE:
+		err = sys_close(sqe->sqe_fd);
+		break;
+	    case IORING_OP_FSYNC:
+		err = sys_fsync(sqe->sqe_fd);
+		break;
+	    default:
+		err = EINVAL;
+		break;
+	}
+
+	return err ? -err : retval;
+}
+
+/*
+ * ioring_setup() - register (or with NULL, unregister) the process's
+ * ring. We only check the header here; ioring_enter rereads it every
+ * time since the process can change it whenever it likes.
+ */
+int
+sys_ioring_setup(userptr_t uring)
+{
+	struct ioring ir;
+	int result;
+
+	if (uring != NULL) {
+		result = copyin(uring, &ir, sizeof(ir));
+		if (result) {
+			return result;
+		}
+		if (!ioring_okentries(ir.ir_entries)) {
+			return EINVAL;
+		}
+	}
+
+	spinlock_acquire(&curproc->p_lock);
+	curproc->p_ioring = uring;
+	spinlock_release(&curproc->p_lock);
+	return 0;
+}
+
+/*
+ * ioring_enter() - run up to TO_SUBMIT pending entries, stopping
+ * early if the completion queue fills up. Returns the number run.
+ *
+ * A fault on the ring itself stops the batch. It's returned as an
+ * error only if no entry was consumed; otherwise we report what was
+ * done. Either way no completion is lost: we make sure the header
+ * and each entry's completion slot can be written before running
+ * anything, since once an entry has run, sq_head moves past it and
+ * its completion is the only record of what happened.
+ */
+int
+sys_ioring_enter(unsigned to_submit, int *retval)
+{
+	struct ioring ir;
+	struct ioring_sqe sqe;
+	struct ioring_cqe cqe;
+	userptr_t uring, ucqe;
+	unsigned mask, pending, done, start;
+	int result, err;
+
+	uring = curproc->p_ioring;
+	if (uring == NULL) {
+		return EINVAL;
+	}
+
+	result = copyin(uring, &ir, sizeof(ir));
+	if (result) {
+		return result;
+	}
+	if (!ioring_okentries(ir.ir_entries)) {
+		return EINVAL;
+	}
+	mask = ir.ir_entries - 1;
+
+	pending = ir.sq_tail - ir.sq_head;
+	if (pending > ir.ir_entries) {
+		return EINVAL;
+	}
+	if (to_submit > pending) {
+		to_submit = pending;
+	}
+
+	/* Rewrite the header unchanged, to be sure we can update it */
+	result = copyout(&ir, uring, IORING_KERNSIZE);
+	if (result) {
+		return result;
+	}
+
+	start = ir.sq_head;
+	err = 0;
+	for (done = 0; done < to_submit; done++) {
+		if (ir.cq_tail - ir.cq_head >= ir.ir_entries) {
+			/* completion queue is full */
+			break;
+		}
+
+		err = copyin(ir.ir_usqes + (ir.sq_head & mask) * sizeof(sqe),
+			     &sqe, sizeof(sqe));
+		if (err) {
+			break;
+		}
+
+		/*
+		 * Claim the completion slot first. Until cq_tail moves
+		 * the process ignores what's there, so this is harmless,
+		 * and a bad slot stops us before the entry runs.
+		 */
+		ucqe = ir.ir_ucqes + (ir.cq_tail & mask) * sizeof(cqe);
+		cqe.cqe_data = sqe.sqe_data;
+		cqe.cqe_res = 0;
+		err = copyout(&cqe, ucqe, sizeof(cqe));
+		if (err) {
+			break;
+		}
+
+		cqe.cqe_res = ioring_run(&sqe);
+		err = copyout(&cqe, ucqe, sizeof(cqe));
+
+		/* the entry has run now; never run it again */
+		ir.sq_head++;
+		if (err) {
+			/* only if the slot became unwritable as it ran */
+			break;
+		}
+		ir.cq_tail++;
+	}
+
+	if (ir.sq_head == start) {
+		/* nothing consumed (to_submit was 0, or a fault) */
+		return err;
+	}
+
+	result = copyout(&ir, uring, IORING_KERNSIZE);
+	if (result) {
+		return result;
+	}
+
+	*retval = done;
+	return 0;
+}
@@ -36,9 +36,43 @@
 #include <kern/fcntl.h>
 #include <lib.h>
 #include <synch.h>
+#include <slab.h>
 #include <vfs.h>
 #include <openfile.h>
 
+/*
+ * Openfiles come from their own cache. The lock and spinlock are set
+ * up once when the object is first carved out of a slab and survive
+ * across reuse, so opening a file doesn't have to create a lock.
+ */
+static
+int
+openfile_ctor(void *obj)
+{
+	struct openfile *file = obj;
+
+	file->of_offsetlock = lock_create("openfile");
+	if (file->of_offsetlock == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&file->of_reflock);
+	return 0;
+}
+
+static
+void
+openfile_dtor(void *obj)
+{
+	struct openfile *file = obj;
+
+	spinlock_cleanup(&file->of_reflock);
+	lock_destroy(file->of_offsetlock);
+}
+
+static struct kmem_cache openfile_cache =
+	KMEM_CACHE_INITIALIZER("openfile", sizeof(struct openfile),
+			       openfile_ctor, openfile_dtor);
+
 /*
  * Constructor for struct openfile.
  */
@@ -53,19 +87,11 @@ openfile_create(struct vnode *vn, int accmode)
 		accmode == O_WRONLY ||
 		accmode == O_RDWR);
 
-	file = kmalloc(sizeof(struct openfile));
+	file = kmem_cache_alloc(&openfile_cache);
 	if (file == NULL) {
 		return NULL;
 	}
 
-	file->of_offsetlock = lock_create("openfile");
-	if (file->of_offsetlock == NULL) {
-		kfree(file);
-		return NULL;
-	}
-
-	spinlock_init(&file->of_reflock);
-
 	file->of_vnode = vn;
 	file->of_accmode = accmode;
 	file->of_offset = 0;
@@ -85,9 +111,8 @@ openfile_destroy(struct openfile *file)
 	/* balance vfs_open with vfs_close (not VOP_DECREF) */
 	vfs_close(file->of_vnode);
 
-	spinlock_cleanup(&file->of_reflock);
-	lock_destroy(file->of_offsetlock);
-	kfree(file);
+	/* the locks stay constructed for the next user */
+	kmem_cache_free(&openfile_cache, file);
 }
 
 /*
@@ -116,6 +141,25 @@ openfile_open(char *filename, int openflags, mode_t mode,
 	return 0;
 }
 
+/*
+ * Wrap an already-open vnode (such as one end of a pipe) in an
+ * openfile object. On success the openfile takes over the caller's
+ * reference to the vnode.
+ */
+int
+openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret)
+{
+	struct openfile *file;
+
+	file = openfile_create(vn, accmode);
+	if (file == NULL) {
+		return ENOMEM;
+	}
+
+	*ret = file;
+	return 0;
+}
+
 /*
  * Increment the reference count on an openfile.
  */
@@ -127,6 +171,23 @@ openfile_incref(struct openfile *file)
 	spinlock_release(&file->of_reflock);
 }
 
+/*
+ * Check if the caller holds the only reference to an openfile, in
+ * which case nobody else can be using its seek position and the
+ * offset lock can be skipped.
+ *
+ * This doesn't need the spinlock. With one reference, the count can
+ * only go up by the holder (in fork or dup2), and the holder is the
+ * caller and busy calling us. If it's higher we might read a stale
+ * value while another holder is closing, but that only makes us take
+ * the lock unnecessarily.
+ */
+bool
+openfile_isexclusive(struct openfile *file)
+{
+	return file->of_refcount == 1;
+}
+
 /*
  * Decrement the reference count on an openfile. Destroys it when the
  * reference count reaches zero.
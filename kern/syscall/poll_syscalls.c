@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll() and select().
+ *
+ * Both are implemented by the same loop: take a reference to each
+ * open file, then repeatedly ask each one's vnode (with VOP_POLL)
+ * which of the requested events are ready, sleeping in between until
+ * one of them (or the timeout) wakes us up. The first pass also
+ * registers on each object's wakeup queue; we keep those
+ * registrations until the end rather than redoing them every time.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <kern/time.h>
+#include <limits.h>
+#include <lib.h>
+#include <clock.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <poll.h>
+#include <syscall.h>
+
+/*
+ * Events that are always reported whether or not they were asked for.
+ */
+#define POLL_ALWAYS	(POLLERR | POLLHUP | POLLNVAL)
+
+/*
+ * One file being polled.
+ */
+struct pollslot {
+	struct openfile *ps_file;	/* NULL if fd < 0 or not open */
+	struct pollfd ps_pfd;
+};
+
+/*
+ * Convert a timeout to hardclock ticks, rounding up so we never wake
+ * early. Returns false for an infinite timeout.
+ */
+static
+bool
+poll_ticks(uint64_t num, uint64_t den, unsigned *ticks)
+{
+	uint64_t t;
+
+	t = (num * HZ + den - 1) / den;
+	if (t > (unsigned)-1) {
+		/* longer than we can count; close enough to forever */
+		return false;
+	}
+	*ticks = t;
+	return true;
+}
+
+/*
+ * Look up the files for the slots. A slot with a negative fd is
+ * ignored; one with a bad fd gets POLLNVAL.
+ */
+static
+void
+poll_getfiles(struct pollslot *slots, unsigned nfds)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct openfile *file;
+	unsigned i;
+
+	for (i=0; i<nfds; i++) {
+		slots[i].ps_file = NULL;
+		slots[i].ps_pfd.revents = 0;
+		if (slots[i].ps_pfd.fd < 0) {
+			continue;
+		}
+		if (filetable_get(ft, slots[i].ps_pfd.fd, &file)) {
+			slots[i].ps_pfd.revents = POLLNVAL;
+			continue;
+		}
+		openfile_incref(file);
+		filetable_put(ft, slots[i].ps_pfd.fd, file);
+		slots[i].ps_file = file;
+	}
+}
+
+static
+void
+poll_putfiles(struct pollslot *slots, unsigned nfds)
+{
+	unsigned i;
+
+	for (i=0; i<nfds; i++) {
+		if (slots[i].ps_file != NULL) {
+			openfile_decref(slots[i].ps_file);
+			slots[i].ps_file = NULL;
+		}
+	}
+}
+
+/*
+ * The common part of poll and select. If FOREVER is false, wait no
+ * longer than TICKS; zero means don't wait at all. Sets the revents
+ * of each slot and returns the number of slots with nonzero revents
+ * in NREADY.
+ */
+static
+int
+dopoll(struct pollslot *slots, unsigned nfds, bool forever, unsigned ticks,
+       int *nready)
+{
+	struct poller pl;
+	struct vnode *vn;
+	bool first, timedout;
+	unsigned i;
+	int events, revents, n, result;
+
+	result = poller_init(&pl);
+	if (result) {
+		return result;
+	}
+	if (!forever && ticks > 0) {
+		poller_settimeout(&pl, ticks);
+	}
+
+	/* No point registering if we aren't going to sleep. */
+	first = forever || ticks > 0;
+	timedout = false;
+
+	while (1) {
+		poller_reset(&pl);
+		n = 0;
+		for (i=0; i<nfds; i++) {
+			if (slots[i].ps_file == NULL) {
+				/* ignored, or POLLNVAL from poll_getfiles */
+				if (slots[i].ps_pfd.revents != 0) {
+					n++;
+				}
+				continue;
+			}
+			vn = slots[i].ps_file->of_vnode;
+			events = slots[i].ps_pfd.events;
+			result = VOP_POLL(vn, events, first ? &pl : NULL,
+					  &revents);
+			if (result) {
+				goto out;
+			}
+			revents &= events | POLL_ALWAYS;
+			slots[i].ps_pfd.revents = revents;
+			if (revents != 0) {
+				n++;
+			}
+		}
+		first = false;
+
+		if (n > 0 || timedout || (!forever && ticks == 0)) {
+			break;
+		}
+		if (!poller_wait(&pl)) {
+			/* Check once more, then give up. */
+			timedout = true;
+		}
+	}
+	*nready = n;
+	result = 0;
+
+ out:
+	poller_cleanup(&pl);
+	return result;
+}
+
+/*
+ * poll() - copy in the pollfd array, run dopoll, and copy it back.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout_ms, int *retval)
+{
+	struct pollslot *slots;
+	struct pollfd pfd;
+	unsigned i, ticks;
+	bool forever;
+	int result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	if (timeout_ms < 0) {
+		forever = true;
+		ticks = 0;
+	}
+	else {
+		forever = !poll_ticks(timeout_ms, 1000, &ticks);
+	}
+
+	slots = NULL;
+	if (nfds > 0) {
+		slots = kmalloc(nfds * sizeof(*slots));
+		if (slots == NULL) {
+			return ENOMEM;
+		}
+		for (i=0; i<nfds; i++) {
+			result = copyin(ufds + i * sizeof(pfd), &slots[i].ps_pfd,
+					sizeof(pfd));
+			if (result) {
+				kfree(slots);
+				return result;
+			}
+		}
+	}
+
+	poll_getfiles(slots, nfds);
+	result = dopoll(slots, nfds, forever, ticks, retval);
+	poll_putfiles(slots, nfds);
+
+	for (i=0; result == 0 && i<nfds; i++) {
+		result = copyout(&slots[i].ps_pfd, ufds + i * sizeof(pfd),
+				 sizeof(pfd));
+	}
+
+	kfree(slots);
+	return result;
+}
+
+/*
+ * select() works on bitmaps, which in userland are fd_sets: arrays
+ * of 32-bit words with fd N in bit N%32 of word N/32. We only copy
+ * the words that cover the first NFDS descriptors.
+ */
+
+#define FDSET_WORDS	((OPEN_MAX + 31) / 32)
+
+struct fdsets {
+	uint32_t read[FDSET_WORDS];
+	uint32_t write[FDSET_WORDS];
+	uint32_t except[FDSET_WORDS];
+};
+
+static
+bool
+fdset_isset(const uint32_t *set, int fd)
+{
+	return (set[fd / 32] & ((uint32_t)1 << (fd % 32))) != 0;
+}
+
+static
+void
+fdset_set(uint32_t *set, int fd)
+{
+	set[fd / 32] |= (uint32_t)1 << (fd % 32);
+}
+
+static
+int
+fdset_copyin(userptr_t uset, uint32_t *set, unsigned nwords)
+{
+	bzero(set, FDSET_WORDS * sizeof(uint32_t));
+	if (uset == NULL) {
+		return 0;
+	}
+	return copyin(uset, set, nwords * sizeof(uint32_t));
+}
+
+static
+int
+fdset_copyout(const uint32_t *set, userptr_t uset, unsigned nwords)
+{
+	if (uset == NULL) {
+		return 0;
+	}
+	return copyout(set, uset, nwords * sizeof(uint32_t));
+}
+
+/*
+ * select() - turn the bitmaps into pollslots, run dopoll, and turn
+ * the results back into bitmaps. As on other systems, a hangup or
+ * error counts as readable, and an error also counts as writable.
+ */
+int
+sys_select(int nfds, userptr_t ureadfds, userptr_t uwritefds,
+	   userptr_t uexceptfds, userptr_t utimeout, int *retval)
+{
+	struct fdsets *sets;
+	struct pollslot *slots;
+	struct timeval tv;
+	unsigned nwords, nslots, i, ticks;
+	bool forever;
+	int fd, events, revents, count, nready, result;
+
+	if (nfds < 0 || nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+	nwords = (nfds + 31) / 32;
+
+	if (utimeout == NULL) {
+		forever = true;
+		ticks = 0;
+	}
+	else {
+		result = copyin(utimeout, &tv, sizeof(tv));
+		if (result) {
+			return result;
+		}
+		if (tv.tv_sec < 0 || tv.tv_usec < 0 || tv.tv_usec >= 1000000) {
+			return EINVAL;
+		}
+		forever = tv.tv_sec > (time_t)((unsigned)-1 / HZ) ||
+			!poll_ticks((uint64_t)tv.tv_sec * 1000000 + tv.tv_usec,
+				    1000000, &ticks);
+	}
+
+	/* The sets are too big to put on the kernel stack. */
+	sets = kmalloc(sizeof(*sets));
+	if (sets == NULL) {
+		return ENOMEM;
+	}
+	slots = NULL;
+	if (nfds > 0) {
+		slots = kmalloc(nfds * sizeof(*slots));
+		if (slots == NULL) {
+			kfree(sets);
+			return ENOMEM;
+		}
+	}
+
+	result = fdset_copyin(ureadfds, sets->read, nwords);
+	if (result) {
+		goto out;
+	}
+	result = fdset_copyin(uwritefds, sets->write, nwords);
+	if (result) {
+		goto out;
+	}
+	result = fdset_copyin(uexceptfds, sets->except, nwords);
+	if (result) {
+		goto out;
+	}
+
+	/* Build a slot for each descriptor in any of the sets. */
+	nslots = 0;
+	for (fd=0; fd<nfds; fd++) {
+		events = 0;
+		if (fdset_isset(sets->read, fd)) {
+			events |= POLLIN;
+		}
+		if (fdset_isset(sets->write, fd)) {
+			events |= POLLOUT;
+		}
+		if (fdset_isset(sets->except, fd)) {
+			events |= POLLPRI;
+		}
+		if (events != 0) {
+			slots[nslots].ps_pfd.fd = fd;
+			slots[nslots].ps_pfd.events = events;
+			nslots++;
+		}
+	}
+
+	poll_getfiles(slots, nslots);
+	for (i=0; i<nslots; i++) {
+		if (slots[i].ps_pfd.revents & POLLNVAL) {
+			result = EBADF;
+			poll_putfiles(slots, nslots);
+			goto out;
+		}
+	}
+	result = dopoll(slots, nslots, forever, ticks, &nready);
+	poll_putfiles(slots, nslots);
+	if (result) {
+		goto out;
+	}
+
+	/* Convert back. */
+	bzero(sets, sizeof(*sets));
+	count = 0;
+	for (i=0; i<nslots; i++) {
+		fd = slots[i].ps_pfd.fd;
+		events = slots[i].ps_pfd.events;
+		revents = slots[i].ps_pfd.revents;
+		if ((events & POLLIN) &&
+		    (revents & (POLLIN | POLLHUP | POLLERR))) {
+			fdset_set(sets->read, fd);
+			count++;
+		}
+		if ((events & POLLOUT) && (revents & (POLLOUT | POLLERR))) {
+			fdset_set(sets->write, fd);
+			count++;
+		}
+		if ((events & POLLPRI) && (revents & POLLPRI)) {
+			fdset_set(sets->except, fd);
+			count++;
+		}
+	}
+
+	result = fdset_copyout(sets->read, ureadfds, nwords);
+	if (result) {
+		goto out;
+	}
+	result = fdset_copyout(sets->write, uwritefds, nwords);
+	if (result) {
+		goto out;
+	}
+	result = fdset_copyout(sets->except, uexceptfds, nwords);
+	if (result) {
+		goto out;
+	}
+	*retval = count;
+
+ out:
+	kfree(slots);
+	kfree(sets);
+	return result;
+}
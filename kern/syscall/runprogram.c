@@ -395,6 +395,9 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		as_destroy(oldvm);
 	}
 
+	/* Any ioring went with the old address space. */
+	curproc->p_ioring = NULL;
+
 	/*
 	 * Now that we know we're succeeding, change the current thread's
 	 * name to reflect the new process.
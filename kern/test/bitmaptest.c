@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <bitmap.h>
 #include <test.h>
@@ -101,6 +102,34 @@ bitmaptest(int nargs, char **args)
 		KASSERT(data[i]==0);
 	}
 
+	/* alloc_near takes the first clear bit at or after the goal */
+	bitmap_unmark(b, 5);
+	bitmap_unmark(b, 300);
+	bitmap_unmark(b, 301);
+	KASSERT(bitmap_alloc_near(b, 200, &x)==0 && x==300);
+	KASSERT(bitmap_alloc_near(b, 301, &x)==0 && x==301);
+	/* ...and wraps around when there's nothing past it */
+	KASSERT(bitmap_alloc_near(b, 400, &x)==0 && x==5);
+	KASSERT(bitmap_alloc_near(b, 0, &x)==ENOSPC);
+	KASSERT(bitmap_nfree(b)==0);
+
+	/* Runs: free 100-139 and 20-24, then carve them back up */
+	for (i=100; i<140; i++) {
+		bitmap_unmark(b, i);
+	}
+	for (i=20; i<25; i++) {
+		bitmap_unmark(b, i);
+	}
+	KASSERT(bitmap_nfree(b)==45);
+	KASSERT(bitmap_alloc_run(b, 0, 6, &x)==0 && x==100);
+	KASSERT(bitmap_alloc_run(b, 0, 5, &x)==0 && x==20);
+	/* 106-139 are left; this one has to wrap back before the goal */
+	KASSERT(bitmap_alloc_run(b, 110, 31, &x)==0 && x==106);
+	KASSERT(bitmap_alloc_run(b, 0, 4, &x)==ENOSPC);
+	KASSERT(bitmap_alloc_run(b, 200, 3, &x)==0 && x==137);
+	KASSERT(bitmap_nfree(b)==0);
+	KASSERT(bitmap_alloc(b, &x)==ENOSPC);
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
@@ -379,3 +379,90 @@ kmalloctest4(int nargs, char **args)
 	kprintf("Multipage kmalloc test done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+// km5
+
+/*
+ * Fragment physical memory by taking every free page and giving back
+ * every other one, so no two free frames are adjacent; then check
+ * that multipage blocks can still be allocated and used. This only
+ * works because multipage blocks come from the kseg2 arena.
+ */
+
+#define KM5_NBLOCKS	8
+#define KM5_BLOCKPAGES	4
+
+int
+kmalloctest5(int nargs, char **args)
+{
+	void **pages, **p, **keep;
+	void *blocks[KM5_NBLOCKS];
+	uint32_t *words;
+	unsigned npages, nwords, i, j;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting fragmented multipage kmalloc test...\n");
+#if OPT_DUMBVM && (! OPT_UNSWRAM)
+	kprintf("(This test will not work with dumbvm)\n");
+#endif
+
+	/* take all the free pages, chained through the pages themselves */
+	pages = NULL;
+	npages = 0;
+	while ((p = kmalloc(PAGE_SIZE)) != NULL) {
+		*p = pages;
+		pages = p;
+		npages++;
+	}
+	kprintf("kmalloctest5: took %u pages\n", npages);
+
+	/* give back every other one */
+	keep = NULL;
+	i = 0;
+	while (pages != NULL) {
+		p = pages;
+		pages = *p;
+		if (i++ % 2) {
+			kfree(p);
+		}
+		else {
+			*p = keep;
+			keep = p;
+		}
+	}
+
+	nwords = KM5_BLOCKPAGES * PAGE_SIZE / sizeof(uint32_t);
+	for (i=0; i<KM5_NBLOCKS; i++) {
+		blocks[i] = kmalloc(KM5_BLOCKPAGES * PAGE_SIZE);
+		if (blocks[i] == NULL) {
+			panic("kmalloctest5: block %u: allocation failed\n", i);
+		}
+		words = blocks[i];
+		for (j=0; j<nwords; j++) {
+			words[j] = i * nwords + j;
+		}
+	}
+	for (i=0; i<KM5_NBLOCKS; i++) {
+		words = blocks[i];
+		for (j=0; j<nwords; j++) {
+			if (words[j] != i * nwords + j) {
+				panic("kmalloctest5: block %u word %u: "
+				      "expected %u, found %u\n",
+				      i, j, i * nwords + j, words[j]);
+			}
+		}
+		kfree(blocks[i]);
+	}
+
+	while (keep != NULL) {
+		p = keep;
+		keep = *p;
+		kfree(p);
+	}
+
+	kprintf("kmalloctest5: passed\n");
+	return 0;
+}
@@ -59,6 +59,12 @@
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * Pending timeouts. Each one counts down in hardclock on CPU 0.
+ */
+static struct timeout *timeouts;
+static struct spinlock timeout_lock;
+
 /*
  * Setup.
  */
@@ -66,6 +72,8 @@ void
 hardclock_bootstrap(void)
 {
 	spinlock_init(&lbolt_lock);
+	spinlock_init(&timeout_lock);
+	timeouts = NULL;
 	lbolt = wchan_create("lbolt");
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
@@ -85,6 +93,34 @@ timerclock(void)
 	spinlock_release(&lbolt_lock);
 }
 
+/*
+ * Count down the pending timeouts and fire the ones that expire.
+ * Each is unlinked before its function is called, and the function
+ * is called with timeout_lock held so timeout_stop can't return
+ * while it's still running.
+ */
+static
+void
+timeout_tick(void)
+{
+	struct timeout **pp, *to;
+
+	spinlock_acquire(&timeout_lock);
+	pp = &timeouts;
+	while (*pp != NULL) {
+		to = *pp;
+		if (--to->to_ticks > 0) {
+			pp = &to->to_next;
+			continue;
+		}
+		*pp = to->to_next;
+		to->to_next = NULL;
+		to->to_pending = false;
+		to->to_func(to->to_data);
+	}
+	spinlock_release(&timeout_lock);
+}
+
 /*
  * This is called HZ times a second (on each processor) by the timer
  * code.
@@ -97,6 +133,9 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	if (curcpu->c_number == 0 && timeouts != NULL) {
+		timeout_tick();
+	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -106,6 +145,57 @@ hardclock(void)
 	thread_yield();
 }
 
+/*
+ * Set up a timeout to call FUNC(DATA).
+ */
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *data)
+{
+	to->to_next = NULL;
+	to->to_ticks = 0;
+	to->to_pending = false;
+	to->to_func = func;
+	to->to_data = data;
+}
+
+/*
+ * Start a timeout to go off after TICKS hardclocks (at least one).
+ * If it was already pending, it's restarted.
+ */
+void
+timeout_start(struct timeout *to, unsigned ticks)
+{
+	spinlock_acquire(&timeout_lock);
+	if (!to->to_pending) {
+		to->to_next = timeouts;
+		timeouts = to;
+		to->to_pending = true;
+	}
+	to->to_ticks = ticks > 0 ? ticks : 1;
+	spinlock_release(&timeout_lock);
+}
+
+/*
+ * Cancel a timeout if it hasn't gone off yet. Once this returns the
+ * function is not running and won't be called.
+ */
+void
+timeout_stop(struct timeout *to)
+{
+	struct timeout **pp;
+
+	spinlock_acquire(&timeout_lock);
+	if (to->to_pending) {
+		for (pp = &timeouts; *pp != to; pp = &(*pp)->to_next) {
+			KASSERT(*pp != NULL);
+		}
+		*pp = to->to_next;
+		to->to_next = NULL;
+		to->to_pending = false;
+	}
+	spinlock_release(&timeout_lock);
+}
+
 /*
  * Suspend execution for n seconds.
  */
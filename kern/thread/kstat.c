@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel event counters: the report and the stats: device.
+ *
+ * The counting itself is done in place with KSTAT_INC; see kstat.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/syscall.h>
+#include <lib.h>
+#include <cpu.h>
+#include <uio.h>
+#include <vfs.h>
+#include <device.h>
+#include <kstat.h>
+
+#define KSTAT_MAXCPUS	32	/* LAMEbus can't have more */
+#define KSTAT_NAMEWIDTH	20
+#define KSTAT_COLWIDTH	11	/* " %10u" */
+#define KSTAT_NLINES	16	/* header and lines other than syscalls */
+
+/* Names for the syscalls we implement; the rest print by number. */
+#define SC(name) [SYS_##name] = #name
+static const char *const kstat_syscallnames[KSTAT_NSYSCALLS] = {
+	SC(fork), SC(execv), SC(_exit), SC(waitpid), SC(getpid),
+	SC(open), SC(pipe), SC(dup2), SC(close),
+	SC(read), SC(pread), SC(readv), SC(preadv), SC(getdirentry),
+	SC(write), SC(pwrite), SC(writev), SC(pwritev),
+	SC(lseek), SC(ftruncate), SC(fsync), SC(select), SC(poll),
+	SC(link), SC(remove), SC(mkdir), SC(rmdir), SC(rename),
+	SC(chdir), SC(__getcwd), SC(fstat),
+	SC(__time), SC(sync), SC(reboot),
+	SC(ioring_setup), SC(ioring_enter),
+};
+#undef SC
+
+static const char *const kstat_tlbnames[KSTAT_NTLB] = {
+	[KSTAT_TLB_READ] = "tlbfault.read",
+	[KSTAT_TLB_WRITE] = "tlbfault.write",
+	[KSTAT_TLB_READONLY] = "tlbfault.readonly",
+	[KSTAT_TLB_KHEAP] = "tlbfault.kheap",
+};
+
+/*
+ * Value of a counter for cpu number CPU, given FIELD, the counter in
+ * the first of an array of snapshots.
+ */
+static
+uint32_t
+kstat_get(const uint32_t *field, unsigned cpu)
+{
+	return *(const uint32_t *)((const char *)field +
+				   cpu * sizeof(struct kstats));
+}
+
+/*
+ * Print one line: NAME, the total, and the value for each cpu. Lines
+ * whose total is zero are left out if SKIPZERO is set.
+ */
+static
+size_t
+kstat_line(char *buf, size_t buflen, const char *name,
+	   const uint32_t *field, unsigned ncpus, bool skipzero)
+{
+	uint32_t total;
+	size_t pos;
+	unsigned i;
+
+	total = 0;
+	for (i=0; i<ncpus; i++) {
+		total += kstat_get(field, i);
+	}
+	if (total == 0 && skipzero) {
+		return 0;
+	}
+
+	pos = snprintf(buf, buflen, "%-*s %10u", KSTAT_NAMEWIDTH, name,
+		       total);
+	for (i=0; i<ncpus; i++) {
+		pos += snprintf(buf + pos, buflen - pos, " %10u",
+				kstat_get(field, i));
+	}
+	pos += snprintf(buf + pos, buflen - pos, "\n");
+	return pos;
+}
+
+char *
+kstat_report(size_t *lenret)
+{
+	struct kstats *snap;
+	char *buf, name[KSTAT_NAMEWIDTH + 1];
+	size_t buflen, linelen, pos;
+	unsigned ncpus, i;
+
+	snap = kmalloc(KSTAT_MAXCPUS * sizeof(*snap));
+	if (snap == NULL) {
+		return NULL;
+	}
+	for (ncpus = 0; ncpus < KSTAT_MAXCPUS; ncpus++) {
+		if (!cpu_getstats(ncpus, &snap[ncpus])) {
+			break;
+		}
+	}
+
+	linelen = KSTAT_NAMEWIDTH + KSTAT_COLWIDTH * (ncpus + 1) + 2;
+	buflen = (KSTAT_NLINES + KSTAT_NSYSCALLS) * linelen;
+	buf = kmalloc(buflen);
+	if (buf == NULL) {
+		kfree(snap);
+		return NULL;
+	}
+
+	pos = snprintf(buf, buflen, "%-*s %10s", KSTAT_NAMEWIDTH, "counter",
+		       "total");
+	for (i=0; i<ncpus; i++) {
+		snprintf(name, sizeof(name), "cpu%u", i);
+		pos += snprintf(buf + pos, buflen - pos, " %10s", name);
+	}
+	pos += snprintf(buf + pos, buflen - pos, "\n");
+
+#define LINE(name, field) \
+	pos += kstat_line(buf + pos, buflen - pos, name, &snap[0].field, \
+			  ncpus, false)
+	LINE("pagefaults", ks_pagefaults);
+	LINE("frames", ks_frames);
+	LINE("switches", ks_switches);
+	LINE("migrations", ks_migrations);
+	LINE("sleeps", ks_sleeps);
+	LINE("lockwaits", ks_lockwaits);
+	LINE("disk.sectreads", ks_sectreads);
+	LINE("disk.sectwrites", ks_sectwrites);
+	LINE("bcache.hits", ks_cachehits);
+	LINE("bcache.misses", ks_cachemisses);
+#undef LINE
+	for (i=0; i<KSTAT_NTLB; i++) {
+		pos += kstat_line(buf + pos, buflen - pos, kstat_tlbnames[i],
+				  &snap[0].ks_tlbfaults[i], ncpus, false);
+	}
+	for (i=0; i<KSTAT_NSYSCALLS; i++) {
+		if (kstat_syscallnames[i] != NULL) {
+			snprintf(name, sizeof(name), "syscall.%s",
+				 kstat_syscallnames[i]);
+		}
+		else {
+			snprintf(name, sizeof(name), "syscall.%u", i);
+		}
+		pos += kstat_line(buf + pos, buflen - pos, name,
+				  &snap[0].ks_syscalls[i], ncpus, true);
+	}
+
+	kfree(snap);
+	*lenret = pos;
+	return buf;
+}
+
+void
+kstat_print(void)
+{
+	char *report;
+	size_t len;
+
+	report = kstat_report(&len);
+	if (report == NULL) {
+		kprintf("stats: Out of memory\n");
+		return;
+	}
+	kprintf("%s", report);
+	kfree(report);
+}
+
+////////////////////////////////////////////////////////////
+// stats: device
+
+/* For open() */
+static
+int
+statsopen(struct device *dev, int openflags)
+{
+	(void)dev;
+
+	if ((openflags & O_ACCMODE) != O_RDONLY) {
+		return EROFS;
+	}
+	return 0;
+}
+
+/*
+ * For d_io(). Reads get the report, regenerated each time, from the
+ * current offset. The device is seekable, so that's the open file's
+ * own offset, and a reader gets EOF once it has had a whole report.
+ */
+static
+int
+statsio(struct device *dev, struct uio *uio)
+{
+	char *report;
+	size_t len;
+	int result;
+
+	(void)dev;
+
+	if (uio->uio_rw == UIO_WRITE) {
+		return EROFS;
+	}
+
+	report = kstat_report(&len);
+	if (report == NULL) {
+		return ENOMEM;
+	}
+	result = 0;
+	if (uio->uio_offset < (off_t)len) {
+		result = uiomove(report + uio->uio_offset,
+				 len - uio->uio_offset, uio);
+	}
+	kfree(report);
+	return result;
+}
+
+/* For ioctl() */
+static
+int
+statsioctl(struct device *dev, int op, userptr_t data)
+{
+	(void)dev;
+	(void)op;
+	(void)data;
+
+	return EINVAL;
+}
+
+static const struct device_ops stats_devops = {
+	.devop_eachopen = statsopen,
+	.devop_io = statsio,
+	.devop_ioctl = statsioctl,
+	.devop_seekable = true,
+};
+
+/*
+ * Function to create and attach stats:
+ */
+void
+devstats_create(void)
+{
+	int result;
+	struct device *dev;
+
+	dev = kmalloc(sizeof(*dev));
+	if (dev==NULL) {
+		panic("Could not add stats device: out of memory\n");
+	}
+
+	dev->d_ops = &stats_devops;
+
+	dev->d_blocks = 0;
+	dev->d_blocksize = 1;
+
+	dev->d_devnumber = 0; /* assigned by vfs_adddev */
+
+	dev->d_data = NULL;
+
+	result = vfs_adddev("stats", dev, 0);
+	if (result) {
+		panic("Could not add stats device: %s\n", strerror(result));
+	}
+}
@@ -38,6 +38,7 @@
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <cpu.h>
 #include <synch.h>
 
 ////////////////////////////////////////////////////////////
@@ -193,6 +194,9 @@ lock_acquire(struct lock *lock)
 	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
 	KASSERT(lock->lk_holder != curthread);
+	if (lock->lk_holder != NULL) {
+		KSTAT_INC(ks_lockwaits);
+	}
 	while (lock->lk_holder != NULL) {
 		/* As in the semaphore. */
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
@@ -53,6 +53,7 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <slab.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
@@ -72,6 +73,10 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Allocator for thread structures. */
+static struct kmem_cache thread_cache =
+	KMEM_CACHE_INITIALIZER("thread", sizeof(struct thread), NULL, NULL);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -123,14 +128,14 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = kmem_cache_alloc(&thread_cache);
 	if (thread == NULL) {
 		return NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
+		kmem_cache_free(&thread_cache, thread);
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
@@ -182,6 +187,7 @@ cpu_create(unsigned hardware_number)
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	bzero(&c->c_stats, sizeof(c->c_stats));
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -287,7 +293,7 @@ thread_destroy(struct thread *thread)
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
-	kfree(thread);
+	kmem_cache_free(&thread_cache, thread);
 }
 
 /*
@@ -484,6 +490,23 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 }
 
+/*
+ * Copy out a cpu's event counters. They are updated without locking,
+ * so this is only a snapshot.
+ */
+bool
+cpu_getstats(unsigned num, struct kstats *stats)
+{
+	struct cpu *c;
+
+	if (num >= cpuarray_num(&allcpus)) {
+		return false;
+	}
+	c = cpuarray_get(&allcpus, num);
+	memcpy(stats, &c->c_stats, sizeof(*stats));
+	return true;
+}
+
 /*
  * Create a new thread based on an existing one.
  *
@@ -653,6 +676,10 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	if (next != cur) {
+		KSTAT_INC(ks_switches);
+	}
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -924,6 +951,7 @@ thread_consider_migration(void)
 
 			t->t_cpu = c;
 			threadlist_addtail(&c->c_runqueue, t);
+			KSTAT_INC(ks_migrations);
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -1015,6 +1043,7 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	/* must not hold other spinlocks */
 	KASSERT(curcpu->c_spinlocks == 1);
 
+	KSTAT_INC(ks_sleeps);
 	thread_switch(S_SLEEP, wc, lk);
 	spinlock_acquire(lk);
 }
@@ -220,7 +220,7 @@ dev_isseekable(struct vnode *v)
 	struct device *d = v->vn_data;
 
 	if (d->d_blocks == 0) {
-		return false;
+		return d->d_ops->devop_seekable;
 	}
 	return true;
 }
@@ -319,6 +319,22 @@ dev_lookup(struct vnode *dir,
 	return 0;
 }
 
+/*
+ * For poll/select. Hand off to the device if it knows how to poll;
+ * otherwise assume it never blocks.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct poller *poller, int *revents)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_ops->devop_poll == NULL) {
+		return vnode_poll_ready(v, events, poller, revents);
+	}
+	return DEVOP_POLL(d, events, poller, revents);
+}
+
 /*
  * Function table for device vnodes.
  */
@@ -339,6 +355,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_mmap = dev_mmap,
 	.vop_truncate = dev_truncate,
 	.vop_namefile = dev_namefile,
+	.vop_poll = dev_poll,
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
 	.vop_mkdir = vopfail_mkdir_notdir,
@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipes.
+ *
+ * A pipe is a ring buffer shared by two vnodes, one for the read end
+ * and one for the write end. Each end's vnode is reference-counted in
+ * the usual way (through dup2, fork, etc.) so VOP_RECLAIM on an end
+ * means that end has been closed for good: the reader then sees EOF
+ * once the buffer drains, and the writer gets EPIPE.
+ *
+ * Readers are serialized against each other by pp_readlock and
+ * writers by pp_writelock, so the ring itself only ever has one
+ * producer and one consumer. It is managed without locking: the
+ * producer only ever advances pp_head and the consumer only ever
+ * advances pp_tail, both free-running counters, with memory barriers
+ * ordering the data against the index updates. The spinlock and wait
+ * channels are only used when one side has to sleep; a side about to
+ * sleep sets its "waiting" flag first, and the other side takes the
+ * spinlock to wake it only if it sees the flag set.
+ *
+ * Data moves directly between the user's buffer and the ring with
+ * uiomove, so each byte is copied once going in and once coming out.
+ *
+ * Writes of up to PIPE_BUF bytes are atomic: the writer waits until
+ * there's room for the whole thing before copying any of it, and
+ * holding pp_writelock keeps other writers from interleaving.
+ *
+ * For poll, both ends share one pollq, which is woken whenever data
+ * or space appears and when either end closes.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+/* Size of the ring; must be a power of two */
+#define PIPE_SIZE PAGE_SIZE
+
+struct pipe {
+	struct vnode pp_readvn;		/* vnode for the read end */
+	struct vnode pp_writevn;	/* vnode for the write end */
+
+	char *pp_buf;			/* ring buffer */
+	unsigned pp_head;		/* total bytes written */
+	unsigned pp_tail;		/* total bytes read */
+
+	struct lock *pp_readlock;	/* one reader at a time */
+	struct lock *pp_writelock;	/* one writer at a time */
+
+	struct spinlock pp_lock;	/* protects the rest */
+	struct wchan *pp_readwchan;	/* reader sleeps here */
+	struct wchan *pp_writewchan;	/* writer sleeps here */
+	bool pp_readwaiting;		/* reader is (about to be) asleep */
+	bool pp_writewaiting;		/* writer is (about to be) asleep */
+	bool pp_readclosed;		/* read end is gone */
+	bool pp_writeclosed;		/* write end is gone */
+
+	struct pollq pp_pollq;		/* poll()ers of either end */
+};
+
+static const struct vnode_ops pipe_vnode_ops;
+
+////////////////////////////////////////////////////////////
+// ring operations
+
+/*
+ * Bytes available to read. Called by the reader; the barrier makes
+ * sure the data is loaded only after the head that covers it.
+ */
+static
+unsigned
+pipe_avail(struct pipe *pp)
+{
+	unsigned head;
+
+	head = pp->pp_head;
+	membar_load_load();
+	return head - pp->pp_tail;
+}
+
+/*
+ * Space available to write. Called by the writer.
+ */
+static
+unsigned
+pipe_space(struct pipe *pp)
+{
+	unsigned tail;
+
+	tail = pp->pp_tail;
+	membar_load_load();
+	return PIPE_SIZE - (pp->pp_head - tail);
+}
+
+/*
+ * Wake the other side if it's asleep or about to go to sleep.
+ */
+static
+void
+pipe_wakeup(struct pipe *pp, bool *waiting, struct wchan *wc)
+{
+	membar_any_any();
+	if (*waiting) {
+		spinlock_acquire(&pp->pp_lock);
+		*waiting = false;
+		wchan_wakeall(wc, &pp->pp_lock);
+		spinlock_release(&pp->pp_lock);
+	}
+}
+
+/*
+ * Move up to LEN bytes between the ring, starting at counter POS, and
+ * the uio, in at most two pieces if it wraps. Returns the amount
+ * actually moved in *MOVED, which may be short if uiomove fails.
+ */
+static
+int
+pipe_uiomove(struct pipe *pp, unsigned pos, unsigned len, struct uio *uio,
+	     unsigned *moved)
+{
+	unsigned off, amt;
+	size_t startresid;
+	int result;
+
+	startresid = uio->uio_resid;
+
+	off = pos & (PIPE_SIZE - 1);
+	amt = PIPE_SIZE - off;
+	if (amt > len) {
+		amt = len;
+	}
+	result = uiomove(pp->pp_buf + off, amt, uio);
+	if (result == 0 && amt < len) {
+		result = uiomove(pp->pp_buf, len - amt, uio);
+	}
+
+	*moved = startresid - uio->uio_resid;
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// vnode ops
+
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	struct pipe *pp = vn->vn_data;
+	int how = openflags & O_ACCMODE;
+
+	if (vn == &pp->pp_readvn) {
+		return how == O_RDONLY ? 0 : EINVAL;
+	}
+	return how == O_WRONLY ? 0 : EINVAL;
+}
+
+/*
+ * Called when the last reference to one end goes away. Tell the
+ * other end, and free the pipe once both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *pp = vn->vn_data;
+	bool done;
+
+	spinlock_acquire(&pp->pp_lock);
+	if (vn == &pp->pp_readvn) {
+		pp->pp_readclosed = true;
+		pp->pp_writewaiting = false;
+		wchan_wakeall(pp->pp_writewchan, &pp->pp_lock);
+	}
+	else {
+		pp->pp_writeclosed = true;
+		pp->pp_readwaiting = false;
+		wchan_wakeall(pp->pp_readwchan, &pp->pp_lock);
+	}
+	done = pp->pp_readclosed && pp->pp_writeclosed;
+	spinlock_release(&pp->pp_lock);
+
+	pollq_wakeup(&pp->pp_pollq);
+	vnode_cleanup(vn);
+
+	if (done) {
+		pollq_cleanup(&pp->pp_pollq);
+		wchan_destroy(pp->pp_readwchan);
+		wchan_destroy(pp->pp_writewchan);
+		spinlock_cleanup(&pp->pp_lock);
+		lock_destroy(pp->pp_readlock);
+		lock_destroy(pp->pp_writelock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+	}
+	return 0;
+}
+
+/*
+ * Read. Wait until there's something in the pipe (or the write end
+ * is closed, which is EOF) and take as much as fits.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	unsigned avail, moved;
+	int result;
+
+	if (vn != &pp->pp_readvn) {
+		return EBADF;
+	}
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(pp->pp_readlock);
+
+	avail = pipe_avail(pp);
+	if (avail == 0) {
+		spinlock_acquire(&pp->pp_lock);
+		while (1) {
+			pp->pp_readwaiting = true;
+			membar_any_any();
+			avail = pipe_avail(pp);
+			if (avail > 0 || pp->pp_writeclosed) {
+				break;
+			}
+			wchan_sleep(pp->pp_readwchan, &pp->pp_lock);
+		}
+		pp->pp_readwaiting = false;
+		spinlock_release(&pp->pp_lock);
+
+		if (avail == 0) {
+			/* EOF */
+			lock_release(pp->pp_readlock);
+			return 0;
+		}
+	}
+
+	if (avail > uio->uio_resid) {
+		avail = uio->uio_resid;
+	}
+	result = pipe_uiomove(pp, pp->pp_tail, avail, uio, &moved);
+
+	/* finish reading the data before giving the space back */
+	membar_any_store();
+	pp->pp_tail += moved;
+	pipe_wakeup(pp, &pp->pp_writewaiting, pp->pp_writewchan);
+	pollq_wakeup(&pp->pp_pollq);
+
+	lock_release(pp->pp_readlock);
+	return result;
+}
+
+/*
+ * Write. Copy into the ring as space allows, waiting for the reader
+ * to make more. Fails with EPIPE if the read end is closed before
+ * anything is written; if it closes partway through, the short count
+ * is returned instead.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	unsigned need, space, moved;
+	size_t startresid;
+	int result = 0;
+
+	if (vn != &pp->pp_writevn) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_writelock);
+
+	startresid = uio->uio_resid;
+	need = (startresid <= PIPE_BUF) ? startresid : 1;
+
+	while (uio->uio_resid > 0) {
+		space = pipe_space(pp);
+		if (space < need || pp->pp_readclosed) {
+			spinlock_acquire(&pp->pp_lock);
+			while (1) {
+				pp->pp_writewaiting = true;
+				membar_any_any();
+				space = pipe_space(pp);
+				if (space >= need || pp->pp_readclosed) {
+					break;
+				}
+				wchan_sleep(pp->pp_writewchan, &pp->pp_lock);
+			}
+			pp->pp_writewaiting = false;
+			spinlock_release(&pp->pp_lock);
+
+			if (pp->pp_readclosed) {
+				if (uio->uio_resid == startresid) {
+					result = EPIPE;
+				}
+				break;
+			}
+		}
+
+		if (space > uio->uio_resid) {
+			space = uio->uio_resid;
+		}
+		result = pipe_uiomove(pp, pp->pp_head, space, uio, &moved);
+
+		/* publish the data before the head that covers it */
+		membar_store_store();
+		pp->pp_head += moved;
+		pipe_wakeup(pp, &pp->pp_readwaiting, pp->pp_readwchan);
+		pollq_wakeup(&pp->pp_pollq);
+
+		if (result) {
+			break;
+		}
+		need = 1;
+	}
+
+	lock_release(pp->pp_writelock);
+	return result;
+}
+
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+/*
+ * stat: report the amount of data currently in the pipe as the size.
+ */
+static
+int
+pipe_stat(struct vnode *vn, struct stat *statbuf)
+{
+	struct pipe *pp = vn->vn_data;
+
+	bzero(statbuf, sizeof(*statbuf));
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 0;
+	statbuf->st_size = pp->pp_head - pp->pp_tail;
+	statbuf->st_blksize = PIPE_SIZE;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+static
+int
+pipe_namefile(struct vnode *vn, struct uio *uio)
+{
+	(void)vn;
+	(void)uio;
+	return ENOTDIR;
+}
+
+/*
+ * Poll. The read end is readable if there's data or the write end is
+ * gone (so read won't block but returns EOF), which is also reported
+ * as POLLHUP. The write end is writable if an atomic write of
+ * PIPE_BUF bytes would fit, and reports POLLERR once the read end is
+ * gone.
+ */
+static
+int
+pipe_poll(struct vnode *vn, int events, struct poller *poller, int *revents)
+{
+	struct pipe *pp = vn->vn_data;
+	int result;
+
+	if (poller != NULL) {
+		result = poller_register(poller, &pp->pp_pollq);
+		if (result) {
+			return result;
+		}
+	}
+
+	*revents = 0;
+	if (vn == &pp->pp_readvn) {
+		if (pp->pp_writeclosed) {
+			*revents |= POLLHUP;
+		}
+		if (pp->pp_head != pp->pp_tail || pp->pp_writeclosed) {
+			*revents |= events & (POLLIN | POLLRDNORM);
+		}
+	}
+	else {
+		if (pp->pp_readclosed) {
+			*revents |= POLLERR;
+		}
+		else if (pipe_space(pp) >= PIPE_BUF) {
+			*revents |= events & (POLLOUT | POLLWRNORM);
+		}
+	}
+	return 0;
+}
+
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = pipe_namefile,
+	.vop_poll = pipe_poll,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// creation
+
+/*
+ * Create a pipe, handing back a vnode for each end. Each comes with
+ * one reference, which should be dropped with vfs_close.
+ */
+int
+pipe_create(struct vnode **readvn, struct vnode **writevn)
+{
+	struct pipe *pp;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_buf = kmalloc(PIPE_SIZE);
+	if (pp->pp_buf == NULL) {
+		goto fail_pp;
+	}
+	pp->pp_readlock = lock_create("pipe read");
+	if (pp->pp_readlock == NULL) {
+		goto fail_buf;
+	}
+	pp->pp_writelock = lock_create("pipe write");
+	if (pp->pp_writelock == NULL) {
+		goto fail_readlock;
+	}
+	pp->pp_readwchan = wchan_create("pipe read");
+	if (pp->pp_readwchan == NULL) {
+		goto fail_writelock;
+	}
+	pp->pp_writewchan = wchan_create("pipe write");
+	if (pp->pp_writewchan == NULL) {
+		goto fail_readwchan;
+	}
+
+	spinlock_init(&pp->pp_lock);
+	pp->pp_head = 0;
+	pp->pp_tail = 0;
+	pp->pp_readwaiting = false;
+	pp->pp_writewaiting = false;
+	pp->pp_readclosed = false;
+	pp->pp_writeclosed = false;
+	pollq_init(&pp->pp_pollq);
+
+	/* vnode_init doesn't fail */
+	vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+
+	*readvn = &pp->pp_readvn;
+	*writevn = &pp->pp_writevn;
+	return 0;
+
+ fail_readwchan:
+	wchan_destroy(pp->pp_readwchan);
+ fail_writelock:
+	lock_destroy(pp->pp_writelock);
+ fail_readlock:
+	lock_destroy(pp->pp_readlock);
+ fail_buf:
+	kfree(pp->pp_buf);
+ fail_pp:
+	kfree(pp);
+	return ENOMEM;
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Readiness notification for poll() and select(). See poll.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <poll.h>
+
+/*
+ * One registration of a poller on a pollq.
+ */
+struct pollent {
+	struct poller *pe_poller;
+	struct pollq *pe_q;
+	struct pollent *pe_qnext;	/* next on pe_q (under pq_lock) */
+	struct pollent *pe_pnext;	/* next of pe_poller's */
+};
+
+////////////////////////////////////////////////////////////
+// pollq
+
+void
+pollq_init(struct pollq *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_ents = NULL;
+}
+
+void
+pollq_cleanup(struct pollq *pq)
+{
+	KASSERT(pq->pq_ents == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+/*
+ * Wake up one poller. Called with the pollq's lock held.
+ */
+static
+void
+poller_wake(struct poller *pl)
+{
+	spinlock_acquire(&pl->pl_lock);
+	pl->pl_ready = true;
+	wchan_wakeall(pl->pl_wchan, &pl->pl_lock);
+	spinlock_release(&pl->pl_lock);
+}
+
+/*
+ * Called by an object whenever it might have become ready.
+ */
+void
+pollq_wakeup(struct pollq *pq)
+{
+	struct pollent *pe;
+
+	membar_any_any();
+	if (pq->pq_ents == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_ents; pe != NULL; pe = pe->pe_qnext) {
+		poller_wake(pe->pe_poller);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+////////////////////////////////////////////////////////////
+// poller
+
+/*
+ * Timeout function: wake the poller as if something happened.
+ */
+static
+void
+poller_timeout(void *data)
+{
+	struct poller *pl = data;
+
+	spinlock_acquire(&pl->pl_lock);
+	pl->pl_timedout = true;
+	pl->pl_ready = true;
+	wchan_wakeall(pl->pl_wchan, &pl->pl_lock);
+	spinlock_release(&pl->pl_lock);
+}
+
+int
+poller_init(struct poller *pl)
+{
+	pl->pl_wchan = wchan_create("poll");
+	if (pl->pl_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pl->pl_lock);
+	pl->pl_ready = false;
+	pl->pl_timedout = false;
+	timeout_init(&pl->pl_timeout, poller_timeout, pl);
+	pl->pl_ents = NULL;
+	return 0;
+}
+
+/*
+ * Stop the timeout, remove all the registrations, and clean up.
+ */
+void
+poller_cleanup(struct poller *pl)
+{
+	struct pollent *pe, **pp;
+	struct pollq *pq;
+
+	timeout_stop(&pl->pl_timeout);
+
+	while (pl->pl_ents != NULL) {
+		pe = pl->pl_ents;
+		pl->pl_ents = pe->pe_pnext;
+
+		pq = pe->pe_q;
+		spinlock_acquire(&pq->pq_lock);
+		for (pp = &pq->pq_ents; *pp != pe; pp = &(*pp)->pe_qnext) {
+			KASSERT(*pp != NULL);
+		}
+		*pp = pe->pe_qnext;
+		spinlock_release(&pq->pq_lock);
+
+		kfree(pe);
+	}
+
+	spinlock_cleanup(&pl->pl_lock);
+	wchan_destroy(pl->pl_wchan);
+}
+
+/*
+ * Register PL on PQ. Called from vop_poll before checking whether
+ * the object is ready.
+ */
+int
+poller_register(struct poller *pl, struct pollq *pq)
+{
+	struct pollent *pe;
+
+	pe = kmalloc(sizeof(*pe));
+	if (pe == NULL) {
+		return ENOMEM;
+	}
+	pe->pe_poller = pl;
+	pe->pe_q = pq;
+	pe->pe_pnext = pl->pl_ents;
+	pl->pl_ents = pe;
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_qnext = pq->pq_ents;
+	pq->pq_ents = pe;
+	spinlock_release(&pq->pq_lock);
+
+	return 0;
+}
+
+/*
+ * Arrange for poller_wait to give up after TICKS hardclocks.
+ */
+void
+poller_settimeout(struct poller *pl, unsigned ticks)
+{
+	timeout_start(&pl->pl_timeout, ticks);
+}
+
+/*
+ * Forget earlier wakeups before polling the objects again.
+ */
+void
+poller_reset(struct poller *pl)
+{
+	spinlock_acquire(&pl->pl_lock);
+	pl->pl_ready = pl->pl_timedout;
+	spinlock_release(&pl->pl_lock);
+}
+
+/*
+ * Sleep until something registered on changes state or the timeout
+ * goes off. Returns false if it was the timeout.
+ */
+bool
+poller_wait(struct poller *pl)
+{
+	bool ret;
+
+	spinlock_acquire(&pl->pl_lock);
+	while (!pl->pl_ready) {
+		wchan_sleep(pl->pl_wchan, &pl->pl_lock);
+	}
+	ret = !pl->pl_timedout;
+	spinlock_release(&pl->pl_lock);
+	return ret;
+}
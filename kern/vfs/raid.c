@@ -0,0 +1,704 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Software RAID device. See raid.h.
+ *
+ * Each member disk has a worker thread with a queue of pieces of
+ * I/O. A request that touches several disks is split into pieces,
+ * one per stripe unit (RAID-0) or one per disk (RAID-1 writes), that
+ * are handed to the workers so the disks run at the same time; the
+ * caller sleeps until they are all done. A request that only touches
+ * one disk, which is the common case for filesystem blocks and is
+ * always the case for mirror reads, is done in the caller's thread.
+ *
+ * The workers run in the kernel process and can't see user memory,
+ * so data goes through a kernel buffer RAID_MAXIO bytes at a time.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <device.h>
+#include <raid.h>
+
+/* Largest transfer done in one pass */
+#define RAID_MAXIO	(64*1024)
+
+struct raid_batch {
+	unsigned rb_pending;		/* pieces not yet done */
+};
+
+struct raid_piece {
+	unsigned rp_member;		/* which disk */
+	off_t rp_offset;		/* byte offset on that disk */
+	char *rp_buf;
+	size_t rp_len;
+	enum uio_rw rp_rw;
+	int rp_result;
+	struct raid_batch *rp_batch;
+	struct raid_piece *rp_next;	/* worker queue link */
+};
+
+struct raid_member {
+	char *rm_name;
+	struct vnode *rm_vn;		/* raw device, from vfs_claimdev */
+	bool rm_failed;
+	unsigned rm_reading;		/* mirror reads in progress */
+	off_t rm_lastpos;		/* where the last I/O ended */
+	struct raid_piece *rm_head;	/* work queue */
+	struct raid_piece *rm_tail;
+	struct wchan *rm_wchan;		/* worker sleeps here */
+};
+
+struct raid_softc {
+	struct device rs_dev;
+	char *rs_name;
+	int rs_level;
+	unsigned rs_ndisks;
+	unsigned rs_nlive;		/* members not failed */
+	uint32_t rs_unit;		/* stripe unit in bytes */
+	unsigned rs_maxpieces;		/* pieces in one pass, at most */
+	struct raid_member *rs_members;
+
+	struct spinlock rs_lock;	/* protects everything below */
+	struct wchan *rs_donewchan;	/* callers wait for pieces here */
+	unsigned rs_nworkers;		/* worker threads running */
+	bool rs_dying;			/* tell the workers to exit */
+};
+
+////////////////////////////////////////////////////////////
+// Moving pieces
+
+/*
+ * Do one piece of I/O on its member disk.
+ */
+static
+int
+raid_pieceio(struct raid_softc *rs, struct raid_piece *rp)
+{
+	struct raid_member *rm = &rs->rs_members[rp->rp_member];
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	uio_kinit(&iov, &ku, rp->rp_buf, rp->rp_len, rp->rp_offset,
+		  rp->rp_rw);
+	if (rp->rp_rw == UIO_READ) {
+		result = VOP_READ(rm->rm_vn, &ku);
+	}
+	else {
+		result = VOP_WRITE(rm->rm_vn, &ku);
+	}
+	if (result == 0 && ku.uio_resid != 0) {
+		result = EIO;
+	}
+
+	spinlock_acquire(&rs->rs_lock);
+	rm->rm_lastpos = rp->rp_offset + rp->rp_len;
+	spinlock_release(&rs->rs_lock);
+
+	return result;
+}
+
+/*
+ * Worker thread for member disk INDEX.
+ */
+static
+void
+raid_worker(void *data1, unsigned long index)
+{
+	struct raid_softc *rs = data1;
+	struct raid_member *rm = &rs->rs_members[index];
+	struct raid_piece *rp;
+
+	spinlock_acquire(&rs->rs_lock);
+	while (1) {
+		while (rm->rm_head == NULL && !rs->rs_dying) {
+			wchan_sleep(rm->rm_wchan, &rs->rs_lock);
+		}
+		if (rm->rm_head == NULL) {
+			break;
+		}
+		rp = rm->rm_head;
+		rm->rm_head = rp->rp_next;
+		if (rm->rm_head == NULL) {
+			rm->rm_tail = NULL;
+		}
+		spinlock_release(&rs->rs_lock);
+
+		rp->rp_result = raid_pieceio(rs, rp);
+
+		spinlock_acquire(&rs->rs_lock);
+		KASSERT(rp->rp_batch->rb_pending > 0);
+		rp->rp_batch->rb_pending--;
+		if (rp->rp_batch->rb_pending == 0) {
+			wchan_wakeall(rs->rs_donewchan, &rs->rs_lock);
+		}
+	}
+
+	KASSERT(rs->rs_nworkers > 0);
+	rs->rs_nworkers--;
+	wchan_wakeall(rs->rs_donewchan, &rs->rs_lock);
+	spinlock_release(&rs->rs_lock);
+}
+
+/*
+ * Run NP pieces and wait for all of them. If they all go to the same
+ * disk there's nothing to overlap, so skip the workers.
+ */
+static
+void
+raid_runpieces(struct raid_softc *rs, struct raid_piece *pieces,
+	       unsigned np)
+{
+	struct raid_batch rb;
+	struct raid_member *rm;
+	bool spread = false;
+	unsigned i;
+
+	for (i=1; i<np; i++) {
+		if (pieces[i].rp_member != pieces[0].rp_member) {
+			spread = true;
+			break;
+		}
+	}
+
+	if (!spread) {
+		for (i=0; i<np; i++) {
+			pieces[i].rp_result = raid_pieceio(rs, &pieces[i]);
+		}
+		return;
+	}
+
+	rb.rb_pending = np;
+
+	spinlock_acquire(&rs->rs_lock);
+	for (i=0; i<np; i++) {
+		rm = &rs->rs_members[pieces[i].rp_member];
+		pieces[i].rp_batch = &rb;
+		pieces[i].rp_next = NULL;
+		if (rm->rm_tail == NULL) {
+			rm->rm_head = &pieces[i];
+		}
+		else {
+			rm->rm_tail->rp_next = &pieces[i];
+		}
+		rm->rm_tail = &pieces[i];
+		wchan_wakeall(rm->rm_wchan, &rs->rs_lock);
+	}
+	while (rb.rb_pending > 0) {
+		wchan_sleep(rs->rs_donewchan, &rs->rs_lock);
+	}
+	spinlock_release(&rs->rs_lock);
+}
+
+/*
+ * Drop a mirror that failed an I/O.
+ */
+static
+void
+raid_fail(struct raid_softc *rs, unsigned index, int err)
+{
+	struct raid_member *rm = &rs->rs_members[index];
+	bool wasgood;
+	unsigned nlive;
+
+	spinlock_acquire(&rs->rs_lock);
+	wasgood = !rm->rm_failed;
+	if (wasgood) {
+		rm->rm_failed = true;
+		rs->rs_nlive--;
+	}
+	nlive = rs->rs_nlive;
+	spinlock_release(&rs->rs_lock);
+
+	if (wasgood) {
+		kprintf("%s: %s failed (%s); %u of %u disks left\n",
+			rs->rs_name, rm->rm_name, strerror(err),
+			nlive, rs->rs_ndisks);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// RAID-0
+
+/*
+ * Stripe unit N lives on disk N % ndisks, as unit N / ndisks there.
+ */
+static
+int
+raid0_rw(struct raid_softc *rs, off_t pos, char *buf, size_t len,
+	 enum uio_rw rw, struct raid_piece *pieces)
+{
+	struct raid_piece *rp;
+	uint64_t unit;
+	uint32_t within;
+	size_t done, amt;
+	unsigned np, i;
+
+	np = 0;
+	for (done = 0; done < len; done += amt) {
+		unit = (pos + done) / rs->rs_unit;
+		within = (pos + done) % rs->rs_unit;
+		amt = rs->rs_unit - within;
+		if (amt > len - done) {
+			amt = len - done;
+		}
+
+		KASSERT(np < rs->rs_maxpieces);
+		rp = &pieces[np++];
+		rp->rp_member = unit % rs->rs_ndisks;
+		rp->rp_offset = (unit / rs->rs_ndisks) * rs->rs_unit + within;
+		rp->rp_buf = buf + done;
+		rp->rp_len = amt;
+		rp->rp_rw = rw;
+	}
+
+	raid_runpieces(rs, pieces, np);
+
+	for (i=0; i<np; i++) {
+		if (pieces[i].rp_result) {
+			return pieces[i].rp_result;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// RAID-1
+
+/*
+ * Choose the mirror to read POS from: the one with the fewest reads
+ * in progress, and among those the one that last did I/O nearest
+ * POS. Returns the index, or -1 if no disks are left.
+ */
+static
+int
+raid1_pick(struct raid_softc *rs, off_t pos)
+{
+	struct raid_member *rm;
+	off_t dist, bestdist = 0;
+	int best = -1;
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&rs->rs_lock));
+
+	for (i=0; i<rs->rs_ndisks; i++) {
+		rm = &rs->rs_members[i];
+		if (rm->rm_failed) {
+			continue;
+		}
+		dist = rm->rm_lastpos > pos ?
+			rm->rm_lastpos - pos : pos - rm->rm_lastpos;
+		if (best < 0 ||
+		    rm->rm_reading < rs->rs_members[best].rm_reading ||
+		    (rm->rm_reading == rs->rs_members[best].rm_reading &&
+		     dist < bestdist)) {
+			best = i;
+			bestdist = dist;
+		}
+	}
+	return best;
+}
+
+static
+int
+raid1_read(struct raid_softc *rs, off_t pos, char *buf, size_t len)
+{
+	struct raid_piece rp;
+	int which;
+
+	while (1) {
+		spinlock_acquire(&rs->rs_lock);
+		which = raid1_pick(rs, pos);
+		if (which < 0) {
+			spinlock_release(&rs->rs_lock);
+			return EIO;
+		}
+		rs->rs_members[which].rm_reading++;
+		spinlock_release(&rs->rs_lock);
+
+		rp.rp_member = which;
+		rp.rp_offset = pos;
+		rp.rp_buf = buf;
+		rp.rp_len = len;
+		rp.rp_rw = UIO_READ;
+		rp.rp_result = raid_pieceio(rs, &rp);
+
+		spinlock_acquire(&rs->rs_lock);
+		rs->rs_members[which].rm_reading--;
+		spinlock_release(&rs->rs_lock);
+
+		if (rp.rp_result == 0) {
+			return 0;
+		}
+		/* Drop that disk and try another copy. */
+		raid_fail(rs, which, rp.rp_result);
+	}
+}
+
+/*
+ * Write to every good mirror. Succeeds as long as one copy made it.
+ */
+static
+int
+raid1_write(struct raid_softc *rs, off_t pos, char *buf, size_t len,
+	    struct raid_piece *pieces)
+{
+	unsigned np, i;
+	int result = EIO;
+
+	np = 0;
+	spinlock_acquire(&rs->rs_lock);
+	for (i=0; i<rs->rs_ndisks; i++) {
+		if (rs->rs_members[i].rm_failed) {
+			continue;
+		}
+		pieces[np].rp_member = i;
+		pieces[np].rp_offset = pos;
+		pieces[np].rp_buf = buf;
+		pieces[np].rp_len = len;
+		pieces[np].rp_rw = UIO_WRITE;
+		np++;
+	}
+	spinlock_release(&rs->rs_lock);
+
+	raid_runpieces(rs, pieces, np);
+
+	for (i=0; i<np; i++) {
+		if (pieces[i].rp_result) {
+			raid_fail(rs, pieces[i].rp_member,
+				  pieces[i].rp_result);
+		}
+		else {
+			result = 0;
+		}
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// Device operations
+
+static
+int
+raid_eachopen(struct device *d, int openflags)
+{
+	(void)d;
+	(void)openflags;
+	return 0;
+}
+
+static
+int
+raid_io(struct device *d, struct uio *uio)
+{
+	struct raid_softc *rs = d->d_data;
+	struct raid_piece *pieces;
+	char *buf;
+	size_t len;
+	off_t pos;
+	int result = 0;
+
+	/* Same rules as a disk: whole blocks, inside the device. */
+	if (uio->uio_offset < 0 ||
+	    uio->uio_offset % d->d_blocksize != 0 ||
+	    uio->uio_resid % d->d_blocksize != 0) {
+		return EINVAL;
+	}
+	if (uio->uio_resid / d->d_blocksize > d->d_blocks ||
+	    uio->uio_offset / d->d_blocksize >
+	    d->d_blocks - uio->uio_resid / d->d_blocksize) {
+		return EINVAL;
+	}
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	len = uio->uio_resid < RAID_MAXIO ? uio->uio_resid : RAID_MAXIO;
+	buf = kmalloc(len);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	pieces = kmalloc(rs->rs_maxpieces * sizeof(*pieces));
+	if (pieces == NULL) {
+		kfree(buf);
+		return ENOMEM;
+	}
+
+	while (uio->uio_resid > 0) {
+		len = uio->uio_resid < RAID_MAXIO ? uio->uio_resid : RAID_MAXIO;
+		pos = uio->uio_offset;
+
+		if (uio->uio_rw == UIO_WRITE) {
+			result = uiomove(buf, len, uio);
+			if (result) {
+				break;
+			}
+		}
+
+		if (rs->rs_level == RAID_STRIPE) {
+			result = raid0_rw(rs, pos, buf, len, uio->uio_rw,
+					  pieces);
+		}
+		else if (uio->uio_rw == UIO_READ) {
+			result = raid1_read(rs, pos, buf, len);
+		}
+		else {
+			result = raid1_write(rs, pos, buf, len, pieces);
+		}
+		if (result) {
+			break;
+		}
+
+		if (uio->uio_rw == UIO_READ) {
+			result = uiomove(buf, len, uio);
+			if (result) {
+				break;
+			}
+		}
+	}
+
+	kfree(pieces);
+	kfree(buf);
+	return result;
+}
+
+static
+int
+raid_ioctl(struct device *d, int op, userptr_t data)
+{
+	(void)d;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+static const struct device_ops raid_devops = {
+	.devop_eachopen = raid_eachopen,
+	.devop_io = raid_io,
+	.devop_ioctl = raid_ioctl,
+};
+
+////////////////////////////////////////////////////////////
+// Setup
+
+/*
+ * Stop the workers and release the disks. Used when creation fails.
+ */
+static
+void
+raid_destroy(struct raid_softc *rs)
+{
+	struct raid_member *rm;
+	unsigned i;
+
+	spinlock_acquire(&rs->rs_lock);
+	rs->rs_dying = true;
+	for (i=0; i<rs->rs_ndisks; i++) {
+		wchan_wakeall(rs->rs_members[i].rm_wchan, &rs->rs_lock);
+	}
+	while (rs->rs_nworkers > 0) {
+		wchan_sleep(rs->rs_donewchan, &rs->rs_lock);
+	}
+	spinlock_release(&rs->rs_lock);
+
+	for (i=0; i<rs->rs_ndisks; i++) {
+		rm = &rs->rs_members[i];
+		if (rm->rm_vn != NULL) {
+			VOP_DECREF(rm->rm_vn);
+			vfs_releasedev(rm->rm_name);
+		}
+		if (rm->rm_wchan != NULL) {
+			wchan_destroy(rm->rm_wchan);
+		}
+		if (rm->rm_name != NULL) {
+			kfree(rm->rm_name);
+		}
+	}
+	if (rs->rs_donewchan != NULL) {
+		wchan_destroy(rs->rs_donewchan);
+	}
+	spinlock_cleanup(&rs->rs_lock);
+	kfree(rs->rs_members);
+	kfree(rs->rs_name);
+	kfree(rs);
+}
+
+int
+raid_create(const char *name, int level, unsigned ndisks, char **disks)
+{
+	struct raid_softc *rs;
+	struct raid_member *rm;
+	struct stat st;
+	blkcnt_t minblocks = 0, perdisk;
+	blksize_t blocksize = 0;
+	unsigned i;
+	size_t len;
+	int result;
+
+	if (level != RAID_STRIPE && level != RAID_MIRROR) {
+		return EINVAL;
+	}
+	if (ndisks < 2 || ndisks > RAID_MAXDISKS) {
+		return EINVAL;
+	}
+
+	rs = kmalloc(sizeof(*rs));
+	if (rs == NULL) {
+		return ENOMEM;
+	}
+	rs->rs_name = kstrdup(name);
+	rs->rs_members = kmalloc(ndisks * sizeof(*rs->rs_members));
+	if (rs->rs_name == NULL || rs->rs_members == NULL) {
+		kfree(rs->rs_members);
+		kfree(rs->rs_name);
+		kfree(rs);
+		return ENOMEM;
+	}
+	rs->rs_level = level;
+	rs->rs_ndisks = ndisks;
+	rs->rs_nlive = ndisks;
+	spinlock_init(&rs->rs_lock);
+	rs->rs_donewchan = wchan_create("raid");
+	rs->rs_nworkers = 0;
+	rs->rs_dying = false;
+	for (i=0; i<ndisks; i++) {
+		rm = &rs->rs_members[i];
+		rm->rm_name = NULL;
+		rm->rm_vn = NULL;
+		rm->rm_failed = false;
+		rm->rm_reading = 0;
+		rm->rm_lastpos = 0;
+		rm->rm_head = rm->rm_tail = NULL;
+		rm->rm_wchan = wchan_create("raidq");
+	}
+
+	if (rs->rs_donewchan == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+	for (i=0; i<ndisks; i++) {
+		if (rs->rs_members[i].rm_wchan == NULL) {
+			result = ENOMEM;
+			goto fail;
+		}
+	}
+
+	/* Claim the disks. */
+	for (i=0; i<ndisks; i++) {
+		rm = &rs->rs_members[i];
+		rm->rm_name = kstrdup(disks[i]);
+		if (rm->rm_name == NULL) {
+			result = ENOMEM;
+			goto fail;
+		}
+		/* Allow (but do not require) colon after device name */
+		len = strlen(rm->rm_name);
+		if (len > 0 && rm->rm_name[len-1] == ':') {
+			rm->rm_name[len-1] = 0;
+		}
+
+		result = vfs_claimdev(rm->rm_name, &rm->rm_vn);
+		if (result) {
+			kprintf("%s: %s: %s\n", name, rm->rm_name,
+				strerror(result));
+			rm->rm_vn = NULL;
+			goto fail;
+		}
+		result = VOP_STAT(rm->rm_vn, &st);
+		if (result) {
+			goto fail;
+		}
+		if (st.st_blocks == 0 ||
+		    (blocksize != 0 && st.st_blksize != blocksize)) {
+			kprintf("%s: %s: not a disk like the others\n",
+				name, rm->rm_name);
+			result = EINVAL;
+			goto fail;
+		}
+		blocksize = st.st_blksize;
+		if (i == 0 || st.st_blocks < minblocks) {
+			minblocks = st.st_blocks;
+		}
+	}
+
+	rs->rs_unit = RAID_STRIPESECTS * blocksize;
+	if (level == RAID_STRIPE) {
+		perdisk = minblocks - minblocks % RAID_STRIPESECTS;
+		rs->rs_dev.d_blocks = perdisk * ndisks;
+		rs->rs_maxpieces = RAID_MAXIO / rs->rs_unit + 1;
+	}
+	else {
+		rs->rs_dev.d_blocks = minblocks;
+		rs->rs_maxpieces = ndisks;
+	}
+	if (rs->rs_dev.d_blocks == 0) {
+		result = EINVAL;
+		goto fail;
+	}
+	rs->rs_dev.d_ops = &raid_devops;
+	rs->rs_dev.d_blocksize = blocksize;
+	rs->rs_dev.d_devnumber = 0; /* assigned by vfs_adddev */
+	rs->rs_dev.d_data = rs;
+
+	for (i=0; i<ndisks; i++) {
+		spinlock_acquire(&rs->rs_lock);
+		rs->rs_nworkers++;
+		spinlock_release(&rs->rs_lock);
+		result = thread_fork(rs->rs_members[i].rm_name, NULL,
+				     raid_worker, rs, i);
+		if (result) {
+			spinlock_acquire(&rs->rs_lock);
+			rs->rs_nworkers--;
+			spinlock_release(&rs->rs_lock);
+			goto fail;
+		}
+	}
+
+	result = vfs_adddev(name, &rs->rs_dev, 1);
+	if (result) {
+		goto fail;
+	}
+
+	kprintf("%s: RAID-%d over %u disks, %u blocks\n", name, level,
+		ndisks, (unsigned)rs->rs_dev.d_blocks);
+	return 0;
+
+ fail:
+	raid_destroy(rs);
+	return result;
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * RAM disk: a block device whose blocks are kept in kernel pages.
+ *
+ * It behaves like a disk (fixed size, whole-block I/O) so mksfs can
+ * format it through its raw device and SFS can mount it. Pages are
+ * only allocated when first written; blocks never written read as
+ * zeros, so an unused RAM disk costs just its page table. Since the
+ * pages can all end up allocated, though, the sizes of all RAM disks
+ * together are limited to 1/RD_RAMSHARE of physical memory.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <vm.h>
+#include <mainbus.h>
+#include <vfs.h>
+#include <device.h>
+
+#define RD_BLOCKSIZE	512
+#define RD_RAMSHARE	4	/* all RAM disks: 1/this of RAM */
+
+/* Pages promised to RAM disks so far */
+static struct spinlock rd_budgetlock = SPINLOCK_INITIALIZER;
+static unsigned rd_reserved;
+
+struct ramdisk {
+	struct device rd_dev;
+	struct lock *rd_lock;		/* protects rd_pages contents */
+	vaddr_t *rd_pages;		/* 0 for a page never written */
+	unsigned rd_npages;
+};
+
+static
+int
+ramdisk_eachopen(struct device *d, int openflags)
+{
+	(void)d;
+	(void)openflags;
+	return 0;
+}
+
+static
+int
+ramdisk_io(struct device *d, struct uio *uio)
+{
+	struct ramdisk *rd = d->d_data;
+	unsigned pageno;
+	vaddr_t page;
+	size_t off, amt;
+	int result = 0;
+
+	/* Same rules as a disk: whole blocks, inside the device. */
+	if (uio->uio_offset < 0 ||
+	    uio->uio_offset % RD_BLOCKSIZE != 0 ||
+	    uio->uio_resid % RD_BLOCKSIZE != 0) {
+		return EINVAL;
+	}
+	if (uio->uio_resid / RD_BLOCKSIZE > d->d_blocks ||
+	    uio->uio_offset / RD_BLOCKSIZE >
+	    d->d_blocks - uio->uio_resid / RD_BLOCKSIZE) {
+		return EINVAL;
+	}
+
+	lock_acquire(rd->rd_lock);
+	while (uio->uio_resid > 0) {
+		pageno = uio->uio_offset / PAGE_SIZE;
+		off = uio->uio_offset % PAGE_SIZE;
+		amt = PAGE_SIZE - off;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		KASSERT(pageno < rd->rd_npages);
+
+		page = rd->rd_pages[pageno];
+		if (uio->uio_rw == UIO_READ) {
+			if (page == 0) {
+				result = uiomovezeros(amt, uio);
+			}
+			else {
+				result = uiomove((char *)page + off, amt, uio);
+			}
+		}
+		else {
+			if (page == 0) {
+				page = alloc_kpages(1);
+				if (page == 0) {
+					result = ENOSPC;
+					break;
+				}
+				bzero((void *)page, PAGE_SIZE);
+				rd->rd_pages[pageno] = page;
+			}
+			result = uiomove((char *)page + off, amt, uio);
+		}
+		if (result) {
+			break;
+		}
+	}
+	lock_release(rd->rd_lock);
+	return result;
+}
+
+static
+int
+ramdisk_ioctl(struct device *d, int op, userptr_t data)
+{
+	(void)d;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+static const struct device_ops ramdisk_devops = {
+	.devop_eachopen = ramdisk_eachopen,
+	.devop_io = ramdisk_io,
+	.devop_ioctl = ramdisk_ioctl,
+};
+
+/*
+ * Reserve the pages for a new RAM disk of SIZE bytes, returning how
+ * many in NPAGES_RET, or fail with ENOSPC if that would take RAM
+ * disks past their share of memory.
+ */
+static
+int
+ramdisk_reserve(size_t size, unsigned *npages_ret)
+{
+	unsigned npages, max;
+	int result;
+
+	max = mainbus_ramsize() / PAGE_SIZE / RD_RAMSHARE;
+	if (size > (size_t)max * PAGE_SIZE) {
+		return ENOSPC;
+	}
+	npages = DIVROUNDUP(size, PAGE_SIZE);
+
+	spinlock_acquire(&rd_budgetlock);
+	if (npages > max - rd_reserved) {
+		result = ENOSPC;
+	}
+	else {
+		rd_reserved += npages;
+		*npages_ret = npages;
+		result = 0;
+	}
+	spinlock_release(&rd_budgetlock);
+	return result;
+}
+
+/*
+ * Give back a reservation, for a RAM disk that couldn't be created.
+ */
+static
+void
+ramdisk_unreserve(unsigned npages)
+{
+	spinlock_acquire(&rd_budgetlock);
+	KASSERT(rd_reserved >= npages);
+	rd_reserved -= npages;
+	spinlock_release(&rd_budgetlock);
+}
+
+/*
+ * Create a RAM disk of SIZE bytes (rounded up to whole pages) and
+ * add it to the VFS as a mountable device called NAME. Fails with
+ * ENOSPC if it doesn't fit in what's left of the RAM disks' share of
+ * memory.
+ */
+int
+ramdisk_create(const char *name, size_t size)
+{
+	struct ramdisk *rd;
+	unsigned npages, i;
+	int result;
+
+	if (size == 0) {
+		return EINVAL;
+	}
+	result = ramdisk_reserve(size, &npages);
+	if (result) {
+		return result;
+	}
+
+	rd = kmalloc(sizeof(*rd));
+	if (rd == NULL) {
+		ramdisk_unreserve(npages);
+		return ENOMEM;
+	}
+	rd->rd_npages = npages;
+	rd->rd_pages = kmalloc(rd->rd_npages * sizeof(*rd->rd_pages));
+	if (rd->rd_pages == NULL) {
+		kfree(rd);
+		ramdisk_unreserve(npages);
+		return ENOMEM;
+	}
+	for (i=0; i<rd->rd_npages; i++) {
+		rd->rd_pages[i] = 0;
+	}
+	rd->rd_lock = lock_create(name);
+	if (rd->rd_lock == NULL) {
+		kfree(rd->rd_pages);
+		kfree(rd);
+		ramdisk_unreserve(npages);
+		return ENOMEM;
+	}
+
+	rd->rd_dev.d_ops = &ramdisk_devops;
+	rd->rd_dev.d_blocks = rd->rd_npages * (PAGE_SIZE / RD_BLOCKSIZE);
+	rd->rd_dev.d_blocksize = RD_BLOCKSIZE;
+	rd->rd_dev.d_devnumber = 0; /* assigned by vfs_adddev */
+	rd->rd_dev.d_data = rd;
+
+	result = vfs_adddev(name, &rd->rd_dev, 1);
+	if (result) {
+		lock_destroy(rd->rd_lock);
+		kfree(rd->rd_pages);
+		kfree(rd);
+		ramdisk_unreserve(npages);
+		return result;
+	}
+
+	kprintf("%s: RAM disk, %u blocks\n", name,
+		(unsigned)rd->rd_dev.d_blocks);
+	return 0;
+}
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * VFS name cache.
+ *
+ * Maps (directory vnode, component name) to the vnode that
+ * VOP_LOOKUP returned for it, or to "no such file" for a negative
+ * entry. Path translation in vfslookup.c consults this before going
+ * to the filesystem, so repeated opens of the same names (/bin/sh,
+ * /testbin/..., long relative paths) are resolved without calling
+ * into the driver and without taking the VFS big lock.
+ *
+ * Each entry holds a reference to both the directory and, for
+ * positive entries, the child. The cache is a fixed table of entries
+ * on hash chains plus an LRU list; when it fills up the least
+ * recently used entry is recycled.
+ *
+ * Anything that changes the contents of a directory must call
+ * vfs_dcache_remove for the names it touches after the operation is
+ * done. Misses are looked up and entered while holding the big lock
+ * so a negative entry can't be entered behind the back of a create
+ * that has already invalidated the name.
+ *
+ * Invalidation is by (filesystem, name) rather than by directory
+ * vnode, because some filesystems (emufs) can hand out more than one
+ * vnode for the same directory. This is conservative: it may also
+ * drop entries for the same name in other directories.
+ *
+ * Locking: the cache has its own lock, which may be taken while
+ * holding the big lock but never the other way around. Vnode
+ * references dropped by the cache are released only after the cache
+ * lock is released, since VOP_DECREF can call into the filesystem.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <vfs.h>
+#include <vnode.h>
+
+/* Number of entries and hash chains */
+#define DCACHE_SIZE	128
+#define DCACHE_HASHSIZE	64
+
+/* Longest name we cache; longer names always go to the filesystem */
+#define DCACHE_NAMELEN	31
+
+struct dcentry {
+	struct vnode *dc_dir;		/* directory (NULL if entry unused) */
+	struct vnode *dc_vn;		/* result; NULL for negative entry */
+	unsigned dc_hash;		/* hash of dc_dir and dc_name */
+	int dc_chain;			/* hash chain, -1 if not on one */
+	struct dcentry *dc_hnext;	/* next on hash chain */
+	struct dcentry *dc_prev;	/* LRU list (head is most recent) */
+	struct dcentry *dc_next;
+	char dc_name[DCACHE_NAMELEN+1];
+};
+
+static struct lock *dcache_lock;
+static struct dcentry dcache_entries[DCACHE_SIZE];
+static struct dcentry *dcache_hash[DCACHE_HASHSIZE];
+static struct dcentry *dcache_lruhead, *dcache_lrutail;
+
+/*
+ * Decide whether a name is worth caching. Device vnodes have no
+ * directory structure; "." and ".." depend on more than the
+ * directory's own contents and are cheap anyway.
+ */
+static
+bool
+dcache_cacheable(struct vnode *dir, const char *name)
+{
+	if (dir->vn_fs == NULL) {
+		return false;
+	}
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return false;
+	}
+	return strlen(name) <= DCACHE_NAMELEN;
+}
+
+static
+unsigned
+dcache_hashfn(struct vnode *dir, const char *name)
+{
+	unsigned h;
+
+	h = (unsigned)(uintptr_t)dir >> 4;
+	while (*name) {
+		h = h*33 + (unsigned char)*name++;
+	}
+	return h;
+}
+
+/*
+ * LRU list operations.
+ */
+static
+void
+dcache_lru_unlink(struct dcentry *dc)
+{
+	if (dc->dc_prev != NULL) {
+		dc->dc_prev->dc_next = dc->dc_next;
+	}
+	else {
+		dcache_lruhead = dc->dc_next;
+	}
+	if (dc->dc_next != NULL) {
+		dc->dc_next->dc_prev = dc->dc_prev;
+	}
+	else {
+		dcache_lrutail = dc->dc_prev;
+	}
+	dc->dc_prev = dc->dc_next = NULL;
+}
+
+static
+void
+dcache_lru_push(struct dcentry *dc)
+{
+	dc->dc_prev = NULL;
+	dc->dc_next = dcache_lruhead;
+	if (dcache_lruhead != NULL) {
+		dcache_lruhead->dc_prev = dc;
+	}
+	else {
+		dcache_lrutail = dc;
+	}
+	dcache_lruhead = dc;
+}
+
+/*
+ * Take an entry off its hash chain and clear it, handing back the
+ * references it held in DIRRET and VNRET for the caller to release
+ * once the cache lock has been dropped. The entry moves to the tail
+ * of the LRU list so it gets reused first.
+ */
+static
+void
+dcache_drop(struct dcentry *dc, struct vnode **dirret, struct vnode **vnret)
+{
+	struct dcentry **pp;
+
+	KASSERT(lock_do_i_hold(dcache_lock));
+	KASSERT(dc->dc_dir != NULL);
+
+	for (pp = &dcache_hash[dc->dc_chain]; *pp != dc;
+	     pp = &(*pp)->dc_hnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = dc->dc_hnext;
+	dc->dc_hnext = NULL;
+	dc->dc_chain = -1;
+
+	*dirret = dc->dc_dir;
+	*vnret = dc->dc_vn;
+	dc->dc_dir = NULL;
+	dc->dc_vn = NULL;
+	dc->dc_name[0] = 0;
+
+	dcache_lru_unlink(dc);
+	dc->dc_prev = dcache_lrutail;
+	dc->dc_next = NULL;
+	if (dcache_lrutail != NULL) {
+		dcache_lrutail->dc_next = dc;
+	}
+	else {
+		dcache_lruhead = dc;
+	}
+	dcache_lrutail = dc;
+}
+
+static
+struct dcentry *
+dcache_find(struct vnode *dir, const char *name, unsigned hash)
+{
+	struct dcentry *dc;
+
+	KASSERT(lock_do_i_hold(dcache_lock));
+
+	for (dc = dcache_hash[hash % DCACHE_HASHSIZE]; dc != NULL;
+	     dc = dc->dc_hnext) {
+		if (dc->dc_hash == hash && dc->dc_dir == dir &&
+		    !strcmp(dc->dc_name, name)) {
+			return dc;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Look up NAME in DIR. Returns true on a cache hit, in which case
+ * *RET is set to the (incref'd) vnode found, or to NULL if the name
+ * is known not to exist. Returns false if the cache has nothing to
+ * say and the filesystem must be asked.
+ */
+bool
+vfs_dcache_lookup(struct vnode *dir, const char *name, struct vnode **ret)
+{
+	struct dcentry *dc;
+
+	if (!dcache_cacheable(dir, name)) {
+		return false;
+	}
+
+	lock_acquire(dcache_lock);
+	dc = dcache_find(dir, name, dcache_hashfn(dir, name));
+	if (dc == NULL) {
+		lock_release(dcache_lock);
+		return false;
+	}
+
+	if (dc->dc_vn != NULL) {
+		VOP_INCREF(dc->dc_vn);
+	}
+	*ret = dc->dc_vn;
+
+	if (dc != dcache_lruhead) {
+		dcache_lru_unlink(dc);
+		dcache_lru_push(dc);
+	}
+	lock_release(dcache_lock);
+	return true;
+}
+
+/*
+ * Record the result of looking up NAME in DIR. VN is the vnode found,
+ * or NULL to record that the name does not exist. The cache takes its
+ * own references; the caller's are not consumed.
+ */
+void
+vfs_dcache_enter(struct vnode *dir, const char *name, struct vnode *vn)
+{
+	struct dcentry *dc;
+	struct vnode *old[2] = { NULL, NULL };
+	unsigned hash;
+
+	if (!dcache_cacheable(dir, name)) {
+		return;
+	}
+	hash = dcache_hashfn(dir, name);
+
+	lock_acquire(dcache_lock);
+
+	dc = dcache_find(dir, name, hash);
+	if (dc == NULL) {
+		/* Recycle the least recently used entry. */
+		dc = dcache_lrutail;
+		KASSERT(dc != NULL);
+		if (dc->dc_dir != NULL) {
+			dcache_drop(dc, &old[0], &old[1]);
+		}
+		VOP_INCREF(dir);
+		dc->dc_dir = dir;
+		dc->dc_hash = hash;
+		strcpy(dc->dc_name, name);
+		dc->dc_chain = hash % DCACHE_HASHSIZE;
+		dc->dc_hnext = dcache_hash[dc->dc_chain];
+		dcache_hash[dc->dc_chain] = dc;
+	}
+	else {
+		/* Replace the old result. */
+		old[1] = dc->dc_vn;
+	}
+
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	dc->dc_vn = vn;
+
+	dcache_lru_unlink(dc);
+	dcache_lru_push(dc);
+
+	lock_release(dcache_lock);
+
+	if (old[0] != NULL) {
+		VOP_DECREF(old[0]);
+	}
+	if (old[1] != NULL) {
+		VOP_DECREF(old[1]);
+	}
+}
+
+/*
+ * Drop one entry whose directory is on FS, and whose directory is DIR
+ * and name is NAME if those aren't NULL. Returns false if nothing
+ * matched. The reference to the entry's directory is released here;
+ * the one to its result (if any) is handed back in VNRET.
+ *
+ * This does one entry per call so no more than two references are
+ * ever pending release at once; the table is small enough that
+ * rescanning it is cheap next to the operations that invalidate.
+ */
+static
+bool
+dcache_dropone(struct fs *fs, struct vnode *dir, const char *name,
+	       struct vnode **vnret)
+{
+	struct dcentry *dc;
+	struct vnode *olddir;
+	unsigned i;
+
+	lock_acquire(dcache_lock);
+	for (i=0; i<DCACHE_SIZE; i++) {
+		dc = &dcache_entries[i];
+		if (dc->dc_dir == NULL || dc->dc_dir->vn_fs != fs) {
+			continue;
+		}
+		if (dir != NULL && dc->dc_dir != dir) {
+			continue;
+		}
+		if (name != NULL && strcmp(dc->dc_name, name)) {
+			continue;
+		}
+		dcache_drop(dc, &olddir, vnret);
+		lock_release(dcache_lock);
+		VOP_DECREF(olddir);
+		return true;
+	}
+	lock_release(dcache_lock);
+	return false;
+}
+
+/*
+ * Forget everything cached about NAME in directories on DIR's
+ * filesystem. If an entry being dropped names a directory, whatever
+ * was cached under it is dropped too, so that a removed directory
+ * isn't kept alive by the cache's references.
+ */
+void
+vfs_dcache_remove(struct vnode *dir, const char *name)
+{
+	struct vnode *victim, *vn;
+
+	if (!dcache_cacheable(dir, name)) {
+		return;
+	}
+
+	while (dcache_dropone(dir->vn_fs, NULL, name, &victim)) {
+		if (victim == NULL) {
+			continue;
+		}
+		while (dcache_dropone(dir->vn_fs, victim, NULL, &vn)) {
+			if (vn != NULL) {
+				VOP_DECREF(vn);
+			}
+		}
+		VOP_DECREF(victim);
+	}
+}
+
+/*
+ * Drop every entry that refers to a vnode on FS. Used before
+ * unmounting, so the cache's references don't keep the volume busy.
+ */
+void
+vfs_dcache_purgefs(struct fs *fs)
+{
+	struct vnode *vn;
+
+	while (dcache_dropone(fs, NULL, NULL, &vn)) {
+		if (vn != NULL) {
+			VOP_DECREF(vn);
+		}
+	}
+}
+
+/*
+ * Setup function.
+ */
+void
+vfs_dcache_bootstrap(void)
+{
+	unsigned i;
+
+	dcache_lock = lock_create("vfs_dcache");
+	if (dcache_lock == NULL) {
+		panic("vfs: Could not create name cache lock\n");
+	}
+
+	dcache_lruhead = dcache_lrutail = NULL;
+	for (i=0; i<DCACHE_HASHSIZE; i++) {
+		dcache_hash[i] = NULL;
+	}
+	for (i=0; i<DCACHE_SIZE; i++) {
+		dcache_entries[i].dc_dir = NULL;
+		dcache_entries[i].dc_vn = NULL;
+		dcache_entries[i].dc_chain = -1;
+		dcache_entries[i].dc_hnext = NULL;
+		dcache_entries[i].dc_name[0] = 0;
+		dcache_lru_push(&dcache_entries[i]);
+	}
+}
@@ -43,6 +43,7 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include "opt-tmpfs.h"
 
 /*
  * Structure for a single named device.
@@ -85,6 +86,12 @@ struct knowndev {
 /* A placeholder for kd_fs for devices used as swap */
 #define SWAP_FS	((struct fs *)-1)
 
+/* A placeholder for kd_fs for devices claimed by another device (RAID) */
+#define CLAIMED_FS	((struct fs *)-2)
+
+/* True if kd_fs is an actual filesystem and not one of the above */
+#define REAL_FS(fs)	((fs) != NULL && (fs) != SWAP_FS && (fs) != CLAIMED_FS)
+
 DECLARRAY(knowndev, static __UNUSED inline);
 DEFARRAY(knowndev, static __UNUSED inline);
 
@@ -112,8 +119,14 @@ vfs_bootstrap(void)
 	}
 	vfs_biglock_depth = 0;
 
+	vfs_dcache_bootstrap();
 	devnull_create();
+	devkheap_create();
+	devstats_create();
 	semfs_bootstrap();
+#if OPT_TMPFS
+	tmpfs_bootstrap();
+#endif
 }
 
 /*
@@ -180,7 +193,7 @@ vfs_sync(void)
 	num = knowndevarray_num(knowndevs);
 	for (i=0; i<num; i++) {
 		dev = knowndevarray_get(knowndevs, i);
-		if (dev->kd_fs != NULL && dev->kd_fs != SWAP_FS) {
+		if (REAL_FS(dev->kd_fs)) {
 			/*result =*/ FSOP_SYNC(dev->kd_fs);
 		}
 	}
@@ -215,7 +228,7 @@ vfs_getroot(const char *devname, struct vnode **ret)
 		 * and DEVNAME names the device, return ENXIO.
 		 */
 
-		if (kd->kd_fs != NULL && kd->kd_fs != SWAP_FS) {
+		if (REAL_FS(kd->kd_fs)) {
 			const char *volname;
 			volname = FSOP_GETVOLNAME(kd->kd_fs);
 
@@ -364,7 +377,7 @@ badnames(const char *n1, const char *n2, const char *n3)
 	for (i=0; i<num; i++) {
 		kd = knowndevarray_get(knowndevs, i);
 
-		if (kd->kd_fs != NULL && kd->kd_fs != SWAP_FS) {
+		if (REAL_FS(kd->kd_fs)) {
 			volname = FSOP_GETVOLNAME(kd->kd_fs);
 			if (samestring3(volname, n1, n2, n3)) {
 				return 1;
@@ -647,13 +660,16 @@ vfs_unmount(const char *devname)
 		goto fail;
 	}
 
-	if (kd->kd_fs == NULL || kd->kd_fs == SWAP_FS) {
+	if (!REAL_FS(kd->kd_fs)) {
 		result = EINVAL;
 		goto fail;
 	}
 	KASSERT(kd->kd_rawname != NULL);
 	KASSERT(kd->kd_device != NULL);
 
+	/* drop cached names so they don't hold the fs busy */
+	vfs_dcache_purgefs(kd->kd_fs);
+
 	/* sync the fs */
 	result = FSOP_SYNC(kd->kd_fs);
 	if (result) {
@@ -714,6 +730,70 @@ vfs_swapoff(const char *devname)
 	return result;
 }
 
+/*
+ * Claim a mountable device for use by another device, such as a RAID
+ * set built on top of it. Like swapon, hands back the raw device
+ * vnode and keeps the device from being mounted or claimed again
+ * until it is released.
+ */
+int
+vfs_claimdev(const char *devname, struct vnode **ret)
+{
+	struct knowndev *kd;
+	int result;
+
+	vfs_biglock_acquire();
+
+	result = findmount(devname, &kd);
+	if (result) {
+		goto out;
+	}
+
+	if (kd->kd_fs != NULL) {
+		result = EBUSY;
+		goto out;
+	}
+	KASSERT(kd->kd_rawname != NULL);
+	KASSERT(kd->kd_device != NULL);
+
+	kd->kd_fs = CLAIMED_FS;
+	VOP_INCREF(kd->kd_vnode);
+	*ret = kd->kd_vnode;
+
+ out:
+	vfs_biglock_release();
+	return result;
+}
+
+/*
+ * Release a device claimed with vfs_claimdev. The vnode should be
+ * decref'd first.
+ */
+int
+vfs_releasedev(const char *devname)
+{
+	struct knowndev *kd;
+	int result;
+
+	vfs_biglock_acquire();
+
+	result = findmount(devname, &kd);
+	if (result) {
+		goto fail;
+	}
+
+	if (kd->kd_fs != CLAIMED_FS) {
+		result = EINVAL;
+		goto fail;
+	}
+
+	kd->kd_fs = NULL;
+
+ fail:
+	vfs_biglock_release();
+	return result;
+}
+
 /*
  * Global unmount function.
  */
@@ -737,7 +817,7 @@ vfs_unmountall(void)
 			/* not mounted */
 			continue;
 		}
-		if (dev->kd_fs == SWAP_FS) {
+		if (dev->kd_fs == SWAP_FS || dev->kd_fs == CLAIMED_FS) {
 			/* just drop it */
 			dev->kd_fs = NULL;
 			continue;
@@ -745,6 +825,8 @@ vfs_unmountall(void)
 
 		kprintf("vfs: Unmounting %s:\n", dev->kd_name);
 
+		vfs_dcache_purgefs(dev->kd_fs);
+
 		result = FSOP_SYNC(dev->kd_fs);
 		if (result) {
 			kprintf("vfs: Warning: sync failed for %s: %s, trying "
@@ -234,9 +234,86 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	return 0;
 }
 
+/*
+ * Look up a single path component NAME in directory DIR, trying the
+ * name cache first. On a miss, the filesystem lookup and the cache
+ * update are done together under the big lock, so they can't race
+ * with a create or remove that invalidates the same name.
+ */
+static
+int
+lookonce(struct vnode *dir, char *name, struct vnode **ret)
+{
+	int result;
+
+	if (vfs_dcache_lookup(dir, name, ret)) {
+		return (*ret == NULL) ? ENOENT : 0;
+	}
+
+	vfs_biglock_acquire();
+	result = VOP_LOOKUP(dir, name, ret);
+	if (result == 0) {
+		vfs_dcache_enter(dir, name, *ret);
+	}
+	else if (result == ENOENT) {
+		vfs_dcache_enter(dir, name, NULL);
+	}
+	vfs_biglock_release();
+	return result;
+}
+
+/*
+ * Translate PATH, relative to STARTVN, one component at a time.
+ * Consumes the caller's reference to STARTVN. Empty components
+ * (doubled or trailing slashes) are skipped, so an empty path
+ * yields STARTVN itself. PATH is destroyed.
+ */
+static
+int
+walkpath(struct vnode *startvn, char *path, struct vnode **ret)
+{
+	struct vnode *dir, *next;
+	char *name, *s;
+	int result;
+
+	dir = startvn;
+	name = path;
+	while (1) {
+		while (*name == '/') {
+			name++;
+		}
+		if (*name == 0) {
+			break;
+		}
+		s = strchr(name, '/');
+		if (s != NULL) {
+			*s = 0;
+		}
+
+		result = lookonce(dir, name, &next);
+		VOP_DECREF(dir);
+		if (result) {
+			return result;
+		}
+		dir = next;
+
+		if (s == NULL) {
+			break;
+		}
+		name = s+1;
+	}
+
+	*ret = dir;
+	return 0;
+}
+
 /*
  * Name-to-vnode translation.
  * (In BSD, both of these are subsumed by namei().)
+ *
+ * Only finding the starting point needs the big lock; after that
+ * the path is walked a component at a time through the name cache
+ * and the lock is only taken to call the filesystem on a miss.
  */
 
 int
@@ -244,32 +321,48 @@ vfs_lookparent(char *path, struct vnode **retval,
 	       char *buf, size_t buflen)
 {
 	struct vnode *startvn;
+	char *name;
+	size_t len;
 	int result;
 
 	vfs_biglock_acquire();
-
 	result = getdevice(path, &path, &startvn);
+	vfs_biglock_release();
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
-	if (strlen(path)==0) {
+	/* Split off the last component, ignoring trailing slashes. */
+	len = strlen(path);
+	while (len > 0 && path[len-1] == '/') {
+		path[--len] = 0;
+	}
+	if (len == 0) {
 		/*
 		 * It does not make sense to use just a device name in
 		 * a context where "lookparent" is the desired
 		 * operation.
 		 */
-		result = EINVAL;
+		VOP_DECREF(startvn);
+		return EINVAL;
+	}
+
+	name = strrchr(path, '/');
+	if (name == NULL) {
+		name = path;
+		path = path + len;
 	}
 	else {
-		result = VOP_LOOKPARENT(startvn, path, retval, buf, buflen);
+		*name++ = 0;
 	}
 
-	VOP_DECREF(startvn);
+	if (strlen(name)+1 > buflen) {
+		VOP_DECREF(startvn);
+		return ENAMETOOLONG;
+	}
+	strcpy(buf, name);
 
-	vfs_biglock_release();
-	return result;
+	return walkpath(startvn, path, retval);
 }
 
 int
@@ -279,22 +372,11 @@ vfs_lookup(char *path, struct vnode **retval)
 	int result;
 
 	vfs_biglock_acquire();
-
 	result = getdevice(path, &path, &startvn);
+	vfs_biglock_release();
 	if (result) {
-		vfs_biglock_release();
 		return result;
 	}
 
-	if (strlen(path)==0) {
-		*retval = startvn;
-		vfs_biglock_release();
-		return 0;
-	}
-
-	result = VOP_LOOKUP(startvn, path, retval);
-
-	VOP_DECREF(startvn);
-	vfs_biglock_release();
-	return result;
+	return walkpath(startvn, path, retval);
 }
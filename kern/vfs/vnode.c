@@ -32,6 +32,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
@@ -122,6 +123,21 @@ vnode_decref(struct vnode *vn)
 	}
 }
 
+/*
+ * Poll for an object that never blocks: whatever's asked for is
+ * ready, and there's no need to register.
+ */
+int
+vnode_poll_ready(struct vnode *vn, int events, struct poller *poller,
+		 int *revents)
+{
+	(void)vn;
+	(void)poller;
+
+	*revents = events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+	return 0;
+}
+
 /*
  * Check for various things being valid.
  * Called before all VOP_* calls.
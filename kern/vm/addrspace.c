@@ -37,6 +37,7 @@
 #include <addrspace.h>
 #include <vm.h>
 #include <proc.h>
+#include <slab.h>
 
 /*
  * Note! If OPT_DUMBVM is set, as is the case until you start the VM
@@ -48,6 +49,21 @@
  *
  */
 
+/*
+ * Caches for the pieces an address space is built from; these come
+ * and go on every fork, exec and exit.
+ */
+static struct kmem_cache as_cache =
+	KMEM_CACHE_INITIALIZER("addrspace", sizeof(struct addrspace), NULL, NULL);
+static struct kmem_cache region_cache =
+	KMEM_CACHE_INITIALIZER("region", sizeof(struct region), NULL, NULL);
+static struct kmem_cache pt_l2_cache =
+	KMEM_CACHE_INITIALIZER("pt-l2", sizeof(struct addrspace_l3) * PAGE_L2_L3_NUM,
+			       NULL, NULL);
+static struct kmem_cache pt_l3_cache =
+	KMEM_CACHE_INITIALIZER("pt-l3", sizeof(uint32_t) * PAGE_L2_L3_NUM,
+			       NULL, NULL);
+
 /* 
  * Address Space
  */
@@ -56,7 +72,7 @@
 struct addrspace *as_create(void)
 {
 	struct addrspace *as;
-	as = (struct addrspace *)kmalloc(sizeof(struct addrspace));
+	as = (struct addrspace *)kmem_cache_alloc(&as_cache);
 	/* return Null if kmalloc fail  */
 	if (as == NULL)
 	{
@@ -133,7 +149,7 @@ void as_destroy(struct addrspace *as)
 	page_table_destroy(as);
 	region_destroy(as -> regions);
 
-	kfree(as);
+	kmem_cache_free(&as_cache, as);
 }
 
 /* flush TLB */
@@ -197,7 +213,7 @@ int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize, int re
 	int err = 0;
 	struct region *new_region = NULL;
 	uint8_t permission = 0;
-	new_region = (struct region*)kmalloc(sizeof(struct region));
+	new_region = (struct region*)kmem_cache_alloc(&region_cache);
 	if(!new_region){
 		return ENOMEM;
 	}
@@ -216,7 +232,7 @@ int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize, int re
 		while(temp -> next != NULL){
 			err = region_checkInUse(temp, new_region); 
 			if(err){
-				kfree(new_region); 
+				kmem_cache_free(&region_cache, new_region); 
 				return err;
 			}
 			temp = temp -> next; 
@@ -370,7 +386,7 @@ int page_table_l2_init(struct addrspace *as, uint32_t l1){
 	if(l1 >= PAGE_L1_NUM){
 		return 1; 
 	}
-	as->page_table[l1] = (struct addrspace_l3*)kmalloc(sizeof(struct addrspace_l3) * PAGE_L2_L3_NUM);
+	as->page_table[l1] = (struct addrspace_l3*)kmem_cache_alloc(&pt_l2_cache);
 	if(as->page_table[l1] == NULL){
 		return ENOMEM; 
 	}
@@ -402,7 +418,7 @@ int page_table_l3_init(struct addrspace *as, uint32_t l1, uint32_t l2){
 		// the l3 entries already exist 
 		return err; 
 	}
-	as->page_table[l1][l2].entries = (uint32_t*)kmalloc(sizeof(uint32_t) * PAGE_L2_L3_NUM);
+	as->page_table[l1][l2].entries = (uint32_t*)kmem_cache_alloc(&pt_l3_cache);
 	if(!as->page_table[l1][l2].entries){
 		return ENOMEM; 
 	}	
@@ -426,13 +442,13 @@ void page_table_destroy(struct addrspace* as){
 							free_kpages(PADDR_TO_KVADDR(*addr));
 						}
 					}
-					kfree(as->page_table[i][j].entries); 
+					kmem_cache_free(&pt_l3_cache, as->page_table[i][j].entries); 
 					as->page_table[i][j].entries = NULL; 
 				}
 				/* wrong here, as->page_table[i] is assigned memory only once, so here cannot be free sperately  */
 				// kfree(as->page_table[i] + j);  
 			}
-			kfree(as->page_table[i]);
+			kmem_cache_free(&pt_l2_cache, as->page_table[i]);
 		}
 		as -> page_table[i] = NULL;
 	}
@@ -449,7 +465,7 @@ int region_destroy(struct region *ls){
 		return 0;
 	}
 	region_destroy(ls -> next);
-	kfree(ls);
+	kmem_cache_free(&region_cache, ls);
 	return 0;
 }
 
@@ -460,7 +476,7 @@ struct region *region_dup(struct region *ls, int *ret){
 		return NULL;
 	}
 
-	struct region *head = (struct region *)kmalloc(sizeof(struct region));
+	struct region *head = (struct region *)kmem_cache_alloc(&region_cache);
 	if(head == NULL){
 		return NULL;
 		*ret = ENOMEM;
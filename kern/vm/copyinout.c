@@ -35,6 +35,7 @@
 #include <current.h>
 #include <vm.h>
 #include <copyinout.h>
+#include <machine/usercopy.h>
 
 /*
  * User/kernel memory copying functions.
@@ -84,6 +85,13 @@
  * To make use of this code, in addition to tm_badfaultfunc the
  * thread_machdep structure should contain a jmp_buf called
  * "tm_copyjmp".
+ *
+ * The block copies (copyin, copyout, copyoutzeros) are the hot path
+ * for every read and write, so they don't use this scheme. They call
+ * the machine's usercopy and userzero, which copy a word or a cache
+ * line at a time and recover from faults through a table in the trap
+ * code, and so cost nothing to arm. Only the string copies still pay
+ * for setjmp.
  */
 
 /*
@@ -146,8 +154,7 @@ copycheck(const_userptr_t userptr, size_t len, size_t *stoplen)
  * copyin
  *
  * Copy a block of memory of length LEN from user-level address USERSRC
- * to kernel address DEST. We can use memcpy because it's protected by
- * the tm_badfaultfunc/copyfail logic.
+ * to kernel address DEST.
  */
 int
 copyin(const_userptr_t usersrc, void *dest, size_t len)
@@ -164,26 +171,14 @@ copyin(const_userptr_t usersrc, void *dest, size_t len)
 		return EFAULT;
 	}
 
-	curthread->t_machdep.tm_badfaultfunc = copyfail;
-
-	result = setjmp(curthread->t_machdep.tm_copyjmp);
-	if (result) {
-		curthread->t_machdep.tm_badfaultfunc = NULL;
-		return EFAULT;
-	}
-
-	memcpy(dest, (const void *)usersrc, len);
-
-	curthread->t_machdep.tm_badfaultfunc = NULL;
-	return 0;
+	return usercopy(dest, (const void *)usersrc, len);
 }
 
 /*
  * copyout
  *
  * Copy a block of memory of length LEN from kernel address SRC to
- * user-level address USERDEST. We can use memcpy because it's
- * protected by the tm_badfaultfunc/copyfail logic.
+ * user-level address USERDEST.
  */
 int
 copyout(const void *src, userptr_t userdest, size_t len)
@@ -200,18 +195,29 @@ copyout(const void *src, userptr_t userdest, size_t len)
 		return EFAULT;
 	}
 
-	curthread->t_machdep.tm_badfaultfunc = copyfail;
+	return usercopy((void *)userdest, src, len);
+}
 
-	result = setjmp(curthread->t_machdep.tm_copyjmp);
+/*
+ * copyoutzeros
+ *
+ * Zero LEN bytes at user-level address USERDEST.
+ */
+int
+copyoutzeros(userptr_t userdest, size_t len)
+{
+	int result;
+	size_t stoplen;
+
+	result = copycheck(userdest, len, &stoplen);
 	if (result) {
-		curthread->t_machdep.tm_badfaultfunc = NULL;
+		return result;
+	}
+	if (stoplen != len) {
 		return EFAULT;
 	}
 
-	memcpy((void *)userdest, src, len);
-
-	curthread->t_machdep.tm_badfaultfunc = NULL;
-	return 0;
+	return userzero((void *)userdest, len);
 }
 
 /*
@@ -0,0 +1,528 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Kernel heap profiler.
+ *
+ * Two tables, both open-addressed hashes allocated the first time
+ * profiling is turned on:
+ *
+ *   - sites, keyed by (caller, size class), with the counters;
+ *   - live blocks, keyed by address, giving the site each block was
+ *     charged to so kfree can credit it back.
+ *
+ * Neither table grows. When one fills up, further blocks are counted
+ * as untracked rather than dropped silently. Blocks allocated while
+ * profiling was off aren't in the live table, so freeing them is
+ * ignored.
+ *
+ * The hooks run inside kmalloc and kfree, so nothing here may
+ * allocate while holding khp_lock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <vfs.h>
+#include <device.h>
+#include <kheapprof.h>
+
+#define KHP_MAXSITES	256	/* (caller, size class) pairs */
+#define KHP_MAXLIVE	8192	/* live blocks; must be a power of 2 */
+#define KHP_LINESIZE	80	/* report bytes per site, at most */
+
+struct khp_site {
+	vaddr_t ks_caller;		/* return address in the caller */
+	size_t ks_class;		/* block size; 0 if slot unused */
+	unsigned ks_allocs;		/* blocks allocated */
+	unsigned ks_frees;		/* blocks freed */
+	size_t ks_live;			/* bytes currently allocated */
+	size_t ks_peak;			/* most bytes ever allocated at once */
+};
+
+struct khp_live {
+	vaddr_t kl_ptr;			/* block address; 0 if slot unused */
+	unsigned kl_site;		/* index in khp_sites */
+};
+
+volatile bool kheapprof_on;
+
+static struct spinlock khp_lock = SPINLOCK_INITIALIZER;
+static struct khp_site *khp_sites;
+static struct khp_live *khp_live;
+static unsigned khp_nsites;		/* sites in use */
+static unsigned khp_nlive;		/* live blocks tracked */
+static unsigned khp_lost;		/* blocks not tracked */
+static size_t khp_livebytes;		/* total live bytes */
+static size_t khp_peakbytes;		/* peak of khp_livebytes */
+static struct timespec khp_started;	/* when profiling started */
+static struct timespec khp_stopped;	/* when it stopped, if it has */
+
+////////////////////////////////////////////////////////////
+// tables
+
+static
+unsigned
+khp_hash(vaddr_t key)
+{
+	/* Fibonacci hashing; blocks are at least 8-aligned */
+	return ((uint32_t)(key >> 3) * 2654435761U) >> 19;
+}
+
+/*
+ * Find or add the site for CALLER and CLASS. Returns KHP_MAXSITES if
+ * the table is full. Call with khp_lock held.
+ */
+static
+unsigned
+khp_getsite(vaddr_t caller, size_t class)
+{
+	unsigned ix, n;
+
+	ix = khp_hash(caller ^ class) % KHP_MAXSITES;
+	for (n = 0; n < KHP_MAXSITES; n++) {
+		if (khp_sites[ix].ks_class == 0) {
+			if (khp_nsites == KHP_MAXSITES - 1) {
+				/* keep one empty slot so lookups end */
+				return KHP_MAXSITES;
+			}
+			khp_sites[ix].ks_caller = caller;
+			khp_sites[ix].ks_class = class;
+			khp_nsites++;
+			return ix;
+		}
+		if (khp_sites[ix].ks_caller == caller &&
+		    khp_sites[ix].ks_class == class) {
+			return ix;
+		}
+		ix = (ix + 1) % KHP_MAXSITES;
+	}
+	return KHP_MAXSITES;
+}
+
+/*
+ * Find the live-table slot for PTR, or the empty slot where it would
+ * go. Call with khp_lock held.
+ */
+static
+unsigned
+khp_findlive(vaddr_t ptr)
+{
+	unsigned ix;
+
+	ix = khp_hash(ptr) & (KHP_MAXLIVE - 1);
+	while (khp_live[ix].kl_ptr != 0 && khp_live[ix].kl_ptr != ptr) {
+		ix = (ix + 1) & (KHP_MAXLIVE - 1);
+	}
+	return ix;
+}
+
+/*
+ * Remove the live entry at IX, shifting later entries of the same
+ * probe run back so lookups don't need tombstones.
+ */
+static
+void
+khp_removelive(unsigned ix)
+{
+	unsigned next, home;
+
+	next = ix;
+	while (1) {
+		next = (next + 1) & (KHP_MAXLIVE - 1);
+		if (khp_live[next].kl_ptr == 0) {
+			break;
+		}
+		home = khp_hash(khp_live[next].kl_ptr) & (KHP_MAXLIVE - 1);
+		/* move it back unless its home lies in (ix, next] */
+		if ((next > ix && (home <= ix || home > next)) ||
+		    (next < ix && (home <= ix && home > next))) {
+			khp_live[ix] = khp_live[next];
+			ix = next;
+		}
+	}
+	khp_live[ix].kl_ptr = 0;
+	khp_nlive--;
+}
+
+////////////////////////////////////////////////////////////
+// hooks
+
+void
+kheapprof_alloc(void *ptr, size_t class, vaddr_t caller)
+{
+	struct khp_site *ks;
+	unsigned site, ix;
+
+	spinlock_acquire(&khp_lock);
+	if (!kheapprof_on) {
+		spinlock_release(&khp_lock);
+		return;
+	}
+
+	site = khp_getsite(caller, class);
+	/* keep the live table at most 3/4 full */
+	if (site == KHP_MAXSITES || khp_nlive >= KHP_MAXLIVE / 4 * 3) {
+		khp_lost++;
+		spinlock_release(&khp_lock);
+		return;
+	}
+
+	ix = khp_findlive((vaddr_t)ptr);
+	KASSERT(khp_live[ix].kl_ptr == 0);
+	khp_live[ix].kl_ptr = (vaddr_t)ptr;
+	khp_live[ix].kl_site = site;
+	khp_nlive++;
+
+	ks = &khp_sites[site];
+	ks->ks_allocs++;
+	ks->ks_live += class;
+	if (ks->ks_live > ks->ks_peak) {
+		ks->ks_peak = ks->ks_live;
+	}
+	khp_livebytes += class;
+	if (khp_livebytes > khp_peakbytes) {
+		khp_peakbytes = khp_livebytes;
+	}
+	spinlock_release(&khp_lock);
+}
+
+void
+kheapprof_free(void *ptr)
+{
+	struct khp_site *ks;
+	unsigned ix;
+
+	spinlock_acquire(&khp_lock);
+	if (!kheapprof_on) {
+		spinlock_release(&khp_lock);
+		return;
+	}
+
+	ix = khp_findlive((vaddr_t)ptr);
+	if (khp_live[ix].kl_ptr != 0) {
+		ks = &khp_sites[khp_live[ix].kl_site];
+		ks->ks_frees++;
+		ks->ks_live -= ks->ks_class;
+		khp_livebytes -= ks->ks_class;
+		khp_removelive(ix);
+	}
+	spinlock_release(&khp_lock);
+}
+
+////////////////////////////////////////////////////////////
+// control
+
+int
+kheapprof_start(void)
+{
+	struct khp_site *sites;
+	struct khp_live *live;
+	unsigned i;
+
+	/* allocate outside the lock, and before turning the hooks on */
+	sites = NULL;
+	live = NULL;
+	if (khp_sites == NULL) {
+		sites = kmalloc(KHP_MAXSITES * sizeof(*sites));
+		live = kmalloc(KHP_MAXLIVE * sizeof(*live));
+		if (sites == NULL || live == NULL) {
+			kfree(sites);
+			kfree(live);
+			return ENOMEM;
+		}
+	}
+
+	spinlock_acquire(&khp_lock);
+	if (khp_sites == NULL) {
+		khp_sites = sites;
+		khp_live = live;
+		sites = NULL;
+		live = NULL;
+	}
+	for (i=0; i<KHP_MAXSITES; i++) {
+		khp_sites[i].ks_class = 0;
+		khp_sites[i].ks_allocs = 0;
+		khp_sites[i].ks_frees = 0;
+		khp_sites[i].ks_live = 0;
+		khp_sites[i].ks_peak = 0;
+	}
+	for (i=0; i<KHP_MAXLIVE; i++) {
+		khp_live[i].kl_ptr = 0;
+	}
+	khp_nsites = 0;
+	khp_nlive = 0;
+	khp_lost = 0;
+	khp_livebytes = 0;
+	khp_peakbytes = 0;
+	gettime(&khp_started);
+	kheapprof_on = true;
+	spinlock_release(&khp_lock);
+
+	/* lost a race with another start */
+	kfree(sites);
+	kfree(live);
+	return 0;
+}
+
+void
+kheapprof_stop(void)
+{
+	spinlock_acquire(&khp_lock);
+	if (kheapprof_on) {
+		kheapprof_on = false;
+		gettime(&khp_stopped);
+	}
+	spinlock_release(&khp_lock);
+}
+
+////////////////////////////////////////////////////////////
+// reporting
+
+/*
+ * Format the report. The sites are copied out under the lock and
+ * sorted by live bytes, biggest first, so the subsystems holding the
+ * most memory come out on top.
+ */
+char *
+kheapprof_report(size_t *lenret)
+{
+	struct khp_site *snap, tmp;
+	struct timespec now, elapsed;
+	char *buf;
+	size_t buflen, pos;
+	unsigned nsites, lost, i, j;
+	size_t livebytes, peakbytes;
+	uint64_t ms;
+	bool on;
+
+	buflen = (KHP_MAXSITES + 4) * KHP_LINESIZE;
+	buf = kmalloc(buflen);
+	snap = kmalloc(KHP_MAXSITES * sizeof(*snap));
+	if (buf == NULL || snap == NULL) {
+		kfree(buf);
+		kfree(snap);
+		return NULL;
+	}
+
+	spinlock_acquire(&khp_lock);
+	nsites = 0;
+	if (khp_sites != NULL) {
+		for (i=0; i<KHP_MAXSITES; i++) {
+			if (khp_sites[i].ks_class != 0) {
+				snap[nsites++] = khp_sites[i];
+			}
+		}
+	}
+	lost = khp_lost;
+	livebytes = khp_livebytes;
+	peakbytes = khp_peakbytes;
+	on = kheapprof_on;
+	if (on) {
+		gettime(&now);
+	}
+	else {
+		now = khp_stopped;
+	}
+	timespec_sub(&now, &khp_started, &elapsed);
+	spinlock_release(&khp_lock);
+
+	/* insertion sort; there aren't many */
+	for (i=1; i<nsites; i++) {
+		tmp = snap[i];
+		for (j=i; j>0 && snap[j-1].ks_live < tmp.ks_live; j--) {
+			snap[j] = snap[j-1];
+		}
+		snap[j] = tmp;
+	}
+
+	ms = (uint64_t)elapsed.tv_sec * 1000 + elapsed.tv_nsec / 1000000;
+
+	pos = 0;
+	pos += snprintf(buf + pos, buflen - pos,
+			"kheap profile (%s): %llu.%03llu s, "
+			"%lu bytes live, peak %lu, %u untracked\n",
+			on ? "on" : "off", ms / 1000, ms % 1000,
+			(unsigned long)livebytes, (unsigned long)peakbytes,
+			lost);
+	pos += snprintf(buf + pos, buflen - pos,
+			"caller      size    allocs     frees  allocs/s"
+			"      live      peak\n");
+	for (i=0; i<nsites; i++) {
+		pos += snprintf(buf + pos, buflen - pos,
+				"0x%08x %5lu %9u %9u %9llu %9lu %9lu\n",
+				snap[i].ks_caller,
+				(unsigned long)snap[i].ks_class,
+				snap[i].ks_allocs, snap[i].ks_frees,
+				ms ? snap[i].ks_allocs * 1000ULL / ms : 0ULL,
+				(unsigned long)snap[i].ks_live,
+				(unsigned long)snap[i].ks_peak);
+	}
+	KASSERT(pos < buflen);
+
+	kfree(snap);
+	*lenret = pos;
+	return buf;
+}
+
+void
+kheapprof_print(void)
+{
+	char *report;
+	size_t len;
+
+	report = kheapprof_report(&len);
+	if (report == NULL) {
+		kprintf("khprof: Out of memory\n");
+		return;
+	}
+	kprintf("%s", report);
+	kfree(report);
+}
+
+////////////////////////////////////////////////////////////
+// kheap: device
+
+/* For open() */
+static
+int
+kheapopen(struct device *dev, int openflags)
+{
+	(void)dev;
+	(void)openflags;
+
+	return 0;
+}
+
+/*
+ * For d_io(). Reads get the report, regenerated each time, from the
+ * current offset; since the device is seekable, that's the open
+ * file's own offset, and a reader gets EOF once it has had a whole
+ * report. Writes take a command.
+ */
+static
+int
+kheapio(struct device *dev, struct uio *uio)
+{
+	char cmd[16], *report;
+	size_t len;
+	int result;
+
+	(void)dev;
+
+	if (uio->uio_rw == UIO_WRITE) {
+		len = uio->uio_resid < sizeof(cmd) - 1 ?
+			uio->uio_resid : sizeof(cmd) - 1;
+		result = uiomove(cmd, len, uio);
+		if (result) {
+			return result;
+		}
+		cmd[len] = '\0';
+		if (len > 0 && cmd[len-1] == '\n') {
+			cmd[len-1] = '\0';
+		}
+		if (!strcmp(cmd, "on") || !strcmp(cmd, "reset")) {
+			result = kheapprof_start();
+		}
+		else if (!strcmp(cmd, "off")) {
+			kheapprof_stop();
+			result = 0;
+		}
+		else {
+			result = EINVAL;
+		}
+		/* don't make the writer loop on a short write */
+		uio->uio_resid = 0;
+		return result;
+	}
+
+	report = kheapprof_report(&len);
+	if (report == NULL) {
+		return ENOMEM;
+	}
+	result = 0;
+	if (uio->uio_offset < (off_t)len) {
+		result = uiomove(report + uio->uio_offset,
+				 len - uio->uio_offset, uio);
+	}
+	kfree(report);
+	return result;
+}
+
+/* For ioctl() */
+static
+int
+kheapioctl(struct device *dev, int op, userptr_t data)
+{
+	(void)dev;
+	(void)op;
+	(void)data;
+
+	return EINVAL;
+}
+
+static const struct device_ops kheap_devops = {
+	.devop_eachopen = kheapopen,
+	.devop_io = kheapio,
+	.devop_ioctl = kheapioctl,
+	.devop_seekable = true,
+};
+
+/*
+ * Function to create and attach kheap:
+ */
+void
+devkheap_create(void)
+{
+	int result;
+	struct device *dev;
+
+	dev = kmalloc(sizeof(*dev));
+	if (dev==NULL) {
+		panic("Could not add kheap device: out of memory\n");
+	}
+
+	dev->d_ops = &kheap_devops;
+
+	dev->d_blocks = 0;
+	dev->d_blocksize = 1;
+
+	dev->d_devnumber = 0; /* assigned by vfs_adddev */
+
+	dev->d_data = NULL;
+
+	result = vfs_adddev("kheap", dev, 0);
+	if (result) {
+		panic("Could not add kheap device: %s\n", strerror(result));
+	}
+}
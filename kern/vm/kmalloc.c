@@ -31,9 +31,18 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <vm.h>
+#include <slab.h>
+#include <kheapprof.h>
 
 /*
  * Kernel malloc.
+ *
+ * Whole-page allocations go straight to alloc_kpages. Smaller ones
+ * normally come from a slab cache for each size class (see slab.c),
+ * which has per-CPU magazines and finds a block's page in constant
+ * time on free. The debugging modes below that need to lay out the
+ * blocks themselves (GUARDS and LABELS) use the older pool-based
+ * subpage allocator instead.
  */
 
 
@@ -121,6 +130,10 @@ fill_deadbeef(void *vptr, size_t len)
 #undef CHECKBEEF
 #undef CHECKGUARDS
 
+#if defined(GUARDS) || defined(LABELS)
+#define SUBPAGE
+#endif
+
 ////////////////////////////////////////
 
 #if PAGE_SIZE == 4096
@@ -131,6 +144,19 @@ static const size_t sizes[NSIZES] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
 #define SMALLEST_SUBPAGE_SIZE 16
 #define LARGEST_SUBPAGE_SIZE 2048
 
+#ifndef SUBPAGE
+static struct kmem_cache kmalloc_caches[NSIZES] = {
+	KMEM_CACHE_INITIALIZER("kmalloc-16", 16, NULL, NULL),
+	KMEM_CACHE_INITIALIZER("kmalloc-32", 32, NULL, NULL),
+	KMEM_CACHE_INITIALIZER("kmalloc-64", 64, NULL, NULL),
+	KMEM_CACHE_INITIALIZER("kmalloc-128", 128, NULL, NULL),
+	KMEM_CACHE_INITIALIZER("kmalloc-256", 256, NULL, NULL),
+	KMEM_CACHE_INITIALIZER("kmalloc-512", 512, NULL, NULL),
+	KMEM_CACHE_INITIALIZER("kmalloc-1024", 1024, NULL, NULL),
+	KMEM_CACHE_INITIALIZER("kmalloc-2048", 2048, NULL, NULL),
+};
+#endif
+
 #elif PAGE_SIZE == 8192
 #error "No support for 8k pages (yet?)"
 #else
@@ -210,6 +236,8 @@ struct kheap_root {
 #define NUM_PAGEREFPAGES 16
 #define TOTAL_PAGEREFS (NUM_PAGEREFPAGES * NPAGEREFS_PER_PAGE)
 
+#ifdef SUBPAGE
+
 static struct kheap_root kheaproots[NUM_PAGEREFPAGES];
 
 /*
@@ -336,6 +364,8 @@ freepageref(struct pageref *p)
 	KASSERT(0);
 }
 
+#endif /* SUBPAGE */
+
 ////////////////////////////////////////
 
 /*
@@ -812,10 +842,15 @@ kheap_printstats(void)
 	}
 
 	spinlock_release(&kmalloc_spinlock);
+
+	kmem_printstats();
+	kvmem_printstats();
 }
 
 ////////////////////////////////////////
 
+#ifdef SUBPAGE
+
 /*
  * Remove a pageref from both lists that it's on.
  */
@@ -844,6 +879,8 @@ remove_lists(struct pageref *pr, int blktype)
 	}
 }
 
+#endif /* SUBPAGE */
+
 /*
  * Given a requested client size, return the block type, that is, the
  * index into the sizes[] array for the block size to use.
@@ -866,6 +903,8 @@ int blocktype(size_t clientsz)
 	return 0;
 }
 
+#ifdef SUBPAGE
+
 /*
  * Allocate a block of size SZ, where SZ is not large enough to
  * warrant a whole-page allocation.
@@ -1159,50 +1198,68 @@ subpage_kfree(void *ptr)
 	return 0;
 }
 
+#endif /* SUBPAGE */
+
 //
 ////////////////////////////////////////////////////////////
 
 /*
- * Allocate a block of size SZ. Redirect either to subpage_kmalloc or
- * alloc_kpages depending on how big SZ is.
+ * Allocate a block of size SZ. Redirect either to a slab cache (or
+ * subpage_kmalloc) or alloc_kpages depending on how big SZ is.
  */
 void *
 kmalloc(size_t sz)
 {
-	size_t checksz;
-#ifdef LABELS
-	vaddr_t label;
-#endif
+	size_t checksz, class;
+	vaddr_t caller;
+	void *ptr;
 
-#ifdef LABELS
 #ifdef __GNUC__
-	label = (vaddr_t)__builtin_return_address(0);
+	caller = (vaddr_t)__builtin_return_address(0);
 #else
 #error "Don't know how to get return address with this compiler"
 #endif /* __GNUC__ */
-#endif /* LABELS */
 
 	checksz = sz + GUARD_OVERHEAD + LABEL_OVERHEAD;
 	if (checksz >= LARGEST_SUBPAGE_SIZE) {
 		unsigned long npages;
 		vaddr_t address;
 
-		/* Round up to a whole number of pages. */
+		/*
+		 * Round up to a whole number of pages. Anything
+		 * bigger than a page comes from the kseg2 arena so it
+		 * doesn't need contiguous frames.
+		 */
 		npages = (sz + PAGE_SIZE - 1)/PAGE_SIZE;
-		address = alloc_kpages(npages);
+		if (npages > 1) {
+			address = alloc_kvpages(npages);
+		}
+		else {
+			address = alloc_kpages(npages);
+		}
 		if (address==0) {
 			return NULL;
 		}
 		KASSERT(address % PAGE_SIZE == 0);
 
-		return (void *)address;
+		ptr = (void *)address;
+		class = npages * PAGE_SIZE;
 	}
-
-#ifdef LABELS
-	return subpage_kmalloc(sz, label);
+	else {
+#if defined(LABELS)
+		ptr = subpage_kmalloc(sz, caller);
+#elif defined(SUBPAGE)
+		ptr = subpage_kmalloc(sz);
 #else
-	return subpage_kmalloc(sz);
+		ptr = kmem_cache_alloc(&kmalloc_caches[blocktype(sz)]);
 #endif
+		class = sizes[blocktype(checksz)];
+	}
+
+	if (kheapprof_on && ptr != NULL) {
+		kheapprof_alloc(ptr, class, caller);
+	}
+	return ptr;
 }
 
 /*
@@ -1212,13 +1269,28 @@ void
 kfree(void *ptr)
 {
 	/*
-	 * Try subpage first; if that fails, assume it's a big allocation.
+	 * Try the slabs (which include the typed caches) and then
+	 * subpage; if that fails, it's a big allocation, either from
+	 * the arena or a single page.
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
-		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
-		free_kpages((vaddr_t)ptr);
 	}
+	if (kheapprof_on) {
+		kheapprof_free(ptr);
+	}
+	if (kmem_free(ptr) == 0) {
+		return;
+	}
+#ifdef SUBPAGE
+	else if (subpage_kfree(ptr) == 0) {
+		return;
+	}
+#endif
+	KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
+	if (free_kvpages((vaddr_t)ptr) == 0) {
+		return;
+	}
+	free_kpages((vaddr_t)ptr);
 }
 
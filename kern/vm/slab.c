@@ -0,0 +1,553 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Slab allocator with per-CPU magazines. See slab.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <vm.h>
+#include <slab.h>
+
+/*
+ * Objects are aligned to KMEM_ALIGN. Each CPU's magazine holds up to
+ * KMEM_MAGSIZE objects, and objects move between magazines and slabs
+ * KMEM_BATCH at a time. (With a 15-entry magazine, struct kmem_mag is
+ * 64 bytes.)
+ */
+#define KMEM_ALIGN	8
+#define KMEM_MAGSIZE	15
+#define KMEM_BATCH	8
+
+/*
+ * Bookkeeping for one physical page. For a slab page, free objects
+ * are chained through a 16-bit page offset stored in each object at
+ * kc_linkoff: at the start of the object normally, or after its end
+ * if the cache has a constructor (so the constructed state isn't
+ * disturbed).
+ */
+struct slab {
+	struct kmem_cache *sl_cache;	/* owning cache; NULL if not a slab */
+	struct slab *sl_next;		/* on kc_partial */
+	struct slab *sl_prev;
+	uint16_t sl_free;		/* offset of first free object */
+	uint16_t sl_inuse;		/* number of objects allocated */
+};
+
+#define SLAB_NOFREE	0xffff
+
+struct kmem_mag {
+	unsigned m_rounds;		/* number of objects held */
+	void *m_objs[KMEM_MAGSIZE];
+};
+
+/* The page table: one struct slab per physical page */
+static struct slab *kmem_pages;
+static unsigned kmem_npages;
+
+/* All caches that have been used, for kmem_printstats */
+static struct spinlock kmem_lock = SPINLOCK_INITIALIZER;
+static struct kmem_cache *kmem_caches;
+
+/* Magazines come from a cache of their own, which has none. */
+static struct kmem_cache kmem_magcache =
+	{ "kmem_mag", sizeof(struct kmem_mag), NULL, NULL, true,
+	  SPINLOCK_INITIALIZER, 0, 0, 0, NULL, 0, 0, NULL, { NULL } };
+
+/*
+ * Set up the page table. Must be called after ram_bootstrap, before
+ * anything is allocated.
+ */
+void
+kmem_bootstrap(void)
+{
+	size_t size;
+	vaddr_t va;
+
+	kmem_npages = ram_getsize() / PAGE_SIZE;
+	size = ROUNDUP(kmem_npages * sizeof(struct slab), PAGE_SIZE);
+	va = alloc_kpages(size / PAGE_SIZE);
+	if (va == 0) {
+		panic("kmem_bootstrap: Out of memory\n");
+	}
+	kmem_pages = (struct slab *)va;
+	bzero(kmem_pages, size);
+}
+
+////////////////////////////////////////////////////////////
+// slabs
+
+/*
+ * Find the slab for a kernel address; NULL if it's not in a slab.
+ */
+static
+struct slab *
+kmem_slabof(vaddr_t va)
+{
+	paddr_t pn;
+
+	/* anything not in the direct-mapped segment lands out of range */
+	pn = KVADDR_TO_PADDR(va) / PAGE_SIZE;
+	if (pn >= kmem_npages || kmem_pages[pn].sl_cache == NULL) {
+		return NULL;
+	}
+	return &kmem_pages[pn];
+}
+
+static
+vaddr_t
+kmem_slabaddr(struct slab *sl)
+{
+	return PADDR_TO_KVADDR((paddr_t)(sl - kmem_pages) * PAGE_SIZE);
+}
+
+static
+uint16_t *
+kmem_link(struct kmem_cache *kc, vaddr_t obj)
+{
+	return (uint16_t *)(obj + kc->kc_linkoff);
+}
+
+/*
+ * Work out the object layout the first time a cache is used, and
+ * put it on the list of caches. Call with kc_lock held.
+ */
+static
+void
+kmem_setup(struct kmem_cache *kc)
+{
+	size_t size;
+
+	KASSERT(spinlock_do_i_hold(&kc->kc_lock));
+	if (kc->kc_objsize != 0) {
+		return;
+	}
+
+	size = ROUNDUP(kc->kc_size, KMEM_ALIGN);
+	if (size == 0) {
+		size = KMEM_ALIGN;
+	}
+	if (kc->kc_ctor != NULL || kc->kc_dtor != NULL) {
+		kc->kc_linkoff = size;
+		size = ROUNDUP(size + sizeof(uint16_t), KMEM_ALIGN);
+	}
+	else {
+		kc->kc_linkoff = 0;
+	}
+	KASSERT(size <= PAGE_SIZE);
+	kc->kc_perslab = PAGE_SIZE / size;
+	kc->kc_objsize = size;
+
+	spinlock_acquire(&kmem_lock);
+	kc->kc_next = kmem_caches;
+	kmem_caches = kc;
+	spinlock_release(&kmem_lock);
+}
+
+/*
+ * Make a new slab for KC, running the constructor on each object.
+ * Called without kc_lock, since both the page allocator and the
+ * constructor may need to allocate memory.
+ */
+static
+struct slab *
+kmem_slab_create(struct kmem_cache *kc)
+{
+	struct slab *sl;
+	vaddr_t va, obj;
+	unsigned i, j;
+
+	va = alloc_kpages(1);
+	if (va == 0) {
+		return NULL;
+	}
+	sl = &kmem_pages[KVADDR_TO_PADDR(va) / PAGE_SIZE];
+	KASSERT(sl->sl_cache == NULL);
+
+	for (i=0; i<kc->kc_perslab; i++) {
+		obj = va + i * kc->kc_objsize;
+		if (kc->kc_ctor != NULL && kc->kc_ctor((void *)obj) != 0) {
+			for (j=0; j<i; j++) {
+				if (kc->kc_dtor != NULL) {
+					kc->kc_dtor((void *)(va +
+						      j * kc->kc_objsize));
+				}
+			}
+			free_kpages(va);
+			return NULL;
+		}
+		*kmem_link(kc, obj) = (i + 1 < kc->kc_perslab) ?
+			(i + 1) * kc->kc_objsize : SLAB_NOFREE;
+	}
+
+	sl->sl_next = sl->sl_prev = NULL;
+	sl->sl_free = 0;
+	sl->sl_inuse = 0;
+	return sl;
+}
+
+/*
+ * Give an empty slab's page back. Called without kc_lock.
+ */
+static
+void
+kmem_slab_destroy(struct kmem_cache *kc, struct slab *sl)
+{
+	vaddr_t va;
+	unsigned i;
+
+	KASSERT(sl->sl_inuse == 0);
+	va = kmem_slabaddr(sl);
+	if (kc->kc_dtor != NULL) {
+		for (i=0; i<kc->kc_perslab; i++) {
+			kc->kc_dtor((void *)(va + i * kc->kc_objsize));
+		}
+	}
+	sl->sl_cache = NULL;
+	free_kpages(va);
+}
+
+static
+void
+kmem_partial_add(struct kmem_cache *kc, struct slab *sl)
+{
+	sl->sl_prev = NULL;
+	sl->sl_next = kc->kc_partial;
+	if (sl->sl_next != NULL) {
+		sl->sl_next->sl_prev = sl;
+	}
+	kc->kc_partial = sl;
+}
+
+static
+void
+kmem_partial_remove(struct kmem_cache *kc, struct slab *sl)
+{
+	if (sl->sl_prev != NULL) {
+		sl->sl_prev->sl_next = sl->sl_next;
+	}
+	else {
+		KASSERT(kc->kc_partial == sl);
+		kc->kc_partial = sl->sl_next;
+	}
+	if (sl->sl_next != NULL) {
+		sl->sl_next->sl_prev = sl->sl_prev;
+	}
+	sl->sl_next = sl->sl_prev = NULL;
+}
+
+/*
+ * Take up to WANT objects from the slabs, making a new slab only if
+ * there are none at all. Returns the number taken; 0 means out of
+ * memory.
+ */
+static
+unsigned
+kmem_getbatch(struct kmem_cache *kc, void **objs, unsigned want)
+{
+	struct slab *sl;
+	vaddr_t obj;
+	unsigned n;
+
+	n = 0;
+	spinlock_acquire(&kc->kc_lock);
+	kmem_setup(kc);
+	while (n < want) {
+		sl = kc->kc_partial;
+		if (sl == NULL) {
+			if (n > 0) {
+				break;
+			}
+			spinlock_release(&kc->kc_lock);
+			sl = kmem_slab_create(kc);
+			if (sl == NULL) {
+				return 0;
+			}
+			spinlock_acquire(&kc->kc_lock);
+			sl->sl_cache = kc;
+			kc->kc_nslabs++;
+			kc->kc_nfree += kc->kc_perslab;
+			kmem_partial_add(kc, sl);
+			continue;
+		}
+
+		KASSERT(sl->sl_free != SLAB_NOFREE);
+		obj = kmem_slabaddr(sl) + sl->sl_free;
+		sl->sl_free = *kmem_link(kc, obj);
+		sl->sl_inuse++;
+		if (sl->sl_free == SLAB_NOFREE) {
+			kmem_partial_remove(kc, sl);
+		}
+		objs[n++] = (void *)obj;
+	}
+	KASSERT(kc->kc_nfree >= n);
+	kc->kc_nfree -= n;
+	spinlock_release(&kc->kc_lock);
+	return n;
+}
+
+/*
+ * Return N objects to their slabs. A slab that becomes empty is
+ * freed if the cache has at least another slab's worth of free
+ * objects, so a cache that's in use doesn't thrash pages.
+ */
+static
+void
+kmem_putbatch(struct kmem_cache *kc, void **objs, unsigned n)
+{
+	struct slab *sl, *dead;
+	vaddr_t obj, offset;
+	unsigned i;
+
+	dead = NULL;
+	spinlock_acquire(&kc->kc_lock);
+	for (i=0; i<n; i++) {
+		obj = (vaddr_t)objs[i];
+		sl = kmem_slabof(obj);
+		KASSERT(sl != NULL && sl->sl_cache == kc);
+		offset = obj - kmem_slabaddr(sl);
+		KASSERT(offset % kc->kc_objsize == 0);
+		KASSERT(sl->sl_inuse > 0);
+
+		if (sl->sl_free == SLAB_NOFREE) {
+			kmem_partial_add(kc, sl);
+		}
+		else {
+			/* check just the head for a double free */
+			KASSERT(sl->sl_free != offset);
+		}
+		*kmem_link(kc, obj) = sl->sl_free;
+		sl->sl_free = offset;
+		sl->sl_inuse--;
+		kc->kc_nfree++;
+
+		if (sl->sl_inuse == 0 && kc->kc_nfree >= 2 * kc->kc_perslab) {
+			kmem_partial_remove(kc, sl);
+			kc->kc_nslabs--;
+			kc->kc_nfree -= kc->kc_perslab;
+			sl->sl_next = dead;
+			dead = sl;
+		}
+	}
+	spinlock_release(&kc->kc_lock);
+
+	while (dead != NULL) {
+		sl = dead;
+		dead = sl->sl_next;
+		kmem_slab_destroy(kc, sl);
+	}
+}
+
+////////////////////////////////////////////////////////////
+// magazines
+
+/*
+ * Make sure the current CPU has a magazine for KC. Failing is
+ * harmless; we just go to the slabs every time.
+ */
+static
+void
+kmem_getmag(struct kmem_cache *kc)
+{
+	struct kmem_mag *mag;
+	int spl;
+
+	spl = splhigh();
+	mag = kc->kc_mags[curcpu->c_number];
+	splx(spl);
+	if (mag != NULL) {
+		return;
+	}
+
+	mag = kmem_cache_alloc(&kmem_magcache);
+	if (mag == NULL) {
+		return;
+	}
+	mag->m_rounds = 0;
+
+	/* we may have moved to another CPU meanwhile; that's fine */
+	spl = splhigh();
+	if (kc->kc_mags[curcpu->c_number] == NULL) {
+		kc->kc_mags[curcpu->c_number] = mag;
+		mag = NULL;
+	}
+	splx(spl);
+
+	if (mag != NULL) {
+		kmem_cache_free(&kmem_magcache, mag);
+	}
+}
+
+/*
+ * Allocate when the magazine is empty (or there isn't one): get a
+ * batch from the slabs, return one object and load the rest.
+ */
+static
+void *
+kmem_alloc_slow(struct kmem_cache *kc)
+{
+	void *batch[KMEM_BATCH];
+	struct kmem_mag *mag;
+	unsigned n, i;
+	int spl;
+
+	if (kc->kc_nomag || !CURCPU_EXISTS()) {
+		return kmem_getbatch(kc, batch, 1) ? batch[0] : NULL;
+	}
+
+	kmem_getmag(kc);
+	n = kmem_getbatch(kc, batch, KMEM_BATCH);
+	if (n == 0) {
+		return NULL;
+	}
+
+	i = 1;
+	spl = splhigh();
+	mag = kc->kc_mags[curcpu->c_number];
+	while (mag != NULL && i < n && mag->m_rounds < KMEM_MAGSIZE) {
+		mag->m_objs[mag->m_rounds++] = batch[i++];
+	}
+	splx(spl);
+
+	if (i < n) {
+		kmem_putbatch(kc, batch + i, n - i);
+	}
+	return batch[0];
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *kc)
+{
+	struct kmem_mag *mag;
+	void *obj;
+	int spl;
+
+	if (!kc->kc_nomag && CURCPU_EXISTS()) {
+		spl = splhigh();
+		mag = kc->kc_mags[curcpu->c_number];
+		if (mag != NULL && mag->m_rounds > 0) {
+			obj = mag->m_objs[--mag->m_rounds];
+			splx(spl);
+			return obj;
+		}
+		splx(spl);
+	}
+	return kmem_alloc_slow(kc);
+}
+
+void
+kmem_cache_free(struct kmem_cache *kc, void *obj)
+{
+	void *batch[KMEM_BATCH];
+	struct kmem_mag *mag;
+	unsigned i;
+	int spl;
+
+	KASSERT(obj != NULL);
+
+	if (!kc->kc_nomag && CURCPU_EXISTS()) {
+		spl = splhigh();
+		mag = kc->kc_mags[curcpu->c_number];
+		if (mag != NULL) {
+			if (mag->m_rounds < KMEM_MAGSIZE) {
+				mag->m_objs[mag->m_rounds++] = obj;
+				splx(spl);
+				return;
+			}
+			/* full: push out a batch to make room */
+			for (i=0; i<KMEM_BATCH; i++) {
+				batch[i] = mag->m_objs[--mag->m_rounds];
+			}
+			mag->m_objs[mag->m_rounds++] = obj;
+			splx(spl);
+			kmem_putbatch(kc, batch, KMEM_BATCH);
+			return;
+		}
+		splx(spl);
+	}
+	kmem_putbatch(kc, &obj, 1);
+}
+
+/*
+ * Free an object without knowing its cache. This is what lets kfree
+ * find the owner of a small block in constant time.
+ */
+int
+kmem_free(void *obj)
+{
+	struct slab *sl;
+
+	sl = kmem_slabof((vaddr_t)obj);
+	if (sl == NULL) {
+		return -1;
+	}
+	if (((vaddr_t)obj - kmem_slabaddr(sl)) % sl->sl_cache->kc_objsize) {
+		panic("kfree: slab free of invalid addr %p\n", obj);
+	}
+	kmem_cache_free(sl->sl_cache, obj);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// statistics
+
+void
+kmem_printstats(void)
+{
+	struct kmem_cache *kc;
+	unsigned i, inmags, total;
+
+	spinlock_acquire(&kmem_lock);
+	kc = kmem_caches;
+	spinlock_release(&kmem_lock);
+
+	/* caches are never removed from the list, so we can walk it */
+	kprintf("Slab caches:\n");
+	kprintf("  %-16s %6s %6s %8s %8s %8s\n",
+		"name", "size", "slabs", "inuse", "free", "magazine");
+	for (; kc != NULL; kc = kc->kc_next) {
+		spinlock_acquire(&kc->kc_lock);
+		inmags = 0;
+		for (i=0; i<MAXCPUS; i++) {
+			if (kc->kc_mags[i] != NULL) {
+				inmags += kc->kc_mags[i]->m_rounds;
+			}
+		}
+		total = kc->kc_nslabs * kc->kc_perslab;
+		kprintf("  %-16s %6zu %6u %8u %8u %8u\n",
+			kc->kc_name, kc->kc_objsize, kc->kc_nslabs,
+			total - kc->kc_nfree - inmags, kc->kc_nfree, inmags);
+		spinlock_release(&kc->kc_lock);
+	}
+}
@@ -7,6 +7,8 @@
 #include <machine/tlb.h>
 #include <spl.h>
 #include <proc.h>
+#include <current.h>
+#include <cpu.h>
 
 /* Place your page table functions here */
 
@@ -109,6 +111,7 @@ int vm_fault(int faulttype, vaddr_t faultaddress)
         free_kpages(newpage);
         return err; 
     }
+    KSTAT_INC(ks_pagefaults);
     
     /* turn off the interrupts */
     spl = splhigh();
@@ -33,6 +33,9 @@
  * Usage:
  *     sh
  *     sh -c command
+ *
+ * Commands may be joined into a pipeline with "|", e.g.
+ *     cat file | sort | tail
  */
 
 #include <sys/types.h>
@@ -73,23 +76,26 @@ static int timing = 0;
 #define MAXBG 128
 static pid_t bgpids[MAXBG];
 
+/* maximum number of commands in one pipeline */
+#define MAXSTAGES 16
+
 /*
  * can_bg
- * just checks for an open slot.
+ * just checks for N open slots.
  */
 static
 int
-can_bg(void)
+can_bg(int n)
 {
 	int i;
 
-	for (i = 0; i < MAXBG; i++) {
+	for (i = 0; i < MAXBG && n > 0; i++) {
 		if (bgpids[i] == 0) {
-			return 1;
+			n--;
 		}
 	}
 
-	return 0;
+	return n == 0;
 }
 
 /*
@@ -355,21 +361,98 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * runpipeline
+ * forks and execs each stage of a pipeline, connecting the standard
+ * output of each stage to the standard input of the next with a pipe.
+ * the pids of the stages started are stored in PIDS; returns how many
+ * there are, which is fewer than NSTAGES if something failed.
+ */
+static
+int
+runpipeline(char **stages[], int nstages, pid_t *pids)
+{
+	int i, infd, fds[2];
+	pid_t pid;
+
+	infd = -1;
+	for (i=0; i<nstages; i++) {
+		if (i < nstages-1) {
+			if (pipe(fds) < 0) {
+				warn("pipe");
+				break;
+			}
+		}
+		else {
+			fds[0] = fds[1] = -1;
+		}
+
+		pid = fork();
+		if (pid < 0) {
+			warn("fork");
+			if (fds[0] >= 0) {
+				close(fds[0]);
+				close(fds[1]);
+			}
+			break;
+		}
+		if (pid == 0) {
+			/* child */
+			if (infd >= 0) {
+				dup2(infd, STDIN_FILENO);
+				close(infd);
+			}
+			if (fds[1] >= 0) {
+				dup2(fds[1], STDOUT_FILENO);
+				close(fds[1]);
+				close(fds[0]);
+			}
+			execvp(stages[i][0], stages[i]);
+			warn("%s", stages[i][0]);
+			/*
+			 * Use _exit() instead of exit() in the child
+			 * process to avoid calling atexit() functions,
+			 * which would cause hostcompat (if present) to
+			 * reset the tty state and mess up our input
+			 * handling.
+			 */
+			_exit(1);
+		}
+
+		/* parent */
+		pids[i] = pid;
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (fds[1] >= 0) {
+			close(fds[1]);
+		}
+		infd = fds[0];
+	}
+
+	if (infd >= 0) {
+		close(infd);
+	}
+	return i;
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * otherwise, it's a standard command, or a pipeline of them separated
+ * by "|".  check for the '&', try to background the job if possible,
+ * otherwise just run it and wait on it.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **stages[MAXSTAGES];
+	pid_t pids[MAXSTAGES];
+	int nargs, nstages, nstarted, i;
 	char *s;
-	pid_t pid;
 	int status;
 	int bg=0;
 	time_t startsecs, endsecs;
@@ -405,60 +488,69 @@ docommand(char *buf, struct exitinfo *ei)
 
 	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
 		/* background */
-		if (!can_bg()) {
-			printf("%s: Too many background jobs; wait for "
-			       "some to finish before starting more\n",
-			       args[0]);
-			exitinfo_exit(ei, 1);
-			return;
-		}
 		nargs--;
 		args[nargs] = NULL;
 		bg = 1;
 	}
 
+	/* split into pipeline stages at each "|" */
+	nstages = 0;
+	stages[nstages++] = args;
+	for (i=0; i<nargs; i++) {
+		if (strcmp(args[i], "|") != 0) {
+			continue;
+		}
+		args[i] = NULL;
+		if (nstages >= MAXSTAGES) {
+			printf("Too many commands in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+		stages[nstages++] = &args[i+1];
+	}
+	for (i=0; i<nstages; i++) {
+		if (stages[i][0] == NULL) {
+			printf("Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
+	if (bg && !can_bg(nstages)) {
+		printf("%s: Too many background jobs; wait for "
+		       "some to finish before starting more\n",
+		       args[0]);
+		exitinfo_exit(ei, 1);
+		return;
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
-	}
+	nstarted = runpipeline(stages, nstages, pids);
 
 	/* parent */
-	if (bg) {
+	if (bg && nstarted == nstages) {
 		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
+		for (i=0; i<nstarted; i++) {
+			remember_bg(pids[i]);
+			printf("[%d] %s ... &\n", pids[i], stages[i][0]);
+		}
 		exitinfo_exit(ei, 0);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
-	}
-	else {
-		readstatus(status, ei);
+	/* wait for all of it; the last stage's status is the result */
+	exitinfo_exit(ei, 255);
+	for (i=0; i<nstarted; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			exitinfo_exit(ei, 255);
+		}
+		else if (i == nstages-1) {
+			readstatus(status, ei);
+		}
 	}
 
 	if (timing) {
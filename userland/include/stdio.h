@@ -41,6 +41,53 @@
 /* Constant returned by a bunch of stdio functions on error */
 #define EOF (-1)
 
+/* Buffering modes, for setvbuf */
+#define _IOFBF 0	/* fully buffered */
+#define _IOLBF 1	/* line buffered */
+#define _IONBF 2	/* unbuffered */
+
+/* Default buffer size */
+#define BUFSIZ 1024
+
+/* Maximum number of open streams, including stdin/stdout/stderr */
+#define FOPEN_MAX 20
+
+/*
+ * Stdio stream. The fields are for libc internal use only.
+ *
+ * A stream's buffer holds either data read ahead (__pos is the next
+ * byte to hand out, __len the end of the valid data) or data waiting
+ * to be written (__pos bytes), never both; the __SRDING and __SWRING
+ * flags say which. The buffering mode and buffer are chosen on first
+ * use unless setvbuf has been called: output to a terminal (character
+ * device) is line buffered, input from one is unbuffered so that
+ * programs that read a character at a time still see each keystroke,
+ * and everything else is fully buffered. stderr is always unbuffered.
+ */
+typedef struct __FILE {
+	int __fd;		/* file descriptor */
+	unsigned __flags;	/* __S* flags below */
+	int __mode;		/* _IO*BF, or -1 if not chosen yet */
+	char *__buf;		/* buffer, or NULL if not set up yet */
+	size_t __bufsize;	/* size of buffer */
+	size_t __pos;		/* next byte to read / bytes to write */
+	size_t __len;		/* end of data read into buffer */
+	char __ch;		/* one-byte buffer for unbuffered input */
+} FILE;
+
+#define __SINUSE  0x0001	/* stream slot in use */
+#define __SRD     0x0002	/* open for reading */
+#define __SWR     0x0004	/* open for writing */
+#define __SEOF    0x0008	/* end of file seen */
+#define __SERR    0x0010	/* error seen */
+#define __SMALLOC 0x0020	/* buffer came from malloc */
+#define __SRDING  0x0040	/* buffer holds read-ahead data */
+#define __SWRING  0x0080	/* buffer holds data to write */
+
+extern FILE *stdin;
+extern FILE *stdout;
+extern FILE *stderr;
+
 /*
  * The actual guts of printf
  * (for libc internal use only)
@@ -50,9 +97,50 @@ int __vprintf(void (*sendfunc)(void *clientdata, const char *, size_t len),
 	      const char *fmt,
 	      __va_list ap);
 
+/*
+ * The guts of stdio
+ * (for libc internal use only)
+ */
+extern FILE __stdio_files[FOPEN_MAX];
+void __stdio_setup(FILE *f);
+int __stdio_fill(FILE *f);
+int __stdio_write(FILE *f, const char *data, size_t len);
+int __stdio_flush(FILE *f);
+void __stdio_flushlbf(void);
+FILE *__stdio_open(int fd, const char *mode, int *openflags);
+
+/* Opening and closing streams */
+FILE *fopen(const char *path, const char *mode);
+FILE *fdopen(int fd, const char *mode);
+int fclose(FILE *f);
+int setvbuf(FILE *f, char *buf, int mode, size_t size);
+
+/* Write out buffered output; if F is NULL, for all streams */
+int fflush(FILE *f);
+
+/* Block and line I/O */
+size_t fread(void *ptr, size_t size, size_t nitems, FILE *f);
+size_t fwrite(const void *ptr, size_t size, size_t nitems, FILE *f);
+char *fgets(char *buf, int len, FILE *f);
+int fputs(const char *str, FILE *f);
+
+/* Character I/O */
+int fgetc(FILE *f);
+int getc(FILE *f);
+int fputc(int ch, FILE *f);
+int putc(int ch, FILE *f);
+
+/* Stream state */
+int feof(FILE *f);
+int ferror(FILE *f);
+void clearerr(FILE *f);
+int fileno(FILE *f);
+
 /* Printf calls for user programs */
 int printf(const char *fmt, ...);
 int vprintf(const char *fmt, __va_list ap);
+int fprintf(FILE *f, const char *fmt, ...);
+int vfprintf(FILE *f, const char *fmt, __va_list ap);
 int snprintf(char *buf, size_t len, const char *fmt, ...);
 int vsnprintf(char *buf, size_t len, const char *fmt, __va_list ap);
 
@@ -63,10 +151,10 @@ int puts(const char *);
 /* Nonstandard C, hence the __. */
 int __puts(const char *);
 
-/* Writes one character. Returns it. */
+/* Writes one character to stdout. Returns it. */
 int putchar(int);
 
-/* Reads one character (0-255) or returns EOF on error. */
+/* Reads one character (0-255) from stdin or returns EOF on error. */
 int getchar(void);
 
 #endif /* _STDIO_H_ */
@@ -76,6 +76,9 @@ char *setstate(char *);
 void *malloc(size_t size);
 void free(void *ptr);
 
+/* Print allocator statistics to stderr. Nonstandard, hence the __. */
+void __malloc_stats(void);
+
 /*
  * Sort.
  */
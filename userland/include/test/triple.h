@@ -28,3 +28,4 @@
  */
 
 void triple(const char *prog);
+void triplev(const char *prog, int nargs, char **args);
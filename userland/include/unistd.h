@@ -132,6 +132,9 @@ pid_t getpid(void);
 int ioctl(int filehandle, int code, void *buf);
 off_t lseek(int filehandle, off_t pos, int code);
 int fsync(int filehandle);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+/* readv, writev, preadv, pwritev - see sys/uio.h */
 int ftruncate(int filehandle, off_t size);
 int remove(const char *filename);
 int rename(const char *oldfile, const char *newfile);
@@ -159,6 +162,14 @@ int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
 
+/*
+ * The raw fork and execv system calls; fork and execv themselves are
+ * libc wrappers that flush stdio first.
+ * (for libc internal use only)
+ */
+int __sys_execv(const char *prog, char *const *args);
+pid_t __sys_fork(void);
+
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
  * You should implement this version as this is what we expect to test.
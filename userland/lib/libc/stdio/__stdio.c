@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+/*
+ * Stdio internals: the stream table, buffer setup, and the low-level
+ * fill, write and flush operations the rest of stdio is built on.
+ */
+
+/*
+ * stdin and stdout get static buffers, so programs that never open a
+ * file never call malloc on account of stdio.
+ */
+static char stdinbuf[BUFSIZ];
+static char stdoutbuf[BUFSIZ];
+
+FILE __stdio_files[FOPEN_MAX] = {
+	{ STDIN_FILENO, __SINUSE | __SRD, -1, stdinbuf, BUFSIZ, 0, 0, 0 },
+	{ STDOUT_FILENO, __SINUSE | __SWR, -1, stdoutbuf, BUFSIZ, 0, 0, 0 },
+	{ STDERR_FILENO, __SINUSE | __SWR, _IONBF, NULL, 0, 0, 0, 0 },
+};
+
+FILE *stdin = &__stdio_files[0];
+FILE *stdout = &__stdio_files[1];
+FILE *stderr = &__stdio_files[2];
+
+/*
+ * Pick the buffering mode and get a buffer, if that hasn't been done
+ * yet. Character devices count as terminals.
+ */
+void
+__stdio_setup(FILE *f)
+{
+	struct stat st;
+	int tty;
+
+	if (f->__mode < 0) {
+		tty = fstat(f->__fd, &st) == 0 && S_ISCHR(st.st_mode);
+		if (!tty) {
+			f->__mode = _IOFBF;
+		}
+		else if (f->__flags & __SWR) {
+			f->__mode = _IOLBF;
+		}
+		else {
+			f->__mode = _IONBF;
+		}
+	}
+	if (f->__buf == NULL && f->__mode != _IONBF) {
+		f->__buf = malloc(BUFSIZ);
+		if (f->__buf != NULL) {
+			f->__bufsize = BUFSIZ;
+			f->__flags |= __SMALLOC;
+		}
+		else {
+			f->__mode = _IONBF;
+		}
+	}
+	if (f->__mode == _IONBF && (f->__flags & __SMALLOC) == 0) {
+		/* reads still need somewhere to land */
+		f->__buf = &f->__ch;
+		f->__bufsize = 1;
+	}
+}
+
+/*
+ * Refill the read buffer of F, which must be empty. Returns the
+ * number of bytes read, 0 at EOF, or -1 on error.
+ *
+ * Before blocking on an interactive stream, write out any pending
+ * line-buffered output so prompts show up.
+ */
+int
+__stdio_fill(FILE *f)
+{
+	ssize_t r;
+
+	if ((f->__flags & __SRD) == 0) {
+		f->__flags |= __SERR;
+		errno = EBADF;
+		return -1;
+	}
+	if (f->__flags & __SWRING) {
+		if (__stdio_flush(f)) {
+			return -1;
+		}
+	}
+	__stdio_setup(f);
+	if (f->__mode != _IOFBF) {
+		__stdio_flushlbf();
+	}
+
+	f->__flags |= __SRDING;
+	f->__pos = f->__len = 0;
+	r = read(f->__fd, f->__buf, f->__bufsize);
+	if (r < 0) {
+		f->__flags |= __SERR;
+		return -1;
+	}
+	if (r == 0) {
+		f->__flags |= __SEOF;
+		return 0;
+	}
+	f->__len = r;
+	return r;
+}
+
+/*
+ * Write LEN bytes straight to the file, coping with short writes.
+ */
+static
+int
+__stdio_writeall(FILE *f, const char *data, size_t len)
+{
+	ssize_t r;
+
+	while (len > 0) {
+		r = write(f->__fd, data, len);
+		if (r <= 0) {
+			if (r == 0) {
+				errno = EIO;
+			}
+			f->__flags |= __SERR;
+			return EOF;
+		}
+		data += r;
+		len -= r;
+	}
+	return 0;
+}
+
+/*
+ * Write out the buffer. For a stream that was being read, give back
+ * the read-ahead instead by seeking backwards over it (which fails
+ * harmlessly on pipes and terminals, where it can't be given back).
+ */
+int
+__stdio_flush(FILE *f)
+{
+	int result = 0;
+
+	if (f->__flags & __SWRING) {
+		result = __stdio_writeall(f, f->__buf, f->__pos);
+		f->__flags &= ~__SWRING;
+	}
+	else if (f->__flags & __SRDING) {
+		if (f->__len > f->__pos) {
+			lseek(f->__fd, -(off_t)(f->__len - f->__pos), SEEK_CUR);
+		}
+		f->__flags &= ~__SRDING;
+		f->__len = 0;
+	}
+	f->__pos = 0;
+	return result;
+}
+
+/*
+ * Write LEN bytes to F through its buffer. Blocks at least as big as
+ * the buffer go straight out once the buffer is flushed.
+ */
+int
+__stdio_write(FILE *f, const char *data, size_t len)
+{
+	size_t i;
+
+	if ((f->__flags & __SWR) == 0) {
+		f->__flags |= __SERR;
+		errno = EBADF;
+		return EOF;
+	}
+	if (f->__flags & __SRDING) {
+		__stdio_flush(f);
+	}
+	__stdio_setup(f);
+
+	if (f->__mode == _IONBF) {
+		return __stdio_writeall(f, data, len);
+	}
+
+	f->__flags |= __SWRING;
+	if (f->__pos + len > f->__bufsize) {
+		if (__stdio_flush(f)) {
+			return EOF;
+		}
+		f->__flags |= __SWRING;
+		if (len >= f->__bufsize) {
+			return __stdio_writeall(f, data, len);
+		}
+	}
+	memcpy(f->__buf + f->__pos, data, len);
+	f->__pos += len;
+
+	if (f->__mode == _IOLBF) {
+		for (i=0; i<len; i++) {
+			if (data[i] == '\n') {
+				return __stdio_flush(f);
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Flush all line-buffered output streams.
+ */
+void
+__stdio_flushlbf(void)
+{
+	unsigned i;
+
+	for (i=0; i<FOPEN_MAX; i++) {
+		if ((__stdio_files[i].__flags & __SWRING) &&
+		    __stdio_files[i].__mode == _IOLBF) {
+			__stdio_flush(&__stdio_files[i]);
+		}
+	}
+}
+
+/*
+ * Set up a stream for FD with fopen-style MODE. If OPENFLAGS isn't
+ * NULL, the corresponding open(2) flags are returned there. Returns
+ * NULL with errno set if MODE is bad or all the streams are in use.
+ */
+FILE *
+__stdio_open(int fd, const char *mode, int *openflags)
+{
+	unsigned flags, i;
+	int oflags;
+	FILE *f;
+
+	switch (mode[0]) {
+	    case 'r':
+		flags = __SRD;
+		oflags = O_RDONLY;
+		break;
+	    case 'w':
+		flags = __SWR;
+		oflags = O_WRONLY | O_CREAT | O_TRUNC;
+		break;
+	    case 'a':
+		flags = __SWR;
+		oflags = O_WRONLY | O_CREAT | O_APPEND;
+		break;
+	    default:
+		errno = EINVAL;
+		return NULL;
+	}
+	/* "b" means nothing here */
+	if (strchr(mode + 1, '+') != NULL) {
+		flags = __SRD | __SWR;
+		oflags = (oflags & ~O_ACCMODE) | O_RDWR;
+	}
+
+	f = NULL;
+	for (i=0; i<FOPEN_MAX; i++) {
+		if ((__stdio_files[i].__flags & __SINUSE) == 0) {
+			f = &__stdio_files[i];
+			break;
+		}
+	}
+	if (f == NULL) {
+		errno = EMFILE;
+		return NULL;
+	}
+
+	f->__fd = fd;
+	f->__flags = __SINUSE | flags;
+	f->__mode = -1;
+	f->__buf = NULL;
+	f->__bufsize = 0;
+	f->__pos = 0;
+	f->__len = 0;
+	if (openflags != NULL) {
+		*openflags = oflags;
+	}
+	return f;
+}
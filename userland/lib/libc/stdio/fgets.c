@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * fgets - C standard I/O function: read a line, including the
+ * newline, of at most LEN-1 characters into BUF and null-terminate
+ * it. Returns NULL if nothing could be read.
+ */
+
+char *
+fgets(char *buf, int len, FILE *f)
+{
+	size_t got, n, i;
+	bool nl = false;
+
+	if (len <= 0) {
+		return NULL;
+	}
+
+	got = 0;
+	while (got < (size_t)len - 1) {
+		if (f->__pos >= f->__len || (f->__flags & __SRDING) == 0) {
+			if (__stdio_fill(f) <= 0) {
+				break;
+			}
+		}
+		n = f->__len - f->__pos;
+		if (n > (size_t)len - 1 - got) {
+			n = (size_t)len - 1 - got;
+		}
+		for (i=0; i<n; i++) {
+			if (f->__buf[f->__pos + i] == '\n') {
+				n = i + 1;
+				nl = true;
+				break;
+			}
+		}
+		memcpy(buf + got, f->__buf + f->__pos, n);
+		f->__pos += n;
+		got += n;
+		if (nl) {
+			break;
+		}
+	}
+
+	if (got == 0) {
+		return NULL;
+	}
+	buf[got] = 0;
+	return buf;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * fread - C standard I/O function: read NITEMS items of SIZE bytes.
+ * Returns the number of complete items read.
+ *
+ * Whatever is in the buffer is used first; after that, requests at
+ * least as big as the buffer are read directly into the caller's
+ * memory rather than going through the buffer.
+ */
+
+size_t
+fread(void *ptr, size_t size, size_t nitems, FILE *f)
+{
+	char *dest = ptr;
+	size_t total, got, n;
+	ssize_t r;
+
+	total = size * nitems;
+	if (total == 0) {
+		return 0;
+	}
+
+	got = 0;
+	while (got < total) {
+		if ((f->__flags & __SRDING) && f->__pos < f->__len) {
+			n = f->__len - f->__pos;
+			if (n > total - got) {
+				n = total - got;
+			}
+			memcpy(dest + got, f->__buf + f->__pos, n);
+			f->__pos += n;
+			got += n;
+			continue;
+		}
+
+		__stdio_setup(f);
+		if (total - got >= f->__bufsize && (f->__flags & __SRD)) {
+			if (__stdio_flush(f)) {
+				break;
+			}
+			r = read(f->__fd, dest + got, total - got);
+			if (r < 0) {
+				f->__flags |= __SERR;
+				break;
+			}
+			if (r == 0) {
+				f->__flags |= __SEOF;
+				break;
+			}
+			got += r;
+			continue;
+		}
+
+		if (__stdio_fill(f) <= 0) {
+			break;
+		}
+	}
+	return got / size;
+}
@@ -29,13 +29,28 @@
 
 #include <stdio.h>
 #include <stdarg.h>
-#include <unistd.h>
+#include <string.h>
 #include <errno.h>
 
 /*
- * printf - C standard I/O function.
+ * printf, fprintf - C standard I/O functions.
  */
 
+/*
+ * State for the output function passed to __vprintf.
+ *
+ * Output to an unbuffered stream (stderr, mainly) is collected in a
+ * temporary buffer on the stack and written at the end, or whenever
+ * it fills, so that one printf call isn't a write per conversion.
+ */
+struct printfinfo {
+	FILE *f;
+	char *tmp;		/* temporary buffer, or NULL */
+	size_t tmplen;		/* bytes in temporary buffer */
+	int err;		/* first error, or 0 */
+};
+
+#define PRINTF_TMPSIZE 256
 
 /*
  * Function passed to __vprintf to do the actual output.
@@ -44,11 +59,35 @@ static
 void
 __printf_send(void *mydata, const char *data, size_t len)
 {
-	ssize_t ret;
-	int *err = mydata;
+	struct printfinfo *pi = mydata;
+	size_t n;
 
-	ret = write(STDOUT_FILENO, data, len);
-	*err = (ret == -1) ? errno : 0;
+	if (pi->err) {
+		return;
+	}
+	if (pi->tmp == NULL) {
+		if (__stdio_write(pi->f, data, len)) {
+			pi->err = errno;
+		}
+		return;
+	}
+	while (len > 0) {
+		if (pi->tmplen == PRINTF_TMPSIZE) {
+			if (__stdio_write(pi->f, pi->tmp, pi->tmplen)) {
+				pi->err = errno;
+				return;
+			}
+			pi->tmplen = 0;
+		}
+		n = PRINTF_TMPSIZE - pi->tmplen;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(pi->tmp + pi->tmplen, data, n);
+		pi->tmplen += n;
+		data += n;
+		len -= n;
+	}
 }
 
 /* printf: hand off to vprintf */
@@ -59,19 +98,53 @@ printf(const char *fmt, ...)
 	va_list ap;
 
 	va_start(ap, fmt);
-	chars = vprintf(fmt, ap);
+	chars = vfprintf(stdout, fmt, ap);
 	va_end(ap);
 	return chars;
 }
 
-/* vprintf: call __vprintf to do the work. */
+/* vprintf: hand off to vfprintf */
 int
 vprintf(const char *fmt, va_list ap)
 {
-	int chars, err;
-	chars = __vprintf(__printf_send, &err, fmt, ap);
-	if (err) {
-		errno = err;
+	return vfprintf(stdout, fmt, ap);
+}
+
+/* fprintf: hand off to vfprintf */
+int
+fprintf(FILE *f, const char *fmt, ...)
+{
+	int chars;
+	va_list ap;
+
+	va_start(ap, fmt);
+	chars = vfprintf(f, fmt, ap);
+	va_end(ap);
+	return chars;
+}
+
+/* vfprintf: call __vprintf to do the work. */
+int
+vfprintf(FILE *f, const char *fmt, va_list ap)
+{
+	char tmp[PRINTF_TMPSIZE];
+	struct printfinfo pi;
+	int chars;
+
+	__stdio_setup(f);
+	pi.f = f;
+	pi.tmp = (f->__mode == _IONBF) ? tmp : NULL;
+	pi.tmplen = 0;
+	pi.err = 0;
+
+	chars = __vprintf(__printf_send, &pi, fmt, ap);
+	if (pi.tmplen > 0 && pi.err == 0) {
+		if (__stdio_write(f, pi.tmp, pi.tmplen)) {
+			pi.err = errno;
+		}
+	}
+	if (pi.err) {
+		errno = pi.err;
 		return -1;
 	}
 	return chars;
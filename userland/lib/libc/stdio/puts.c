@@ -36,7 +36,8 @@
 int
 puts(const char *s)
 {
-	__puts(s);
-	putchar('\n');
+	if (__puts(s) == EOF || putchar('\n') == EOF) {
+		return EOF;
+	}
 	return 0;
 }
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+/*
+ * setvbuf - C standard I/O function: choose the buffering mode and
+ * optionally supply a buffer. Must be called before any I/O on the
+ * stream. If BUF is NULL a buffer of SIZE bytes (or BUFSIZ if SIZE
+ * is 0) is allocated on first use.
+ */
+
+int
+setvbuf(FILE *f, char *buf, int mode, size_t size)
+{
+	if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) {
+		errno = EINVAL;
+		return EOF;
+	}
+	if (f->__flags & (__SRDING | __SWRING)) {
+		errno = EBUSY;
+		return EOF;
+	}
+
+	if (f->__flags & __SMALLOC) {
+		free(f->__buf);
+		f->__flags &= ~__SMALLOC;
+	}
+	f->__mode = mode;
+	f->__buf = NULL;
+	f->__bufsize = 0;
+	if (mode == _IONBF) {
+		return 0;
+	}
+
+	if (buf == NULL) {
+		if (size == 0) {
+			size = BUFSIZ;
+		}
+		buf = malloc(size);
+		if (buf == NULL) {
+			/* __stdio_setup will fall back to unbuffered */
+			return EOF;
+		}
+		f->__flags |= __SMALLOC;
+	}
+	else if (size == 0) {
+		errno = EINVAL;
+		return EOF;
+	}
+	f->__buf = buf;
+	f->__bufsize = size;
+	return 0;
+}
@@ -27,6 +27,7 @@
  * SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -40,7 +41,9 @@ exit(int code)
 	/*
 	 * In a more complicated libc, this would call functions registered
 	 * with atexit() before calling the syscall to actually exit.
+	 * As it is, the only cleanup needed is writing out stdio buffers.
 	 */
+	fflush(NULL);
 
 #ifdef __mips__
 	/*
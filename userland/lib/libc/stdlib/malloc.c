@@ -30,10 +30,19 @@
 /*
  * User-level malloc and free implementation.
  *
- * This is a basic first-fit allocator. It's intended to be simple and
- * easy to follow. It performs abysmally if the heap becomes larger than
- * physical memory. To get (much) better out-of-core performance, port
- * the kernel's malloc. :-)
+ * The heap (grown with sbrk) is divided into page-aligned spans. Each
+ * span starts with a header recording its size in pages and the size
+ * of the span below it, so neighbours can be found and free spans
+ * coalesced in constant time. Free spans are kept on lists by size.
+ *
+ * Small requests are rounded up to one of a fixed set of size
+ * classes and served from one-page "runs" of equal-sized objects,
+ * with a bitmap in the run header recording which objects are free.
+ * Runs with free objects are kept on a list per size class, so small
+ * allocations and frees never search the heap. A run that becomes
+ * empty goes back to the span lists.
+ *
+ * Requests too big for any size class get a span of their own.
  */
 
 #include <stdlib.h>
@@ -53,106 +62,105 @@
 #endif
 
 /*
- * malloc block header.
- *
- * mh_prevblock is the downwards offset to the previous header, 0 if this
- * is the bottom of the heap.
- *
- * mh_nextblock is the upwards offset to the next header.
- *
- * mh_pad is unused.
- * mh_inuse is 1 if the block is in use, 0 if it is free.
- * mh_magic* should always be a fixed value.
- *
- * MBLOCKSIZE should equal sizeof(struct mheader) and be a power of 2.
- * MBLOCKSHIFT is the log base 2 of MBLOCKSIZE.
- * MMAGIC is the value for mh_magic*.
+ * System page size. In POSIX you're supposed to call
+ * sysconf(_SC_PAGESIZE). If _SC_PAGESIZE isn't defined, as on OS/161,
+ * assume 4K.
  */
-struct mheader {
-
-#if defined(MALLOC32)
-#define MBLOCKSIZE 8
-#define MBLOCKSHIFT 3
-#define MMAGIC 2
-	/*
-	 * 32-bit platform. size_t is 32 bits (4 bytes).
-	 * Block size is 8 bytes.
-	 */
-	unsigned mh_prevblock:29;
-	unsigned mh_pad:1;
-	unsigned mh_magic1:2;
-
-	unsigned mh_nextblock:29;
-	unsigned mh_inuse:1;
-	unsigned mh_magic2:2;
-
-#elif defined(MALLOC64)
-#define MBLOCKSIZE 16
-#define MBLOCKSHIFT 4
-#define MMAGIC 6
-	/*
-	 * 64-bit platform. size_t is 64 bits (8 bytes)
-	 * Block size is 16 bytes.
-	 */
-	unsigned mh_prevblock:60;
-	unsigned mh_pad:1;
-	unsigned mh_magic1:3;
-
-	unsigned mh_nextblock:60;
-	unsigned mh_inuse:1;
-	unsigned mh_magic2:3;
 
+#ifdef _SC_PAGESIZE
+static size_t __malloc_pagesize;
+#define PAGE_SIZE __malloc_pagesize
 #else
-#error "please fix me"
+#define PAGE_SIZE 4096
 #endif
-};
 
 /*
- * Operator macros on struct mheader.
+ * Span header. Lives at the start of every span.
  *
- * M_NEXT/PREVOFF:	return offset to next/previous header
- * M_NEXT/PREV:		return next/previous header
+ * ms_magic says what the span is used for.
+ * ms_npages is the size of the span in pages.
+ * ms_prevpages is the size of the span below, 0 at the bottom of the heap.
+ * ms_class is the size class of a run.
+ * ms_nfree is the number of free objects in a run.
+ * ms_next/ms_prev link free spans on their free list, or runs with
+ *    free objects on their size class's list.
+ * ms_bitmap has one bit per object in a run, set if it is free.
  *
- * M_DATA:		return data pointer of a header
- * M_SIZE:		return data size of a header
- *
- * M_OK:		true if the magic values are correct
- *
- * M_MKFIELD:		prepare a value for mh_next/prevblock.
- * 			(value should include the header size)
+ * MSPAN_HDRSIZE is the space reserved for the header; it is a
+ * multiple of MALIGN so objects after it are aligned.
  */
+#define MRUNBITS 256
+#define MBITMAPWORDS (MRUNBITS / 32)
+
+struct mspan {
+	uint32_t ms_magic;
+	uint32_t ms_npages;
+	uint32_t ms_prevpages;
+	uint16_t ms_class;
+	uint16_t ms_nfree;
+	struct mspan *ms_next;
+	struct mspan *ms_prev;
+	uint32_t ms_bitmap[MBITMAPWORDS];
+};
+
+#define MSPAN_HDRSIZE	64
+#define MALIGN		16
 
-#define M_NEXTOFF(mh)	((size_t)(((size_t)((mh)->mh_nextblock))<<MBLOCKSHIFT))
-#define M_PREVOFF(mh)	((size_t)(((size_t)((mh)->mh_prevblock))<<MBLOCKSHIFT))
-#define M_NEXT(mh)	((struct mheader *)(((char*)(mh))+M_NEXTOFF(mh)))
-#define M_PREV(mh)	((struct mheader *)(((char*)(mh))-M_PREVOFF(mh)))
+#define MSPAN_FREE	0xf4eef4ee	/* free span */
+#define MSPAN_LARGE	0x1a46e000	/* large allocation */
+#define MSPAN_RUN	0x4a4a4a00	/* run of small objects */
 
-#define M_DATA(mh)	((void *)((mh)+1))
-#define M_SIZE(mh)	(M_NEXTOFF(mh)-MBLOCKSIZE)
+#define MS_DATA(ms)	((void *)((char *)(ms) + MSPAN_HDRSIZE))
+#define MS_SIZE(ms)	((size_t)(ms)->ms_npages * PAGE_SIZE)
+#define MS_NEXTSPAN(ms)	((struct mspan *)((char *)(ms) + MS_SIZE(ms)))
+#define MS_PREVSPAN(ms)	\
+	((struct mspan *)((char *)(ms) - (size_t)(ms)->ms_prevpages * PAGE_SIZE))
+
+/*
+ * Size classes. All are multiples of MALIGN; the last two are sized
+ * to fit three and two objects in a 4K run.
+ */
+static const size_t __malloc_sizes[] = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512,
+	640, 768, 896, 1024, 1344, 2016,
+};
+#define NSIZES (sizeof(__malloc_sizes) / sizeof(__malloc_sizes[0]))
+#define MAXSMALL 2016
 
-#define M_OK(mh)	((mh)->mh_magic1==MMAGIC && (mh)->mh_magic2==MMAGIC)
+/* Size class for each multiple of MALIGN up to MAXSMALL */
+static uint8_t __malloc_classof[MAXSMALL / MALIGN + 1];
 
-#define M_MKFIELD(off)	((off)>>MBLOCKSHIFT)
+/* Objects per run for each size class */
+static unsigned __malloc_nobjs[NSIZES];
 
 /*
- * System page size. In POSIX you're supposed to call
- * sysconf(_SC_PAGESIZE). If _SC_PAGESIZE isn't defined, as on OS/161,
- * assume 4K.
+ * Free span lists. List i < NSPANLISTS-1 holds free spans of exactly
+ * i+1 pages; the last list holds everything bigger.
  */
+#define NSPANLISTS 16
+static struct mspan *__malloc_freespans[NSPANLISTS];
 
-#ifdef _SC_PAGESIZE
-static size_t __malloc_pagesize;
-#define PAGE_SIZE __malloc_pagesize
-#else
-#define PAGE_SIZE 4096
-#endif
+/* Runs with at least one free object, per size class */
+static struct mspan *__malloc_runs[NSIZES];
+
+/*
+ * Statistics.
+ */
+static unsigned __malloc_inuse[NSIZES];		/* objects allocated */
+static unsigned __malloc_nruns[NSIZES];		/* runs */
+static unsigned __malloc_nlarge;		/* large allocations */
+static size_t __malloc_largepages;		/* pages in them */
+static size_t __malloc_freepages;		/* pages in free spans */
 
 ////////////////////////////////////////////////////////////
 
 /*
- * Static variables - the bottom and top addresses of the heap.
+ * Static variables - the bottom and top addresses of the heap, and
+ * the topmost span.
  */
 static uintptr_t __heapbase, __heaptop;
+static struct mspan *__lastspan;
 
 /*
  * Setup function.
@@ -162,18 +170,17 @@ void
 __malloc_init(void)
 {
 	void *x;
+	unsigned i, c;
+	size_t n;
 
 	/*
 	 * Check various assumed properties of the sizes.
 	 */
-	if (sizeof(struct mheader) != MBLOCKSIZE) {
-		errx(1, "malloc: Internal error - MBLOCKSIZE wrong");
-	}
-	if ((MBLOCKSIZE & (MBLOCKSIZE-1))!=0) {
-		errx(1, "malloc: Internal error - MBLOCKSIZE not power of 2");
+	if (sizeof(struct mspan) > MSPAN_HDRSIZE) {
+		errx(1, "malloc: Internal error - MSPAN_HDRSIZE too small");
 	}
-	if (1<<MBLOCKSHIFT != MBLOCKSIZE) {
-		errx(1, "malloc: Internal error - MBLOCKSHIFT wrong");
+	if (MSPAN_HDRSIZE % MALIGN != 0) {
+		errx(1, "malloc: Internal error - MSPAN_HDRSIZE misaligned");
 	}
 
 	/* init should only be called once. */
@@ -186,6 +193,19 @@ __malloc_init(void)
 	__malloc_pagesize = sysconf(_SC_PAGESIZE);
 #endif
 
+	/* Set up the size class tables. */
+	c = 0;
+	for (i=0; i<=MAXSMALL / MALIGN; i++) {
+		while (__malloc_sizes[c] < i * MALIGN) {
+			c++;
+		}
+		__malloc_classof[i] = c;
+	}
+	for (c=0; c<NSIZES; c++) {
+		n = (PAGE_SIZE - MSPAN_HDRSIZE) / __malloc_sizes[c];
+		__malloc_nobjs[c] = n > MRUNBITS ? MRUNBITS : n;
+	}
+
 	/* Use sbrk to find the base of the heap. */
 	x = sbrk(0);
 	if (x==(void *)-1) {
@@ -197,14 +217,14 @@ __malloc_init(void)
 	__heapbase = __heaptop = (uintptr_t)x;
 
 	/*
-	 * Make sure the heap base is aligned the way we want it.
+	 * Make sure the heap base is page aligned, as spans must be.
 	 * (On OS/161, it will begin on a page boundary. But on
 	 * an arbitrary Unix, it may not be, as traditionally it
 	 * begins at _end.)
 	 */
 
-	if (__heapbase % MBLOCKSIZE != 0) {
-		size_t adjust = MBLOCKSIZE - (__heapbase % MBLOCKSIZE);
+	if (__heapbase % PAGE_SIZE != 0) {
+		size_t adjust = PAGE_SIZE - (__heapbase % PAGE_SIZE);
 		x = sbrk(adjust);
 		if (x==(void *)-1) {
 			err(1, "malloc: sbrk failed aligning heap base");
@@ -223,6 +243,29 @@ __malloc_init(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Check a span header, and that the span below agrees about where
+ * this one starts.
+ */
+static
+void
+__malloc_checkspan(struct mspan *ms, const char *func)
+{
+	if (ms->ms_magic != MSPAN_FREE && ms->ms_magic != MSPAN_LARGE &&
+	    ms->ms_magic != MSPAN_RUN) {
+		errx(1, "%s: Heap corrupt; span at %p has bad magic", func, ms);
+	}
+	if (ms->ms_npages == 0 ||
+	    (uintptr_t)MS_NEXTSPAN(ms) > __heaptop) {
+		errx(1, "%s: Heap corrupt; span at %p has bad size", func, ms);
+	}
+	if (ms->ms_prevpages != 0 &&
+	    MS_PREVSPAN(ms)->ms_npages != ms->ms_prevpages) {
+		errx(1, "%s: Heap corrupt; span at %p and the one below "
+		     "are inconsistent", func, ms);
+	}
+}
+
 #ifdef MALLOCDEBUG
 
 /*
@@ -232,35 +275,18 @@ static
 void
 __malloc_dump(void)
 {
-	struct mheader *mh;
+	struct mspan *ms;
 	uintptr_t i;
-	size_t rightprevblock;
 
 	warnx("heap: ************************************************");
 
-	rightprevblock = 0;
-	for (i=__heapbase; i<__heaptop; i += M_NEXTOFF(mh)) {
-		mh = (struct mheader *) i;
-		if (!M_OK(mh)) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad magic bits",
-			     (unsigned long) i);
-		}
-		if (mh->mh_prevblock != rightprevblock) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad previous-block size %lu "
-			     "(should be %lu)",
-			     (unsigned long) i,
-			     (unsigned long) mh->mh_prevblock << MBLOCKSHIFT,
-			     (unsigned long) rightprevblock << MBLOCKSHIFT);
-		}
-		rightprevblock = mh->mh_nextblock;
-
-		warnx("heap: 0x%lx 0x%-6lx (next: 0x%lx) %s",
-		      (unsigned long) i + MBLOCKSIZE,
-		      (unsigned long) M_SIZE(mh),
-		      (unsigned long) (i+M_NEXTOFF(mh)),
-		      mh->mh_inuse ? "INUSE" : "FREE");
+	for (i=__heapbase; i<__heaptop; i += MS_SIZE(ms)) {
+		ms = (struct mspan *) i;
+		__malloc_checkspan(ms, "malloc");
+		warnx("heap: 0x%lx %4lu pages %s",
+		      (unsigned long) i, (unsigned long) ms->ms_npages,
+		      ms->ms_magic == MSPAN_FREE ? "FREE" :
+		      ms->ms_magic == MSPAN_LARGE ? "LARGE" : "RUN");
 	}
 	if (i!=__heaptop) {
 		errx(1, "malloc: Heap corrupt; ran off end");
@@ -271,78 +297,330 @@ __malloc_dump(void)
 
 #endif /* MALLOCDEBUG */
 
+/*
+ * Print allocator statistics to stderr.
+ */
+void
+__malloc_stats(void)
+{
+	unsigned c;
+
+	warnx("malloc: heap %lu bytes, %lu pages free",
+	      (unsigned long) (__heaptop - __heapbase),
+	      (unsigned long) __malloc_freepages);
+	for (c=0; c<NSIZES; c++) {
+		if (__malloc_nruns[c] == 0) {
+			continue;
+		}
+		warnx("malloc: %4lu bytes: %u in use, %u runs",
+		      (unsigned long) __malloc_sizes[c],
+		      __malloc_inuse[c], __malloc_nruns[c]);
+	}
+	warnx("malloc: large: %u in use, %lu pages",
+	      __malloc_nlarge, (unsigned long) __malloc_largepages);
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
- * Get more memory (at the top of the heap) using sbrk, and
- * return a pointer to it.
+ * Doubly-linked list operations for free spans and runs.
  */
 static
-void *
-__malloc_sbrk(size_t size)
+void
+__malloc_listadd(struct mspan **head, struct mspan *ms)
 {
-	void *x;
+	ms->ms_prev = NULL;
+	ms->ms_next = *head;
+	if (*head != NULL) {
+		(*head)->ms_prev = ms;
+	}
+	*head = ms;
+}
 
-	x = sbrk(size);
-	if (x == (void *)-1) {
-		return NULL;
+static
+void
+__malloc_listremove(struct mspan **head, struct mspan *ms)
+{
+	if (ms->ms_prev != NULL) {
+		ms->ms_prev->ms_next = ms->ms_next;
+	}
+	else {
+		*head = ms->ms_next;
+	}
+	if (ms->ms_next != NULL) {
+		ms->ms_next->ms_prev = ms->ms_prev;
+	}
+	ms->ms_next = ms->ms_prev = NULL;
+}
+
+static
+struct mspan **
+__malloc_spanlist(size_t npages)
+{
+	if (npages >= NSPANLISTS) {
+		return &__malloc_freespans[NSPANLISTS-1];
 	}
+	return &__malloc_freespans[npages-1];
+}
+
+/*
+ * Set the size of span MS, and tell the span above.
+ */
+static
+void
+__malloc_setsize(struct mspan *ms, size_t npages)
+{
+	struct mspan *next;
 
-	if ((uintptr_t)x != __heaptop) {
-		errx(1, "malloc: Internal error - "
-		     "heap top moved itself from 0x%lx to 0x%lx",
-		     (unsigned long) __heaptop,
-		     (unsigned long) (uintptr_t) x);
+	ms->ms_npages = npages;
+	next = MS_NEXTSPAN(ms);
+	if ((uintptr_t)next < __heaptop) {
+		next->ms_prevpages = npages;
+	}
+	else {
+		__lastspan = ms;
 	}
-	__heaptop += size;
-	return x;
 }
 
 /*
- * Make a new (free) block from the block passed in, leaving size
- * bytes for data in the current block. size must be a multiple of
- * MBLOCKSIZE.
- *
- * Only split if the excess space is at least twice the blocksize -
- * one blocksize to hold a header and one for data.
+ * Put span MS on the free lists, merging it with free neighbours.
  */
 static
 void
-__malloc_split(struct mheader *mh, size_t size)
+__malloc_freespan(struct mspan *ms)
+{
+	struct mspan *other;
+	size_t npages;
+
+	__malloc_freepages += ms->ms_npages;
+	npages = ms->ms_npages;
+
+	other = MS_NEXTSPAN(ms);
+	if ((uintptr_t)other < __heaptop && other->ms_magic == MSPAN_FREE) {
+		__malloc_listremove(__malloc_spanlist(other->ms_npages), other);
+		npages += other->ms_npages;
+		other->ms_magic = 0;
+	}
+	if (ms->ms_prevpages != 0) {
+		other = MS_PREVSPAN(ms);
+		if (other->ms_magic == MSPAN_FREE) {
+			__malloc_listremove(__malloc_spanlist(other->ms_npages),
+					    other);
+			npages += other->ms_npages;
+			ms->ms_magic = 0;
+			ms = other;
+		}
+	}
+
+	ms->ms_magic = MSPAN_FREE;
+	__malloc_setsize(ms, npages);
+	__malloc_listadd(__malloc_spanlist(npages), ms);
+}
+
+/*
+ * Get a span of NPAGES pages, from the free lists if possible and
+ * otherwise by growing the heap. Returns NULL if out of memory.
+ */
+static
+struct mspan *
+__malloc_getspan(size_t npages)
 {
-	struct mheader *mhnext, *mhnew;
-	size_t oldsize;
+	struct mspan *ms, *rest;
+	size_t morepages;
+	unsigned i;
+	void *x;
 
-	if (size % MBLOCKSIZE != 0) {
-		errx(1, "malloc: Internal error (size %lu passed to split)",
-		     (unsigned long) size);
+	/* Exact-size lists first, then first fit in the big list. */
+	ms = NULL;
+	for (i = npages < NSPANLISTS ? npages-1 : NSPANLISTS-1;
+	     i < NSPANLISTS-1; i++) {
+		if (__malloc_freespans[i] != NULL) {
+			ms = __malloc_freespans[i];
+			break;
+		}
+	}
+	if (ms == NULL) {
+		for (ms = __malloc_freespans[NSPANLISTS-1]; ms != NULL;
+		     ms = ms->ms_next) {
+			if (ms->ms_npages >= npages) {
+				break;
+			}
+		}
 	}
 
-	if (M_SIZE(mh) - size < 2*MBLOCKSIZE) {
-		/* no room */
-		return;
+	if (ms != NULL) {
+		__malloc_listremove(__malloc_spanlist(ms->ms_npages), ms);
+		__malloc_freepages -= ms->ms_npages;
+	}
+	else {
+		/*
+		 * Grow the heap. If the top span is free, it only
+		 * needs extending.
+		 */
+		if (__lastspan != NULL && __lastspan->ms_magic == MSPAN_FREE) {
+			ms = __lastspan;
+			__malloc_listremove(__malloc_spanlist(ms->ms_npages), ms);
+			__malloc_freepages -= ms->ms_npages;
+			morepages = npages - ms->ms_npages;
+		}
+		else {
+			ms = NULL;
+			morepages = npages;
+		}
+
+		if (morepages > (size_t)-1 / PAGE_SIZE) {
+			x = (void *)-1;
+		}
+		else {
+			x = sbrk(morepages * PAGE_SIZE);
+		}
+		if (x == (void *)-1) {
+			if (ms != NULL) {
+				__malloc_freepages += ms->ms_npages;
+				__malloc_listadd(__malloc_spanlist(ms->ms_npages),
+						 ms);
+			}
+			return NULL;
+		}
+		if ((uintptr_t)x != __heaptop) {
+			errx(1, "malloc: Internal error - "
+			     "heap top moved itself from 0x%lx to 0x%lx",
+			     (unsigned long) __heaptop,
+			     (unsigned long) (uintptr_t) x);
+		}
+		__heaptop += morepages * PAGE_SIZE;
+
+		if (ms == NULL) {
+			ms = x;
+			ms->ms_prevpages =
+				__lastspan == NULL ? 0 : __lastspan->ms_npages;
+		}
+		ms->ms_npages = npages;
+		__lastspan = ms;
 	}
 
-	mhnext = M_NEXT(mh);
+	/* Give back any excess. */
+	if (ms->ms_npages > npages) {
+		rest = (struct mspan *)((char *)ms + npages * PAGE_SIZE);
+		rest->ms_magic = MSPAN_FREE;
+		rest->ms_prevpages = npages;
+		__malloc_setsize(rest, ms->ms_npages - npages);
+		__malloc_setsize(ms, npages);
+		__malloc_freepages += rest->ms_npages;
+		__malloc_listadd(__malloc_spanlist(rest->ms_npages), rest);
+	}
+	return ms;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Find the first set bit in a nonzero word.
+ */
+static
+unsigned
+__malloc_firstbit(uint32_t w)
+{
+	unsigned b = 0;
+
+	if ((w & 0xffff) == 0) { w >>= 16; b += 16; }
+	if ((w & 0xff) == 0) { w >>= 8; b += 8; }
+	if ((w & 0xf) == 0) { w >>= 4; b += 4; }
+	if ((w & 0x3) == 0) { w >>= 2; b += 2; }
+	if ((w & 0x1) == 0) { b += 1; }
+	return b;
+}
+
+/*
+ * Make a new run for size class C.
+ */
+static
+struct mspan *
+__malloc_newrun(unsigned c)
+{
+	struct mspan *ms;
+	unsigned i, n;
+
+	ms = __malloc_getspan(1);
+	if (ms == NULL) {
+		return NULL;
+	}
+	ms->ms_magic = MSPAN_RUN;
+	ms->ms_class = c;
+	n = __malloc_nobjs[c];
+	ms->ms_nfree = n;
+	for (i=0; i<MBITMAPWORDS; i++) {
+		if (n >= 32) {
+			ms->ms_bitmap[i] = 0xffffffff;
+			n -= 32;
+		}
+		else {
+			ms->ms_bitmap[i] = ((uint32_t)1 << n) - 1;
+			n = 0;
+		}
+	}
+	__malloc_listadd(&__malloc_runs[c], ms);
+	__malloc_nruns[c]++;
+	return ms;
+}
 
-	oldsize = M_SIZE(mh);
-	mh->mh_nextblock = M_MKFIELD(size + MBLOCKSIZE);
+/*
+ * Allocate an object of size class C.
+ */
+static
+void *
+__malloc_small(unsigned c)
+{
+	struct mspan *ms;
+	unsigned i, bit;
+
+	ms = __malloc_runs[c];
+	if (ms == NULL) {
+		ms = __malloc_newrun(c);
+		if (ms == NULL) {
+			return NULL;
+		}
+	}
 
-	mhnew = M_NEXT(mh);
-	if (mhnew==mhnext) {
-		errx(1, "malloc: Internal error (split screwed up?)");
+	for (i=0; ms->ms_bitmap[i] == 0; i++) {
+		assert(i < MBITMAPWORDS - 1);
+	}
+	bit = __malloc_firstbit(ms->ms_bitmap[i]);
+	ms->ms_bitmap[i] &= ~((uint32_t)1 << bit);
+	if (--ms->ms_nfree == 0) {
+		__malloc_listremove(&__malloc_runs[c], ms);
 	}
+	__malloc_inuse[c]++;
+
+	return (char *)MS_DATA(ms) + (i*32 + bit) * __malloc_sizes[c];
+}
+
+/*
+ * Allocate a span of its own for SIZE bytes.
+ */
+static
+void *
+__malloc_large(size_t size)
+{
+	struct mspan *ms;
+	size_t npages;
 
-	mhnew->mh_prevblock = M_MKFIELD(size + MBLOCKSIZE);
-	mhnew->mh_pad = 0;
-	mhnew->mh_magic1 = MMAGIC;
-	mhnew->mh_nextblock = M_MKFIELD(oldsize - size);
-	mhnew->mh_inuse = 0;
-	mhnew->mh_magic2 = MMAGIC;
+	if (size > (size_t)-1 - MSPAN_HDRSIZE - PAGE_SIZE) {
+		return NULL;
+	}
+	npages = (size + MSPAN_HDRSIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+	if ((uint32_t)npages != npages) {
+		return NULL;
+	}
 
-	if (mhnext != (struct mheader *) __heaptop) {
-		mhnext->mh_prevblock = mhnew->mh_nextblock;
+	ms = __malloc_getspan(npages);
+	if (ms == NULL) {
+		return NULL;
 	}
+	ms->ms_magic = MSPAN_LARGE;
+	__malloc_nlarge++;
+	__malloc_largepages += npages;
+	return MS_DATA(ms);
 }
 
 /*
@@ -351,10 +629,6 @@ __malloc_split(struct mheader *mh, size_t size)
 void *
 malloc(size_t size)
 {
-	struct mheader *mh;
-	uintptr_t i;
-	size_t rightprevblock;
-	size_t morespace;
 	void *p;
 
 	if (__heapbase==0) {
@@ -372,111 +646,18 @@ malloc(size_t size)
 	__malloc_dump();
 #endif
 
-	/* Round size up to an integral number of blocks. */
-	size = ((size + MBLOCKSIZE - 1) & ~(size_t)(MBLOCKSIZE-1));
-
-	/*
-	 * First-fit search algorithm for available blocks.
-	 * Check to make sure the next/previous sizes all agree.
-	 */
-	rightprevblock = 0;
-	mh = NULL;
-	for (i=__heapbase; i<__heaptop; i += M_NEXTOFF(mh)) {
-		mh = (struct mheader *) i;
-		if (!M_OK(mh)) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad magic bits",
-			     (unsigned long) i);
-		}
-		if (mh->mh_prevblock != rightprevblock) {
-			errx(1, "malloc: Heap corrupt; header at 0x%lx"
-			     " has bad previous-block size %lu "
-			     "(should be %lu)",
-			     (unsigned long) i,
-			     (unsigned long) mh->mh_prevblock << MBLOCKSHIFT,
-			     (unsigned long) rightprevblock << MBLOCKSHIFT);
-		}
-		rightprevblock = mh->mh_nextblock;
-
-		/* Can't allocate a block that's in use. */
-		if (mh->mh_inuse) {
-			continue;
-		}
-
-		/* Can't allocate a block that isn't big enough. */
-		if (M_SIZE(mh) < size) {
-			continue;
-		}
-
-		/* Try splitting block. */
-		__malloc_split(mh, size);
-
-		/*
-		 * Now, allocate.
-		 */
-		mh->mh_inuse = 1;
-
-#ifdef MALLOCDEBUG
-		warnx("malloc: allocating at %p", M_DATA(mh));
-		__malloc_dump();
-#endif
-		return M_DATA(mh);
-	}
-	if (i!=__heaptop) {
-		errx(1, "malloc: Heap corrupt; ran off end");
-	}
-
-	/*
-	 * Didn't find anything. Expand the heap.
-	 *
-	 * If the heap is nonempty and the top block (the one mh is
-	 * left pointing to after the above loop) is free, we can
-	 * expand it. Otherwise we need a new block.
-	 */
-	if (mh != NULL && !mh->mh_inuse) {
-		assert(size > M_SIZE(mh));
-		morespace = size - M_SIZE(mh);
-	}
-	else {
-		morespace = MBLOCKSIZE + size;
-	}
-
-	/* Round the amount of space we ask for up to a whole page. */
-	morespace = PAGE_SIZE * ((morespace + PAGE_SIZE - 1) / PAGE_SIZE);
-
-	p = __malloc_sbrk(morespace);
-	if (p == NULL) {
-		return NULL;
-	}
-
-	if (mh != NULL && !mh->mh_inuse) {
-		/* update old header */
-		mh->mh_nextblock = M_MKFIELD(M_NEXTOFF(mh) + morespace);
-		mh->mh_inuse = 1;
+	if (size <= MAXSMALL) {
+		p = __malloc_small(__malloc_classof[(size + MALIGN-1) / MALIGN]);
 	}
 	else {
-		/* fill out new header */
-		mh = p;
-		mh->mh_prevblock = rightprevblock;
-		mh->mh_magic1 = MMAGIC;
-		mh->mh_magic2 = MMAGIC;
-		mh->mh_pad = 0;
-		mh->mh_inuse = 1;
-		mh->mh_nextblock = M_MKFIELD(morespace);
+		p = __malloc_large(size);
 	}
 
-	/*
-	 * Either way, try splitting the block we got as because of
-	 * the page rounding it might be quite a bit bigger than we
-	 * needed.
-	 */
-	__malloc_split(mh, size);
-
 #ifdef MALLOCDEBUG
-	warnx("malloc: allocating at %p", M_DATA(mh));
+	warnx("malloc: allocating at %p", p);
 	__malloc_dump();
 #endif
-	return M_DATA(mh);
+	return p;
 }
 
 ////////////////////////////////////////////////////////////
@@ -497,34 +678,50 @@ __malloc_deadbeef(void *ptr, size_t size)
 }
 
 /*
- * Attempt to merge two adjacent blocks (mh below mhnext).
+ * Free an object in run MS.
  */
 static
 void
-__malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
+__malloc_freesmall(struct mspan *ms, void *x)
 {
-	struct mheader *mhnextnext;
-
-	if (mh->mh_nextblock != mhnext->mh_prevblock) {
-		errx(1, "free: Heap corrupt (%p and %p inconsistent)",
-		     mh, mhnext);
-	}
-	if (mh->mh_inuse || mhnext->mh_inuse) {
-		/* can't merge */
-		return;
+	unsigned c, i, bit;
+	size_t off;
+
+	c = ms->ms_class;
+	if (c >= NSIZES) {
+		errx(1, "free: Heap corrupt; run at %p has bad size class",
+		     ms);
+	}
+	off = (char *)x - (char *)MS_DATA(ms);
+	if ((char *)x < (char *)MS_DATA(ms) ||
+	    off % __malloc_sizes[c] != 0 ||
+	    off / __malloc_sizes[c] >= __malloc_nobjs[c]) {
+		errx(1, "free: Invalid pointer %p freed (not an object)", x);
+	}
+	i = off / __malloc_sizes[c] / 32;
+	bit = off / __malloc_sizes[c] % 32;
+	if (ms->ms_bitmap[i] & ((uint32_t)1 << bit)) {
+		errx(1, "free: Invalid pointer %p freed (already free)", x);
 	}
 
-	mhnextnext = M_NEXT(mhnext);
-
-	mh->mh_nextblock = M_MKFIELD(MBLOCKSIZE + M_SIZE(mh) +
-				     MBLOCKSIZE + M_SIZE(mhnext));
+	/* wipe it */
+	__malloc_deadbeef(x, __malloc_sizes[c]);
 
-	if (mhnextnext != (struct mheader *)__heaptop) {
-		mhnextnext->mh_prevblock = mh->mh_nextblock;
+	ms->ms_bitmap[i] |= (uint32_t)1 << bit;
+	__malloc_inuse[c]--;
+	if (ms->ms_nfree++ == 0) {
+		__malloc_listadd(&__malloc_runs[c], ms);
 	}
 
-	/* Deadbeef out the memory used by the now-obsolete header */
-	__malloc_deadbeef(mhnext, sizeof(struct mheader));
+	/*
+	 * Give back an empty run right away, so its page can be used
+	 * for other size classes or large allocations.
+	 */
+	if (ms->ms_nfree == __malloc_nobjs[c]) {
+		__malloc_listremove(&__malloc_runs[c], ms);
+		__malloc_nruns[c]--;
+		__malloc_freespan(ms);
+	}
 }
 
 /*
@@ -533,7 +730,7 @@ __malloc_trymerge(struct mheader *mh, struct mheader *mhnext)
 void
 free(void *x)
 {
-	struct mheader *mh, *mhnext, *mhprev;
+	struct mspan *ms;
 
 	if (x==NULL) {
 		/* safest practice */
@@ -557,33 +754,34 @@ free(void *x)
 	__malloc_dump();
 #endif
 
-	mh = ((struct mheader *)x)-1;
-	if (!M_OK(mh)) {
-		errx(1, "free: Invalid pointer %p freed (corrupt header)", x);
-	}
-
-	if (!mh->mh_inuse) {
+	/*
+	 * Runs are one page and large allocations start right after
+	 * the header, so the header is at the bottom of x's page.
+	 */
+	ms = (struct mspan *)((uintptr_t)x & ~(uintptr_t)(PAGE_SIZE-1));
+	if ((uintptr_t)x % PAGE_SIZE == 0) {
+		errx(1, "free: Invalid pointer %p freed (not an object)", x);
+	}
+	__malloc_checkspan(ms, "free");
+
+	switch (ms->ms_magic) {
+	    case MSPAN_RUN:
+		__malloc_freesmall(ms, x);
+		break;
+	    case MSPAN_LARGE:
+		if (x != MS_DATA(ms)) {
+			errx(1, "free: Invalid pointer %p freed "
+			     "(not an object)", x);
+		}
+		__malloc_nlarge--;
+		__malloc_largepages -= ms->ms_npages;
+		__malloc_deadbeef(x, MS_SIZE(ms) - MSPAN_HDRSIZE);
+		__malloc_freespan(ms);
+		break;
+	    default:
 		errx(1, "free: Invalid pointer %p freed (already free)", x);
 	}
 
-	/* mark it free */
-	mh->mh_inuse = 0;
-
-	/* wipe it */
-	__malloc_deadbeef(M_DATA(mh), M_SIZE(mh));
-
-	/* Try merging with the block above (but not if we're at the top) */
-	mhnext = M_NEXT(mh);
-	if (mhnext != (struct mheader *)__heaptop) {
-		__malloc_trymerge(mh, mhnext);
-	}
-
-	/* Try merging with the block below (but not if we're at the bottom) */
-	if (mh != (struct mheader *)__heapbase) {
-		mhprev = M_PREV(mh);
-		__malloc_trymerge(mhprev, mh);
-	}
-
 #ifdef MALLOCDEBUG
 	warnx("free: freed %p", x);
 	__malloc_dump();
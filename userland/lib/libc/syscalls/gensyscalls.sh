@@ -21,5 +21,11 @@ awk '
     }
 ' | awk '{
 	# output something simple that will work in syscalls.S.
-	printf "SYSCALL(%s, %s)\n", $1, $2;
+	# fork and execv get wrappers in libc that flush stdio.
+	if ($1 == "fork" || $1 == "execv") {
+		printf "SYSCALL_WRAPPED(%s, %s)\n", $1, $2;
+	}
+	else {
+		printf "SYSCALL(%s, %s)\n", $1, $2;
+	}
 }'
@@ -80,21 +80,27 @@ dowait(int index, int pid)
 	return 0;
 }
 
+/*
+ * Run three copies of PROG, passing each the NARGS arguments in ARGS.
+ */
 void
-triple(const char *prog)
+triplev(const char *prog, int nargs, char **args)
 {
 	pid_t pids[3];
 	int i, failures = 0;
-	char *args[2];
+	char *argv[nargs + 2];
 
 	/* set up the argv */
-	args[0]=(char *)prog;
-	args[1]=NULL;
+	argv[0]=(char *)prog;
+	for (i=0; i<nargs; i++) {
+		argv[i+1]=args[i];
+	}
+	argv[nargs+1]=NULL;
 
 	warnx("Starting: running three copies of %s...", prog);
 
 	for (i=0; i<3; i++) {
-		pids[i]=spawnv(args[0], args);
+		pids[i]=spawnv(argv[0], argv);
 	}
 
 	for (i=0; i<3; i++) {
@@ -109,3 +115,8 @@ triple(const char *prog)
 	}
 }
 
+void
+triple(const char *prog)
+{
+	triplev(prog, 0, NULL);
+}
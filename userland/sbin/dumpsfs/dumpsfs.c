@@ -163,6 +163,15 @@ dumpsb(void)
 		 SFS_FREEMAPBLOCKS(SWAP32(sb.sb_nblocks)));
 	dumpvalf("Block size", "%u bytes", SFS_BLOCKSIZE);
 	dumplval("Volume name", sb.sb_volname);
+	if (SWAP32(sb.sb_logstart) != 0) {
+		dumpvalf("Journal", "blocks %u - %u",
+			 SWAP32(sb.sb_logstart),
+			 SWAP32(sb.sb_logstart) +
+			 SWAP32(sb.sb_lognblocks) - 1);
+	}
+	else {
+		dumplval("Journal", "none");
+	}
 
 	for (i=0; i<ARRAYCOUNT(sb.reserved); i++) {
 		if (sb.reserved[i] != 0) {
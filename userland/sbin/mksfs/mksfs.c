@@ -73,6 +73,7 @@ check(void)
 	assert(sizeof(struct sfs_superblock)==SFS_BLOCKSIZE);
 	assert(sizeof(struct sfs_dinode)==SFS_BLOCKSIZE);
 	assert(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
+	assert(sizeof(struct sfs_loghdr)==SFS_BLOCKSIZE);
 }
 
 /*
@@ -89,12 +90,39 @@ allocblock(uint32_t block)
 	freemapbuf[mapbyte] |= mask;
 }
 
+/*
+ * Decide where the journal goes and how big it is: right after the
+ * freemap, with room for a transaction that rewrites the whole
+ * freemap plus SFS_LOGBLOCKS other blocks. Volumes too small to spare
+ * the space get no journal.
+ */
+static
+void
+placelog(uint32_t fsblocks, uint32_t *logstart, uint32_t *lognblocks)
+{
+	uint32_t start, n;
+
+	start = SFS_FREEMAP_START + SFS_FREEMAPBLOCKS(fsblocks);
+	n = SFS_LOGBLOCKS + SFS_FREEMAPBLOCKS(fsblocks);
+	if (n > SFS_LOG_MAXBLOCKS + 1) {
+		n = SFS_LOG_MAXBLOCKS + 1;
+	}
+
+	if (start + n > fsblocks / 2) {
+		*logstart = 0;
+		*lognblocks = 0;
+		return;
+	}
+	*logstart = start;
+	*lognblocks = n;
+}
+
 /*
  * Initialize the free block bitmap.
  */
 static
 void
-initfreemap(uint32_t fsblocks)
+initfreemap(uint32_t fsblocks, uint32_t logstart, uint32_t lognblocks)
 {
 	uint32_t freemapbits = SFS_FREEMAPBITS(fsblocks);
 	uint32_t freemapblocks = SFS_FREEMAPBLOCKS(fsblocks);
@@ -114,6 +142,11 @@ initfreemap(uint32_t fsblocks)
 		allocblock(SFS_FREEMAP_START + i);
 	}
 
+	/* and so must the journal */
+	for (i=0; i<lognblocks; i++) {
+		allocblock(logstart + i);
+	}
+
 	/* all blocks in the freemap but past the volume end are "in use" */
 	for (i=fsblocks; i<freemapbits; i++) {
 		allocblock(i);
@@ -125,7 +158,8 @@ initfreemap(uint32_t fsblocks)
  */
 static
 void
-writesuper(const char *volname, uint32_t nblocks)
+writesuper(const char *volname, uint32_t nblocks,
+	   uint32_t logstart, uint32_t lognblocks)
 {
 	struct sfs_superblock sb;
 
@@ -140,6 +174,8 @@ writesuper(const char *volname, uint32_t nblocks)
 	sb.sb_magic = SWAP32(SFS_MAGIC);
 	sb.sb_nblocks = SWAP32(nblocks);
 	strcpy(sb.sb_volname, volname);
+	sb.sb_logstart = SWAP32(logstart);
+	sb.sb_lognblocks = SWAP32(lognblocks);
 
 	/* and write it out. */
 	diskwrite(&sb, SFS_SUPER_BLOCK);
@@ -164,6 +200,23 @@ writefreemap(uint32_t fsblocks)
 	}
 }
 
+/*
+ * Write out an empty journal header.
+ */
+static
+void
+writelog(uint32_t logstart)
+{
+	struct sfs_loghdr lh;
+
+	bzero((void *)&lh, sizeof(lh));
+	lh.lh_magic = SWAP32(SFS_LOG_MAGIC);
+	lh.lh_seq = SWAP32(0);
+	lh.lh_nblocks = SWAP32(0);
+
+	diskwrite(&lh, logstart);
+}
+
 /*
  * Write out the root directory inode.
  */
@@ -190,6 +243,7 @@ int
 main(int argc, char **argv)
 {
 	uint32_t size, blocksize;
+	uint32_t logstart, lognblocks;
 	char *volname, *s;
 
 #ifdef HOST
@@ -229,9 +283,13 @@ main(int argc, char **argv)
 	size = diskblocks();
 
 	/* Write out the on-disk structures */
-	initfreemap(size);
-	writesuper(volname, size);
+	placelog(size, &logstart, &lognblocks);
+	initfreemap(size, logstart, lognblocks);
+	writesuper(volname, size, logstart, lognblocks);
 	writefreemap(size);
+	if (lognblocks > 0) {
+		writelog(logstart);
+	}
 	writerootdir();
 
 	closedisk();
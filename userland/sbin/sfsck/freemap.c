@@ -78,6 +78,11 @@ freemap_setup(void)
 	for (i=0; i < mapblocks; i++) {
 		freemap_blockinuse(SFS_FREEMAP_START+i, B_FREEMAPBLOCK, i);
 	}
+
+	/* And the journal */
+	for (i=0; i < sb_lognblocks(); i++) {
+		freemap_blockinuse(sb_logstart()+i, B_LOGBLOCK, i);
+	}
 }
 
 /*
@@ -95,6 +100,10 @@ blockusagestr(blockusage_t how, uint32_t howdesc)
 		snprintf(rv, sizeof(rv), "freemap block %lu",
 			 (unsigned long) howdesc);
 		break;
+	    case B_LOGBLOCK:
+		snprintf(rv, sizeof(rv), "journal block %lu",
+			 (unsigned long) howdesc);
+		break;
 	    case B_INODE:
 		snprintf(rv, sizeof(rv), "inode %lu",
 			 (unsigned long) howdesc);
@@ -78,6 +78,7 @@ main(int argc, char **argv)
 	sfs_setup();
 	sb_load();
 	sb_check();
+	sb_replaylog();
 	freemap_setup();
 
 	printf("Phase 1 -- check blocks and sizes\n");
@@ -30,12 +30,14 @@
 #include <sys/types.h>	/* for CHAR_BIT */
 #include <limits.h>	/* also for CHAR_BIT */
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include <err.h>
 
 #include "compat.h"
 #include <kern/sfs.h>
 
+#include "disk.h"
 #include "utils.h"
 #include "sfs.h"
 #include "sb.h"
@@ -88,6 +90,25 @@ sb_check(void)
 		setbadness(EXIT_RECOV);
 		schanged = 1;
 	}
+	if (sb.sb_logstart == 0 && sb.sb_lognblocks != 0) {
+		warnx("Journal size set but no journal (fixed)");
+		setbadness(EXIT_RECOV);
+		sb.sb_lognblocks = 0;
+		schanged = 1;
+	}
+	if (sb.sb_logstart != 0 &&
+	    (sb.sb_logstart < SFS_FREEMAP_START + sb_freemapblocks() ||
+	     sb.sb_logstart >= sb.sb_nblocks ||
+	     sb.sb_lognblocks < 2 ||
+	     sb.sb_lognblocks > sb.sb_nblocks - sb.sb_logstart)) {
+		warnx("Journal at block %lu (%lu blocks) is out of range "
+		      "(dropped)", (unsigned long)sb.sb_logstart,
+		      (unsigned long)sb.sb_lognblocks);
+		setbadness(EXIT_RECOV);
+		sb.sb_logstart = 0;
+		sb.sb_lognblocks = 0;
+		schanged = 1;
+	}
 
 	/* Write the superblock back if necessary */
 	if (schanged) {
@@ -114,6 +135,108 @@ sb_freemapblocks(void)
 	return SFS_FREEMAPBLOCKS(sb.sb_nblocks);
 }
 
+/*
+ * Return the first block of the journal, or 0 if there isn't one.
+ */
+uint32_t
+sb_logstart(void)
+{
+	return sb.sb_logstart;
+}
+
+/*
+ * Return the number of journal blocks.
+ */
+uint32_t
+sb_lognblocks(void)
+{
+	return sb.sb_lognblocks;
+}
+
+/*
+ * If the journal holds a committed transaction that hasn't been put
+ * in place, do that now, exactly as mounting the volume would, so we
+ * check the metadata the kernel would see. The checksum is described
+ * in kern/sfs.h.
+ */
+void
+sb_replaylog(void)
+{
+	struct sfs_loghdr lh;
+	uint8_t buf[SFS_BLOCKSIZE];
+	uint32_t i, j, max, sum, seq;
+
+	if (sb.sb_logstart == 0) {
+		return;
+	}
+
+	sfs_readloghdr(sb.sb_logstart, &lh);
+	if (lh.lh_magic != SFS_LOG_MAGIC) {
+		warnx("Journal header has bad magic number (fixed)");
+		setbadness(EXIT_RECOV);
+		lh.lh_nblocks = 0;
+	}
+	else if (lh.lh_nblocks == 0) {
+		return;
+	}
+
+	max = sb.sb_lognblocks - 1;
+	if (max > SFS_LOG_MAXBLOCKS) {
+		max = SFS_LOG_MAXBLOCKS;
+	}
+	if (lh.lh_nblocks > max) {
+		warnx("Journal transaction %lu too large (discarded)",
+		      (unsigned long)lh.lh_seq);
+		setbadness(EXIT_RECOV);
+		lh.lh_nblocks = 0;
+	}
+
+	sum = 0;
+	for (i=0; i<lh.lh_nblocks; i++) {
+		if (lh.lh_blocks[i] >= sb.sb_nblocks) {
+			warnx("Journal transaction %lu has bad block %lu "
+			      "(discarded)", (unsigned long)lh.lh_seq,
+			      (unsigned long)lh.lh_blocks[i]);
+			setbadness(EXIT_RECOV);
+			lh.lh_nblocks = 0;
+			break;
+		}
+		diskread(buf, sb.sb_logstart + 1 + i);
+		for (j=0; j<SFS_BLOCKSIZE; j++) {
+			sum = sum*31 + buf[j];
+		}
+	}
+	if (lh.lh_nblocks > 0 && sum != lh.lh_sum) {
+		warnx("Journal transaction %lu is damaged (discarded)",
+		      (unsigned long)lh.lh_seq);
+		setbadness(EXIT_RECOV);
+		lh.lh_nblocks = 0;
+	}
+
+	if (lh.lh_nblocks > 0) {
+		warnx("Replaying journal transaction %lu (%lu blocks)",
+		      (unsigned long)lh.lh_seq,
+		      (unsigned long)lh.lh_nblocks);
+		for (i=0; i<lh.lh_nblocks; i++) {
+			diskread(buf, sb.sb_logstart + 1 + i);
+			diskwrite(buf, lh.lh_blocks[i]);
+		}
+		/* The superblock may have been among them */
+		sfs_readsb(SFS_SUPER_BLOCK, &sb);
+	}
+
+	/*
+	 * Mark the journal empty, as the kernel does after putting a
+	 * transaction in place: keep the sequence number, so the
+	 * kernel's numbering carries on where it left off.
+	 */
+	seq = lh.lh_seq;
+	bzero((void *)&lh, sizeof(lh));
+	lh.lh_magic = SFS_LOG_MAGIC;
+	lh.lh_seq = seq;
+	sfs_writeloghdr(sb.sb_logstart, &lh);
+}
+
 /*
  * Return the volume name.
  */
@@ -49,6 +49,13 @@ uint32_t sb_freemapblocks(void);
 /* After the superblock is loaded: return volume name. */
 const char *sb_volname(void);
 
+/* After the superblock is checked: return journal location and size. */
+uint32_t sb_logstart(void);
+uint32_t sb_lognblocks(void);
+
+/* After the superblock is checked: finish any committed transaction. */
+void sb_replaylog(void);
+
 /* Check the superblock. Must load it first. */
 void sb_check(void);
 
@@ -51,6 +51,7 @@ sfs_setup(void)
 	assert(sizeof(struct sfs_superblock)==SFS_BLOCKSIZE);
 	assert(sizeof(struct sfs_dinode)==SFS_BLOCKSIZE);
 	assert(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
+	assert(sizeof(struct sfs_loghdr)==SFS_BLOCKSIZE);
 }
 
 ////////////////////////////////////////////////////////////
@@ -62,6 +63,8 @@ swapsb(struct sfs_superblock *sb)
 {
 	sb->sb_magic = SWAP32(sb->sb_magic);
 	sb->sb_nblocks = SWAP32(sb->sb_nblocks);
+	sb->sb_logstart = SWAP32(sb->sb_logstart);
+	sb->sb_lognblocks = SWAP32(sb->sb_lognblocks);
 }
 
 static
@@ -116,6 +119,21 @@ swapindir(uint32_t *entries)
 	}
 }
 
+static
+void
+swaploghdr(struct sfs_loghdr *lh)
+{
+	int i;
+
+	lh->lh_magic = SWAP32(lh->lh_magic);
+	lh->lh_seq = SWAP32(lh->lh_seq);
+	lh->lh_nblocks = SWAP32(lh->lh_nblocks);
+	lh->lh_sum = SWAP32(lh->lh_sum);
+	for (i=0; i<SFS_LOG_MAXBLOCKS; i++) {
+		lh->lh_blocks[i] = SWAP32(lh->lh_blocks[i]);
+	}
+}
+
 ////////////////////////////////////////////////////////////
 // bmap()
 
@@ -264,6 +282,25 @@ sfs_writeindirect(uint32_t blocknum, uint32_t *entries)
 	swapindir(entries);
 }
 
+/*
+ *  journal header - blocknum is a disk block number.
+ */
+
+void
+sfs_readloghdr(uint32_t blocknum, struct sfs_loghdr *lh)
+{
+	diskread(lh, blocknum);
+	swaploghdr(lh);
+}
+
+void
+sfs_writeloghdr(uint32_t blocknum, struct sfs_loghdr *lh)
+{
+	swaploghdr(lh);
+	diskwrite(lh, blocknum);
+	swaploghdr(lh);
+}
+
 ////////////////////////////////////////////////////////////
 // directory I/O
 
@@ -41,6 +41,7 @@
 struct sfs_superblock;
 struct sfs_dinode;
 struct sfs_direntry;
+struct sfs_loghdr;
 
 /* Call this before anything else in this module */
 void sfs_setup(void);
@@ -65,6 +66,10 @@ void sfs_writeinode(uint32_t inum, struct sfs_dinode *sfi);
 void sfs_readindirect(uint32_t blocknum, uint32_t *entries);
 void sfs_writeindirect(uint32_t blocknum, uint32_t *entries);
 
+/* journal header */
+void sfs_readloghdr(uint32_t blocknum, struct sfs_loghdr *lh);
+void sfs_writeloghdr(uint32_t blocknum, struct sfs_loghdr *lh);
+
 /* directory - ND should be the number of directory entries D points to */
 void sfs_readdir(struct sfs_dinode *sfi, struct sfs_direntry *d, unsigned nd);
 void sfs_writedir(const struct sfs_dinode *sfi,
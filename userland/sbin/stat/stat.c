@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * stat - show kernel event counters.
+ * usage: stat [command [args...]]
+ *
+ * With no arguments, prints the counters from the stats: device: for
+ * each one the total and the count on each cpu.
+ *
+ * Otherwise, runs the command (which must be given as a path, e.g.
+ * /testbin/psort) and then prints how much each counter went up
+ * while it ran, leaving out the ones that didn't change. Whatever
+ * else the system was doing at the time is counted too, as are the
+ * few system calls stat itself makes around the command.
+ *
+ * This program uses these system calls:
+ *    open read write close fork execv waitpid _exit
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define PATH_STATS	"stats:"
+#define MAXREPORT	65536	/* enough for 32 cpus and every syscall */
+#define MAXCOLS		33	/* total and 32 cpus */
+
+static char before[MAXREPORT], after[MAXREPORT];
+
+/*
+ * Read the whole report into BUF. The report is made afresh for each
+ * read, so take it in one read; a second could pick up the rest of a
+ * different report.
+ */
+static
+void
+readstats(char *buf)
+{
+	int fd;
+	ssize_t r;
+
+	fd = open(PATH_STATS, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", PATH_STATS);
+	}
+	r = read(fd, buf, MAXREPORT - 1);
+	if (r < 0) {
+		err(1, "%s: read", PATH_STATS);
+	}
+	close(fd);
+	buf[r] = '\0';
+}
+
+/*
+ * Split a report line into the counter name and its values. The line
+ * (which is modified) ends at the next newline. Returns the number of
+ * values and sets *NEXT to the following line.
+ */
+static
+unsigned
+parseline(char *line, char **name, unsigned long *vals, char **next)
+{
+	char *end, *s;
+	unsigned n;
+
+	end = strchr(line, '\n');
+	if (end != NULL) {
+		*end = '\0';
+		*next = end + 1;
+	}
+	else {
+		*next = line + strlen(line);
+	}
+
+	s = line;
+	while (*s == ' ') {
+		s++;
+	}
+	*name = s;
+	while (*s != ' ' && *s != '\0') {
+		s++;
+	}
+
+	n = 0;
+	while (*s != '\0' && n < MAXCOLS) {
+		if (*s == ' ') {
+			*s++ = '\0';
+			continue;
+		}
+		vals[n] = 0;
+		while (*s >= '0' && *s <= '9') {
+			vals[n] = vals[n] * 10 + (*s - '0');
+			s++;
+		}
+		n++;
+		while (*s != ' ' && *s != '\0') {
+			s++;
+		}
+	}
+	return n;
+}
+
+/*
+ * Find counter NAME in REPORT and get its values. Returns the number
+ * of values, or 0 if it isn't there.
+ */
+static
+unsigned
+findline(const char *report, const char *name, unsigned long *vals)
+{
+	char copy[512], *line, *next, *lname;
+	const char *s, *e;
+	size_t len;
+	unsigned n;
+
+	for (s = report; *s != '\0'; s = e) {
+		e = strchr(s, '\n');
+		e = e != NULL ? e + 1 : s + strlen(s);
+		len = e - s;
+		if (len >= sizeof(copy)) {
+			continue;
+		}
+		memcpy(copy, s, len);
+		copy[len] = '\0';
+		line = copy;
+		n = parseline(line, &lname, vals, &next);
+		if (!strcmp(lname, name)) {
+			return n;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Print the counters in AFTER that went up since BEFORE.
+ */
+static
+void
+printdiff(void)
+{
+	unsigned long vals[MAXCOLS], oldvals[MAXCOLS];
+	char *line, *next, *name;
+	unsigned n, oldn, i;
+
+	/* the header line goes out as is */
+	line = strchr(after, '\n');
+	if (line == NULL) {
+		return;
+	}
+	*line = '\0';
+	printf("%s\n", after);
+
+	for (line = line + 1; *line != '\0'; line = next) {
+		n = parseline(line, &name, vals, &next);
+		if (n == 0) {
+			continue;
+		}
+		oldn = findline(before, name, oldvals);
+		for (i=0; i<n; i++) {
+			vals[i] -= i < oldn ? oldvals[i] : 0;
+		}
+		if (vals[0] == 0) {
+			continue;
+		}
+		printf("%-20s", name);
+		for (i=0; i<n; i++) {
+			printf(" %10lu", vals[i]);
+		}
+		printf("\n");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	pid_t pid;
+	int status;
+
+	if (argc < 2) {
+		readstats(after);
+		printf("%s", after);
+		return 0;
+	}
+
+	readstats(before);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(argv[1], argv + 1);
+		err(1, "%s", argv[1]);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+
+	readstats(after);
+
+	if (WIFSIGNALED(status)) {
+		warnx("%s: signal %d", argv[1], WTERMSIG(status));
+	}
+	else if (WEXITSTATUS(status) != 0) {
+		warnx("%s: exit %d", argv[1], WEXITSTATUS(status));
+	}
+	printdiff();
+	return 0;
+}
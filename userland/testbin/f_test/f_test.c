@@ -91,6 +91,8 @@ forkoff(void (*func)(void))
 		return -1;
 	    case 0:
 		func();
+		/* _exit doesn't flush stdout */
+		fflush(stdout);
 		_exit(0);
 	    default: break;
 	}
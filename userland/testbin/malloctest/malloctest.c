@@ -36,9 +36,8 @@
  * These tests (subject to restrictions and limitations noted below)
  * should work once the kernel provides sbrk().
  *
- * Note that because the userlevel malloc is extremely dumb,
- * malloctest 3 is extremely slow and on most VM systems will run more
- * or less forever.
+ * Note that malloctest 3 fills all of memory, so on most VM systems
+ * it will page heavily and take a long time.
  */
 
 #include <stdint.h>
@@ -629,6 +628,21 @@ test7(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Test 8
+ *
+ * Not really a test: print malloc's statistics.
+ */
+
+static
+void
+test8(void)
+{
+	__malloc_stats();
+}
+
+////////////////////////////////////////////////////////////
+
 static struct {
 	int num;
 	const char *desc;
@@ -641,6 +655,7 @@ static struct {
 	{ 5, "Stress test", test5 },
 	{ 6, "Randomized stress test", test6 },
 	{ 7, "Stress test with particular seed", test7 },
+	{ 8, "Print malloc statistics", test8 },
 	{ -1, NULL, NULL }
 };
 
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipetest - test pipes.
+ *
+ * A child process writes a known pattern through a pipe in
+ * assorted chunk sizes, larger than the pipe buffer in total; the
+ * parent reads it back in different chunk sizes and checks it, then
+ * checks for EOF after the writer exits and for EPIPE when writing
+ * with the read end closed.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define TOTAL 40000
+
+static char buf[4096];
+
+static
+char
+patternbyte(unsigned pos)
+{
+	return 'A' + (pos * 7) % 53 % 26;
+}
+
+static
+void
+writer(int fd)
+{
+	static const unsigned sizes[] = { 1, 17, 512, 4000, 100, 4096, 3 };
+	unsigned pos, len, i, k;
+	ssize_t r;
+
+	pos = 0;
+	k = 0;
+	while (pos < TOTAL) {
+		len = sizes[k++ % (sizeof(sizes)/sizeof(sizes[0]))];
+		if (len > TOTAL - pos) {
+			len = TOTAL - pos;
+		}
+		for (i=0; i<len; i++) {
+			buf[i] = patternbyte(pos + i);
+		}
+		r = write(fd, buf, len);
+		if (r < 0) {
+			err(1, "child: write");
+		}
+		if ((unsigned)r != len) {
+			errx(1, "child: short write %ld of %u", (long)r, len);
+		}
+		pos += len;
+	}
+}
+
+static
+void
+reader(int fd)
+{
+	static const unsigned sizes[] = { 4096, 1, 333, 2048, 7 };
+	unsigned pos, i, k;
+	ssize_t r;
+
+	pos = 0;
+	k = 0;
+	while (1) {
+		r = read(fd, buf, sizes[k++ % (sizeof(sizes)/sizeof(sizes[0]))]);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		for (i=0; i<(unsigned)r; i++) {
+			if (buf[i] != patternbyte(pos + i)) {
+				errx(1, "wrong data at offset %u", pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (pos != TOTAL) {
+		errx(1, "got %u bytes, expected %u", pos, TOTAL);
+	}
+}
+
+int
+main(void)
+{
+	int fds[2];
+	int status;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		writer(fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	reader(fds[0]);
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "writer failed");
+	}
+	printf("pipetest: data ok\n");
+
+	/* writing with no reader fails */
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	if (write(fds[1], "x", 1) != -1) {
+		errx(1, "write with no reader succeeded");
+	}
+	if (errno != EPIPE) {
+		err(1, "write with no reader: expected EPIPE, got");
+	}
+	close(fds[1]);
+
+	printf("pipetest: passed\n");
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * polltest - test poll() and select() on pipes.
+ *
+ * Checks that an empty pipe isn't readable, that a timeout expires,
+ * that a child writing after a delay wakes a parent blocked in poll,
+ * that select agrees, and that closing the write end shows up as
+ * POLLHUP.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+static
+void
+checkpoll(struct pollfd *pfd, int timeout, int wantret, int wantrevents,
+	  const char *what)
+{
+	int r;
+
+	pfd->revents = 0;
+	r = poll(pfd, 1, timeout);
+	if (r < 0) {
+		err(1, "%s: poll", what);
+	}
+	if (r != wantret || pfd->revents != wantrevents) {
+		errx(1, "%s: poll returned %d revents 0x%x, expected %d 0x%x",
+		     what, r, pfd->revents, wantret, wantrevents);
+	}
+}
+
+int
+main(void)
+{
+	struct pollfd pfd;
+	struct timeval tv;
+	fd_set rset;
+	int fds[2];
+	int status, r;
+	pid_t pid;
+	char ch;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	/* empty pipe: not readable, but writable */
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	checkpoll(&pfd, 0, 0, 0, "empty pipe");
+	checkpoll(&pfd, 100, 0, 0, "empty pipe with timeout");
+	pfd.fd = fds[1];
+	pfd.events = POLLOUT;
+	checkpoll(&pfd, 0, 1, POLLOUT, "write end");
+
+	/* a bad fd is reported, not an error */
+	pfd.fd = 99;
+	pfd.events = POLLIN;
+	checkpoll(&pfd, 0, 1, POLLNVAL, "bad fd");
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		/* give the parent time to go to sleep */
+		pfd.fd = -1;
+		poll(&pfd, 0, 200);
+		if (write(fds[1], "x", 1) != 1) {
+			err(1, "child: write");
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+
+	/* wait for the child's byte */
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	checkpoll(&pfd, -1, 1, POLLIN, "wakeup");
+
+	FD_ZERO(&rset);
+	FD_SET(fds[0], &rset);
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	r = select(fds[0] + 1, &rset, NULL, NULL, &tv);
+	if (r != 1 || !FD_ISSET(fds[0], &rset)) {
+		errx(1, "select returned %d", r);
+	}
+
+	if (read(fds[0], &ch, 1) != 1 || ch != 'x') {
+		errx(1, "wrong data");
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+
+	/* writer is gone now */
+	checkpoll(&pfd, -1, 1, POLLIN | POLLHUP, "hangup");
+	close(fds[0]);
+
+	printf("polltest: passed\n");
+	return 0;
+}
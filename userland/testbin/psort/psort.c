@@ -30,15 +30,36 @@
 /*
  * psort - parallel sort.
  *
- * This is loosely based on some real parallel sort benchmarks, but
- * because of various limitations of OS/161 it is massively
- * inefficient. But that's ok; the goal is to stress the VM and buffer
- * cache.
+ * This is loosely based on some real parallel sort benchmarks. The
+ * goal is still to stress the VM and buffer cache, but it is also
+ * usable as an actual sort for files of integers, including files
+ * much larger than memory:
+ *
+ *    1. Tossing: each proc reads its slice of the input and tosses
+ *       each key into one of numprocs bins by key range.
+ *    2. Run formation: proc J reads all the bins for range J a
+ *       workspace at a time, sorts each workspaceful in memory, and
+ *       writes it out as a sorted run.
+ *    3. Merging: proc J merges its runs with a heap, at most fanout
+ *       (-f) at a time, in as many passes as needed.
+ *    4. Assembly: the merged ranges are concatenated into the output.
+ *
+ * All streaming I/O goes through double buffers, and the reads and
+ * writes are submitted in batches through the I/O ring (see
+ * ioring_setup(2)) when it is available. The time spent in each phase
+ * is reported at the end.
+ *
+ * Options: -i sorts an existing file of keys instead of generating
+ * one (the keys must be in the generated range, 0 < key < RANDOM_MAX),
+ * -o names the output file, and -t gives a prefix for the scratch
+ * files, e.g. "tmp:" to keep them on the tmpfs. Files named with -i
+ * and -o are not removed afterwards.
  */
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/ioring.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -98,7 +119,9 @@
  * for every batch of forks.
  *
  * Also note that you can set numprocs and numkeys on the command
- * line, but not WORKNUM.
+ * line, but not WORKNUM. Since each proc sorts its key range a
+ * workspace at a time and merges the runs, the ranges need not fit
+ * in WORKNUM.
  *
  * FUTURE: maybe make a build option to malloc the work space instead
  * of using a static buffer, which would allow choosing WORKNUM on the
@@ -110,6 +133,21 @@
 static int numprocs = 4;
 static int numkeys = 128*1024;
 
+/*
+ * Merge fan-out: how many runs are merged at once. Each input stream
+ * and the output stream get two buffers carved out of the workspace,
+ * so a larger fan-out means fewer merge passes but smaller I/Os.
+ */
+#define MAXPROCS     32
+#define MAXFANOUT    32
+static int fanout = 8;
+
+/* Files: input, output, and a prefix (e.g. "tmp:") for scratch files */
+static const char *keypath = PATH_KEYS;
+static const char *outpath = PATH_SORTED;
+static const char *tmpdir = "";
+static int havekeys, haveoutput;
+
 /* Per-process work buffer */
 static int workspace[WORKNUM];
 
@@ -461,6 +499,402 @@ dofork(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Per-phase timing. The parent notes the time at the start and end
+ * of each phase; the report at the end shows where the time went.
+ */
+
+#define MAXPHASES 8
+
+static struct {
+	const char *name;
+	time_t secs;
+	unsigned long nsecs;
+} phasetimes[MAXPHASES];
+static unsigned numphases;
+static time_t phasesecs;
+static unsigned long phasensecs;
+
+static
+void
+phase_begin(void)
+{
+	__time(&phasesecs, &phasensecs);
+}
+
+static
+void
+phase_end(const char *name)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	if (nsecs < phasensecs) {
+		secs--;
+		nsecs += 1000000000;
+	}
+
+	assert(numphases < MAXPHASES);
+	phasetimes[numphases].name = name;
+	phasetimes[numphases].secs = secs - phasesecs;
+	phasetimes[numphases].nsecs = nsecs - phasensecs;
+	numphases++;
+}
+
+static
+void
+phase_report(void)
+{
+	unsigned i;
+	time_t secs = 0;
+	unsigned long nsecs = 0;
+
+	for (i=0; i<numphases; i++) {
+		complainx("%-16s %4lu.%03lu seconds", phasetimes[i].name,
+			  (unsigned long) phasetimes[i].secs,
+			  phasetimes[i].nsecs / 1000000);
+		secs += phasetimes[i].secs;
+		nsecs += phasetimes[i].nsecs;
+		if (nsecs >= 1000000000) {
+			secs++;
+			nsecs -= 1000000000;
+		}
+	}
+	complainx("%-16s %4lu.%03lu seconds", "Total",
+		  (unsigned long) secs, nsecs / 1000000);
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Buffered streams of keys.
+ *
+ * Each stream has two buffers. While the program works in one, the
+ * other is being filled (input) or drained (output): its read or
+ * write is queued on the I/O ring as soon as the buffer is handed
+ * over, and the queue is only submitted when some stream actually
+ * needs a buffer back, so the I/O for all the open streams goes to
+ * the kernel in batches. Because every stream is sequential, the file
+ * system's read-ahead and write-behind carry on while we compute.
+ *
+ * If the ring isn't available, each I/O is done on the spot with
+ * pread or pwrite instead.
+ *
+ * Ring entries are tagged with the stream's slot in streamtab and
+ * the buffer number.
+ */
+
+#define MAXSTREAMS   (MAXPROCS > MAXFANOUT ? MAXPROCS+1 : MAXFANOUT+1)
+#define RINGENTRIES  128	/* power of two, >= 2*MAXSTREAMS */
+
+struct stream {
+	char s_name[128];	/* file name, for messages */
+	int s_fd;		/* open file */
+	int s_slot;		/* index in streamtab */
+	int s_input;		/* true for input, false for output */
+	off_t s_pos;		/* file position of the next I/O */
+	off_t s_end;		/* input: where to stop */
+	unsigned s_size;	/* buffer size in keys */
+	int *s_buf[2];		/* the buffers */
+	unsigned s_len[2];	/* keys in each buffer */
+	size_t s_want[2];	/* bytes of I/O outstanding on each */
+	int s_pending[2];	/* true if that I/O isn't done */
+	unsigned s_cur;		/* buffer in use */
+	unsigned s_idx;		/* next key in it */
+};
+
+static struct stream *streamtab[MAXSTREAMS];
+
+static struct ioring ring;
+static struct ioring_sqe ringsqes[RINGENTRIES];
+static struct ioring_cqe ringcqes[RINGENTRIES];
+static int usering;
+
+static
+void
+ring_init(void)
+{
+	ring.ir_entries = RINGENTRIES;
+	ring.ir_sqes = ringsqes;
+	ring.ir_cqes = ringcqes;
+	if (ioring_setup(&ring) < 0) {
+		complain("ioring_setup (using plain I/O)");
+		return;
+	}
+	usering = 1;
+}
+
+/*
+ * Account for a finished read or write. RES is what the system call
+ * returned, or minus the error code.
+ */
+static
+void
+stream_done(unsigned tag, int res)
+{
+	struct stream *s;
+	unsigned b;
+
+	assert(tag / 2 < MAXSTREAMS);
+	s = streamtab[tag / 2];
+	b = tag % 2;
+	assert(s != NULL);
+	assert(s->s_pending[b]);
+
+	if (res < 0) {
+		errno = -res;
+		complain("%s: %s", s->s_name, s->s_input ? "read" : "write");
+		exit(1);
+	}
+	if ((size_t) res != s->s_want[b]) {
+		complainx("%s: %s: short count", s->s_name,
+			  s->s_input ? "read" : "write");
+		exit(1);
+	}
+	if (s->s_input) {
+		s->s_len[b] = res / sizeof(int);
+	}
+	s->s_pending[b] = 0;
+}
+
+/*
+ * Run everything queued on the ring and collect the results.
+ */
+static
+void
+ring_submit(void)
+{
+	struct ioring_cqe *cqe;
+	int result;
+
+	while (ring.sq_head != ring.sq_tail) {
+		result = ioring_enter(ring.sq_tail - ring.sq_head);
+		if (result < 0) {
+			complain("ioring_enter");
+			exit(1);
+		}
+		if (ring.cq_head == ring.cq_tail) {
+			complainx("ioring_enter: no progress");
+			exit(1);
+		}
+		while (ring.cq_head != ring.cq_tail) {
+			cqe = &ringcqes[ring.cq_head % RINGENTRIES];
+			stream_done(cqe->cqe_data, cqe->cqe_res);
+			ring.cq_head++;
+		}
+	}
+}
+
+/*
+ * Start the I/O for buffer B: fill it (input) or drain it (output).
+ */
+static
+void
+stream_start(struct stream *s, unsigned b)
+{
+	struct ioring_sqe *sqe;
+	unsigned tag;
+	int res;
+
+	assert(!s->s_pending[b]);
+
+	if (s->s_input) {
+		s->s_len[b] = 0;
+		s->s_want[b] = s->s_size * sizeof(int);
+		if ((off_t) s->s_want[b] > s->s_end - s->s_pos) {
+			s->s_want[b] = s->s_end - s->s_pos;
+		}
+	}
+	else {
+		s->s_want[b] = s->s_len[b] * sizeof(int);
+	}
+	if (s->s_want[b] == 0) {
+		return;
+	}
+
+	tag = s->s_slot * 2 + b;
+	s->s_pending[b] = 1;
+
+	if (usering) {
+		if (ring.sq_tail - ring.sq_head == RINGENTRIES) {
+			ring_submit();
+		}
+		sqe = &ringsqes[ring.sq_tail % RINGENTRIES];
+		sqe->sqe_op = s->s_input ? IORING_OP_READ : IORING_OP_WRITE;
+		sqe->sqe_fd = s->s_fd;
+		sqe->sqe_buf = s->s_buf[b];
+		sqe->sqe_len = s->s_want[b];
+		sqe->sqe_pos = s->s_pos;
+		sqe->sqe_flags = 0;
+		sqe->sqe_data = tag;
+		ring.sq_tail++;
+	}
+	else {
+		if (s->s_input) {
+			res = pread(s->s_fd, s->s_buf[b], s->s_want[b],
+				    s->s_pos);
+		}
+		else {
+			res = pwrite(s->s_fd, s->s_buf[b], s->s_want[b],
+				     s->s_pos);
+		}
+		stream_done(tag, res < 0 ? -errno : res);
+	}
+	s->s_pos += s->s_want[b];
+}
+
+/*
+ * Wait until buffer B's I/O is done.
+ */
+static
+void
+stream_wait(struct stream *s, unsigned b)
+{
+	if (s->s_pending[b]) {
+		ring_submit();
+	}
+	assert(!s->s_pending[b]);
+}
+
+/*
+ * Common setup. SPACE holds the two buffers of BUFKEYS keys each.
+ */
+static
+void
+stream_init(struct stream *s, const char *name, int input,
+	    int *space, unsigned bufkeys)
+{
+	int i;
+
+	snprintf(s->s_name, sizeof(s->s_name), "%s", name);
+	s->s_input = input;
+	s->s_pos = 0;
+	s->s_end = 0;
+	s->s_size = bufkeys;
+	s->s_buf[0] = space;
+	s->s_buf[1] = space + bufkeys;
+	s->s_len[0] = s->s_len[1] = 0;
+	s->s_want[0] = s->s_want[1] = 0;
+	s->s_pending[0] = s->s_pending[1] = 0;
+	s->s_cur = 0;
+	s->s_idx = 0;
+
+	for (i=0; i<MAXSTREAMS; i++) {
+		if (streamtab[i] == NULL) {
+			streamtab[i] = s;
+			s->s_slot = i;
+			return;
+		}
+	}
+	complainx("%s: too many open streams", name);
+	exit(1);
+}
+
+static
+void
+stream_cleanup(struct stream *s)
+{
+	stream_wait(s, 0);
+	stream_wait(s, 1);
+	doclose(s->s_name, s->s_fd);
+	streamtab[s->s_slot] = NULL;
+}
+
+/*
+ * Open NAME for reading the keys between byte offsets START and END.
+ * An END of -1 means the end of the file.
+ */
+static
+void
+instream_open(struct stream *s, const char *name, off_t start, off_t end,
+	      int *space, unsigned bufkeys)
+{
+	stream_init(s, name, 1, space, bufkeys);
+	s->s_fd = doopen(name, O_RDONLY, 0);
+	s->s_pos = start;
+	s->s_end = end < 0 ? getsize(name) : end;
+
+	/*
+	 * Buffer 0 starts out empty, so the first get refills it and
+	 * switches to buffer 1, which we fill now.
+	 */
+	stream_start(s, 1);
+}
+
+/*
+ * Get the next key. Returns 0 at the end of the stream.
+ */
+static
+int
+instream_get(struct stream *s, int *key)
+{
+	if (s->s_idx >= s->s_len[s->s_cur]) {
+		/* Used this buffer up; refill it and take the other one */
+		stream_start(s, s->s_cur);
+		s->s_cur = !s->s_cur;
+		s->s_idx = 0;
+		stream_wait(s, s->s_cur);
+		if (s->s_len[s->s_cur] == 0) {
+			return 0;
+		}
+	}
+	*key = s->s_buf[s->s_cur][s->s_idx++];
+	return 1;
+}
+
+static
+void
+instream_close(struct stream *s)
+{
+	stream_cleanup(s);
+}
+
+static
+void
+outstream_open(struct stream *s, const char *name,
+	       int *space, unsigned bufkeys)
+{
+	stream_init(s, name, 0, space, bufkeys);
+	s->s_fd = doopen(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+}
+
+/*
+ * Send off the current buffer and switch to the other one.
+ */
+static
+void
+outstream_flush(struct stream *s)
+{
+	s->s_len[s->s_cur] = s->s_idx;
+	stream_start(s, s->s_cur);
+	s->s_cur = !s->s_cur;
+	s->s_idx = 0;
+	stream_wait(s, s->s_cur);
+}
+
+static
+void
+outstream_put(struct stream *s, int key)
+{
+	s->s_buf[s->s_cur][s->s_idx++] = key;
+	if (s->s_idx == s->s_size) {
+		outstream_flush(s);
+	}
+}
+
+static
+void
+outstream_close(struct stream *s)
+{
+	if (s->s_idx > 0) {
+		outstream_flush(s);
+	}
+	stream_cleanup(s);
+}
+
+////////////////////////////////////////////////////////////
+
 static
 int
 dowait(int guy, pid_t pid)
@@ -578,10 +1012,10 @@ genkeys_sub(void)
 {
 	int fd, i, mykeys, keys_done, keys_to_do, value;
 
-	fd = doopen(PATH_KEYS, O_WRONLY, 0);
+	fd = doopen(keypath, O_WRONLY, 0);
 
 	mykeys = getmykeys();
-	seekmyplace(PATH_KEYS, fd);
+	seekmyplace(keypath, fd);
 
 	srandom(seeds[me]);
 	keys_done = 0;
@@ -606,11 +1040,11 @@ genkeys_sub(void)
 			workspace[i] = value;
 		}
 
-		dowrite(PATH_KEYS, fd, workspace, keys_to_do*sizeof(int));
+		dowrite(keypath, fd, workspace, keys_to_do*sizeof(int));
 		keys_done += keys_to_do;
 	}
 
-	doclose(PATH_KEYS, fd);
+	doclose(keypath, fd);
 }
 
 static
@@ -621,7 +1055,7 @@ genkeys(void)
 	int i;
 
 	/* Create the file. */
-	docreate(PATH_KEYS);
+	docreate(keypath);
 
 	/* Generate random seeds for each subprocess. */
 	srandom(randomseed);
@@ -632,18 +1066,41 @@ genkeys(void)
 	/* Do it. */
 	complainx("Generating %d integers using %d procs", numkeys, numprocs);
 	seeds = seedspace;
+	phase_begin();
 	doforkall("Initialization", genkeys_sub);
+	phase_end("Generating");
 	seeds = NULL;
 
 	/* Cross-check the size of the output. */
-	if (getsize(PATH_KEYS) != correctsize) {
-		complainx("%s: file is wrong size", PATH_KEYS);
+	if (getsize(keypath) != correctsize) {
+		complainx("%s: file is wrong size", keypath);
 		exit(1);
 	}
 
 	/* Checksum the output. */
 	complainx("Checksumming the data (using one proc)");
-	checksum = checksum_file(PATH_KEYS);
+	checksum = checksum_file(keypath);
+	complainx("Checksum of unsorted keys: %ld", checksum);
+}
+
+/*
+ * Use an existing file of keys (-i) instead of generating them.
+ */
+static
+void
+loadkeys(void)
+{
+	correctsize = getsize(keypath);
+	if (correctsize % sizeof(int) != 0) {
+		complainx("%s: size %ld is not a whole number of keys",
+			  keypath, (long) correctsize);
+		exit(1);
+	}
+	numkeys = correctsize / sizeof(int);
+
+	complainx("Checksumming %d integers in %s (using one proc)",
+		  numkeys, keypath);
+	checksum = checksum_file(keypath);
 	complainx("Checksum of unsorted keys: %ld", checksum);
 }
 
@@ -653,8 +1110,17 @@ static
 const char *
 binname(int a, int b)
 {
-	static char rv[32];
-	snprintf(rv, sizeof(rv), "bin-%d-%d", a, b);
+	static char rv[128];
+	snprintf(rv, sizeof(rv), "%sbin-%d-%d", tmpdir, a, b);
+	return rv;
+}
+
+static
+const char *
+runname(int a, int b)
+{
+	static char rv[128];
+	snprintf(rv, sizeof(rv), "%srun-%d-%d", tmpdir, a, b);
 	return rv;
 }
 
@@ -662,176 +1128,226 @@ static
 const char *
 mergedname(int a)
 {
-	static char rv[32];
-	snprintf(rv, sizeof(rv), "merged-%d", a);
+	static char rv[128];
+	snprintf(rv, sizeof(rv), "%smerged-%d", tmpdir, a);
 	return rv;
 }
 
+/*
+ * Number of runs each proc's run formation produces. Computed by the
+ * parent from the bin sizes and inherited by the merging procs.
+ */
+static int runcounts[MAXPROCS];
+
 static
 void
 bin(void)
 {
-	int infd, outfds[numprocs];
-	const char *name;
-	int i, mykeys, keys_done, keys_to_do;
-	int key, pivot, binnum;
-
-	infd = doopen(PATH_KEYS, O_RDONLY, 0);
-
-	mykeys = getmykeys();
-	seekmyplace(PATH_KEYS, infd);
+	struct stream in, outs[numprocs];
+	int *space;
+	unsigned bufkeys;
+	off_t start;
+	int i, key, pivot, binnum;
+
+	/* Two buffers for the input and for each bin */
+	bufkeys = WORKNUM / (2 * (numprocs + 1));
+	space = workspace;
+
+	start = (off_t) me * (numkeys / numprocs) * sizeof(int);
+	instream_open(&in, keypath, start,
+		      start + (off_t) getmykeys() * sizeof(int),
+		      space, bufkeys);
+	space += 2 * bufkeys;
 
 	for (i=0; i<numprocs; i++) {
-		name = binname(me, i);
-		outfds[i] = doopen(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		outstream_open(&outs[i], binname(me, i), space, bufkeys);
+		space += 2 * bufkeys;
 	}
 
 	pivot = (RANDOM_MAX / numprocs);
 
-	keys_done = 0;
-	while (keys_done < mykeys) {
-		keys_to_do = mykeys - keys_done;
-		if (keys_to_do > WORKNUM) {
-			keys_to_do = WORKNUM;
+	while (instream_get(&in, &key)) {
+		if (key <= 0) {
+			complainx("proc %d: garbage key %d", me, key);
+			key = 0;
 		}
-
-		doexactread(PATH_KEYS, infd, workspace,
-			    keys_to_do * sizeof(int));
-
-		for (i=0; i<keys_to_do; i++) {
-			key = workspace[i];
-
-			binnum = key / pivot;
-			if (key <= 0) {
-				complainx("proc %d: garbage key %d", me, key);
-				key = 0;
-			}
-			assert(binnum >= 0);
-			assert(binnum < numprocs);
-			dowrite("bin", outfds[binnum], &key, sizeof(key));
+		binnum = key / pivot;
+		if (binnum >= numprocs) {
+			/* RANDOM_MAX need not divide evenly */
+			binnum = numprocs - 1;
 		}
-
-		keys_done += keys_to_do;
+		assert(binnum >= 0);
+		outstream_put(&outs[binnum], key);
 	}
-	doclose(PATH_KEYS, infd);
+	instream_close(&in);
 
 	for (i=0; i<numprocs; i++) {
-		doclose(binname(me, i), outfds[i]);
+		outstream_close(&outs[i]);
 	}
 }
 
 static
 void
-sortbins(void)
+writerun(int run, int num)
 {
 	const char *name;
-	int i, fd;
-	off_t binsize;
-
-	for (i=0; i<numprocs; i++) {
-		name = binname(me, i);
-		binsize = getsize(name);
-		if (binsize % sizeof(int) != 0) {
-			complainx("%s: bin size %ld no good", name,
-				  (long) binsize);
-			exit(1);
-		}
-		if (binsize > (off_t) sizeof(workspace)) {
-			complainx("proc %d: %s: bin too large", me, name);
-			exit(1);
-		}
-
-		fd = doopen(name, O_RDWR, 0);
-		doexactread(name, fd, workspace, binsize);
+	int fd;
 
-		sortints(workspace, binsize/sizeof(int));
+	sortints(workspace, num);
 
-		dolseek(name, fd, 0, SEEK_SET);
-		dowrite(name, fd, workspace, binsize);
-		doclose(name, fd);
-	}
+	name = runname(me, run);
+	fd = doopen(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	dowrite(name, fd, workspace, num * sizeof(int));
+	doclose(name, fd);
 }
 
+/*
+ * Read all the bins for my key range a workspace at a time and write
+ * out each workspaceful sorted. This is what lets the range be larger
+ * than memory.
+ */
 static
 void
-mergebins(void)
+makeruns(void)
 {
-	int infds[numprocs], outfd;
-	int values[numprocs], ready[numprocs];
-	const char *name, *outname;
-	int i, result;
-	int numready, place, val, worknum;
-
-	outname = mergedname(me);
-	outfd = doopen(outname, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	const char *name;
+	int i, fd, have, runs;
+	size_t len;
 
+	have = 0;
+	runs = 0;
 	for (i=0; i<numprocs; i++) {
 		name = binname(i, me);
-		infds[i] = doopen(name, O_RDONLY, 0);
-		values[i] = 0;
-		ready[i] = 0;
+		fd = doopen(name, O_RDONLY, 0);
+		while ((len = doread(name, fd, workspace + have,
+				     (WORKNUM - have) * sizeof(int))) > 0) {
+			if (len % sizeof(int) != 0) {
+				complainx("%s: read: partial key", name);
+				exit(1);
+			}
+			have += len / sizeof(int);
+			if (have == WORKNUM) {
+				writerun(runs++, have);
+				have = 0;
+			}
+		}
+		doclose(name, fd);
+		doremove(name);
+	}
+	if (have > 0 || runs == 0) {
+		writerun(runs++, have);
 	}
+	assert(runs == runcounts[me]);
+}
 
-	worknum = 0;
+struct heapent {
+	int key;
+	int src;
+};
 
-	while (1) {
-		numready = 0;
-		for (i=0; i<numprocs; i++) {
-			if (infds[i] < 0) {
-				continue;
-			}
+static
+void
+heap_down(struct heapent *heap, int num, int pos)
+{
+	struct heapent tmp;
+	int kid;
 
-			if (!ready[i]) {
-				result = doread("bin", infds[i],
-						&val, sizeof(int));
-				if (result == 0) {
-					doclose("bin", infds[i]);
-					infds[i] = -1;
-					continue;
-				}
-				if ((size_t) result != sizeof(int)) {
-					complainx("%s: read: short count",
-						  binname(i, me));
-					exit(1);
-				}
-				values[i] = val;
-				ready[i] = 1;
-			}
-			numready++;
+	while ((kid = 2*pos + 1) < num) {
+		if (kid + 1 < num && heap[kid+1].key < heap[kid].key) {
+			kid++;
 		}
-		if (numready == 0) {
+		if (heap[pos].key <= heap[kid].key) {
 			break;
 		}
+		tmp = heap[pos];
+		heap[pos] = heap[kid];
+		heap[kid] = tmp;
+		pos = kid;
+	}
+}
 
-		/* find the smallest */
-		place = -1;
-		for (i=0; i<numprocs; i++) {
-			if (!ready[i]) {
-				continue;
-			}
-			if (place < 0 || values[i] < val) {
-				val = values[i];
-				place = i;
-			}
+/*
+ * Merge runs RUNS[0..NUM-1] into OUTNAME and remove them.
+ */
+static
+void
+mergeruns(const int *runs, int num, const char *outname)
+{
+	struct stream ins[num], out;
+	struct heapent heap[num];
+	int *space;
+	unsigned bufkeys;
+	int i, heapnum;
+
+	bufkeys = WORKNUM / (2 * (num + 1));
+	space = workspace;
+
+	outstream_open(&out, outname, space, bufkeys);
+	space += 2 * bufkeys;
+
+	heapnum = 0;
+	for (i=0; i<num; i++) {
+		instream_open(&ins[i], runname(me, runs[i]), 0, -1,
+			      space, bufkeys);
+		space += 2 * bufkeys;
+		if (instream_get(&ins[i], &heap[heapnum].key)) {
+			heap[heapnum].src = i;
+			heapnum++;
 		}
-		assert(place >= 0);
-
-		workspace[worknum++] = val;
-		if (worknum >= WORKNUM) {
-			assert(worknum == WORKNUM);
-			dowrite(outname, outfd, workspace,
-				worknum * sizeof(int));
-			worknum = 0;
+	}
+	for (i=heapnum/2 - 1; i>=0; i--) {
+		heap_down(heap, heapnum, i);
+	}
+
+	while (heapnum > 0) {
+		outstream_put(&out, heap[0].key);
+		if (!instream_get(&ins[heap[0].src], &heap[0].key)) {
+			heap[0] = heap[--heapnum];
 		}
-		ready[place] = 0;
+		heap_down(heap, heapnum, 0);
 	}
 
-	dowrite(outname, outfd, workspace, worknum * sizeof(int));
-	doclose(outname, outfd);
+	outstream_close(&out);
+	for (i=0; i<num; i++) {
+		instream_close(&ins[i]);
+		doremove(runname(me, runs[i]));
+	}
+}
 
-	for (i=0; i<numprocs; i++) {
-		assert(infds[i] < 0);
+/*
+ * Merge my runs down to one file, fanout runs at a time.
+ */
+static
+void
+mergeall(void)
+{
+	int runs[runcounts[me]];
+	int numruns, nextrun, i, n, kept;
+
+	numruns = runcounts[me];
+	for (i=0; i<numruns; i++) {
+		runs[i] = i;
+	}
+	nextrun = numruns;
+
+	while (numruns > fanout) {
+		kept = 0;
+		for (i=0; i<numruns; i+=n) {
+			n = numruns - i;
+			if (n > fanout) {
+				n = fanout;
+			}
+			if (n == 1) {
+				runs[kept++] = runs[i];
+				continue;
+			}
+			mergeruns(&runs[i], n, runname(me, nextrun));
+			runs[kept++] = nextrun++;
+		}
+		numruns = kept;
 	}
+
+	mergeruns(runs, numruns, mergedname(me));
 }
 
 static
@@ -847,15 +1363,15 @@ assemble(void)
 		mypos += getsize(mergedname(i));
 	}
 
-	fd = doopen(PATH_SORTED, O_WRONLY, 0);
-	dolseek(PATH_SORTED, fd, mypos, SEEK_SET);
+	fd = doopen(outpath, O_WRONLY, 0);
+	dolseek(outpath, fd, mypos, SEEK_SET);
 
 	if (dup2(fd, STDOUT_FILENO) < 0) {
 		complain("dup2");
 		exit(1);
 	}
 
-	doclose(PATH_SORTED, fd);
+	doclose(outpath, fd);
 
 	args[0] = "cat";
 	args[1] = mergedname(me);
@@ -865,18 +1381,26 @@ assemble(void)
 	exit(1);
 }
 
+/*
+ * Check the bin sizes and work out how many runs each range makes.
+ */
 static
 void
 checksize_bins(void)
 {
-	off_t totsize;
-	int i, j;
+	off_t totsize, rangesize;
+	int i, j, numbinkeys;
 
 	totsize = 0;
-	for (i=0; i<numprocs; i++) {
-		for (j=0; j<numprocs; j++) {
-			totsize += getsize(binname(i, j));
+	for (j=0; j<numprocs; j++) {
+		rangesize = 0;
+		for (i=0; i<numprocs; i++) {
+			rangesize += getsize(binname(i, j));
 		}
+		numbinkeys = rangesize / sizeof(int);
+		runcounts[j] = numbinkeys == 0 ? 1 :
+			(numbinkeys + WORKNUM - 1) / WORKNUM;
+		totsize += rangesize;
 	}
 	if (totsize != correctsize) {
 		complain("Sum of bin sizes is wrong (%ld, should be %ld)",
@@ -908,42 +1432,46 @@ void
 sort(void)
 {
 	unsigned long sortedsum;
-	int i, j;
+	int i, totruns;
 
 	/* Step 1. Toss into bins. */
 	complainx("Tossing into %d bins using %d procs",
 		  numprocs*numprocs, numprocs);
+	phase_begin();
 	doforkall("Tossing", bin);
+	phase_end("Tossing");
 	checksize_bins();
 	complainx("Done tossing into bins.");
 
-	/* Step 2: Sort the bins. */
-	complainx("Sorting %d bins using %d procs",
-		  numprocs*numprocs, numprocs);
-	doforkall("Sorting", sortbins);
-	checksize_bins();
+	/* Step 2: Sort the bins into runs (this removes the bins). */
+	totruns = 0;
+	for (i=0; i<numprocs; i++) {
+		totruns += runcounts[i];
+	}
+	complainx("Sorting %d bins into %d runs using %d procs",
+		  numprocs*numprocs, totruns, numprocs);
+	phase_begin();
+	doforkall("Sorting", makeruns);
+	phase_end("Run formation");
 	complainx("Done sorting the bins.");
 
-	/* Step 3: Merge corresponding bins. */
-	complainx("Merging %d bins using %d procs",
-		  numprocs*numprocs, numprocs);
-	doforkall("Merging", mergebins);
+	/* Step 3: Merge each range's runs (this removes the runs). */
+	complainx("Merging %d runs with fan-out %d using %d procs",
+		  totruns, fanout, numprocs);
+	phase_begin();
+	doforkall("Merging", mergeall);
+	phase_end("Merging");
 	checksize_merge();
-	complainx("Done merging the bins.");
-
-	/* Step 3a: delete the bins */
-	for (i=0; i<numprocs; i++) {
-		for (j=0; j<numprocs; j++) {
-			doremove(binname(i, j));
-		}
-	}
+	complainx("Done merging the runs.");
 
 	/* Step 4: assemble output file */
 	complainx("Assembling output file using %d procs", numprocs);
-	docreate(PATH_SORTED);
+	docreate(outpath);
+	phase_begin();
 	doforkall("Final assembly", assemble);
-	if (getsize(PATH_SORTED) != correctsize) {
-		complainx("%s: file is wrong size", PATH_SORTED);
+	phase_end("Assembly");
+	if (getsize(outpath) != correctsize) {
+		complainx("%s: file is wrong size", outpath);
 		exit(1);
 	}
 
@@ -954,7 +1482,7 @@ sort(void)
 
 	/* Step 5: Checksum the result. */
 	complainx("Checksumming the output (using one proc)");
-	sortedsum = checksum_file(PATH_SORTED);
+	sortedsum = checksum_file(outpath);
 	complainx("Checksum of sorted keys: %ld", sortedsum);
 
 	if (sortedsum != checksum) {
@@ -969,8 +1497,8 @@ static
 const char *
 validname(int a)
 {
-	static char rv[32];
-	snprintf(rv, sizeof(rv), "valid-%d", a);
+	static char rv[128];
+	snprintf(rv, sizeof(rv), "%svalid-%d", tmpdir, a);
 	return rv;
 }
 
@@ -1003,7 +1531,7 @@ dovalidate(void)
 	int fd, i, mykeys, keys_done, keys_to_do;
 	int key, smallest, largest;
 
-	name = PATH_SORTED;
+	name = outpath;
 	fd = doopen(name, O_RDONLY, 0);
 
 	mykeys = getmykeys();
@@ -1037,6 +1565,11 @@ dovalidate(void)
 				exit(1);
 			}
 
+			if (key < largest) {
+				complainx("%s: keys out of order", name);
+				exit(1);
+			}
+
 			if (key < smallest) {
 				smallest = key;
 			}
@@ -1065,7 +1598,9 @@ validate(void)
 	const char *name;
 
 	complainx("Validating the sorted data using %d procs", numprocs);
+	phase_begin();
 	doforkall("Validation", dovalidate);
+	phase_end("Validation");
 	checksize_valid();
 
 	prev_largest = 1;
@@ -1076,7 +1611,12 @@ validate(void)
 
 		doexactread(name, fd, &smallest, sizeof(int));
 		doexactread(name, fd, &largest, sizeof(int));
+		doclose(name, fd);
 
+		if (smallest == RANDOM_MAX && largest == 0) {
+			/* Block with no keys (fewer keys than procs) */
+			continue;
+		}
 		if (smallest < 1) {
 			complainx("Validation: block %d: bad SMALLEST", i);
 			exit(1);
@@ -1099,6 +1639,7 @@ validate(void)
 			complain("Validation failed");
 			exit(1);
 		}
+		prev_largest = largest;
 	}
 
 
@@ -1123,8 +1664,13 @@ static
 void
 unsetdir(void)
 {
-	doremove(PATH_KEYS);
-	doremove(PATH_SORTED);
+	/* Don't remove files the user named */
+	if (!havekeys) {
+		doremove(keypath);
+	}
+	if (!haveoutput) {
+		doremove(outpath);
+	}
 #if 0 /* let's not require subdirs */
 	dochdir("..");
 
@@ -1152,7 +1698,9 @@ static
 void
 usage(void)
 {
-	complain("Usage: %s [-p procs] [-k keys] [-s seed] [-r]", progname);
+	complainx("Usage: %s [-p procs] [-k keys] [-s seed] [-r] [-f fanout]",
+		  progname);
+	complainx("       [-i infile] [-o outfile] [-t tmpprefix]");
 	exit(1);
 }
 
@@ -1160,7 +1708,8 @@ static
 void
 doargs(int argc, char *argv[])
 {
-	int i, ch, val, arg;
+	int i, ch, arg;
+	char *val;
 
 	for (i=1; i<argc; i++) {
 		if (argv[i][0] != '-') {
@@ -1172,26 +1721,34 @@ doargs(int argc, char *argv[])
 		    case 'p': arg = 1; break;
 		    case 'k': arg = 1; break;
 		    case 's': arg = 1; break;
+		    case 'f': arg = 1; break;
+		    case 'i': arg = 1; break;
+		    case 'o': arg = 1; break;
+		    case 't': arg = 1; break;
 		    case 'r': arg = 0; break;
 		    default: usage(); return;
 		}
 		if (arg) {
 			if (argv[i][2]) {
-				val = atoi(argv[i]+2);
+				val = argv[i]+2;
 			}
 			else {
 				i++;
 				if (!argv[i]) {
-					complain("Option -%c requires an "
-						 "argument", ch);
+					complainx("Option -%c requires an "
+						  "argument", ch);
 					exit(1);
 				}
-				val = atoi(argv[i]);
+				val = argv[i];
 			}
 			switch (ch) {
-			    case 'p': numprocs = val; break;
-			    case 'k': numkeys = val; break;
-			    case 's': randomseed = val; break;
+			    case 'p': numprocs = atoi(val); break;
+			    case 'k': numkeys = atoi(val); break;
+			    case 's': randomseed = atoi(val); break;
+			    case 'f': fanout = atoi(val); break;
+			    case 'i': keypath = val; havekeys = 1; break;
+			    case 'o': outpath = val; haveoutput = 1; break;
+			    case 't': tmpdir = val; break;
 			    default: assert(0); break;
 			}
 		}
@@ -1202,6 +1759,15 @@ doargs(int argc, char *argv[])
 			}
 		}
 	}
+
+	if (numprocs < 1 || numprocs > MAXPROCS) {
+		complainx("Number of procs must be 1-%d", MAXPROCS);
+		exit(1);
+	}
+	if (fanout < 2 || fanout > MAXFANOUT) {
+		complainx("Fan-out must be 2-%d", MAXFANOUT);
+		exit(1);
+	}
 }
 
 int
@@ -1213,11 +1779,18 @@ main(int argc, char *argv[])
 	correctsize = (off_t) (numkeys*sizeof(int));
 
 	setdir();
+	ring_init();
 
-	genkeys();
+	if (havekeys) {
+		loadkeys();
+	}
+	else {
+		genkeys();
+	}
 	sort();
 	validate();
 	complainx("Succeeded.");
+	phase_report();
 
 	unsetdir();
 
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ringtest - test batched system calls through ioring_enter.
+ *
+ * Opens a file through the ring, then writes a set of blocks with one
+ * batch of positional writes plus an fsync, reads them back with
+ * another batch, and checks the data and the completion tags. Also
+ * checks that errors come back as negative completion results and
+ * that a full completion queue stops a batch.
+ */
+
+#include <sys/types.h>
+#include <sys/ioring.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define ENTRIES 8
+#define NBLOCKS 6
+#define BLOCKSIZE 512
+
+static struct ioring_sqe sqes[ENTRIES];
+static struct ioring_cqe cqes[ENTRIES];
+static struct ioring ring;
+static char blocks[NBLOCKS][BLOCKSIZE];
+static char filename[] = "ringtest.dat";
+
+static
+void
+queue(int op, int fd, void *buf, size_t len, off_t pos, unsigned tag)
+{
+	struct ioring_sqe *sqe;
+
+	if (ring.sq_tail - ring.sq_head >= ENTRIES) {
+		errx(1, "submission queue full");
+	}
+	sqe = &sqes[ring.sq_tail % ENTRIES];
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = len;
+	sqe->sqe_pos = pos;
+	sqe->sqe_flags = 0;
+	sqe->sqe_data = tag;
+	ring.sq_tail++;
+}
+
+static
+void
+submit(unsigned want)
+{
+	int r;
+
+	r = ioring_enter(ring.sq_tail - ring.sq_head);
+	if (r < 0) {
+		err(1, "ioring_enter");
+	}
+	if ((unsigned)r != want) {
+		errx(1, "ioring_enter ran %d entries, expected %u", r, want);
+	}
+}
+
+static
+int
+reap(unsigned tag)
+{
+	struct ioring_cqe *cqe;
+
+	if (ring.cq_head == ring.cq_tail) {
+		errx(1, "no completion for tag %u", tag);
+	}
+	cqe = &cqes[ring.cq_head % ENTRIES];
+	if (cqe->cqe_data != tag) {
+		errx(1, "completion for tag %u, expected %u",
+		     cqe->cqe_data, tag);
+	}
+	ring.cq_head++;
+	return cqe->cqe_res;
+}
+
+int
+main(void)
+{
+	int fd, res;
+	unsigned i, j;
+
+	ring.ir_entries = ENTRIES;
+	ring.ir_sqes = sqes;
+	ring.ir_cqes = cqes;
+	if (ioring_setup(&ring) < 0) {
+		err(1, "ioring_setup");
+	}
+
+	/* open */
+	queue(IORING_OP_OPEN, -1, filename, 0664, -1, 100);
+	sqes[0].sqe_flags = O_RDWR | O_CREAT | O_TRUNC;
+	submit(1);
+	fd = reap(100);
+	if (fd < 0) {
+		errx(1, "open: %s", strerror(-fd));
+	}
+
+	/* write all the blocks and sync in one batch */
+	for (i=0; i<NBLOCKS; i++) {
+		memset(blocks[i], 'a' + i, BLOCKSIZE);
+		queue(IORING_OP_WRITE, fd, blocks[i], BLOCKSIZE,
+		      (off_t)i * BLOCKSIZE, i);
+	}
+	queue(IORING_OP_FSYNC, fd, NULL, 0, -1, NBLOCKS);
+	submit(NBLOCKS + 1);
+	for (i=0; i<NBLOCKS; i++) {
+		res = reap(i);
+		if (res != BLOCKSIZE) {
+			errx(1, "write %u returned %d", i, res);
+		}
+	}
+	if ((res = reap(NBLOCKS)) != 0) {
+		errx(1, "fsync: %s", strerror(-res));
+	}
+
+	/* read them back in reverse order in one batch */
+	memset(blocks, 0, sizeof(blocks));
+	for (i=NBLOCKS; i-- > 0; ) {
+		queue(IORING_OP_READ, fd, blocks[i], BLOCKSIZE,
+		      (off_t)i * BLOCKSIZE, i);
+	}
+	submit(NBLOCKS);
+	for (i=NBLOCKS; i-- > 0; ) {
+		res = reap(i);
+		if (res != BLOCKSIZE) {
+			errx(1, "read %u returned %d", i, res);
+		}
+		for (j=0; j<BLOCKSIZE; j++) {
+			if (blocks[i][j] != (char)('a' + i)) {
+				errx(1, "block %u: wrong data", i);
+			}
+		}
+	}
+
+	/* errors are reported per entry */
+	queue(IORING_OP_CLOSE, fd, NULL, 0, -1, 200);
+	queue(IORING_OP_CLOSE, fd, NULL, 0, -1, 201);
+	submit(2);
+	if ((res = reap(200)) != 0) {
+		errx(1, "close: %s", strerror(-res));
+	}
+	if (reap(201) != -EBADF) {
+		errx(1, "second close didn't fail with EBADF");
+	}
+
+	/* a full completion queue stops the batch */
+	for (i=0; i<ENTRIES; i++) {
+		queue(IORING_OP_NOP, -1, NULL, 0, -1, i);
+	}
+	submit(ENTRIES);
+	queue(IORING_OP_NOP, -1, NULL, 0, -1, ENTRIES);
+	submit(0);
+	for (i=0; i<=ENTRIES; i++) {
+		if (i == ENTRIES) {
+			submit(1);
+		}
+		if (reap(i) != 0) {
+			errx(1, "nop %u failed", i);
+		}
+	}
+
+	remove(filename);
+	printf("ringtest: passed\n");
+	return 0;
+}
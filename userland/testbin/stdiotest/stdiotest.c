@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * stdiotest - test buffered stdio.
+ *
+ * Writes a file through a stream with a mix of fprintf, fputs,
+ * fputc and fwrite, enough to go through the buffer several times,
+ * then reads it back with fgets, fgetc and fread and checks it.
+ * Also checks that output pending at fork time comes out once.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#define TESTFILE "stdiotest.tmp"
+#define NLINES 1000
+#define BLOCKSIZE 3000
+
+static char block[BLOCKSIZE];
+static char readbuf[BLOCKSIZE];
+
+static
+void
+writefile(void)
+{
+	FILE *f;
+	unsigned i;
+
+	f = fopen(TESTFILE, "w");
+	if (f == NULL) {
+		err(1, "%s: fopen for write", TESTFILE);
+	}
+	for (i=0; i<NLINES; i++) {
+		if (i % 3 == 0) {
+			fprintf(f, "line %u\n", i);
+		}
+		else if (i % 3 == 1) {
+			fputs("line ", f);
+			fprintf(f, "%u", i);
+			fputc('\n', f);
+		}
+		else {
+			fprintf(f, "line %u", i);
+			fwrite("\n", 1, 1, f);
+		}
+	}
+
+	/* bigger than the buffer, so it goes straight out */
+	for (i=0; i<BLOCKSIZE; i++) {
+		block[i] = 'a' + i % 26;
+	}
+	if (fwrite(block, 1, BLOCKSIZE, f) != BLOCKSIZE) {
+		err(1, "%s: fwrite", TESTFILE);
+	}
+	fputc('!', f);
+	if (ferror(f)) {
+		errx(1, "%s: error flag set after writing", TESTFILE);
+	}
+	if (fclose(f)) {
+		err(1, "%s: fclose", TESTFILE);
+	}
+}
+
+static
+void
+readfile(void)
+{
+	FILE *f;
+	unsigned i;
+	char line[64], expected[64];
+	int ch;
+
+	f = fopen(TESTFILE, "r");
+	if (f == NULL) {
+		err(1, "%s: fopen for read", TESTFILE);
+	}
+	for (i=0; i<NLINES; i++) {
+		snprintf(expected, sizeof(expected), "line %u\n", i);
+		if (fgets(line, sizeof(line), f) == NULL) {
+			errx(1, "%s: unexpected EOF at line %u", TESTFILE, i);
+		}
+		if (strcmp(line, expected) != 0) {
+			errx(1, "%s: line %u is wrong", TESTFILE, i);
+		}
+	}
+
+	ch = fgetc(f);
+	if (ch != 'a') {
+		errx(1, "%s: got %d instead of 'a'", TESTFILE, ch);
+	}
+	if (fread(readbuf, 1, BLOCKSIZE, f) != BLOCKSIZE - 1) {
+		errx(1, "%s: short fread", TESTFILE);
+	}
+	if (memcmp(readbuf, block + 1, BLOCKSIZE - 2) != 0 ||
+	    readbuf[BLOCKSIZE - 2] != '!') {
+		errx(1, "%s: data read with fread is wrong", TESTFILE);
+	}
+	if (!feof(f) || ferror(f)) {
+		errx(1, "%s: expected EOF and no error", TESTFILE);
+	}
+	if (fgetc(f) != EOF) {
+		errx(1, "%s: read past EOF", TESTFILE);
+	}
+	fclose(f);
+}
+
+/*
+ * Leave a partial line pending in a fully buffered stream across a
+ * fork and make sure it only shows up in the file once.
+ */
+static
+void
+forkflush(void)
+{
+	FILE *f;
+	pid_t pid;
+	int status;
+	char line[64];
+
+	f = fopen(TESTFILE, "w");
+	if (f == NULL) {
+		err(1, "%s: fopen for write", TESTFILE);
+	}
+	fputs("once", f);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		/* exit flushes; without the flush in fork this repeats it */
+		exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	fclose(f);
+
+	f = fopen(TESTFILE, "r");
+	if (f == NULL) {
+		err(1, "%s: fopen for read", TESTFILE);
+	}
+	if (fgets(line, sizeof(line), f) == NULL || strcmp(line, "once")) {
+		errx(1, "%s: output pending at fork was lost or repeated",
+		     TESTFILE);
+	}
+	fclose(f);
+}
+
+int
+main(void)
+{
+	printf("stdiotest: writing...\n");
+	writefile();
+	printf("stdiotest: reading...\n");
+	readfile();
+	printf("stdiotest: fork...\n");
+	forkflush();
+	remove(TESTFILE);
+	printf("stdiotest: passed\n");
+	return 0;
+}
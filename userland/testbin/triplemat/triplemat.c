@@ -30,7 +30,8 @@
 /*
  * triplemat.c
  *
- * 	Calls three matmult programs.
+ * 	Calls three matmult programs. Any arguments (e.g. -v tiled) are
+ * 	passed on to each of them.
  *
  * When the VM assignment is complete, your system should survive this.
  */
@@ -38,8 +39,8 @@
 #include <test/triple.h>
 
 int
-main(void)
+main(int argc, char *argv[])
 {
-	triple("/testbin/matmult");
+	triplev("/testbin/matmult", argc > 1 ? argc - 1 : 0, argv + 1);
 	return 0;
 }
@@ -382,6 +382,13 @@ conctest(void)
 int
 main(void)
 {
+	/*
+	 * say() must reach the console before the next V(), or the
+	 * interleaving shows nothing; and the children leave with
+	 * _exit, which wouldn't flush a buffer anyway.
+	 */
+	setvbuf(stdout, NULL, _IONBF, 0);
+
 	basetest();
 	conctest();
 	say("Passed.\n");
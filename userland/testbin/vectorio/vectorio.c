@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * vectorio - test positional and scatter/gather I/O.
+ *
+ * Writes a file with writev, checks it with pread and readv, and
+ * checks that pread/pwrite/preadv/pwritev leave the seek position
+ * alone while readv/writev advance it.
+ *
+ * Usage: vectorio [filename]
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define NPIECES 5
+#define PIECELEN 37
+#define TOTAL (NPIECES * PIECELEN)
+
+static char pieces[NPIECES][PIECELEN];
+static char buf[TOTAL];
+
+static
+void
+fill(void)
+{
+	int i, j;
+
+	for (i=0; i<NPIECES; i++) {
+		for (j=0; j<PIECELEN; j++) {
+			pieces[i][j] = 'a' + (i*PIECELEN + j) % 26;
+		}
+	}
+}
+
+static
+void
+checkbuf(const char *what, const char *p, off_t pos, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (p[i] != 'a' + (pos + i) % 26) {
+			errx(1, "%s: wrong data at offset %lu",
+			     what, (unsigned long)(pos + i));
+		}
+	}
+}
+
+static
+void
+checkpos(int fd, const char *what, off_t expected)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos == -1) {
+		err(1, "%s: lseek", what);
+	}
+	if (pos != expected) {
+		errx(1, "%s: seek position %ld, expected %ld",
+		     what, (long)pos, (long)expected);
+	}
+}
+
+static
+void
+checklen(const char *what, ssize_t r, size_t expected)
+{
+	if (r < 0) {
+		err(1, "%s", what);
+	}
+	if ((size_t)r != expected) {
+		errx(1, "%s: %ld bytes, expected %lu",
+		     what, (long)r, (unsigned long)expected);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *filename = "vectorio.tmp";
+	struct iovec iov[NPIECES];
+	char small[PIECELEN];
+	ssize_t r;
+	int fd, i;
+
+	if (argc == 2) {
+		filename = argv[1];
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: vectorio [filename]");
+	}
+
+	fill();
+
+	fd = open(filename, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: create", filename);
+	}
+
+	/* gather-write the whole file in one call */
+	for (i=0; i<NPIECES; i++) {
+		iov[i].iov_base = pieces[i];
+		iov[i].iov_len = PIECELEN;
+	}
+	r = writev(fd, iov, NPIECES);
+	checklen("writev", r, TOTAL);
+	checkpos(fd, "writev", TOTAL);
+
+	/* positional reads don't move the seek position */
+	r = pread(fd, buf, TOTAL, 0);
+	checklen("pread", r, TOTAL);
+	checkbuf("pread", buf, 0, TOTAL);
+	checkpos(fd, "pread", TOTAL);
+
+	r = pread(fd, small, PIECELEN, 50);
+	checklen("pread at 50", r, PIECELEN);
+	checkbuf("pread at 50", small, 50, PIECELEN);
+
+	/* scatter-read from the start into uneven buffers */
+	if (lseek(fd, 0, SEEK_SET) == -1) {
+		err(1, "lseek");
+	}
+	memset(buf, 0, sizeof(buf));
+	iov[0].iov_base = buf;
+	iov[0].iov_len = 1;
+	iov[1].iov_base = buf + 1;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = buf + 1;
+	iov[2].iov_len = TOTAL - 11;
+	iov[3].iov_base = buf + TOTAL - 10;
+	iov[3].iov_len = 10;
+	r = readv(fd, iov, 4);
+	checklen("readv", r, TOTAL);
+	checkbuf("readv", buf, 0, TOTAL);
+	checkpos(fd, "readv", TOTAL);
+
+	/* positional write, then preadv it back */
+	for (i=0; i<PIECELEN; i++) {
+		small[i] = 'a' + (10 + i) % 26;
+	}
+	r = pwrite(fd, small, PIECELEN, 10);
+	checklen("pwrite", r, PIECELEN);
+	checkpos(fd, "pwrite", TOTAL);
+
+	memset(buf, 0, sizeof(buf));
+	iov[0].iov_base = buf;
+	iov[0].iov_len = 20;
+	iov[1].iov_base = buf + 20;
+	iov[1].iov_len = 40;
+	r = preadv(fd, iov, 2, 5);
+	checklen("preadv", r, 60);
+	checkbuf("preadv", buf, 5, 60);
+	checkpos(fd, "preadv", TOTAL);
+
+	iov[0].iov_base = pieces[1];
+	iov[0].iov_len = PIECELEN;
+	r = pwritev(fd, iov, 1, PIECELEN);
+	checklen("pwritev", r, PIECELEN);
+	checkpos(fd, "pwritev", TOTAL);
+
+	/* reading past EOF returns 0 */
+	r = pread(fd, buf, TOTAL, TOTAL);
+	checklen("pread at EOF", r, 0);
+
+	/* error cases */
+	if (pread(fd, buf, 1, -1) != -1) {
+		errx(1, "pread at negative offset succeeded");
+	}
+	if (readv(fd, iov, 0) != -1) {
+		errx(1, "readv with no buffers succeeded");
+	}
+
+	close(fd);
+	remove(filename);
+
+	printf("vectorio: passed\n");
+	return 0;
+}